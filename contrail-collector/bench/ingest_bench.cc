@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+//
+// Replays a corpus of Sandesh messages, captured by the collector with
+// DEFAULT.sandesh_capture_file, through the collector write path:
+//
+//   decode:  the message XML is parsed into a SandeshXMLMessage
+//   ruleeng: Ruleeng::rule_execute, which writes the message, object,
+//            session and stats tables through the DbHandler and the UVEs
+//            through the OpServerProxy
+//
+// The DbHandler writes to a database stub that takes every write and the
+// UVEs go to an OpServerProxyMock, so that only the collector itself is
+// measured. The
+// messages/s, the latency percentiles and the allocations per message of
+// every stage are reported, e.g.
+//
+//   ingest_bench --corpus /var/tmp/collector.corpus --count 1000000
+//
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/program_options.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/uuid/random_generator.hpp>
+#include <tbb/atomic.h>
+
+#include <testing/gunit.h>
+#include <base/logging.h>
+#include <io/event_manager.h>
+#include <sandesh/sandesh_message_builder.h>
+
+#include <analytics/viz_constants.h>
+#include <database/cassandra/cql/cql_if.h>
+#include "contrail-collector/db_handler.h"
+#include "contrail-collector/ruleeng.h"
+#include "contrail-collector/sandesh_corpus.h"
+#include "contrail-collector/viz_message.h"
+
+#include "contrail-collector/test/OpServerProxyMock.h"
+
+using ::testing::_;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace opt = boost::program_options;
+
+// Allocations made by the process, counted by the operator new below
+static tbb::atomic<uint64_t> allocs;
+static tbb::atomic<uint64_t> alloc_bytes;
+
+static void *CountedAlloc(size_t size) {
+    allocs++;
+    alloc_bytes += size;
+    void *ptr(malloc(size ? size : 1));
+    if (ptr == NULL) {
+        abort();
+    }
+    return ptr;
+}
+
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#endif
+
+void *operator new(size_t size) BENCH_THROW_BAD_ALLOC {
+    return CountedAlloc(size);
+}
+
+void *operator new[](size_t size) BENCH_THROW_BAD_ALLOC {
+    return CountedAlloc(size);
+}
+
+void operator delete(void *ptr) BENCH_NOTHROW {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) BENCH_NOTHROW {
+    free(ptr);
+}
+
+namespace {
+
+uint64_t NowNsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Message rebuilt from the corpus, the header is kept as captured since
+// the corpus holds the message XML without the header
+class BenchSandeshMessage : public SandeshXMLMessage {
+public:
+    BenchSandeshMessage() {}
+    virtual ~BenchSandeshMessage() {}
+
+    virtual bool Parse(const uint8_t *xml_msg, size_t size) {
+        pugi::xml_parse_result result = xdoc_.load_buffer(xml_msg, size,
+            pugi::parse_default & ~pugi::parse_escapes);
+        if (!result) {
+            return false;
+        }
+        message_node_ = xdoc_.first_child();
+        message_type_ = message_node_.name();
+        size_ = size;
+        return true;
+    }
+
+    void SetHeader(const SandeshHeader &header) { header_ = header; }
+};
+
+struct CorpusMessage {
+    SandeshHeader header;
+    std::string xml;
+};
+
+// Latencies and allocations of a stage, one sample per message
+class StageStats {
+public:
+    explicit StageStats(const std::string &name) :
+        name_(name), allocs_(0), alloc_bytes_(0) {
+    }
+
+    void Start() {
+        start_allocs_ = allocs;
+        start_alloc_bytes_ = alloc_bytes;
+        start_nsec_ = NowNsec();
+    }
+
+    void Stop() {
+        latencies_.push_back(NowNsec() - start_nsec_);
+        allocs_ += allocs - start_allocs_;
+        alloc_bytes_ += alloc_bytes - start_alloc_bytes_;
+    }
+
+    void Reserve(size_t count) { latencies_.reserve(count); }
+
+    void Report(std::ostream &os) {
+        size_t count(latencies_.size());
+        if (count == 0) {
+            return;
+        }
+        uint64_t total(0);
+        for (size_t i = 0; i < count; i++) {
+            total += latencies_[i];
+        }
+        os << std::left << std::setw(10) << name_ << std::right <<
+            std::fixed << std::setprecision(0) <<
+            std::setw(12) << count * 1e9 / total <<
+            std::setprecision(2) <<
+            std::setw(10) << Percentile(0.50) / 1e3 <<
+            std::setw(10) << Percentile(0.99) / 1e3 <<
+            std::setw(10) << Percentile(0.999) / 1e3 <<
+            std::setw(10) << static_cast<double>(allocs_) / count <<
+            std::setprecision(0) <<
+            std::setw(12) << static_cast<double>(alloc_bytes_) / count <<
+            std::endl;
+    }
+
+    static void ReportHeader(std::ostream &os) {
+        os << std::left << std::setw(10) << "stage" << std::right <<
+            std::setw(12) << "msgs/s" <<
+            std::setw(10) << "p50 us" <<
+            std::setw(10) << "p99 us" <<
+            std::setw(10) << "p99.9 us" <<
+            std::setw(10) << "allocs" <<
+            std::setw(12) << "bytes" << std::endl;
+    }
+
+private:
+    uint64_t Percentile(double p) {
+        size_t idx(static_cast<size_t>(p * (latencies_.size() - 1)));
+        std::nth_element(latencies_.begin(), latencies_.begin() + idx,
+            latencies_.end());
+        return latencies_[idx];
+    }
+
+    const std::string name_;
+    std::vector<uint64_t> latencies_;
+    uint64_t allocs_;
+    uint64_t alloc_bytes_;
+    uint64_t start_nsec_;
+    uint64_t start_allocs_;
+    uint64_t start_alloc_bytes_;
+};
+
+bool LoadCorpus(const std::string &path,
+    boost::ptr_vector<CorpusMessage> *messages) {
+    SandeshCorpusReader reader(path);
+    if (!reader.Open()) {
+        return false;
+    }
+    std::auto_ptr<CorpusMessage> message(new CorpusMessage);
+    while (reader.Read(&message->header, &message->xml)) {
+        messages->push_back(message.release());
+        message.reset(new CorpusMessage);
+    }
+    return !messages->empty();
+}
+
+// Takes every write and completes it right away
+class NullDbIf : public cass::cql::CqlIf {
+public:
+    NullDbIf() : CqlIf() {
+    }
+
+    virtual bool Db_AddColumn(std::auto_ptr<GenDb::ColList> cl,
+        GenDb::DbConsistency::type dconsistency,
+        GenDb::GenDbIf::DbAddColumnCb db_cb) {
+        if (!db_cb.empty()) {
+            db_cb(GenDb::DbOpResult::OK);
+        }
+        return true;
+    }
+
+    virtual bool Db_AddColumnSync(std::auto_ptr<GenDb::ColList> cl,
+        GenDb::DbConsistency::type dconsistency) {
+        return true;
+    }
+};
+
+void DbAddColumnCb(GenDb::DbOpResult::type dresult) {
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string corpus;
+    uint64_t count, rate;
+    bool uveproc;
+    opt::options_description desc("Options");
+    desc.add_options()
+        ("help", "Print this help message")
+        ("corpus", opt::value<std::string>(&corpus),
+             "Corpus captured with DEFAULT.sandesh_capture_file")
+        ("count", opt::value<uint64_t>(&count)->default_value(0),
+             "Messages to replay, the corpus is replayed as many times as "
+             "needed, 0 to replay it once")
+        ("rate", opt::value<uint64_t>(&rate)->default_value(0),
+             "Messages per second to replay at, 0 for as fast as possible")
+        ("uveproc", opt::value<bool>(&uveproc)->default_value(true),
+             "Process the UVEs of the messages");
+    opt::variables_map var_map;
+    opt::store(opt::parse_command_line(argc, argv, desc), var_map);
+    opt::notify(var_map);
+    if (var_map.count("help") || corpus.empty()) {
+        std::cout << desc << std::endl;
+        return corpus.empty() ? 1 : 0;
+    }
+
+    LoggingInit();
+    SetLoggingDisabled(true);
+
+    boost::ptr_vector<CorpusMessage> messages;
+    if (!LoadCorpus(corpus, &messages)) {
+        std::cerr << corpus << ": No messages" << std::endl;
+        return 1;
+    }
+    if (count == 0) {
+        count = messages.size();
+    }
+
+    EventManager evm;
+    DbHandlerPtr db_handler(new DbHandler(new NullDbIf,
+        g_viz_constants.TtlValuesDefault));
+    NiceMock<OpServerProxyMock> osp(&evm);
+    ON_CALL(osp, UVEUpdate(_, _, _, _, _, _, _, _, _, _))
+        .WillByDefault(Return(true));
+    ON_CALL(osp, UVENotif(_, _, _, _, _)).WillByDefault(Return(true));
+    Ruleeng ruleeng(db_handler, &osp);
+    ruleeng.Init();
+    // The rules are built by a task
+    TaskScheduler *scheduler(TaskScheduler::GetInstance());
+    while (!scheduler->IsEmpty()) {
+        usleep(1000);
+    }
+
+    StageStats decode("decode"), rule_execute("ruleeng"), total("total");
+    decode.Reserve(count);
+    rule_execute.Reserve(count);
+    total.Reserve(count);
+    boost::uuids::random_generator uuid_gen;
+    uint64_t failures(0);
+    uint64_t start_nsec(NowNsec());
+    for (uint64_t idx = 0; idx < count; idx++) {
+        if (rate) {
+            uint64_t due_nsec(start_nsec + idx * 1000000000ULL / rate);
+            uint64_t now_nsec(NowNsec());
+            if (due_nsec > now_nsec) {
+                usleep((due_nsec - now_nsec) / 1000);
+            }
+        }
+        const CorpusMessage &message(messages[idx % messages.size()]);
+        boost::uuids::uuid unm(uuid_gen());
+        total.Start();
+        decode.Start();
+        BenchSandeshMessage *msg(new BenchSandeshMessage);
+        msg->Parse(reinterpret_cast<const uint8_t *>(message.xml.data()),
+            message.xml.size());
+        msg->SetHeader(message.header);
+        decode.Stop();
+        rule_execute.Start();
+        VizMsg vmsg(msg, unm);
+        if (!ruleeng.rule_execute(&vmsg, uveproc, db_handler.get(),
+                                  &DbAddColumnCb)) {
+            failures++;
+        }
+        rule_execute.Stop();
+        delete msg;
+        total.Stop();
+    }
+    double elapsed((NowNsec() - start_nsec) / 1e9);
+
+    std::cout << messages.size() << " messages in the corpus, " << count <<
+        " replayed in " << std::fixed << std::setprecision(3) << elapsed <<
+        "s, " << std::setprecision(0) << count / elapsed << " msgs/s, " <<
+        failures << " failed" << std::endl;
+    StageStats::ReportHeader(std::cout);
+    decode.Report(std::cout);
+    rule_execute.Report(std::cout);
+    total.Report(std::cout);
+    return 0;
+}
@@ -27,6 +27,8 @@
 #include "collector.h"
 #include "viz_collector.h"
 #include "viz_sandesh.h"
+#include "sandesh_corpus.h"
+#include "stage_latency.h"
 #include <analytics_types.h>
 
 using std::string;
@@ -46,8 +48,8 @@ std::string Collector::self_ip_;
 
 bool Collector::task_policy_set_ = false;
 const std::string Collector::kDbTask = "analytics::DbHandler";
-const int Collector::kQSizeHighWaterMark = 7 * 1024 * 1024;
-const int Collector::kQSizeLowWaterMark  = 3 * 1024 * 1024;
+const int Collector::kQSizeHighWaterMark;
+const int Collector::kQSizeLowWaterMark;
 
 const std::vector<Sandesh::QueueWaterMarkInfo> Collector::kDbQueueWaterMarkInfo =
     boost::assign::tuple_list_of
@@ -77,6 +79,7 @@ Collector::Collector(EventManager *evm, short server_port,
 }
 
 Collector::~Collector() {
+    StopCapture();
 }
 
 void Collector::SessionShutdown() {
@@ -151,10 +154,15 @@ bool Collector::ReceiveResourceUpdate(SandeshSession *session,
 
 bool Collector::ReceiveSandeshMsg(SandeshSession *session,
                                   const SandeshMessage *msg, bool rsc) {
+    StageLatencyTimer timer(StageLatency::RECEIVE_SANDESH_MSG);
     boost::uuids::uuid unm(umn_gen_());
 
     VizMsg vmsg(msg, unm);
 
+    if (capture_) {
+        capture_->Write(msg->GetHeader(), msg->ExtractMessage());
+    }
+
     VizSession *vsession = dynamic_cast<VizSession *>(session);
     if (!vsession) {
         increment_no_session_error();
@@ -172,6 +180,23 @@ bool Collector::ReceiveSandeshMsg(SandeshSession *session,
     }
 }
 
+bool Collector::StartCapture(const std::string &path, uint64_t max_size) {
+    std::auto_ptr<SandeshCorpusWriter> capture(
+        new SandeshCorpusWriter(path, max_size));
+    if (!capture->Open()) {
+        return false;
+    }
+    LOG(INFO, "Capturing Sandesh messages to " << path);
+    capture_.reset(capture.release());
+    return true;
+}
+
+void Collector::StopCapture() {
+    if (capture_) {
+        capture_->Close();
+    }
+}
+
 SslSession* Collector::AllocSession(SslSocket *socket) {
     VizSession *session = new VizSession(this, socket, AllocConnectionIndex(),
                                          session_writer_task_id(),
@@ -10,6 +10,7 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #if __GNUC_PREREQ(4, 6)
 #pragma GCC diagnostic push
@@ -51,12 +52,15 @@ class DbHandler;
 class OpServerProxy;
 class EventManager;
 class SandeshStateMachine;
+class SandeshCorpusWriter;
 
 class Collector : public SandeshServer {
 public:
     const static std::string kDbTask;
-    const static int kQSizeHighWaterMark;
-    const static int kQSizeLowWaterMark;
+    // Database and state machine queue sizes at which the generators are
+    // deferred and undeferred
+    const static int kQSizeHighWaterMark = 7 * 1024 * 1024;
+    const static int kQSizeLowWaterMark = 3 * 1024 * 1024;
 
     typedef boost::function<bool(const VizMsg*, bool, DbHandler *,
         GenDb::GenDbIf::DbAddColumnCb db_cb)> VizCallback;
@@ -118,6 +122,10 @@ public:
         const std::string &host_ip="127.0.0.1");
     void CloseGeneratorSession(std::string source, std::string module,
                          std::string instance, std::string node_type);
+    // Records the messages received in a corpus, to be replayed by the
+    // ingest benchmark
+    bool StartCapture(const std::string &path, uint64_t max_size);
+    void StopCapture();
 protected:
     virtual SslSession *AllocSession(SslSocket *socket);
     virtual void DisconnectSession(SandeshSession *session);
@@ -158,6 +166,7 @@ private:
     // Random generator for UUIDs
     ThreadSafeUuidGenerator umn_gen_;
     CollectorStats stats_;
+    boost::scoped_ptr<SandeshCorpusWriter> capture_;
     std::vector<Sandesh::QueueWaterMarkInfo> db_queue_wm_info_;
     std::vector<Sandesh::QueueWaterMarkInfo> sm_queue_wm_info_;
     static std::string prog_name_;
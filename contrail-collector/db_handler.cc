@@ -2,6 +2,7 @@
  * Copyright (c) 2013 Juniper Networks, Inc. All rights reserved.
  */
 
+#include <algorithm>
 #include <exception>
 #include <string>
 #include <boost/bind.hpp>
@@ -10,6 +11,9 @@
 #include <boost/uuid/name_generator.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
@@ -33,6 +37,8 @@
 #include "db_handler.h"
 #include "parser_util.h"
 #include "db_handler_impl.h"
+#include "stat_table_db_if.h"
+#include "stage_latency.h"
 #include "viz_sandesh.h"
 
 #define DB_LOG(_Level, _Msg)                                                   \
@@ -57,10 +63,54 @@ using process::ConnectionType;
 using process::ConnectionStatus;
 using namespace boost::system;
 
+const std::string DbHandler::kWriteClassNames[] = {
+    "messages", "statistics", "sessions" };
+const uint32_t DbHandler::kSpoolHighWaterMark;
+const uint32_t DbHandler::kSpoolLowWaterMark;
 uint32_t DbHandler::field_cache_index_ = 0;
 std::set<std::string> DbHandler::field_cache_set_;
 tbb::mutex DbHandler::fmutex_;
 
+// Threads at most held on the round trips of preparing the tables
+static const int kUseTablesConcurrency = 8;
+
+// Tables are prepared in an arena of their own: a thread waiting for the
+// prepares must not pick up an unrelated Task from the scheduler arena
+static tbb::task_arena use_tables_arena(kUseTablesConcurrency);
+
+// Prepares the tables, run in use_tables_arena
+class ParallelUseTables {
+public:
+    typedef boost::function<void(size_t)> UseTableFn;
+
+    ParallelUseTables(size_t count, UseTableFn use_table) :
+        count_(count), use_table_(use_table) {
+    }
+    void operator()() const {
+        tbb::parallel_for(size_t(0), count_, use_table_);
+    }
+
+private:
+    size_t count_;
+    UseTableFn use_table_;
+};
+
+static GenDb::GenDbIf *CreateDbIf(EventManager *evm,
+        const Options::Cassandra &cassandra_options) {
+    if (!cassandra_options.local_stats_directory_.empty()) {
+        return new StatTableDbIf(evm, cassandra_options.cassandra_ips_,
+            cassandra_options.cassandra_ports_[0],
+            cassandra_options.user_, cassandra_options.password_,
+            cassandra_options.use_ssl_, cassandra_options.ca_certs_,
+            true, cassandra_options.local_stats_directory_);
+    }
+    return new cass::cql::CqlIf(evm, cassandra_options.cassandra_ips_,
+        cassandra_options.cassandra_ports_[0],
+        cassandra_options.user_, cassandra_options.password_,
+        cassandra_options.use_ssl_, cassandra_options.ca_certs_,
+        true);
+}
+
 DbHandler::DbHandler(EventManager *evm,
         GenDb::GenDbIf::DbErrorHandler err_handler,
         std::string name,
@@ -68,11 +118,7 @@ DbHandler::DbHandler(EventManager *evm,
         bool use_db_write_options,
         const DbWriteOptions &db_write_options,
         ConfigClientCollector *config_client) :
-    dbif_(new cass::cql::CqlIf(evm, cassandra_options.cassandra_ips_,
-        cassandra_options.cassandra_ports_[0],
-        cassandra_options.user_, cassandra_options.password_,
-        cassandra_options.use_ssl_, cassandra_options.ca_certs_,
-        true)),
+    dbif_(CreateDbIf(evm, cassandra_options)),
     name_(name),
     drop_level_(SandeshLevel::INVALID),
     ttl_map_(cassandra_options.ttlmap_),
@@ -85,7 +131,21 @@ DbHandler::DbHandler(EventManager *evm,
     disable_statistics_writes_(cassandra_options.disable_db_stats_writes_),
     disable_messages_writes_(cassandra_options.disable_db_messages_writes_),
     config_client_(config_client),
-    use_db_write_options_(use_db_write_options) {
+    use_db_write_options_(use_db_write_options),
+    spool_timer_(NULL),
+    spool_replay_rate_(cassandra_options.spool_replay_rate_) {
+    db_init_done_ = false;
+    spooling_ = false;
+    write_class_high_watermark_[MESSAGE_WRITES] = 0;
+    write_class_low_watermark_[MESSAGE_WRITES] = 0;
+    write_class_high_watermark_[STATISTICS_WRITES] =
+        cassandra_options.statistics_writes_high_watermark_;
+    write_class_low_watermark_[STATISTICS_WRITES] =
+        cassandra_options.statistics_writes_low_watermark_;
+    write_class_high_watermark_[SESSION_WRITES] =
+        cassandra_options.session_writes_high_watermark_;
+    write_class_low_watermark_[SESSION_WRITES] =
+        cassandra_options.session_writes_low_watermark_;
     udc_.reset(new UserDefinedCounters());
     if (config_client) {
         config_client->RegisterConfigReceive("udc",
@@ -148,6 +208,25 @@ DbHandler::DbHandler(EventManager *evm,
             db_write_options.get_low_watermark2_message_severity_level());
     }
     session_table_db_stats_ = SessionTableDbStats();
+
+    if (!cassandra_options.spool_directory_.empty()) {
+        spool_.reset(new DbSpool(cassandra_options.spool_directory_,
+            static_cast<uint64_t>(cassandra_options.spool_max_size_mb_) <<
+                20));
+        if (spool_->Initialize()) {
+            spool_timer_ = TimerManager::CreateTimer(*evm->io_service(),
+                name + " Db Spool Replay Timer",
+                TaskScheduler::GetInstance()->GetTaskId(Collector::kDbTask));
+            spool_timer_->Start(kSpoolReplayInterval,
+                boost::bind(&DbHandler::SpoolReplayTimerExpired, this),
+                boost::bind(&DbHandler::SpoolReplayTimerErrorHandler, this,
+                            _1, _2));
+        } else {
+            DB_LOG(ERROR, "Spool " << cassandra_options.spool_directory_ <<
+                " FAILED, writes will not be spooled");
+            spool_.reset();
+        }
+    }
 }
 
 
@@ -159,11 +238,23 @@ DbHandler::DbHandler(GenDb::GenDbIf *dbif, const TtlMap& ttl_map) :
     disable_all_writes_(false),
     disable_statistics_writes_(false),
     disable_messages_writes_(false),
-    use_db_write_options_(false) {
+    use_db_write_options_(false),
+    spool_timer_(NULL),
+    spool_replay_rate_(0) {
+    db_init_done_ = false;
+    spooling_ = false;
+    for (int idx = 0; idx < MAX_WRITE_CLASS; idx++) {
+        write_class_high_watermark_[idx] = 0;
+        write_class_low_watermark_[idx] = 0;
+    }
     udc_.reset(new UserDefinedCounters());
 }
 
 DbHandler::~DbHandler() {
+    if (spool_timer_) {
+        TimerManager::DeleteTimer(spool_timer_);
+        spool_timer_ = NULL;
+    }
 }
 
 uint64_t DbHandler::GetTtlInHourFromMap(const TtlMap& ttl_map,
@@ -325,6 +416,115 @@ void DbHandler::SetDropLevel(size_t queue_count, SandeshLevel::type level,
     }
 }
 
+void DbHandler::SetWriteClassDrop(size_t queue_count, WriteClass wclass,
+    bool drop) {
+    DbWriteClassStats &stats(write_class_stats_[wclass]);
+    if (stats.dropping != drop) {
+        DB_LOG(INFO, "DB " << kWriteClassNames[wclass] << " WRITES: " <<
+            (drop ? "DROPPED" : "RESUMED") << ", DB QUEUE COUNT: " <<
+            queue_count);
+        stats.dropping = drop;
+    }
+}
+
+void DbHandler::SetWriteClassWaterMarks() {
+    for (int idx = 0; idx < MAX_WRITE_CLASS; idx++) {
+        WriteClass wclass(static_cast<WriteClass>(idx));
+        if (write_class_high_watermark_[idx] == 0) {
+            continue;
+        }
+        dbif_->Db_SetQueueWaterMark(true, write_class_high_watermark_[idx],
+            boost::bind(&DbHandler::SetWriteClassDrop, this, _1, wclass,
+            true));
+        dbif_->Db_SetQueueWaterMark(false, write_class_low_watermark_[idx],
+            boost::bind(&DbHandler::SetWriteClassDrop, this, _1, wclass,
+            false));
+    }
+}
+
+bool DbHandler::IsWriteClassDropped(WriteClass wclass) const {
+    return write_class_stats_[wclass].dropping;
+}
+
+void DbHandler::SetSpooling(size_t queue_count, bool spooling) {
+    if (spooling_ != spooling) {
+        DB_LOG(INFO, "DB WRITES: " << (spooling ? "SPOOLED" : "RESUMED") <<
+            ", DB QUEUE COUNT: " << queue_count);
+        spooling_ = spooling;
+    }
+}
+
+void DbHandler::SetSpoolWaterMarks() {
+    if (!spool_) {
+        return;
+    }
+    dbif_->Db_SetQueueWaterMark(true, kSpoolHighWaterMark,
+        boost::bind(&DbHandler::SetSpooling, this, _1, true));
+    dbif_->Db_SetQueueWaterMark(false, kSpoolLowWaterMark,
+        boost::bind(&DbHandler::SetSpooling, this, _1, false));
+}
+
+bool DbHandler::SpoolWrite(const GenDb::ColList &col_list,
+    GenDb::DbConsistency::type dconsistency, WriteClass wclass) {
+    if (!spool_->Append(col_list, dconsistency, wclass)) {
+        return false;
+    }
+    write_class_stats_[wclass].spooled++;
+    return true;
+}
+
+bool DbHandler::SpoolReplayTimerExpired() {
+    // Leave the spool alone until the database has caught up
+    if (!db_init_done_ || spooling_) {
+        return true;
+    }
+    for (int idx = 0; idx < MAX_WRITE_CLASS; idx++) {
+        if (IsWriteClassDropped(static_cast<WriteClass>(idx))) {
+            return true;
+        }
+    }
+    uint32_t count(std::max(1U,
+        spool_replay_rate_ * kSpoolReplayInterval / 1000));
+    for (uint32_t i = 0; i < count; i++) {
+        std::auto_ptr<GenDb::ColList> col_list;
+        GenDb::DbConsistency::type dconsistency;
+        uint8_t tag;
+        if (!spool_->Front(&col_list, &dconsistency, &tag)) {
+            break;
+        }
+        WriteClass wclass(tag < MAX_WRITE_CLASS ?
+            static_cast<WriteClass>(tag) : MESSAGE_WRITES);
+        // The write stays in the spool if the database does not take it
+        if (!WriteToDb(col_list, dconsistency, wclass,
+                GenDb::GenDbIf::DbAddColumnCb())) {
+            break;
+        }
+        spool_->Pop();
+    }
+    return true;
+}
+
+void DbHandler::SpoolReplayTimerErrorHandler(std::string error_name,
+    std::string error_message) {
+    DB_LOG(ERROR, error_name << " " << error_message);
+}
+
+bool DbHandler::GetDbSpoolInfo(DbSpoolInfo *spool_info) const {
+    if (!spool_) {
+        return false;
+    }
+    DbSpool::Stats stats;
+    spool_->GetStats(&stats);
+    spool_info->set_segments(stats.segments);
+    spool_info->set_size(stats.size);
+    spool_info->set_records(stats.records);
+    spool_info->set_appends(stats.appends);
+    spool_info->set_append_fails(stats.append_fails);
+    spool_info->set_replays(stats.replays);
+    spool_info->set_corrupt_records(stats.corrupt_records);
+    return true;
+}
+
 bool DbHandler::CreateTables() {
     for (std::vector<GenDb::NewCf>::const_iterator it = vizd_tables.begin();
             it != vizd_tables.end(); it++) {
@@ -390,7 +590,117 @@ bool DbHandler::CreateTables() {
             }
         }
     }
+    return true;
+}
+
+std::string DbHandler::SchemaVersion() const {
+    // Everything the tables are created from
+    std::ostringstream schema;
+    schema << compaction_strategy_ << ":" <<
+        flow_tables_compaction_strategy_ << ";";
+    const std::map<std::string, table_schema> *schemas[] = {
+        &g_viz_constants._VIZD_TABLE_SCHEMA,
+        &g_viz_constants._VIZD_STAT_TABLE_SCHEMA,
+        &g_viz_constants._VIZD_SESSION_TABLE_SCHEMA,
+    };
+    for (size_t i = 0; i < sizeof(schemas) / sizeof(schemas[0]); i++) {
+        for (std::map<std::string, table_schema>::const_iterator it =
+                schemas[i]->begin(); it != schemas[i]->end(); ++it) {
+            schema << i << ":" << it->first << ":" << it->second.is_static;
+            BOOST_FOREACH(const schema_column &column, it->second.columns) {
+                schema << "|" << column.name << ":" << column.datatype <<
+                    ":" << column.key << ":" << column.clustering << ":" <<
+                    column.index_type << ":" << column.index_mode;
+            }
+            schema << ";";
+        }
+    }
+    // 64 bit FNV-1a
+    const std::string str(schema.str());
+    uint64_t hash(14695981039346656037ULL);
+    for (std::string::const_iterator it = str.begin(); it != str.end();
+         ++it) {
+        hash ^= static_cast<uint8_t>(*it);
+        hash *= 1099511628211ULL;
+    }
+    char version[17];
+    snprintf(version, sizeof(version), "%016llx",
+             static_cast<unsigned long long>(hash));
+    return version;
+}
 
+bool DbHandler::IsSchemaCurrent() {
+    GenDb::ColList col_list;
+    GenDb::DbDataValueVec key;
+    key.push_back(g_viz_constants.SYSTEM_OBJECT_ANALYTICS);
+    // Fails if the table does not exist yet
+    if (!dbif_->Db_GetRow(&col_list, g_viz_constants.SCHEMA_VERSION_TABLE,
+            key, GenDb::DbConsistency::LOCAL_ONE)) {
+        return false;
+    }
+    for (GenDb::NewColVec::iterator it = col_list.columns_.begin();
+         it != col_list.columns_.end(); it++) {
+        const std::string *col_name(
+            boost::get<std::string>(&it->name->at(0)));
+        if (col_name == NULL || *col_name != g_viz_constants.SCHEMA_VERSION) {
+            continue;
+        }
+        const std::string *version(
+            boost::get<std::string>(&it->value->at(0)));
+        return version != NULL && *version == SchemaVersion();
+    }
+    return false;
+}
+
+bool DbHandler::WriteSchemaVersion() {
+    std::auto_ptr<GenDb::ColList> col_list(new GenDb::ColList);
+    col_list->cfname_ = g_viz_constants.SCHEMA_VERSION_TABLE;
+    col_list->rowkey_.push_back(g_viz_constants.SYSTEM_OBJECT_ANALYTICS);
+    col_list->columns_.push_back(new GenDb::NewCol(
+        g_viz_constants.SCHEMA_VERSION, SchemaVersion(), 0));
+    if (!dbif_->Db_AddColumnSync(col_list,
+        GenDb::DbConsistency::LOCAL_ONE)) {
+        DB_LOG(ERROR, g_viz_constants.SCHEMA_VERSION_TABLE <<
+            ": Schema Version Column Add FAILED");
+        return false;
+    }
+    return true;
+}
+
+void DbHandler::UseTable(const std::vector<const GenDb::NewCf *> &tables,
+    tbb::atomic<bool> *success, size_t idx) {
+    if (!*success) {
+        return;
+    }
+    if (!dbif_->Db_UseColumnfamily(*tables[idx])) {
+        DB_LOG(ERROR, tables[idx]->cfname_ << ": Db_UseColumnfamily FAILED");
+        *success = false;
+    }
+}
+
+// Prepares the statements of all the tables, each one is a round trip to
+// the database so they are spread over a few threads. CqlIf prepares
+// through the driver session, which may be used from several threads.
+bool DbHandler::UseTables() {
+    std::vector<const GenDb::NewCf *> tables;
+    const std::vector<GenDb::NewCf> *table_lists[] = {
+        &vizd_tables, &vizd_stat_tables, &vizd_session_tables };
+    for (size_t i = 0; i < sizeof(table_lists) / sizeof(table_lists[0]);
+         i++) {
+        for (std::vector<GenDb::NewCf>::const_iterator it =
+                table_lists[i]->begin(); it != table_lists[i]->end(); ++it) {
+            tables.push_back(&*it);
+        }
+    }
+    tbb::atomic<bool> success;
+    success = true;
+    use_tables_arena.execute(ParallelUseTables(tables.size(),
+        boost::bind(&DbHandler::UseTable, this, boost::cref(tables),
+                    &success, _1)));
+    return success;
+}
+
+bool DbHandler::InitSystemObjectTable() {
     if (!dbif_->Db_SetTablespace(tablespace_)) {
         DB_LOG(ERROR, "Set KEYSPACE: " << tablespace_ << " FAILED");
         return false;
@@ -497,20 +807,25 @@ bool DbHandler::CreateTables() {
 }
 
 void DbHandler::UnInit() {
+    db_init_done_ = false;
     dbif_->Db_Uninit();
     dbif_->Db_SetInitDone(false);
 }
 
-bool DbHandler::Init(bool initial) {
+bool DbHandler::Init(bool initial, SchemaUpdateCb schema_update_cb) {
     SetDropLevel(0, SandeshLevel::INVALID, NULL);
-    if (initial) {
-        return Initialize();
-    } else {
-        return Setup();
+    for (int idx = 0; idx < MAX_WRITE_CLASS; idx++) {
+        SetWriteClassDrop(0, static_cast<WriteClass>(idx), false);
     }
+    SetWriteClassWaterMarks();
+    SetSpooling(0, false);
+    SetSpoolWaterMarks();
+    bool success(initial ? Initialize(schema_update_cb) : Setup());
+    db_init_done_ = success;
+    return success;
 }
 
-bool DbHandler::Initialize() {
+bool DbHandler::Initialize(SchemaUpdateCb schema_update_cb) {
     DB_LOG(DEBUG, "Initializing..");
 
     /* init of vizd table structures */
@@ -521,16 +836,44 @@ bool DbHandler::Initialize() {
         return false;
     }
 
-    if (!dbif_->Db_AddSetTablespace(tablespace_, "2")) {
-        DB_LOG(ERROR, "Create/Set KEYSPACE: " << tablespace_ << " FAILED");
-        return false;
+    // Keyspace and table creation are skipped if the schema has not
+    // changed since the tables were last created
+    bool schema_current(dbif_->Db_FindTablespace(tablespace_) &&
+        dbif_->Db_SetTablespace(tablespace_) && IsSchemaCurrent());
+    if (schema_current) {
+        DB_LOG(INFO, "Schema " << SchemaVersion() << " current");
+        if (!UseTables()) {
+            DB_LOG(ERROR, "UseTables FAILED");
+            return false;
+        }
+    } else {
+        // Serializes the keyspace and table creation across collectors
+        if (!schema_update_cb.empty()) {
+            schema_update_cb();
+        }
+        if (!dbif_->Db_AddSetTablespace(tablespace_, "2")) {
+            DB_LOG(ERROR, "Create/Set KEYSPACE: " << tablespace_ <<
+                " FAILED");
+            return false;
+        }
+        if (!CreateTables()) {
+            DB_LOG(ERROR, "CreateTables FAILED");
+            return false;
+        }
     }
 
-    if (!CreateTables()) {
-        DB_LOG(ERROR, "CreateTables FAILED");
+    if (!InitSystemObjectTable()) {
+        DB_LOG(ERROR, "InitSystemObjectTable FAILED");
         return false;
     }
 
+    if (!schema_current) {
+        if (!WriteSchemaVersion()) {
+            return false;
+        }
+        DB_LOG(INFO, "Schema " << SchemaVersion() << " created");
+    }
+
     dbif_->Db_SetInitDone(true);
     DB_LOG(DEBUG, "Initializing Done");
 
@@ -547,20 +890,9 @@ bool DbHandler::Setup() {
         DB_LOG(ERROR, "Set KEYSPACE: " << tablespace_ << " FAILED");
         return false;
     }   
-    for (std::vector<GenDb::NewCf>::const_iterator it = vizd_tables.begin();
-            it != vizd_tables.end(); it++) {
-        if (!dbif_->Db_UseColumnfamily(*it)) {
-            DB_LOG(ERROR, it->cfname_ << 
-                   ": Db_UseColumnfamily FAILED");
-            return false;
-        }
-    }
-    for (std::vector<GenDb::NewCf>::const_iterator it = vizd_stat_tables.begin();
-            it != vizd_stat_tables.end(); it++) {
-        if (!dbif_->Db_UseColumnfamily(*it)) {
-            DB_LOG(ERROR, it->cfname_ << ": Db_UseColumnfamily FAILED");
-            return false;
-        }
+    if (!UseTables()) {
+        DB_LOG(ERROR, "UseTables FAILED");
+        return false;
     }
     dbif_->Db_SetInitDone(true);
     DB_LOG(DEBUG, "Setup Done");
@@ -601,6 +933,10 @@ void DbHandler::SetDbQueueWaterMarkInfo(Sandesh::QueueWaterMarkInfo &wm,
 
 void DbHandler::ResetDbQueueWaterMarkInfo() {
     dbif_->Db_ResetQueueWaterMarks();
+    // The table family watermarks are not part of the collector
+    // configuration, restore them
+    SetWriteClassWaterMarks();
+    SetSpoolWaterMarks();
 }
 
 void DbHandler::GetSandeshStats(std::string *drop_level,
@@ -618,19 +954,13 @@ bool DbHandler::GetStats(uint64_t *queue_count, uint64_t *enqueues) const {
 
 bool DbHandler::GetStats(std::vector<GenDb::DbTableInfo> *vdbti,
     GenDb::DbErrors *dbe, std::vector<GenDb::DbTableInfo> *vstats_dbti) {
-    {
-        tbb::mutex::scoped_lock lock(smutex_);
-        stable_stats_.GetDiffs(vstats_dbti);
-    }
+    stable_stats_.GetDiffs(vstats_dbti);
     return dbif_->Db_GetStats(vdbti, dbe);
 }
 
 bool DbHandler::GetCumulativeStats(std::vector<GenDb::DbTableInfo> *vdbti,
     GenDb::DbErrors *dbe, std::vector<GenDb::DbTableInfo> *vstats_dbti) const {
-    {
-        tbb::mutex::scoped_lock lock(smutex_);
-        stable_stats_.GetCumulative(vstats_dbti);
-    }
+    stable_stats_.GetCumulative(vstats_dbti);
     return dbif_->Db_GetCumulativeStats(vdbti, dbe);
 }
 
@@ -651,12 +981,87 @@ bool DbHandler::GetCqlStats(cass::cql::DbStats *stats) const {
 }
 
 bool DbHandler::InsertIntoDb(std::auto_ptr<GenDb::ColList> col_list,
-    GenDb::DbConsistency::type dconsistency,
+    GenDb::DbConsistency::type dconsistency, WriteClass wclass,
     GenDb::GenDbIf::DbAddColumnCb db_cb) {
     if (IsAllWritesDisabled()) {
         return true;
     }
-    return dbif_->Db_AddColumn(col_list, dconsistency, db_cb);
+    if (spool_ && (!db_init_done_ || spooling_ ||
+            IsWriteClassDropped(wclass))) {
+        if (SpoolWrite(*col_list, dconsistency, wclass)) {
+            // The spool takes the write off the database queue
+            if (!db_cb.empty()) {
+                db_cb(GenDb::DbOpResult::OK);
+            }
+            return true;
+        }
+        // The spool is full
+        if (IsWriteClassDropped(wclass)) {
+            write_class_stats_[wclass].drops++;
+            return true;
+        }
+    }
+    return WriteToDb(col_list, dconsistency, wclass, db_cb);
+}
+
+bool DbHandler::WriteToDb(std::auto_ptr<GenDb::ColList> col_list,
+    GenDb::DbConsistency::type dconsistency, WriteClass wclass,
+    GenDb::GenDbIf::DbAddColumnCb db_cb) {
+    DbWriteClassStats &stats(write_class_stats_[wclass]);
+    if (!dbif_->Db_AddColumn(col_list, dconsistency,
+            boost::bind(&DbHandler::InsertIntoDbDone, this, wclass,
+                UTCTimestampUsec(), db_cb, _1))) {
+        stats.write_fails++;
+        return false;
+    }
+    stats.writes++;
+    return true;
+}
+
+void DbHandler::InsertIntoDbDone(WriteClass wclass, uint64_t start_usec,
+    GenDb::GenDbIf::DbAddColumnCb db_cb, GenDb::DbOpResult::type dresult) {
+    DbWriteClassStats &stats(write_class_stats_[wclass]);
+    uint64_t now_usec(UTCTimestampUsec());
+    stats.completions++;
+    uint64_t latency_usec(now_usec > start_usec ? now_usec - start_usec : 0);
+    stats.latency_usec += latency_usec;
+    StageLatency::GetInstance()->Record(StageLatency::DB_WRITE,
+        latency_usec);
+    if (!db_cb.empty()) {
+        db_cb(dresult);
+    }
+}
+
+void DbHandler::GetDbWriteClassInfo(
+    std::map<std::string, DbWriteClassInfo> *write_class_info) {
+    tbb::mutex::scoped_lock lock(smutex_);
+    for (int idx = 0; idx < MAX_WRITE_CLASS; idx++) {
+        DbWriteClassStats &stats(write_class_stats_[idx]);
+        uint64_t writes(stats.writes);
+        uint64_t write_fails(stats.write_fails);
+        uint64_t drops(stats.drops);
+        uint64_t completions(stats.completions);
+        uint64_t latency_usec(stats.latency_usec);
+        uint64_t spooled(stats.spooled);
+        DbWriteClassInfo info;
+        info.set_writes(writes - stats.last_writes);
+        info.set_write_fails(write_fails - stats.last_write_fails);
+        info.set_drops(drops - stats.last_drops);
+        info.set_pending(writes > completions ? writes - completions : 0);
+        uint64_t interval_completions(completions - stats.last_completions);
+        info.set_avg_latency_usec(interval_completions ?
+            (latency_usec - stats.last_latency_usec) / interval_completions :
+            0);
+        info.set_dropping(stats.dropping);
+        info.set_spooled(spooled - stats.last_spooled);
+        stats.last_writes = writes;
+        stats.last_write_fails = write_fails;
+        stats.last_drops = drops;
+        stats.last_completions = completions;
+        stats.last_latency_usec = latency_usec;
+        stats.last_spooled = spooled;
+        write_class_info->insert(std::make_pair(kWriteClassNames[idx], info));
+    }
 }
 
 bool DbHandler::AllowMessageTableInsert(const SandeshHeader &header) {
@@ -751,7 +1156,8 @@ void DbHandler::MessageTableOnlyInsert(const VizMsg *vmsgp,
     GenDb::NewColVec& columns = col_list->columns_;
     columns.reserve(1);
     columns.push_back(col);
-    if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE, db_cb)) {
+    if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE,
+            MESSAGE_WRITES, db_cb)) {
         DB_LOG(ERROR, "Addition of message: " << message_type <<
                 ", message UUID: " << vmsgp->unm << " COLUMN FAILED");
         return;
@@ -848,7 +1254,7 @@ void DbHandler::FieldNamesTableInsert(uint64_t timestamp,
     attribs.insert(make_pair(string("Source"),pv));
 
     StatTableInsertTtl(timestamp, "FieldNames","fields", tmap, attribs, ttl,
-        db_cb);
+        MESSAGE_WRITES, db_cb);
 }
 
 /*
@@ -915,7 +1321,8 @@ void DbHandler::ObjectTableInsert(const std::string &table, const std::string &o
         GenDb::NewColVec& columns = col_list->columns_;
         columns.reserve(1);
         columns.push_back(col);
-        if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE, db_cb)) {
+        if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE,
+                MESSAGE_WRITES, db_cb)) {
             DB_LOG(ERROR, "Addition of " << objectkey_str <<
                     ", message UUID " << unm << " " << table << " into table "
                     << g_viz_constants.OBJECT_VALUE_TABLE << " FAILED");
@@ -947,7 +1354,7 @@ bool DbHandler::StatTableWrite(uint32_t t2, const std::string& statName,
         const std::string& key, const std::string& proxy,
         const std::vector<std::vector<std::string> >& tags,
         uint32_t t1, const boost::uuids::uuid& unm,
-        const std::string& jsonline, int ttl,
+        const std::string& jsonline, int ttl, WriteClass wclass,
         GenDb::GenDbIf::DbAddColumnCb db_cb) {
 
     uint8_t part = 0;
@@ -979,16 +1386,15 @@ bool DbHandler::StatTableWrite(uint32_t t2, const std::string& statName,
     GenDb::NewColVec& columns = col_list->columns_;
     columns.push_back(col);
 
-    if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE, db_cb)) {
+    if (!InsertIntoDb(col_list, GenDb::DbConsistency::LOCAL_ONE, wclass,
+            db_cb)) {
         DB_LOG(ERROR, "Addition of " << statName <<
                 ", " << statAttr << " into table " <<
                 g_viz_constants.STATS_TABLE <<" FAILED");
-        tbb::mutex::scoped_lock lock(smutex_);
-        stable_stats_.Update(statName + ":" + statAttr, true, true, false, 1);
+        stable_stats_.Update(statName, statAttr, true);
         return false;
     } else {
-        tbb::mutex::scoped_lock lock(smutex_);
-        stable_stats_.Update(statName + ":" + statAttr, true, false, false, 1);
+        stable_stats_.Update(statName, statAttr, false);
         return true;
     }
 }
@@ -1003,9 +1409,14 @@ DbHandler::StatTableInsert(uint64_t ts,
     if (IsAllWritesDisabled() || IsStatisticsWritesDisabled()) {
         return;
     }
+    // With a spool the writes are spooled instead of being dropped
+    if (!spool_ && IsWriteClassDropped(STATISTICS_WRITES)) {
+        write_class_stats_[STATISTICS_WRITES].drops++;
+        return;
+    }
     int ttl = GetTtl(TtlType::STATSDATA_TTL);
     StatTableInsertTtl(ts, statName, statAttr, attribs_tag, attribs, ttl,
-        db_cb);
+        STATISTICS_WRITES, db_cb);
 }
 
 static inline unsigned int djb_hash (const char *str, size_t len) {
@@ -1023,7 +1434,7 @@ DbHandler::StatTableInsertTtl(uint64_t ts,
         const std::string& statName,
         const std::string& statAttr,
         const TagMap & attribs_tag,
-        const AttribMap & attribs, int ttl,
+        const AttribMap & attribs, int ttl, WriteClass wclass,
         GenDb::GenDbIf::DbAddColumnCb db_cb) {
 
     uint64_t temp_u64 = ts;
@@ -1263,7 +1674,7 @@ DbHandler::StatTableInsertTtl(uint64_t ts,
         }
     }
     StatTableWrite(temp_u32, statName, statAttr, source, name, key, proxy, tags, t1,
-                        unm, jsonline, ttl, db_cb);
+                        unm, jsonline, ttl, wclass, db_cb);
 }
 
 boost::uuids::uuid DbHandler::seed_uuid = StringToUuid(std::string("ffffffff-ffff-ffff-ffff-ffffffffffff"));
@@ -1423,6 +1834,10 @@ void JsonifySessionMap(const pugi::xml_node& root, std::string *json_string) {
 bool DbHandler::SessionSampleAdd(const pugi::xml_node& session_sample,
                                  const SandeshHeader& header,
                                  GenDb::GenDbIf::DbAddColumnCb db_cb) {
+    if (!spool_ && IsWriteClassDropped(SESSION_WRITES)) {
+        write_class_stats_[SESSION_WRITES].drops++;
+        return true;
+    }
     SessionValueArray session_entry_values;
     pugi::xml_node &mnode = const_cast<pugi::xml_node &>(session_sample);
 
@@ -1612,7 +2027,7 @@ bool DbHandler::SessionSampleAdd(const pugi::xml_node& session_sample,
         }
         DbInsertCb db_insert_cb =
             boost::bind(&DbHandler::InsertIntoDb, this, _1,
-            GenDb::DbConsistency::LOCAL_ONE, db_cb);
+            GenDb::DbConsistency::LOCAL_ONE, SESSION_WRITES, db_cb);
         if (!PopulateSessionTable(T2, session_entry_values,
             db_insert_cb, ttl_map_)) {
                 DB_LOG(ERROR, "Populating SessionRecordTable FAILED");
@@ -1708,7 +2123,20 @@ bool DbHandler::UnderlayFlowSampleInsert(const UFlowData& flow_data,
         amap.insert(std::make_pair("flow.protocol", protocol));
         DbHandler::Var ft = it->get_flowtype();
         amap.insert(std::make_pair("flow.flowtype", ft));
-        
+        // Counters of aggregated samples
+        if (it->__isset.samples) {
+            DbHandler::Var samples = it->get_samples();
+            amap.insert(std::make_pair("flow.samples", samples));
+        }
+        if (it->__isset.packets) {
+            DbHandler::Var packets = it->get_packets();
+            amap.insert(std::make_pair("flow.packets", packets));
+        }
+        if (it->__isset.bytes) {
+            DbHandler::Var bytes = it->get_bytes();
+            amap.insert(std::make_pair("flow.bytes", bytes));
+        }
+
         DbHandler::TagMap tmap;
         // Add tag -> name:.pifindex
         DbHandler::AttribMap amap_name_pifindex;
@@ -1774,19 +2202,26 @@ DbHandlerInitializer::DbHandlerInitializer(EventManager *evm,
     callback_(callback),
     db_init_timer_(TimerManager::CreateTimer(*evm->io_service(),
         db_name + " Db Init Timer",
-        TaskScheduler::GetInstance()->GetTaskId(timer_task_name))) {
+        TaskScheduler::GetInstance()->GetTaskId(timer_task_name))),
+    use_zookeeper_(false),
+    zoo_locked_(false) {
 }
 
 DbHandlerInitializer::~DbHandlerInitializer() {
 }
 
-bool DbHandlerInitializer::Initialize() {
+void DbHandlerInitializer::LockSchema() {
     // Synchronize creation across nodes using zookeeper
     if (use_zookeeper_ && !zoo_locked_) {
         assert(zoo_mutex_->Lock());
         zoo_locked_ = true;
     }
-    if (!db_handler_->Init(true)) {
+}
+
+bool DbHandlerInitializer::Initialize() {
+    // The lock is only taken if the tables need to be created or updated
+    if (!db_handler_->Init(true,
+            boost::bind(&DbHandlerInitializer::LockSchema, this))) {
         if (use_zookeeper_ && zoo_locked_) {
             assert(zoo_mutex_->Release());
             zoo_locked_ = false;
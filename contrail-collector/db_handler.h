@@ -23,6 +23,7 @@
 #endif
 
 #include <boost/tuple/tuple.hpp>
+#include <tbb/atomic.h>
 
 #include "base/parse_object.h"
 #include "io/event_manager.h"
@@ -38,6 +39,8 @@
 #include "config_client_collector.h"
 #include "usrdef_counters.h"
 #include "options.h"
+#include "db_spool.h"
+#include "stat_table_db_stats.h"
 
 class Options;
 
@@ -57,11 +60,70 @@ public:
     uint64_t curr_json_size;
 };
 
+/*
+ * Stats for the writes of a table family
+ */
+class DbWriteClassStats {
+public:
+    DbWriteClassStats() :
+        last_writes(0),
+        last_write_fails(0),
+        last_drops(0),
+        last_completions(0),
+        last_latency_usec(0),
+        last_spooled(0) {
+        writes = 0;
+        write_fails = 0;
+        drops = 0;
+        completions = 0;
+        latency_usec = 0;
+        dropping = false;
+        spooled = 0;
+    }
+    // Writes handed to the database
+    tbb::atomic<uint64_t> writes;
+    tbb::atomic<uint64_t> write_fails;
+    // Writes dropped because the database queue is above the watermark
+    tbb::atomic<uint64_t> drops;
+    // Writes acknowledged by the database, and the time they took
+    tbb::atomic<uint64_t> completions;
+    tbb::atomic<uint64_t> latency_usec;
+    tbb::atomic<bool> dropping;
+    // Writes held in the spool instead of being handed to the database
+    tbb::atomic<uint64_t> spooled;
+    // Values at the time of the last report
+    uint64_t last_writes;
+    uint64_t last_write_fails;
+    uint64_t last_drops;
+    uint64_t last_completions;
+    uint64_t last_latency_usec;
+    uint64_t last_spooled;
+};
+
 class DbHandler {
 public:
     static const int DefaultDbTTL = 0;
     static boost::uuids::uuid seed_uuid;
 
+    // Table families sharing the database queue, in decreasing order of
+    // importance. When the queue grows, the writes of the least
+    // important family are dropped first:
+    //     MESSAGE_WRITES : MessageTable, ObjectTable and FieldNames,
+    //         subject to the message severity drop levels
+    //     STATISTICS_WRITES : StatTable
+    //     SESSION_WRITES : SessionTable
+    typedef enum {
+        MESSAGE_WRITES = 0,
+        STATISTICS_WRITES = 1,
+        SESSION_WRITES = 2,
+        MAX_WRITE_CLASS
+    } WriteClass;
+    static const std::string kWriteClassNames[MAX_WRITE_CLASS];
+    // Database queue sizes at which writes start and stop being spooled,
+    // kept apart from the table family and generator defer watermarks
+    static const uint32_t kSpoolHighWaterMark = 6 * 1024 * 1024;
+    static const uint32_t kSpoolLowWaterMark = 1 * 1024 * 1024;
+
     typedef enum {
         INVALID = 0,
         UINT64 = 1,
@@ -128,6 +190,8 @@ public:
     typedef std::map<std::string, Var > AttribMap;
     typedef std::multimap<std::string, std::pair<Var, AttribMap> > TagMap;
     typedef std::vector<std::string> ObjectNamesVec;
+    // Called before the tables are created or updated
+    typedef boost::function<void (void)> SchemaUpdateCb;
 
     DbHandler(EventManager *evm, GenDb::GenDbIf::DbErrorHandler err_handler,
         std::string name,
@@ -143,7 +207,11 @@ public:
     static uint64_t GetTtlFromMap(const TtlMap& ttl_map,
             TtlType::type type);
     bool DropMessage(const SandeshHeader &header, const VizMsg *vmsg);
-    bool Init(bool initial);
+    bool Init(bool initial,
+        SchemaUpdateCb schema_update_cb = SchemaUpdateCb());
+    // Digest of the compiled-in table schemas and the compaction
+    // strategies the tables are created with
+    std::string SchemaVersion() const;
     void UnInit();
     void GetRuleMap(RuleMap& rulemap);
 
@@ -174,6 +242,10 @@ public:
     void GetSandeshStats(std::string *drop_level,
         std::vector<SandeshStats> *vdropmstats) const;
     bool GetSessionTableDbInfo(SessionTableDbInfo *session_table_info);
+    void GetDbWriteClassInfo(
+        std::map<std::string, DbWriteClassInfo> *write_class_info);
+    bool IsWriteClassDropped(WriteClass wclass) const;
+    bool GetDbSpoolInfo(DbSpoolInfo *spool_info) const;
     bool GetCqlMetrics(cass::cql::Metrics *metrics) const;
     bool GetCqlStats(cass::cql::DbStats *stats) const;
     void SetDbQueueWaterMarkInfo(Sandesh::QueueWaterMarkInfo &wm,
@@ -225,6 +297,9 @@ public:
     void GetUDCConfig(std::vector<LogStatisticConfigInfo> *config_info) {
         udc_->GetUDCConfig(config_info);
     }
+    void SendUDCStatistics() {
+        udc_->SendUVEs();
+    }
     void ReceiveConfig(const contrail_rapidjson::Document &jdoc, bool add_change) {
         udc_->UDCHandler(jdoc, add_change);
     }
@@ -233,7 +308,7 @@ private:
         const std::string& statName,
         const std::string& statAttr,
         const TagMap & attribs_tag,
-        const AttribMap & attribs_all, int ttl,
+        const AttribMap & attribs_all, int ttl, WriteClass wclass,
         GenDb::GenDbIf::DbAddColumnCb db_cb);
     void FieldNamesTableInsert(uint64_t timestamp,
         const std::string& table_name, const std::string& field_name,
@@ -244,16 +319,24 @@ private:
         GenDb::GenDbIf::DbAddColumnCb db_cb);
     bool AllowMessageTableInsert(const SandeshHeader &header);
     bool CreateTables();
+    bool InitSystemObjectTable();
+    bool IsSchemaCurrent();
+    bool WriteSchemaVersion();
+    bool UseTables();
+    void UseTable(const std::vector<const GenDb::NewCf *> &tables,
+        tbb::atomic<bool> *success, size_t idx);
     void SetDropLevel(size_t queue_count, SandeshLevel::type level,
         boost::function<void (void)> cb);
+    void SetWriteClassWaterMarks();
+    void SetWriteClassDrop(size_t queue_count, WriteClass wclass, bool drop);
     bool Setup();
-    bool Initialize();
+    bool Initialize(SchemaUpdateCb schema_update_cb);
     bool StatTableWrite(uint32_t t2, const std::string& statName,
         const std::string& statAttr, const std::string& source,
         const std::string& name, const std::string& key, const std::string& proxy,
         const std::vector<std::vector<std::string> >& tags,
         uint32_t t1, const boost::uuids::uuid& unm, const std::string& jsonline,
-        int ttl, GenDb::GenDbIf::DbAddColumnCb db_cb);
+        int ttl, WriteClass wclass, GenDb::GenDbIf::DbAddColumnCb db_cb);
     bool StatTableWrite(uint32_t t2,
         const std::string& statName, const std::string& statAttr,
         const std::pair<std::string,DbHandler::Var>& ptag,
@@ -269,8 +352,20 @@ private:
     }
     bool CanRecordDataForT2(uint32_t, std::string);
     bool InsertIntoDb(std::auto_ptr<GenDb::ColList> col_list,
-        GenDb::DbConsistency::type dconsistency,
+        GenDb::DbConsistency::type dconsistency, WriteClass wclass,
+        GenDb::GenDbIf::DbAddColumnCb db_cb);
+    void InsertIntoDbDone(WriteClass wclass, uint64_t start_usec,
+        GenDb::GenDbIf::DbAddColumnCb db_cb, GenDb::DbOpResult::type dresult);
+    bool WriteToDb(std::auto_ptr<GenDb::ColList> col_list,
+        GenDb::DbConsistency::type dconsistency, WriteClass wclass,
         GenDb::GenDbIf::DbAddColumnCb db_cb);
+    bool SpoolWrite(const GenDb::ColList &col_list,
+        GenDb::DbConsistency::type dconsistency, WriteClass wclass);
+    void SetSpooling(size_t queue_count, bool spooling);
+    void SetSpoolWaterMarks();
+    bool SpoolReplayTimerExpired();
+    void SpoolReplayTimerErrorHandler(std::string error_name,
+        std::string error_message);
 
     boost::scoped_ptr<GenDb::GenDbIf> dbif_;
     // Random generator for UUIDs
@@ -279,7 +374,7 @@ private:
     std::string col_name_;
     SandeshLevel::type drop_level_;
     VizMsgStatistics dropped_msg_stats_;
-    GenDb::DbTableStatistics stable_stats_;
+    StatTableDbStats stable_stats_;
     mutable tbb::mutex smutex_;
     TtlMap ttl_map_;
     static uint32_t field_cache_index_;
@@ -305,6 +400,23 @@ private:
     WaterMarkTuple disk_usage_percentage_watermark_tuple_;
     WaterMarkTuple pending_compaction_tasks_watermark_tuple_;
     SessionTableDbStats session_table_db_stats_;
+    DbWriteClassStats write_class_stats_[MAX_WRITE_CLASS];
+    // Queue watermarks of each table family, 0 if it is never dropped
+    uint32_t write_class_high_watermark_[MAX_WRITE_CLASS];
+    uint32_t write_class_low_watermark_[MAX_WRITE_CLASS];
+    // Writes are spooled while the database is not initialized, while
+    // the database queue is above kSpoolHighWaterMark, and instead of
+    // being dropped when their table family is dropped. The spool is
+    // replayed at spool_replay_rate_ writes per second once the queue
+    // is back below kSpoolLowWaterMark. Replayed writes land after the
+    // live writes made in the meantime, a replayed column overwrites a
+    // newer value written to the same column while it was spooled.
+    static const int kSpoolReplayInterval = 100; // in ms
+    boost::scoped_ptr<DbSpool> spool_;
+    Timer *spool_timer_;
+    uint32_t spool_replay_rate_;
+    tbb::atomic<bool> db_init_done_;
+    tbb::atomic<bool> spooling_;
 
     friend class DbHandlerTest;
 
@@ -376,6 +488,7 @@ class DbHandlerInitializer {
         std::string error_message);
     void StartInitTimer();
     void ScheduleInit();
+    void LockSchema();
 
     static const int kInitRetryInterval = 10 * 1000; // in ms
     const std::string db_name_;
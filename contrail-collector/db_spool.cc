@@ -0,0 +1,706 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/variant.hpp>
+
+#include <base/logging.h>
+#include <base/time_util.h>
+
+#include "db_spool.h"
+
+namespace {
+
+// Tags of the encoded GenDb::DbDataValue types
+enum ValueTag {
+    VALUE_BLANK = 0,
+    VALUE_STRING = 1,
+    VALUE_UUID = 2,
+    VALUE_UINT8 = 3,
+    VALUE_UINT16 = 4,
+    VALUE_UINT32 = 5,
+    VALUE_UINT64 = 6,
+    VALUE_DOUBLE = 7,
+    VALUE_IPV4 = 8,
+    VALUE_IPV6 = 9,
+    VALUE_BLOB = 10,
+};
+
+// Offsets in the segment header
+const size_t kHeaderMagic = 0;
+const size_t kHeaderVersion = 4;
+const size_t kHeaderSeqno = 8;
+const size_t kHeaderReadOffset = 16;
+
+const char kSegmentPrefix[] = "spool-";
+const char kSegmentSuffix[] = ".seg";
+
+template <typename T>
+void Put(std::string *buf, T value) {
+    buf->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void PutBytes(std::string *buf, const void *data, size_t len) {
+    Put(buf, static_cast<uint32_t>(len));
+    buf->append(static_cast<const char *>(data), len);
+}
+
+template <typename T>
+T Load(const uint8_t *data) {
+    T value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+template <typename T>
+void Store(uint8_t *data, T value) {
+    memcpy(data, &value, sizeof(value));
+}
+
+uint32_t Checksum(const uint8_t *data, size_t len) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, len);
+    return crc.checksum();
+}
+
+class Reader {
+public:
+    Reader(const uint8_t *data, size_t len) :
+        data_(data), len_(len), offset_(0) {
+    }
+
+    template <typename T>
+    bool Get(T *value) {
+        if (len_ - offset_ < sizeof(T)) {
+            return false;
+        }
+        *value = Load<T>(data_ + offset_);
+        offset_ += sizeof(T);
+        return true;
+    }
+
+    bool GetBytes(const uint8_t **data, size_t *len) {
+        uint32_t blen;
+        if (!Get(&blen) || len_ - offset_ < blen) {
+            return false;
+        }
+        *data = data_ + offset_;
+        *len = blen;
+        offset_ += blen;
+        return true;
+    }
+
+    bool done() const { return offset_ == len_; }
+
+private:
+    const uint8_t *data_;
+    const size_t len_;
+    size_t offset_;
+};
+
+class EncodeVisitor : public boost::static_visitor<bool> {
+public:
+    explicit EncodeVisitor(std::string *buf) : buf_(buf) {
+    }
+    bool operator()(const boost::blank &) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_BLANK));
+        return true;
+    }
+    bool operator()(const std::string &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_STRING));
+        PutBytes(buf_, value.data(), value.size());
+        return true;
+    }
+    bool operator()(const boost::uuids::uuid &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_UUID));
+        buf_->append(reinterpret_cast<const char *>(value.data),
+                     value.size());
+        return true;
+    }
+    bool operator()(const uint8_t &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_UINT8));
+        Put(buf_, value);
+        return true;
+    }
+    bool operator()(const uint16_t &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_UINT16));
+        Put(buf_, value);
+        return true;
+    }
+    bool operator()(const uint32_t &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_UINT32));
+        Put(buf_, value);
+        return true;
+    }
+    bool operator()(const uint64_t &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_UINT64));
+        Put(buf_, value);
+        return true;
+    }
+    bool operator()(const double &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_DOUBLE));
+        Put(buf_, value);
+        return true;
+    }
+    bool operator()(const IpAddress &value) const {
+        if (value.is_v4()) {
+            Ip4Address::bytes_type bytes(value.to_v4().to_bytes());
+            Put(buf_, static_cast<uint8_t>(VALUE_IPV4));
+            buf_->append(reinterpret_cast<const char *>(bytes.data()),
+                         bytes.size());
+        } else {
+            Ip6Address::bytes_type bytes(value.to_v6().to_bytes());
+            Put(buf_, static_cast<uint8_t>(VALUE_IPV6));
+            buf_->append(reinterpret_cast<const char *>(bytes.data()),
+                         bytes.size());
+        }
+        return true;
+    }
+    bool operator()(const GenDb::Blob &value) const {
+        Put(buf_, static_cast<uint8_t>(VALUE_BLOB));
+        PutBytes(buf_, value.data(), value.size());
+        return true;
+    }
+    // Types the spool does not know how to encode
+    template <typename T>
+    bool operator()(const T &) const {
+        return false;
+    }
+
+private:
+    std::string *buf_;
+};
+
+bool EncodeValues(const GenDb::DbDataValueVec &values, std::string *buf) {
+    Put(buf, static_cast<uint32_t>(values.size()));
+    EncodeVisitor visitor(buf);
+    for (GenDb::DbDataValueVec::const_iterator it = values.begin();
+         it != values.end(); ++it) {
+        if (!boost::apply_visitor(visitor, *it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+bool DecodeFixed(Reader *reader, GenDb::DbDataValueVec *values) {
+    T value;
+    if (!reader->Get(&value)) {
+        return false;
+    }
+    values->push_back(value);
+    return true;
+}
+
+bool DecodeValue(Reader *reader, GenDb::DbDataValueVec *values) {
+    uint8_t tag;
+    if (!reader->Get(&tag)) {
+        return false;
+    }
+    const uint8_t *data;
+    size_t len;
+    switch (tag) {
+    case VALUE_BLANK:
+        values->push_back(GenDb::DbDataValue());
+        return true;
+    case VALUE_STRING:
+        if (!reader->GetBytes(&data, &len)) {
+            return false;
+        }
+        values->push_back(std::string(reinterpret_cast<const char *>(data),
+                                      len));
+        return true;
+    case VALUE_UUID: {
+        boost::uuids::uuid value;
+        for (size_t i = 0; i < value.size(); i++) {
+            if (!reader->Get(&value.data[i])) {
+                return false;
+            }
+        }
+        values->push_back(value);
+        return true;
+    }
+    case VALUE_UINT8:
+        return DecodeFixed<uint8_t>(reader, values);
+    case VALUE_UINT16:
+        return DecodeFixed<uint16_t>(reader, values);
+    case VALUE_UINT32:
+        return DecodeFixed<uint32_t>(reader, values);
+    case VALUE_UINT64:
+        return DecodeFixed<uint64_t>(reader, values);
+    case VALUE_DOUBLE:
+        return DecodeFixed<double>(reader, values);
+    case VALUE_IPV4: {
+        Ip4Address::bytes_type bytes;
+        for (size_t i = 0; i < bytes.size(); i++) {
+            if (!reader->Get(&bytes[i])) {
+                return false;
+            }
+        }
+        values->push_back(IpAddress(Ip4Address(bytes)));
+        return true;
+    }
+    case VALUE_IPV6: {
+        Ip6Address::bytes_type bytes;
+        for (size_t i = 0; i < bytes.size(); i++) {
+            if (!reader->Get(&bytes[i])) {
+                return false;
+            }
+        }
+        values->push_back(IpAddress(Ip6Address(bytes)));
+        return true;
+    }
+    case VALUE_BLOB:
+        if (!reader->GetBytes(&data, &len)) {
+            return false;
+        }
+        values->push_back(GenDb::Blob(data, len));
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool DecodeValues(Reader *reader, GenDb::DbDataValueVec *values) {
+    uint32_t count;
+    if (!reader->Get(&count)) {
+        return false;
+    }
+    values->reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (!DecodeValue(reader, values)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseSegmentName(const std::string &name, uint64_t *seqno) {
+    const size_t plen(sizeof(kSegmentPrefix) - 1);
+    const size_t slen(sizeof(kSegmentSuffix) - 1);
+    if (name.size() <= plen + slen ||
+        name.compare(0, plen, kSegmentPrefix) != 0 ||
+        name.compare(name.size() - slen, slen, kSegmentSuffix) != 0) {
+        return false;
+    }
+    const std::string digits(name.substr(plen, name.size() - plen - slen));
+    if (digits.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    *seqno = strtoull(digits.c_str(), NULL, 10);
+    return true;
+}
+
+}  // namespace
+
+struct DbSpool::Segment {
+    Segment(uint64_t seqno, int fd, uint8_t *base, size_t size) :
+        seqno(seqno), fd(fd), base(base), size(size), write_offset(0),
+        read_offset(0), records(0), writable(false) {
+    }
+    ~Segment() {
+        munmap(base, size);
+        close(fd);
+    }
+    const uint64_t seqno;
+    const int fd;
+    uint8_t * const base;
+    const size_t size;
+    size_t write_offset;
+    size_t read_offset;
+    // Records between read_offset and write_offset
+    uint64_t records;
+    // Segments recovered from a previous run are only consumed
+    bool writable;
+};
+
+DbSpool::DbSpool(const std::string &directory, uint64_t max_size,
+                 uint32_t segment_size) :
+    directory_(directory),
+    // Segments are shrunk to fit a maximum size below the segment size
+    segment_size_(std::min<uint64_t>(segment_size, max_size)),
+    max_segments_(segment_size_ > kHeaderSize ?
+                  max_size / segment_size_ : 0),
+    next_seqno_(0),
+    allocate_retry_usec_(0) {
+}
+
+DbSpool::~DbSpool() {
+    Shutdown();
+}
+
+std::string DbSpool::SegmentPath(uint64_t seqno) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%020llu%s", kSegmentPrefix,
+             static_cast<unsigned long long>(seqno), kSegmentSuffix);
+    return (boost::filesystem::path(directory_) / name).string();
+}
+
+bool DbSpool::Initialize() {
+    tbb::mutex::scoped_lock lock(mutex_);
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory_, ec);
+    if (ec) {
+        LOG(ERROR, "DB spool: failed to create " << directory_ << ": " <<
+            ec.message());
+        return false;
+    }
+    std::vector<uint64_t> seqnos;
+    boost::filesystem::directory_iterator it(directory_, ec), end;
+    if (ec) {
+        LOG(ERROR, "DB spool: failed to read " << directory_ << ": " <<
+            ec.message());
+        return false;
+    }
+    for (; it != end; it.increment(ec)) {
+        uint64_t seqno;
+        if (ParseSegmentName(it->path().filename().string(), &seqno)) {
+            seqnos.push_back(seqno);
+        }
+    }
+    std::sort(seqnos.begin(), seqnos.end());
+    for (std::vector<uint64_t>::const_iterator sit = seqnos.begin();
+         sit != seqnos.end(); ++sit) {
+        Segment *segment(OpenSegment(*sit, false));
+        if (segment == NULL) {
+            continue;
+        }
+        if (!RecoverSegment(segment)) {
+            CloseSegment(segment, false);
+            continue;
+        }
+        if (segment->records == 0) {
+            CloseSegment(segment, true);
+            continue;
+        }
+        segments_.push_back(segment);
+        stats_.records += segment->records;
+        stats_.size += segment->write_offset - segment->read_offset;
+    }
+    if (!seqnos.empty()) {
+        next_seqno_ = seqnos.back() + 1;
+    }
+    stats_.segments = segments_.size();
+    if (stats_.records) {
+        LOG(INFO, "DB spool: recovered " << stats_.records << " records in "
+            << stats_.segments << " segments from " << directory_);
+    }
+    return true;
+}
+
+void DbSpool::Shutdown() {
+    tbb::mutex::scoped_lock lock(mutex_);
+    for (SegmentList::iterator it = segments_.begin();
+         it != segments_.end(); ++it) {
+        msync(it->base, it->size, MS_ASYNC);
+    }
+    // Consumed segments are removed as soon as they are exhausted, the
+    // remaining ones are kept for the next run
+    segments_.clear();
+    stats_.segments = 0;
+}
+
+DbSpool::Segment *DbSpool::OpenSegment(uint64_t seqno, bool create) {
+    const std::string path(SegmentPath(seqno));
+    int fd(open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR,
+                0644));
+    if (fd < 0) {
+        LOG(ERROR, "DB spool: failed to open " << path << ": " <<
+            strerror(errno));
+        return NULL;
+    }
+    size_t size(segment_size_);
+    if (create) {
+        // The blocks are reserved up front, a write through the mapping
+        // into a hole the file system has no space for raises SIGBUS
+        int error(posix_fallocate(fd, 0, size));
+        if (error != 0) {
+            LOG(ERROR, "DB spool: failed to allocate " << path << ": " <<
+                strerror(error));
+            close(fd);
+            unlink(path.c_str());
+            return NULL;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            static_cast<size_t>(st.st_size) < kHeaderSize) {
+            LOG(ERROR, "DB spool: ignoring truncated segment " << path);
+            close(fd);
+            return NULL;
+        }
+        size = st.st_size;
+    }
+    void *base(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    if (base == MAP_FAILED) {
+        LOG(ERROR, "DB spool: failed to map " << path << ": " <<
+            strerror(errno));
+        close(fd);
+        if (create) {
+            unlink(path.c_str());
+        }
+        return NULL;
+    }
+    Segment *segment(new Segment(seqno, fd, static_cast<uint8_t *>(base),
+                                 size));
+    if (create) {
+        Store(segment->base + kHeaderMagic, kMagic);
+        Store(segment->base + kHeaderVersion, kVersion);
+        Store(segment->base + kHeaderSeqno, seqno);
+        Store(segment->base + kHeaderReadOffset,
+              static_cast<uint64_t>(kHeaderSize));
+        segment->write_offset = kHeaderSize;
+        segment->read_offset = kHeaderSize;
+        segment->writable = true;
+    }
+    return segment;
+}
+
+void DbSpool::CloseSegment(Segment *segment, bool remove) {
+    const std::string path(SegmentPath(segment->seqno));
+    delete segment;
+    if (remove) {
+        unlink(path.c_str());
+    }
+}
+
+bool DbSpool::ReadRecord(const Segment &segment, size_t offset,
+                         size_t *record_len) const {
+    if (segment.size - offset < kRecordHeaderSize) {
+        return false;
+    }
+    uint32_t len(Load<uint32_t>(segment.base + offset));
+    if (len == 0 || segment.size - offset - kRecordHeaderSize < len) {
+        return false;
+    }
+    *record_len = kRecordHeaderSize + len;
+    return true;
+}
+
+bool DbSpool::RecoverSegment(Segment *segment) {
+    const uint8_t *base(segment->base);
+    uint64_t read_offset(Load<uint64_t>(base + kHeaderReadOffset));
+    if (Load<uint32_t>(base + kHeaderMagic) != kMagic ||
+        Load<uint32_t>(base + kHeaderVersion) != kVersion ||
+        read_offset < kHeaderSize || read_offset > segment->size) {
+        LOG(ERROR, "DB spool: ignoring segment " <<
+            SegmentPath(segment->seqno) << " with unknown format");
+        return false;
+    }
+    // Find the end of the records that made it to the segment, starting
+    // from the first one not yet consumed
+    size_t offset(read_offset), record_len;
+    while (ReadRecord(*segment, offset, &record_len)) {
+        const uint8_t *payload(base + offset + kRecordHeaderSize);
+        if (Load<uint32_t>(base + offset + 4) !=
+            Checksum(payload, record_len - kRecordHeaderSize)) {
+            stats_.corrupt_records++;
+            break;
+        }
+        segment->records++;
+        offset += record_len;
+    }
+    segment->read_offset = read_offset;
+    segment->write_offset = offset;
+    return true;
+}
+
+void DbSpool::SetReadOffset(Segment *segment, size_t offset) {
+    segment->read_offset = offset;
+    Store(segment->base + kHeaderReadOffset, static_cast<uint64_t>(offset));
+}
+
+bool DbSpool::Encode(const GenDb::ColList &col_list,
+                     GenDb::DbConsistency::type dconsistency, uint8_t tag,
+                     std::string *buf) {
+    Put(buf, tag);
+    Put(buf, static_cast<uint8_t>(dconsistency));
+    PutBytes(buf, col_list.cfname_.data(), col_list.cfname_.size());
+    if (!EncodeValues(col_list.rowkey_, buf)) {
+        return false;
+    }
+    Put(buf, static_cast<uint32_t>(col_list.columns_.size()));
+    for (GenDb::NewColVec::const_iterator it = col_list.columns_.begin();
+         it != col_list.columns_.end(); ++it) {
+        Put(buf, static_cast<int32_t>(it->ttl));
+        if (!EncodeValues(*it->name, buf) || !EncodeValues(*it->value, buf)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DbSpool::Decode(const uint8_t *data, size_t len,
+                     std::auto_ptr<GenDb::ColList> *col_list,
+                     GenDb::DbConsistency::type *dconsistency,
+                     uint8_t *tag) {
+    Reader reader(data, len);
+    uint8_t consistency;
+    const uint8_t *cfname;
+    size_t cfname_len;
+    if (!reader.Get(tag) || !reader.Get(&consistency) ||
+        !reader.GetBytes(&cfname, &cfname_len)) {
+        return false;
+    }
+    std::auto_ptr<GenDb::ColList> clist(new GenDb::ColList);
+    clist->cfname_.assign(reinterpret_cast<const char *>(cfname),
+                          cfname_len);
+    uint32_t ncolumns;
+    if (!DecodeValues(&reader, &clist->rowkey_) || !reader.Get(&ncolumns)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < ncolumns; i++) {
+        int32_t ttl;
+        if (!reader.Get(&ttl)) {
+            return false;
+        }
+        std::auto_ptr<GenDb::DbDataValueVec> name(new GenDb::DbDataValueVec);
+        std::auto_ptr<GenDb::DbDataValueVec> value(
+            new GenDb::DbDataValueVec);
+        if (!DecodeValues(&reader, name.get()) ||
+            !DecodeValues(&reader, value.get())) {
+            return false;
+        }
+        clist->columns_.push_back(new GenDb::NewCol(name.release(),
+                                                    value.release(), ttl));
+    }
+    if (!reader.done()) {
+        return false;
+    }
+    *dconsistency = static_cast<GenDb::DbConsistency::type>(consistency);
+    *col_list = clist;
+    return true;
+}
+
+bool DbSpool::Append(const GenDb::ColList &col_list,
+                     GenDb::DbConsistency::type dconsistency, uint8_t tag) {
+    std::string payload;
+    if (!Encode(col_list, dconsistency, tag, &payload)) {
+        LOG(ERROR, "DB spool: unsupported value type in " <<
+            col_list.cfname_ << " write");
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.append_fails++;
+        return false;
+    }
+    const size_t record_len(kRecordHeaderSize + payload.size());
+    tbb::mutex::scoped_lock lock(mutex_);
+    if (kHeaderSize + record_len > segment_size_) {
+        stats_.append_fails++;
+        return false;
+    }
+    Segment *segment(segments_.empty() ? NULL : &segments_.back());
+    if (segment == NULL || !segment->writable ||
+        segment->size - segment->write_offset < record_len) {
+        // Only the tail segment is kept once consumed
+        if (segment != NULL && segment->records == 0) {
+            CloseSegment(segments_.pop_back().release(), true);
+            allocate_retry_usec_ = 0;
+        }
+        if (segments_.size() >= max_segments_) {
+            stats_.append_fails++;
+            return false;
+        }
+        // The file system is likely still full, fail without trying
+        if (allocate_retry_usec_ != 0 &&
+            ClockMonotonicUsec() < allocate_retry_usec_) {
+            stats_.append_fails++;
+            return false;
+        }
+        segment = OpenSegment(next_seqno_++, true);
+        if (segment == NULL) {
+            allocate_retry_usec_ = ClockMonotonicUsec() + kAllocateRetryUsec;
+            stats_.append_fails++;
+            return false;
+        }
+        allocate_retry_usec_ = 0;
+        segments_.push_back(segment);
+        stats_.segments = segments_.size();
+    }
+    // The length is stored last, a record is not visible to the recovery
+    // scan until it is complete
+    uint8_t *record(segment->base + segment->write_offset);
+    memcpy(record + kRecordHeaderSize, payload.data(), payload.size());
+    Store(record + 4, Checksum(record + kRecordHeaderSize, payload.size()));
+    Store(record, static_cast<uint32_t>(payload.size()));
+    segment->write_offset += record_len;
+    segment->records++;
+    stats_.records++;
+    stats_.size += record_len;
+    stats_.appends++;
+    return true;
+}
+
+bool DbSpool::Front(std::auto_ptr<GenDb::ColList> *col_list,
+                    GenDb::DbConsistency::type *dconsistency, uint8_t *tag) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    while (!segments_.empty()) {
+        const Segment &segment(segments_.front());
+        size_t record_len;
+        if (segment.records == 0 ||
+            !ReadRecord(segment, segment.read_offset, &record_len)) {
+            return false;
+        }
+        if (Decode(segment.base + segment.read_offset + kRecordHeaderSize,
+                   record_len - kRecordHeaderSize, col_list, dconsistency,
+                   tag)) {
+            return true;
+        }
+        // Written by an incompatible version, skip it
+        stats_.corrupt_records++;
+        PopFront();
+    }
+    return false;
+}
+
+void DbSpool::Pop() {
+    tbb::mutex::scoped_lock lock(mutex_);
+    if (PopFront()) {
+        stats_.replays++;
+    }
+}
+
+bool DbSpool::PopFront() {
+    if (segments_.empty()) {
+        return false;
+    }
+    Segment *segment(&segments_.front());
+    size_t record_len;
+    if (segment->records == 0 ||
+        !ReadRecord(*segment, segment->read_offset, &record_len)) {
+        return false;
+    }
+    SetReadOffset(segment, segment->read_offset + record_len);
+    segment->records--;
+    stats_.records--;
+    stats_.size -= record_len;
+    if (segment->records == 0 && segments_.size() > 1) {
+        CloseSegment(segments_.pop_front().release(), true);
+        stats_.segments = segments_.size();
+        allocate_retry_usec_ = 0;
+    }
+    return true;
+}
+
+bool DbSpool::IsEmpty() const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return stats_.records == 0;
+}
+
+void DbSpool::GetStats(Stats *stats) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    *stats = stats_;
+}
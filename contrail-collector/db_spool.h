@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __DB_SPOOL_H__
+#define __DB_SPOOL_H__
+
+#include <string>
+
+#include <boost/ptr_container/ptr_deque.hpp>
+#include <tbb/mutex.h>
+
+#include <base/util.h>
+#include "gendb_if.h"
+
+//
+// On-disk spool of database writes, used to hold the writes that can
+// not be handed to the database while it is unavailable or overloaded,
+// and to replay them once it has caught up.
+//
+// The spool is a sequence of fixed size segment files in a directory,
+// each memory mapped. Records are appended at the tail and consumed from
+// the head; a segment is removed once it has been consumed. Every record
+// is protected by a CRC, and the head segment keeps the offset of the
+// next record to consume so that a restarted collector resumes where it
+// stopped. The total size of the segments is bounded, appends fail once
+// the bound is reached; segments are made smaller when the bound is below
+// the segment size.
+//
+// Record layout: length (4 bytes), crc32 of the payload (4 bytes),
+// payload. The payload is the encoded GenDb::ColList along with the
+// write consistency and a caller supplied tag.
+//
+class DbSpool {
+public:
+    static const uint32_t kDefaultSegmentSize = 64 * 1024 * 1024;
+    static const uint32_t kMagic = 0x50534244; // "DBSP"
+    static const uint32_t kVersion = 1;
+
+    struct Stats {
+        Stats() :
+            segments(0), size(0), records(0), appends(0), append_fails(0),
+            replays(0), corrupt_records(0) {
+        }
+        uint64_t segments;
+        // Bytes of records not yet consumed
+        uint64_t size;
+        uint64_t records;
+        uint64_t appends;
+        // Appends that failed because the spool or its file system is full
+        uint64_t append_fails;
+        uint64_t replays;
+        // Records discarded because they failed the CRC or decode check
+        uint64_t corrupt_records;
+    };
+
+    DbSpool(const std::string &directory, uint64_t max_size,
+            uint32_t segment_size = kDefaultSegmentSize);
+    ~DbSpool();
+
+    // Opens the spool directory, recovering the segments left by a
+    // previous run
+    bool Initialize();
+    void Shutdown();
+
+    bool Append(const GenDb::ColList &col_list,
+                GenDb::DbConsistency::type dconsistency, uint8_t tag);
+    // Decodes the oldest record, it stays in the spool until Pop
+    bool Front(std::auto_ptr<GenDb::ColList> *col_list,
+               GenDb::DbConsistency::type *dconsistency, uint8_t *tag);
+    void Pop();
+    bool IsEmpty() const;
+    void GetStats(Stats *stats) const;
+
+    static bool Encode(const GenDb::ColList &col_list,
+                       GenDb::DbConsistency::type dconsistency, uint8_t tag,
+                       std::string *buf);
+    static bool Decode(const uint8_t *data, size_t len,
+                       std::auto_ptr<GenDb::ColList> *col_list,
+                       GenDb::DbConsistency::type *dconsistency,
+                       uint8_t *tag);
+
+private:
+    struct Segment;
+    typedef boost::ptr_deque<Segment> SegmentList;
+
+    static const size_t kHeaderSize = 32;
+    static const size_t kRecordHeaderSize = 8;
+    // Time after a segment failed to allocate before another is tried
+    static const uint64_t kAllocateRetryUsec = 1000000;
+
+    Segment *OpenSegment(uint64_t seqno, bool create);
+    void CloseSegment(Segment *segment, bool remove);
+    bool RecoverSegment(Segment *segment);
+    bool ReadRecord(const Segment &segment, size_t offset,
+                    size_t *record_len) const;
+    void SetReadOffset(Segment *segment, size_t offset);
+    // Removes the oldest record, called with the mutex held
+    bool PopFront();
+    std::string SegmentPath(uint64_t seqno) const;
+
+    const std::string directory_;
+    const uint32_t segment_size_;
+    const uint64_t max_segments_;
+    mutable tbb::mutex mutex_;
+    SegmentList segments_;
+    uint64_t next_seqno_;
+    // No segment is created before then, unless one is removed meanwhile
+    uint64_t allocate_retry_usec_;
+    Stats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(DbSpool);
+};
+
+#endif // __DB_SPOOL_H__
@@ -29,6 +29,7 @@
 #include <nodeinfo_types.h>
 #include <analytics/analytics_types.h>
 #include "generator.h"
+#include "stage_latency.h"
 #include <base/misc_utils.h>
 #include <analytics/buildinfo.h>
 #include "boost/python.hpp"
@@ -93,6 +94,10 @@ bool CollectorSummaryLogger(Collector *collector, const string & hostname,
     collector->GetTxSocketStats(&tx_stats);
     state.set_tx_socket_stats(tx_stats);
 
+    std::map<std::string, StageLatencyInfo> stage_latency;
+    StageLatency::GetInstance()->GetStageLatencyDiffs(&stage_latency);
+    state.set_stage_latency(stage_latency);
+
     CollectorInfo::Send(state);
     return true;
 }
@@ -103,6 +108,8 @@ bool CollectorInfoLogger(VizSandeshContext &ctx) {
     CollectorSummaryLogger(analytics->GetCollector(), analytics->name(),
             analytics->GetOsp());
     analytics->SendDbStatistics();
+    analytics->SendUDCStatistics();
+    analytics->SendSFlowStatistics();
 
     vector<ModuleServerState> sinfos;
     analytics->GetCollector()->GetGeneratorUVEInfo(sinfos);
@@ -281,6 +288,8 @@ int main(int argc, char *argv[])
     string structured_syslog_kafka_topic("");
     uint16_t structured_syslog_kafka_partitions = 0;
     uint64_t structured_syslog_active_session_map_limit = 1000000;
+    uint64_t structured_syslog_active_session_timeout = 3600;
+    uint32_t structured_syslog_uve_aggregation_interval = 10;
     vector<string> structured_syslog_kafka_broker_list = options.collector_structured_syslog_kafka_broker_list();
     for (vector<string>::const_iterator st = structured_syslog_kafka_broker_list.begin();
             st != structured_syslog_kafka_broker_list.end(); st++) {
@@ -295,6 +304,8 @@ int main(int argc, char *argv[])
     }
 
     structured_syslog_active_session_map_limit = options.collector_active_session_map_limit();
+    structured_syslog_active_session_timeout = options.collector_active_session_timeout();
+    structured_syslog_uve_aggregation_interval = options.collector_uve_aggregation_interval();
 
     std::map<std::string, std::string> aggconf;
     vector<string> upl = options.uve_proxy_list();
@@ -394,6 +405,9 @@ int main(int argc, char *argv[])
             structured_syslog_kafka_topic,
             structured_syslog_kafka_partitions,
             structured_syslog_active_session_map_limit,
+            structured_syslog_active_session_timeout,
+            structured_syslog_uve_aggregation_interval,
+            options.sflow_port(),
             string("127.0.0.1"),
             options.redis_port(),
             options.redis_password(),
@@ -414,6 +428,11 @@ int main(int argc, char *argv[])
     config_client->Init();
     analytics->Init();
 
+    if (!options.sandesh_capture_file().empty()) {
+        analytics->GetCollector()->StartCapture(
+            options.sandesh_capture_file(), options.sandesh_capture_size());
+    }
+
     unsigned short coll_port = analytics->GetCollector()->GetPort();
     VizSandeshContext vsc(analytics);
     bool success(Sandesh::InitCollector(
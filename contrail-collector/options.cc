@@ -21,6 +21,7 @@
 #include <database/gendb_constants.h>
 
 #include "config-client-mgr/config_client_manager.h"
+#include "collector.h"
 
 using namespace std;
 using namespace boost::asio::ip;
@@ -28,6 +29,8 @@ using namespace boost::assign;
 namespace opt = boost::program_options;
 using namespace options::util;
 
+const uint32_t Options::Kafka::kUnset;
+
 // Process command line options for collector   .
 Options::Options() {
 }
@@ -107,6 +110,12 @@ void Options::Initialize(EventManager &evm,
     std::string default_low_watermark1_message_severity_level = "SYS_WARN";
     std::string default_high_watermark2_message_severity_level = "SYS_DEBUG";
     std::string default_low_watermark2_message_severity_level = "INVALID";
+    uint32_t default_statistics_writes_high_watermark = 5 * 1024 * 1024;
+    uint32_t default_statistics_writes_low_watermark = 7 * 512 * 1024;
+    uint32_t default_session_writes_high_watermark = 4 * 1024 * 1024;
+    uint32_t default_session_writes_low_watermark = 2 * 1024 * 1024;
+    uint32_t default_spool_max_size_mb = 4096;
+    uint32_t default_spool_replay_rate = 5000;
 
     vector<string> default_cassandra_server_list;
     string default_cassandra_server;
@@ -129,6 +138,11 @@ void Options::Initialize(EventManager &evm,
     string default_structured_syslog_kafka_topic("structured_syslog");
     uint16_t default_structured_syslog_kafka_partitions = 30;
     uint64_t default_structured_syslog_active_session_map_limit = 1000000;
+    uint64_t default_structured_syslog_active_session_timeout = 3600;
+    uint32_t default_structured_syslog_uve_aggregation_interval = 10;
+    uint32_t default_structured_syslog_kafka_linger_ms = 100;
+    uint32_t default_structured_syslog_kafka_batch_num_messages = 10000;
+    string default_structured_syslog_kafka_compression_codec("none");
 
     // Command line and config file options.
     opt::options_description cassandra_config("Cassandra Configuration options");
@@ -225,6 +239,35 @@ void Options::Initialize(EventManager &evm,
             opt::value<string>()->default_value(
                 default_low_watermark2_message_severity_level),
             "Low Watermark 2 Message severity level")
+        ("DATABASE.statistics_writes.high_watermark",
+            opt::value<uint32_t>()->default_value(
+                default_statistics_writes_high_watermark),
+            "Database queue size above which statistics writes are dropped")
+        ("DATABASE.statistics_writes.low_watermark",
+            opt::value<uint32_t>()->default_value(
+                default_statistics_writes_low_watermark),
+            "Database queue size below which statistics writes are resumed")
+        ("DATABASE.session_writes.high_watermark",
+            opt::value<uint32_t>()->default_value(
+                default_session_writes_high_watermark),
+            "Database queue size above which session writes are dropped")
+        ("DATABASE.session_writes.low_watermark",
+            opt::value<uint32_t>()->default_value(
+                default_session_writes_low_watermark),
+            "Database queue size below which session writes are resumed")
+        ("DATABASE.spool_directory", opt::value<string>()->default_value(""),
+            "Directory to spool database writes to while the database "
+            "is unavailable or overloaded, spooling is disabled if empty")
+        ("DATABASE.spool_max_size_mb",
+            opt::value<uint32_t>()->default_value(default_spool_max_size_mb),
+            "Maximum size of the database write spool in MB")
+        ("DATABASE.spool_replay_rate",
+            opt::value<uint32_t>()->default_value(default_spool_replay_rate),
+            "Spooled database writes replayed per second")
+        ("DATABASE.local_stats_directory",
+            opt::value<string>()->default_value(""),
+            "Directory to keep the statistics tables in instead of the "
+            "database, for single node deployments")
 
         ("DATABASE.cluster_id", opt::value<string>()->default_value(""),
              "Analytics Cluster Id")
@@ -268,10 +311,30 @@ void Options::Initialize(EventManager &evm,
            opt::value<uint16_t>()->default_value(
                default_structured_syslog_kafka_partitions),
              "Structured Syslog Number of Kafka Partitions")
+        ("STRUCTURED_SYSLOG_COLLECTOR.kafka_linger_ms",
+           opt::value<uint32_t>()->default_value(
+               default_structured_syslog_kafka_linger_ms),
+             "Structured Syslog Kafka Producer Batching Delay (milliseconds)")
+        ("STRUCTURED_SYSLOG_COLLECTOR.kafka_batch_num_messages",
+           opt::value<uint32_t>()->default_value(
+               default_structured_syslog_kafka_batch_num_messages),
+             "Structured Syslog Kafka Producer Max Messages per Batch")
+        ("STRUCTURED_SYSLOG_COLLECTOR.kafka_compression_codec",
+           opt::value<string>()->default_value(
+               default_structured_syslog_kafka_compression_codec),
+             "Structured Syslog Kafka Compression Codec (none, gzip, snappy, lz4)")
         ("STRUCTURED_SYSLOG_COLLECTOR.active_session_map_limit",
            opt::value<uint64_t>()->default_value(
                default_structured_syslog_active_session_map_limit),
              "Structured Syslog Max Num of Active Sessions in Session Config Map")
+        ("STRUCTURED_SYSLOG_COLLECTOR.active_session_timeout",
+           opt::value<uint64_t>()->default_value(
+               default_structured_syslog_active_session_timeout),
+             "Structured Syslog Inactivity Timeout (seconds) of Sessions in Session Config Map")
+        ("STRUCTURED_SYSLOG_COLLECTOR.uve_aggregation_interval",
+           opt::value<uint32_t>()->default_value(
+               default_structured_syslog_uve_aggregation_interval),
+             "Structured Syslog SD-WAN UVE Aggregation Interval (seconds), 0 to disable")
         ;
 
     // Command line and config file options.
@@ -316,6 +379,8 @@ void Options::Initialize(EventManager &evm,
         ("DEFAULT.http_server_port",
              opt::value<uint16_t>()->default_value(default_http_server_port),
              "Sandesh HTTP listener port")
+        ("DEFAULT.sflow_port", opt::value<int>()->default_value(-1),
+             "UDP port to listen on for sFlow messages, -1 to disable")
 
         ("DEFAULT.log_category", opt::value<string>(),
              "Category filter for local logging of sandesh messages")
@@ -344,6 +409,13 @@ void Options::Initialize(EventManager &evm,
         ("DEFAULT.disable_flow_collection",
             opt::bool_switch(&disable_flow_collection_),
             "Disable flow message collection")
+        ("DEFAULT.sandesh_capture_file",
+             opt::value<string>()->default_value(""),
+             "File to capture the received Sandesh messages to, for replay "
+             "by the ingest benchmark, empty to disable")
+        ("DEFAULT.sandesh_capture_size",
+             opt::value<uint64_t>()->default_value(1024*1024*1024),
+             "Maximum size of the Sandesh message capture file")
         ;
 
     // Command line and config file options.
@@ -508,6 +580,62 @@ static bool ValidateCompactionStrategyOption(
     return true;
 }
 
+// The database queue keeps a single callback per watermark count, a write
+// class watermark at the count of another high (or low) watermark on the
+// queue would silently replace it
+static bool ValidateDbQueueWaterMarks(
+    const Options::Cassandra &cassandra_options) {
+    struct WaterMark {
+        const char *option;
+        uint32_t high;
+        uint32_t low;
+    } watermarks[] = {
+        { "DATABASE.statistics_writes",
+          cassandra_options.statistics_writes_high_watermark_,
+          cassandra_options.statistics_writes_low_watermark_ },
+        { "DATABASE.session_writes",
+          cassandra_options.session_writes_high_watermark_,
+          cassandra_options.session_writes_low_watermark_ },
+        { "collector generator defer",
+          Collector::kQSizeHighWaterMark,
+          Collector::kQSizeLowWaterMark },
+        { "database write spool",
+          DbHandler::kSpoolHighWaterMark,
+          DbHandler::kSpoolLowWaterMark },
+    };
+    // Only the table families are configurable
+    const size_t nconfigured(2);
+    const size_t nwatermarks(sizeof(watermarks) / sizeof(watermarks[0]));
+    for (size_t i = 0; i < nconfigured; i++) {
+        // A zero high watermark disables dropping for the family
+        if (watermarks[i].high == 0) {
+            continue;
+        }
+        if (watermarks[i].low >= watermarks[i].high) {
+            cout << "Invalid " << watermarks[i].option << ".low_watermark " <<
+                watermarks[i].low << ", must be below the high_watermark " <<
+                watermarks[i].high << endl;
+            return false;
+        }
+        for (size_t j = 0; j < nwatermarks; j++) {
+            if (i == j || watermarks[j].high == 0) {
+                continue;
+            }
+            if (watermarks[i].high == watermarks[j].high ||
+                watermarks[i].low == watermarks[j].low) {
+                cout << "Invalid " << watermarks[i].option <<
+                    " watermarks [" << watermarks[i].high << ", " <<
+                    watermarks[i].low << "], the " << watermarks[j].option <<
+                    " watermarks [" << watermarks[j].high << ", " <<
+                    watermarks[j].low << "] use the same database queue " <<
+                    "count" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 uint32_t Options::GenerateHash(const std::vector<std::string> &list) {
     std::string concat_servers;
     std::vector<std::string>::const_iterator iter;
@@ -639,10 +767,25 @@ void Options::Process(int argc, char *argv[],
 
     GetOptValue<uint16_t>(var_map, collector_structured_syslog_kafka_partitions_,
                                   "STRUCTURED_SYSLOG_COLLECTOR.kafka_partitions");
+
+    GetOptValue<uint32_t>(var_map, kafka_options_.forwarder_linger_ms,
+                                  "STRUCTURED_SYSLOG_COLLECTOR.kafka_linger_ms");
+
+    GetOptValue<uint32_t>(var_map, kafka_options_.forwarder_batch_num_messages,
+                                  "STRUCTURED_SYSLOG_COLLECTOR.kafka_batch_num_messages");
+
+    GetOptValue<string>(var_map, kafka_options_.forwarder_compression_codec,
+                                  "STRUCTURED_SYSLOG_COLLECTOR.kafka_compression_codec");
     
     GetOptValue<uint64_t>(var_map, collector_structured_syslog_active_session_map_limit_,
                                   "STRUCTURED_SYSLOG_COLLECTOR.active_session_map_limit");
 
+    GetOptValue<uint64_t>(var_map, collector_structured_syslog_active_session_timeout_,
+                                  "STRUCTURED_SYSLOG_COLLECTOR.active_session_timeout");
+
+    GetOptValue<uint32_t>(var_map, collector_structured_syslog_uve_aggregation_interval_,
+                                  "STRUCTURED_SYSLOG_COLLECTOR.uve_aggregation_interval");
+
     GetOptValue<uint64_t>(var_map, analytics_data_ttl_,
                      "DEFAULT.analytics_data_ttl");
     if (analytics_data_ttl_ == (uint64_t)-1) {
@@ -675,6 +818,7 @@ void Options::Process(int argc, char *argv[],
     GetOptValue<string>(var_map, hostname_, "DEFAULT.hostname");
     GetOptValue<uint16_t>(var_map, http_server_port_,
                           "DEFAULT.http_server_port");
+    GetOptValue<int>(var_map, sflow_port_, "DEFAULT.sflow_port");
 
     GetOptValue<string>(var_map, log_category_, "DEFAULT.log_category");
     GetOptValue<string>(var_map, log_file_, "DEFAULT.log_file");
@@ -684,6 +828,10 @@ void Options::Process(int argc, char *argv[],
     GetOptValue<string>(var_map, log_level_, "DEFAULT.log_level");
     GetOptValue<bool>(var_map, use_syslog_, "DEFAULT.use_syslog");
     GetOptValue<string>(var_map, syslog_facility_, "DEFAULT.syslog_facility");
+    GetOptValue<string>(var_map, sandesh_capture_file_,
+                        "DEFAULT.sandesh_capture_file");
+    GetOptValue<uint64_t>(var_map, sandesh_capture_size_,
+                          "DEFAULT.sandesh_capture_size");
     GetOptValue<string>(var_map, kafka_prefix_, "DATABASE.cluster_id");
     GetOptValue<bool>(var_map, kafka_options_.ssl_enable, "KAFKA.kafka_ssl_enable");
     GetOptValue<string>(var_map, kafka_options_.keyfile, "KAFKA.kafka_keyfile");
@@ -694,6 +842,29 @@ void Options::Process(int argc, char *argv[],
     GetOptValue<string>(var_map, redis_password_, "REDIS.password");
 
     GetOptValue<string>(var_map, cassandra_options_.cluster_id_, "DATABASE.cluster_id");
+    GetOptValue<uint32_t>(var_map,
+        cassandra_options_.statistics_writes_high_watermark_,
+        "DATABASE.statistics_writes.high_watermark");
+    GetOptValue<uint32_t>(var_map,
+        cassandra_options_.statistics_writes_low_watermark_,
+        "DATABASE.statistics_writes.low_watermark");
+    GetOptValue<uint32_t>(var_map,
+        cassandra_options_.session_writes_high_watermark_,
+        "DATABASE.session_writes.high_watermark");
+    GetOptValue<uint32_t>(var_map,
+        cassandra_options_.session_writes_low_watermark_,
+        "DATABASE.session_writes.low_watermark");
+    if (!ValidateDbQueueWaterMarks(cassandra_options_)) {
+        exit(-1);
+    }
+    GetOptValue<string>(var_map, cassandra_options_.spool_directory_,
+        "DATABASE.spool_directory");
+    GetOptValue<uint32_t>(var_map, cassandra_options_.spool_max_size_mb_,
+        "DATABASE.spool_max_size_mb");
+    GetOptValue<uint32_t>(var_map, cassandra_options_.spool_replay_rate_,
+        "DATABASE.spool_replay_rate");
+    GetOptValue<string>(var_map, cassandra_options_.local_stats_directory_,
+        "DATABASE.local_stats_directory");
 
     GetOptValue<string>(var_map, cassandra_options_.user_,
         "CASSANDRA.cassandra_user");
@@ -95,7 +95,15 @@ public:
             flow_tables_compaction_strategy_(),
             disable_all_db_writes_(false),
             disable_db_stats_writes_(false),
-            disable_db_messages_writes_(false)
+            disable_db_messages_writes_(false),
+            statistics_writes_high_watermark_(0),
+            statistics_writes_low_watermark_(0),
+            session_writes_high_watermark_(0),
+            session_writes_low_watermark_(0),
+            spool_directory_(),
+            spool_max_size_mb_(0),
+            spool_replay_rate_(0),
+            local_stats_directory_()
         {
         }
 
@@ -112,6 +120,21 @@ public:
         bool disable_all_db_writes_;
         bool disable_db_stats_writes_;
         bool disable_db_messages_writes_;
+        // Database queue sizes above which writes of the table family
+        // are dropped, and below which they are accepted again
+        uint32_t statistics_writes_high_watermark_;
+        uint32_t statistics_writes_low_watermark_;
+        uint32_t session_writes_high_watermark_;
+        uint32_t session_writes_low_watermark_;
+        // On-disk spool of the writes the database can not take, disabled
+        // if the directory is empty
+        std::string spool_directory_;
+        uint32_t spool_max_size_mb_;
+        // Spooled writes replayed per second once the database catches up
+        uint32_t spool_replay_rate_;
+        // Directory of the local StatTable store, the StatTable is kept
+        // in the database if empty
+        std::string local_stats_directory_;
     };
 
     struct Kafka {
@@ -119,11 +142,21 @@ public:
             ssl_enable(false),
             keyfile(),
             certfile(),
-            ca_cert() {}
+            ca_cert(),
+            forwarder_linger_ms(kUnset),
+            forwarder_batch_num_messages(kUnset),
+            forwarder_compression_codec() {}
+        // Producer setting left to the librdkafka default, 0 is a valid
+        // linger time
+        static const uint32_t kUnset = 0xffffffff;
         bool ssl_enable;
         std::string keyfile;
         std::string certfile;
         std::string ca_cert;
+        // Producer batching of the structured syslog kafka forwarder
+        uint32_t forwarder_linger_ms;
+        uint32_t forwarder_batch_num_messages;
+        std::string forwarder_compression_codec;
     };
 
     Options();
@@ -188,6 +221,12 @@ public:
     const uint64_t collector_active_session_map_limit() const { 
         return collector_structured_syslog_active_session_map_limit_; 
     }
+    const uint64_t collector_active_session_timeout() const {
+        return collector_structured_syslog_active_session_timeout_;
+    }
+    const uint32_t collector_uve_aggregation_interval() const {
+        return collector_structured_syslog_uve_aggregation_interval_;
+    }
     const std::vector<std::string> config_file() const {
         return config_file_;
     }
@@ -200,6 +239,7 @@ public:
     const std::string hostname() const { return hostname_; }
     const std::string host_ip() const { return host_ip_; }
     const uint16_t http_server_port() const { return http_server_port_; }
+    const int sflow_port() const { return sflow_port_; }
     const std::string log_category() const { return log_category_; }
     const bool log_disable() const { return log_disable_; }
     const std::string log_file() const { return log_file_; }
@@ -210,6 +250,12 @@ public:
     const bool log_local() const { return log_local_; }
     const bool use_syslog() const { return use_syslog_; }
     const std::string syslog_facility() const { return syslog_facility_; }
+    const std::string sandesh_capture_file() const {
+        return sandesh_capture_file_;
+    }
+    const uint64_t sandesh_capture_size() const {
+        return sandesh_capture_size_;
+    }
     const std::string kafka_prefix() const { return kafka_prefix_; }
     const bool dup() const { return dup_; }
     const uint64_t analytics_data_ttl() const { return analytics_data_ttl_; }
@@ -265,6 +311,8 @@ private:
     std::string collector_structured_syslog_kafka_topic_;
     uint16_t collector_structured_syslog_kafka_partitions_;
     uint64_t collector_structured_syslog_active_session_map_limit_;
+    uint64_t collector_structured_syslog_active_session_timeout_;
+    uint32_t collector_structured_syslog_uve_aggregation_interval_;
     std::vector<std::string> config_file_;
     std::string redis_server_;
     uint16_t redis_port_;
@@ -274,6 +322,7 @@ private:
     std::string hostname_;
     std::string host_ip_;
     uint16_t http_server_port_;
+    int sflow_port_;
     std::string log_category_;
     bool log_disable_;
     std::string log_file_;
@@ -284,6 +333,8 @@ private:
     bool log_local_;
     bool use_syslog_;
     std::string syslog_facility_;
+    std::string sandesh_capture_file_;
+    uint64_t sandesh_capture_size_;
     std::string kafka_prefix_;
     bool test_mode_;
     bool dup_;
@@ -1,18 +1,10 @@
 /*
  * Copyright (c) 2014 Juniper Networks, Inc. All rights reserved.
  */
-#define BOOST_SPIRIT_DEBUG
-#include "boost/spirit/include/classic.hpp"
-#include <boost/config/warning_disable.hpp>
-#include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/phoenix_core.hpp>
-#include <boost/spirit/include/phoenix_operator.hpp>
-#include <boost/spirit/include/phoenix_stl.hpp>
-#include <boost/spirit/include/qi_repeat.hpp>
-
-#include <boost/assign/list_of.hpp>
-
-#include <boost/algorithm/string/case_conv.hpp>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
 
 #include <iostream>
 #include "base/regex.h"
@@ -22,10 +14,275 @@ using contrail::regex;
 using contrail::regex_match;
 using contrail::regex_search;
 
-namespace qi = boost::spirit::qi;
-namespace ascii = boost::spirit::ascii;
-namespace phx = boost::phoenix;
-using namespace BOOST_SPIRIT_CLASSIC_NS;
+namespace {
+
+//
+// Character classes used by the keyword tokenizer, looked up once per
+// byte instead of going through a generated parser
+//
+enum CharClass {
+    kSkip    = 1 << 0,   // separators skipped between tokens
+    kWordEnd = 1 << 1,   // characters that end a word
+    kDigit   = 1 << 2,
+    kHex     = 1 << 3,
+    kOctal   = 1 << 4
+};
+
+class CharClassTable {
+public:
+    CharClassTable() {
+        memset(table_, 0, sizeof(table_));
+        for (const char *c = " \t\n\v\f\r.,;:[](){}"; *c; c++) {
+            table_[static_cast<uint8_t>(*c)] |= kSkip;
+        }
+        for (const char *c = " .,;:[](){}\t\r"; *c; c++) {
+            table_[static_cast<uint8_t>(*c)] |= kWordEnd;
+        }
+        for (int c = '0'; c <= '9'; c++) {
+            table_[c] |= kDigit | kHex;
+        }
+        for (int c = '0'; c <= '7'; c++) {
+            table_[c] |= kOctal;
+        }
+        for (int c = 'a'; c <= 'f'; c++) {
+            table_[c] |= kHex;
+            table_[c - 'a' + 'A'] |= kHex;
+        }
+    }
+    bool Is(char c, uint8_t cls) const {
+        return (table_[static_cast<uint8_t>(c)] & cls) != 0;
+    }
+private:
+    uint8_t table_[256];
+};
+
+const CharClassTable char_class;
+
+const char *const stop_words[] = {
+    "via", "or", "of", "string", "sandesh", "client", "the", "that", "and",
+};
+
+// End of the run of characters of class cls starting at p
+inline const char *Span(const char *p, const char *end, uint8_t cls) {
+    while (p < end && char_class.Is(*p, cls)) {
+        p++;
+    }
+    return p;
+}
+
+// End of the run of characters not of class cls starting at p
+inline const char *SpanNot(const char *p, const char *end, uint8_t cls) {
+    while (p < end && !char_class.Is(*p, cls)) {
+        p++;
+    }
+    return p;
+}
+
+// Span of exactly n characters of class cls, or NULL
+inline const char *SpanN(const char *p, const char *end, uint8_t cls,
+                         size_t n) {
+    if (static_cast<size_t>(end - p) < n) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!char_class.Is(p[i], cls)) {
+            return NULL;
+        }
+    }
+    return p + n;
+}
+
+//
+// Token matchers. Each returns the end of the token of its kind that
+// starts at p, or NULL if there is none, and consumes greedily without
+// backtracking into a repetition.
+//
+// Stats and addresses also return the end of the keyword in *kw_end.
+// The keyword keeps a trailing separator that was tried but is not
+// followed by digits, e.g. "1.2.3." for an address ending a sentence,
+// so that it stays the same as the one the index was built with.
+//
+
+// Longest stop word that is a prefix at p
+const char *MatchStopWord(const char *p, const char *end) {
+    size_t best = 0;
+    for (size_t i = 0; i < sizeof(stop_words) / sizeof(stop_words[0]); i++) {
+        size_t len = strlen(stop_words[i]);
+        if (len > best && static_cast<size_t>(end - p) >= len &&
+            memcmp(p, stop_words[i], len) == 0) {
+            best = len;
+        }
+    }
+    return best ? p + best : NULL;
+}
+
+// Optional '/' followed by digits, e.g. the prefix length of an address
+const char *SpanPrefixLen(const char *p, const char *end,
+                          const char **kw_end) {
+    *kw_end = p;
+    if (p < end && *p == '/') {
+        const char *q = Span(p + 1, end, kDigit);
+        if (q != p + 1) {
+            *kw_end = q;
+            return q;
+        }
+        *kw_end = p + 1;
+    }
+    return p;
+}
+
+// Counters such as 0/0/0/121/121
+const char *MatchStats(const char *p, const char *end, const char **kw_end) {
+    const char *q = Span(p, end, kDigit);
+    if (q == p) {
+        return NULL;
+    }
+    bool found = false;
+    *kw_end = q;
+    while (q < end && *q == '/') {
+        const char *r = Span(q + 1, end, kDigit);
+        if (r == q + 1) {
+            *kw_end = q + 1;
+            break;
+        }
+        q = r;
+        *kw_end = q;
+        found = true;
+    }
+    return found ? q : NULL;
+}
+
+// Non empty text quoted by quote. The keyword starting at *kw_start
+// excludes the quotes and any separators after the opening quote.
+const char *MatchQuoted(const char *p, const char *end, char quote,
+                        const char **kw_start) {
+    if (p == end || *p != quote) {
+        return NULL;
+    }
+    p = Span(p + 1, end, kSkip);
+    if (p == end || *p == quote) {
+        return NULL;
+    }
+    const char *q = static_cast<const char *>(memchr(p, quote, end - p));
+    if (q == NULL) {
+        return NULL;
+    }
+    *kw_start = p;
+    return q + 1;
+}
+
+const char *MatchUuid(const char *p, const char *end) {
+    static const size_t groups[] = { 8, 4, 4, 4, 12 };
+    for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (i != 0) {
+            if (p == end || *p != '-') {
+                return NULL;
+            }
+            p++;
+        }
+        if ((p = SpanN(p, end, kHex, groups[i])) == NULL) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+// Dotted decimal with at least three components, optional prefix length
+const char *MatchIp(const char *p, const char *end, const char **kw_end) {
+    const char *q = p;
+    int components = 0;
+    bool trailing_dot = false;
+    while (true) {
+        const char *r = Span(q, end, kDigit);
+        if (r == q) {
+            if (components == 0) {
+                return NULL;
+            }
+            // backtrack over the trailing '.'
+            q--;
+            trailing_dot = true;
+            break;
+        }
+        q = r;
+        components++;
+        if (q == end || *q != '.') {
+            break;
+        }
+        q++;
+    }
+    if (components < 3) {
+        return NULL;
+    }
+    if (trailing_dot) {
+        *kw_end = q + 1;
+        return q;
+    }
+    return SpanPrefixLen(q, end, kw_end);
+}
+
+// Hex groups separated by one or more ':', optional prefix length
+const char *MatchIpv6(const char *p, const char *end, const char **kw_end) {
+    const char *q = Span(p, end, kHex);
+    if (q == p) {
+        return NULL;
+    }
+    bool found = false;
+    while (q < end && *q == ':') {
+        const char *colons = q;
+        while (q < end && *q == ':') {
+            q++;
+        }
+        const char *r = Span(q, end, kHex);
+        if (r == q) {
+            if (!found) {
+                return NULL;
+            }
+            *kw_end = q;
+            return colons;
+        }
+        q = r;
+        found = true;
+    }
+    return found ? SpanPrefixLen(q, end, kw_end) : NULL;
+}
+
+const char *MatchHexNumber(const char *p, const char *end) {
+    if (end - p < 3 || p[0] != '0' || p[1] != 'x') {
+        return NULL;
+    }
+    const char *q = Span(p + 2, end, kHex);
+    return q != p + 2 ? q : NULL;
+}
+
+const char *MatchOctalNumber(const char *p, const char *end) {
+    if (p == end || *p != '0') {
+        return NULL;
+    }
+    const char *q = Span(p + 1, end, kOctal);
+    return q != p + 1 ? q : NULL;
+}
+
+// Decimal number, with a fraction or a trailing '.'
+const char *MatchNumber(const char *p, const char *end) {
+    const char *q = Span(p, end, kDigit);
+    if (q < end && *q == '.') {
+        const char *r = Span(q + 1, end, kDigit);
+        if (r != q + 1) {
+            return r;
+        }
+    }
+    if (q == p) {
+        return NULL;
+    }
+    return (q < end && *q == '.') ? q + 1 : q;
+}
+
+inline void Insert(LineParser::WordListType *words, const char *start,
+                   const char *end) {
+    words->insert(words->end(), std::string(start, end));
+}
+
+}  // namespace
 
 bool
 LineParser::GetAtrributes(const pugi::xml_node &node,
@@ -34,10 +291,10 @@ LineParser::GetAtrributes(const pugi::xml_node &node,
      bool r=true;
      for (pugi::xml_attribute attr = node.first_attribute(); attr;
              attr = attr.next_attribute()) {
-         std::string s =  MakeSane(boost::algorithm::to_lower_copy(std::string(
-                     attr.value())));
+         const char *value = attr.value();
+         std::string s = SaneLowerCase(value, strlen(value));
          if (!s.empty()) {
-             r &= ParseDoc(s.begin(), s.end(), words);
+             r &= ParseDoc(s.data(), s.data() + s.size(), words);
          }
      }
      return r;
@@ -54,10 +311,10 @@ LineParser::Traverse(const pugi::xml_node &node,
         if (check_attr)
             r &= GetAtrributes(node, words);
     } else if (type == pugi::node_pcdata || type == pugi::node_cdata) {
-         std::string s =  MakeSane(boost::algorithm::to_lower_copy(std::string(
-                     node.value())));
+         const char *value = node.value();
+         std::string s = SaneLowerCase(value, strlen(value));
          if (!s.empty()) {
-             r &= ParseDoc(s.begin(), s.end(), words);
+             r &= ParseDoc(s.data(), s.data() + s.size(), words);
          }
     }
     for (pugi::xml_node s = node.first_child(); s; s = s.next_sibling())
@@ -79,115 +336,160 @@ LineParser::ParseXML(const pugi::xml_node &node,
 
 bool
 LineParser::Parse(std::string s, LineParser::WordListType *words) {
-    std::string ls = MakeSane(boost::algorithm::to_lower_copy(s));
-    return ParseDoc(ls.begin(), ls.end(), words);
+    std::string ls = SaneLowerCase(s.data(), s.size());
+    return ParseDoc(ls.data(), ls.data() + ls.size(), words);
 }
 
-template<typename Iterator>
-struct msg_skipper : public qi::grammar<Iterator> {
-    msg_skipper() : msg_skipper::base_type(skip, "msgskpr") {
-        skip = ascii::space | qi::char_(".,;:[](){}\t\r");
-    }
-    qi::rule<Iterator> skip;
-};
-
-template <typename Iterator>
+//
+// Splits lower cased text into keywords. Tokens are separated by white
+// space and punctuation; at each token the first of these that matches
+// is taken:
+//   stop words                               - dropped
+//   stats (1/2/3), 'quoted' and "quoted" text,
+//   uuids, IPv4 and IPv6 addresses           - kept
+//   hex, octal and decimal numbers           - dropped
+//   any other run of characters up to a word
+//   separator                                - kept
+// Returns false if the text could not be consumed completely.
+//
 bool
-LineParser::ParseDoc(Iterator start, Iterator end,
+LineParser::ParseDoc(const char *start, const char *end,
         LineParser::WordListType *pv)
 {
-    using ascii::space;
-    using qi::char_;
-    using qi::lit;
-    using qi::_1;
-    using qi::lexeme;
-    using qi::debug;
-    using phx::insert;
-    using phx::ref;
-    using boost::spirit::repeat;
-
-    typedef msg_skipper<Iterator> skipper_t;
-    skipper_t skpr;
-
-    qi::rule<Iterator, std::string(), skipper_t> num1 =
-        lexeme[ *char_("0-9") >> '.' >> +char_("0-9") ];
-    qi::rule<Iterator, std::string(), skipper_t> num2=
-        lexeme[ +char_("0-9") >> -lit('.') ];
-    qi::rule<Iterator, std::string(), skipper_t> hex1=
-        lexeme[ lit('0') >> lit('x') >> +char_("0-9A-Fa-f") ];
-    qi::rule<Iterator, std::string(), skipper_t> oct1=
-        lexeme[ lit('0') >> +char_("0-7") ];
-    qi::rule<Iterator, std::string(), skipper_t> word =
-        lexeme[ +(char_ - char_(" .,;:[](){}\t\r")) ];
-    qi::rule<Iterator, std::string(), skipper_t> word2 =
-        '\'' >> lexeme[ +(char_ - '\'') ] >> '\'';
-    qi::rule<Iterator, std::string(), skipper_t> word3 =
-        '"' >> lexeme[ +(char_ - '"') ] >> '"';
-    qi::rule<Iterator, std::string(), skipper_t> uuid =
-        lexeme[ repeat(8)[char_("0-9a-fA-F")] >> char_('-') >>
-         repeat(3)[ repeat(4)[char_("0-9a-fA-F")] >> char_('-') ] >>
-         repeat(12)[char_("0-9a-fA-F")] ];
-    qi::rule<Iterator, std::string(), skipper_t> ip =
-    lexeme[ +char_(L'0', L'9') >> char_('.') >> +char_(L'0', L'9')
-        >> +(char_('.') >> +char_(L'0', L'9'))
-        >> -(char_('/') >> +char_(L'0', L'9'))];
-    qi::rule<Iterator, std::string(), skipper_t> ipv6 =
-    lexeme[ +char_("0-9a-fA-F") >> +(+ char_(':')
-        >> +char_("0-9a-fA-F")) >> -(char_('/')
-        >> +char_(L'0', L'9'))];
-    qi::rule<Iterator, std::string(), skipper_t> stats =
-    lexeme[ +char_(L'0', L'9') >> +(char_('/') >> +char_(L'0', L'9'))];
-
-    qi::symbols<char, bool> stop_words;
-    stop_words.add
-        ("via", true)("or", true)("of", true)
-        ("string", true)("sandesh", true)("client", true)
-        ("the", true)("that", true)("and", true);
-    qi::rule<Iterator, std::string(), skipper_t> aw =
-        +( *( lit(":")
-            | lit(",")
-            | lit(".")
-            | lit(";")
-            | lit("&")
-            ) >>
-         ( stop_words
-         | stats [insert(boost::phoenix::ref(*pv), _1)]
-         | word2 [insert(boost::phoenix::ref(*pv), _1)]
-         | word3 [insert(boost::phoenix::ref(*pv), _1)]
-         | uuid  [insert(boost::phoenix::ref(*pv), _1)]
-         | ip    [insert(boost::phoenix::ref(*pv), _1)]
-         | ipv6  [insert(boost::phoenix::ref(*pv), _1)]
-         | hex1
-         | oct1
-         | num1
-         | num2
-         | word  [insert(boost::phoenix::ref(*pv), _1)]
-         )
-        );
-
-    bool r = qi::phrase_parse(start, end,
-        // Begin grammer
-        *aw
-        // end grammer
-        , skpr);
-    BOOST_SPIRIT_DEBUG_NODES((word)(num1)(aw)(word2));
-    BOOST_SPIRIT_DEBUG_RULE(word);
-    BOOST_SPIRIT_DEBUG_RULE(word2);
-    BOOST_SPIRIT_DEBUG_RULE(aw);
-    return ((start == end) && r);
+    const char *p = start;
+    while (true) {
+        // separators, and '&' between tokens
+        const char *q = p;
+        while (true) {
+            q = Span(q, end, kSkip);
+            if (q == end || *q != '&') {
+                break;
+            }
+            q++;
+        }
+        if (q == end) {
+            break;
+        }
+        const char *t, *kw_start, *kw_end;
+        if ((t = MatchStopWord(q, end)) != NULL) {
+        } else if ((t = MatchStats(q, end, &kw_end)) != NULL) {
+            Insert(pv, q, kw_end);
+        } else if ((t = MatchQuoted(q, end, '\'', &kw_start)) != NULL ||
+                   (t = MatchQuoted(q, end, '"', &kw_start)) != NULL) {
+            Insert(pv, kw_start, t - 1);
+        } else if ((t = MatchUuid(q, end)) != NULL) {
+            Insert(pv, q, t);
+        } else if ((t = MatchIp(q, end, &kw_end)) != NULL ||
+                   (t = MatchIpv6(q, end, &kw_end)) != NULL) {
+            Insert(pv, q, kw_end);
+        } else if ((t = MatchHexNumber(q, end)) != NULL ||
+                   (t = MatchOctalNumber(q, end)) != NULL ||
+                   (t = MatchNumber(q, end)) != NULL) {
+        } else {
+            // q is not a separator, so the word is not empty
+            t = SpanNot(q, end, kWordEnd);
+            Insert(pv, q, t);
+        }
+        p = t;
+    }
+    return Span(p, end, kSkip) == end;
+}
+
+//
+// The scans below look at a machine word at a time: a word has a zero
+// byte iff (x - 0x01..01) & ~x & 0x80..80 is non zero, and a byte equal
+// to c is a zero byte of x ^ (c * 0x01..01). Once a word reports a hit
+// the exact position is found a byte at a time.
+//
+namespace {
+
+const uint64_t kOnes  = 0x0101010101010101ULL;
+const uint64_t kHighs = 0x8080808080808080ULL;
+
+inline uint64_t LoadWord(const char *p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint64_t HasZeroByte(uint64_t x) {
+    return (x - kOnes) & ~x & kHighs;
+}
+
+inline bool IsXmlSpecial(char c) {
+    return (c & 0x80) || c == '&' || c == '\'' || c == '<' || c == '>';
+}
+
+}  // namespace
+
+size_t
+LineParser::FindNonAscii(const char *text, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        if (LoadWord(text + i) & kHighs) {
+            break;
+        }
+    }
+    for (; i < len; i++) {
+        if (text[i] & 0x80) {
+            return i;
+        }
+    }
+    return len;
+}
+
+size_t
+LineParser::FindXmlSpecial(const char *text, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t x = LoadWord(text + i);
+        if ((x & kHighs) ||
+            HasZeroByte(x ^ (kOnes * '&')) ||
+            HasZeroByte(x ^ (kOnes * '\'')) ||
+            HasZeroByte(x ^ (kOnes * '<')) ||
+            HasZeroByte(x ^ (kOnes * '>'))) {
+            break;
+        }
+    }
+    for (; i < len; i++) {
+        if (IsXmlSpecial(text[i])) {
+            return i;
+        }
+    }
+    return len;
 }
 
 std::string
 LineParser::MakeSane(const std::string &text) {
-    std::ostringstream s;
-    for (std::string::const_iterator it = text.begin(); it != text.end();
-            ++it) {
-        if (0x80 & *it)
-            s << "&#" << (int)((uint8_t)*it) << ";";
-        else
-            s << *it;
+    size_t pos = FindNonAscii(text.data(), text.size());
+    if (pos == text.size()) {
+        return text;
+    }
+    std::string s;
+    s.reserve(text.size() + 8);
+    size_t start = 0;
+    while (pos < text.size()) {
+        s.append(text, start, pos - start);
+        char ref[8];
+        int len = snprintf(ref, sizeof(ref), "&#%u;",
+                           static_cast<uint8_t>(text[pos]));
+        s.append(ref, len);
+        start = pos + 1;
+        pos = start + FindNonAscii(text.data() + start, text.size() - start);
     }
-    return s.str();
+    s.append(text, start, std::string::npos);
+    return s;
+}
+
+std::string
+LineParser::SaneLowerCase(const char *text, size_t len) {
+    std::string s(MakeSane(std::string(text, len)));
+    for (std::string::iterator it = s.begin(); it != s.end(); ++it) {
+        if (*it >= 'A' && *it <= 'Z') {
+            *it += 'a' - 'A';
+        }
+    }
+    return s;
 }
 
 std::string
@@ -237,12 +539,3 @@ LineParser::SearchPattern(const regex &exp, std::string text)
 }
 
 
-// generate a method for the template(required for static template function
-void
-TemplateGen() {
-    std::string s("hello");
-    LineParser::WordListType words;
-    LineParser::Parse(s, &words);
-    std::cout << "result length: " << words.size() << std::endl;
-}
-
@@ -20,14 +20,18 @@ public:
             bool check_attr=true);
     static std::string GetXmlString(const pugi::xml_node node);
     static std::string MakeSane(const std::string &text);
+    // Offset of the first byte with the high bit set, or len
+    static size_t FindNonAscii(const char *text, size_t len);
+    // Offset of the first byte that needs escaping in XML, or len
+    static size_t FindXmlSpecial(const char *text, size_t len);
     static unsigned int SearchPattern(const contrail::regex &exp,
             std::string text);
     static unsigned int SearchPattern(std::string exp, std::string text) {
         return SearchPattern(contrail::regex(exp, boost::regex::icase), text); }
 private:
-    template <typename Iterator>
-    static bool ParseDoc(Iterator start, Iterator end,
+    static bool ParseDoc(const char *start, const char *end,
             LineParser::WordListType *pv);
+    static std::string SaneLowerCase(const char *text, size_t len);
     static bool Traverse(const pugi::xml_node &node, WordListType *words,
             bool check_attr=true);
     static bool GetAtrributes(const pugi::xml_node &node, WordListType *words);
@@ -23,6 +23,7 @@
 #include <analytics/viz_constants.h>
 #include "ruleeng.h"
 #include "stat_walker.h"
+#include "stage_latency.h"
 
 using std::string;
 using std::vector;
@@ -84,15 +85,8 @@ bool Ruleeng::Parserules(const char *bytes, int len) {
 }
 
 bool Ruleeng::rule_present(const VizMsg *vmsgp) {
-    t_rulemsgtype msgtype(vmsgp->msg->GetMessageType());
-
-    const SandeshHeader &header(vmsgp->msg->GetHeader());
-    if (header.__isset.Context) {
-        msgtype.has_context_ = true;
-        msgtype.context_ = header.Context;
-    }
-
-    return rulelist_->rule_present(msgtype);
+    return rulelist_->rule_present(vmsgp->msg->GetMessageType(),
+                                   vmsgp->msg->GetHeader());
 }
 
 
@@ -197,16 +191,18 @@ class DomChildVisitor : public boost::static_visitor<> {
     }
 };
 
-static bool ParseDomTags(const std::string& tstr,
-        std::vector<std::string> *toptags,
-        const ptr_vector<tuple<string,ElemT> >* elem_chain,
-        StatWalker::TagMap *tagmap) {
+StatTagsCache::PlanPtr StatTagsCache::Parse(const std::string& tstr) {
+    boost::shared_ptr<Plan> plan(new Plan);
     size_t pos;
     size_t npos = 0;
 
     // If the tags string is empty, there's nothing to parse
-    if (tstr.empty()) return true;
+    if (tstr.empty()) {
+        plan->valid = plan->toptags_valid = true;
+        return plan;
+    }
 
+    plan->toptags_valid = true;
     do {
         if (npos)
             pos = npos+1;
@@ -234,79 +230,109 @@ static bool ParseDomTags(const std::string& tstr,
             sterm = term.substr(spos+1,string::npos);
         }
 
-        if (sterm.empty()) return false;
+        if (sterm.empty()) return plan;
 
-        if (toptags) {
-            assert(elem_chain==NULL);
-            assert(tagmap==NULL);
-            if (sterm[0] != '.') {
-                // These are top-level tags
+        if (sterm[0] != '.') {
+            // These are top-level tags
 
-                // We do not allow prefixes with top-level tags            
-                if (!pterm.empty()) return false;
+            // We do not allow prefixes with top-level tags            
+            if (!pterm.empty()) plan->toptags_valid = false;
 
-                toptags->push_back(sterm);
-            }
-            
+            plan->toptags.push_back(sterm);
             continue;
-        } else {
-            assert(elem_chain);
-            assert(elem_chain->size()>1);
-            assert(tagmap);
-            if (sterm[0] != '.') {
-                // We are not processing at the top level
-                // Ignore top-level tags 
-                continue;
-            }
         }
 
-        string sname, pname;
-
+        TagSpec spec;
         // strip out the leading "."
-        sname = sterm.substr(1, string::npos);
-        size_t sz = elem_chain->size();
+        spec.name = sterm.substr(1, string::npos);
+        spec.name_is_key =
+            (spec.name.compare(g_viz_constants.STAT_KEY_FIELD) == 0);
+        spec.prefix = pterm;
+        spec.prefix_is_child = (!pterm.empty() && pterm[0] == '.');
+        if (!pterm.empty()) {
+            size_t found = pterm.rfind('.');
+            spec.prefix_attr = pterm.substr(found+1, string::npos);
+        }
+        spec.prefix_attr_is_key =
+            (spec.prefix_attr.compare(g_viz_constants.STAT_KEY_FIELD) == 0);
+        plan->tags.push_back(spec);
+
+    } while (npos != string::npos);
+
+    plan->valid = true;
+    return plan;
+}
+
+StatTagsCache::PlanPtr StatTagsCache::Get(const std::string& tstr) {
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        PlanMap::const_iterator it = plans_.find(tstr);
+        if (it != plans_.end()) {
+            return it->second;
+        }
+    }
+    PlanPtr plan(Parse(tstr));
+    tbb::mutex::scoped_lock lock(mutex_);
+    // Annotations come from the Sandesh types known to the generators,
+    // do not let unexpected ones grow the cache without bound
+    if (plans_.size() < kMaxPlans) {
+        plans_.insert(make_pair(tstr, plan));
+    }
+    return plan;
+}
+
+static bool ParseDomTags(const StatTagsCache::Plan& plan,
+        const ptr_vector<tuple<string,ElemT> >& elem_chain,
+        StatWalker::TagMap *tagmap) {
+    if (!plan.valid) return false;
+
+    assert(elem_chain.size()>1);
+    size_t sz = elem_chain.size();
+
+    for (vector<StatTagsCache::TagSpec>::const_iterator it =
+            plan.tags.begin(); it != plan.tags.end(); it++) {
+        const StatTagsCache::TagSpec& spec(*it);
         StatWalker::TagVal tv;
 
-        if (sname.compare(g_viz_constants.STAT_KEY_FIELD)==0) {
-            tv.val = elem_chain->at(sz-1).get<1>().second;
+        if (spec.name_is_key) {
+            tv.val = elem_chain.at(sz-1).get<1>().second;
         } else {
             // TODO: Add support for map value as tag
-            const ElemVar& ev = elem_chain->at(sz-1).get<1>().first;
+            const ElemVar& ev = elem_chain.at(sz-1).get<1>().first;
             pugi::xml_node anode_s;
 
             DomChildVisitor dcv; 
             boost::apply_visitor(dcv, ev);
-            dcv.GetResult(sname, anode_s);
+            dcv.GetResult(spec.name, anode_s);
 
             if (!anode_s) return false;
             tv.val = ParseNode(anode_s);
         }
 
-        if (!pterm.empty()) {
+        if (!spec.prefix.empty()) {
             // The prefix is a child of the deepest node,
             // or a child at the current level (2nd deepest node)
-            size_t idx = ((pterm[0] == '.') ? sz-1 : sz-2);
+            size_t idx = (spec.prefix_is_child ? sz-1 : sz-2);
+            string pname;
             for (size_t ix=1; ix<=idx; ix++) {
                 if (!pname.empty()) pname.append(".");
-                pname.append(elem_chain->at(ix).get<0>());
+                pname.append(elem_chain.at(ix).get<0>());
             }
-            if (pterm[0] != '.') {
+            if (!spec.prefix_is_child) {
                 if (!pname.empty()) pname.append(".");
             }
-            pname.append(pterm);
-            size_t found = pterm.rfind('.');
-            string pattr = pterm.substr(found+1, string::npos);
+            pname.append(spec.prefix);
             DbHandler::Var pv;
-            if (pattr.compare(g_viz_constants.STAT_KEY_FIELD)==0) {
-                pv = elem_chain->at(idx).get<1>().second;
+            if (spec.prefix_attr_is_key) {
+                pv = elem_chain.at(idx).get<1>().second;
             } else {
                 // TODO: Add support for map value as tag
-                const ElemVar& ev = elem_chain->at(idx).get<1>().first;
+                const ElemVar& ev = elem_chain.at(idx).get<1>().first;
                 pugi::xml_node anode_p;
 
                 DomChildVisitor dcv; 
                 boost::apply_visitor(dcv, ev);
-                dcv.GetResult(pattr, anode_p);
+                dcv.GetResult(spec.prefix_attr, anode_p);
 
                 if (!anode_p) return false;
                 pv = ParseNode(anode_p);
@@ -314,9 +340,8 @@ static bool ParseDomTags(const std::string& tstr,
             tv.prefix = make_pair(pname, pv);
         }
 
-        tagmap->insert(make_pair(sname, tv));
-
-    } while (npos != string::npos);
+        tagmap->insert(make_pair(spec.name, tv));
+    }
 
     return true;
 }
@@ -450,8 +475,8 @@ class DomSelfVisitor : public boost::static_visitor<> {
    It is invoked after finding a top-level
    stats attribute
 */
-static bool DomStatWalker(StatWalker& sw,
-        const std::string& tstr,
+static bool DomStatWalker(StatWalker& sw, StatTagsCache *tags_cache,
+        const std::string& tstr, const StatTagsCache::Plan& plan,
         ptr_vector<tuple<string,ElemT> > elem_chain) {
 
     pugi::xml_node object;
@@ -468,7 +493,7 @@ static bool DomStatWalker(StatWalker& sw,
     StatWalker::TagMap tagmap;
     // Parse the tags annotation to find all tags that will
     // be used to index stats samples
-    if (ParseDomTags(tstr, NULL, &elem_chain, &tagmap)) {
+    if (ParseDomTags(plan, elem_chain, &tagmap)) {
         DbHandler::AttribMap attribs;
         // For this map:
         //     the key is the attribute name
@@ -490,12 +515,14 @@ static bool DomStatWalker(StatWalker& sw,
                 elem_map.begin(); ei != elem_map.end(); ei++) {
             ptr_vector<ElemT> & elem_list = ei->second.second;
             string & tstr_sub(ei->second.first);
+            StatTagsCache::PlanPtr plan_sub(tags_cache->Get(tstr_sub));
             for (size_t idx=0; idx<elem_list.size(); idx++) {
                 ptr_vector<tuple<string,ElemT> > elem_parent = elem_chain;
                 elem_parent.push_back(new tuple<string,ElemT>(ei->first, elem_list[idx]));
                 // recursive invokation to process stats of child
                 // structs and lists that have the tags annotation
-                if (!DomStatWalker(sw, tstr_sub, elem_parent)) {
+                if (!DomStatWalker(sw, tags_cache, tstr_sub, *plan_sub,
+                        elem_parent)) {
                     LOG(ERROR, __func__ << 
                       " Name: " << object.name() <<  " Node: " << node_name  <<
                       " Bad element " << ei->first);
@@ -518,6 +545,7 @@ static bool DomStatWalker(StatWalker& sw,
 */
 
 static bool DomTopStatWalker(const pugi::xml_node& object,
+        StatTagsCache *tags_cache,
         DbHandler *db,
         uint64_t timestamp,
         const pugi::xml_node& node,
@@ -538,12 +566,12 @@ static bool DomTopStatWalker(const pugi::xml_node& object,
         return false;
     }
 
-    std::vector<std::string> toptags;
-
     string tstr(node.attribute("tags").value());
+    StatTagsCache::PlanPtr plan(tags_cache->Get(tstr));
+    const std::vector<std::string>& toptags(plan->toptags);
 
     // Get the top-level tags for this stat attribute
-    if (ParseDomTags(tstr, &toptags, NULL, NULL)) {
+    if (plan->valid && plan->toptags_valid) {
 
         StatWalker::TagMap m1 = tmap;
 
@@ -566,7 +594,7 @@ static bool DomTopStatWalker(const pugi::xml_node& object,
         for (size_t idx=0; idx<elem_list.size(); idx++) {
             ptr_vector<tuple<string, ElemT> > elem_chain = parent_chain; 
             elem_chain.push_back(new tuple<string, ElemT>(node.name(), elem_list[idx]));
-            if (!DomStatWalker(sw, tstr, elem_chain)) {
+            if (!DomStatWalker(sw, tags_cache, tstr, *plan, elem_chain)) {
                 LOG(ERROR, __func__ << " Source: " << source <<
                   " Name: " << object.name() <<  " Node: " << node.name());
                 continue;
@@ -684,7 +712,7 @@ void Ruleeng::handle_object_log(const pugi::xml_node& parent, const VizMsg *rmsg
            node = node.next_sibling()) {
 
         if (!node.attribute("tags").empty()) {
-           DomTopStatWalker(object, db, timestamp, node,
+           DomTopStatWalker(object, &stat_tags_cache_, db, timestamp, node,
                    m1, source, db_cb);
         }
     }
@@ -744,7 +772,7 @@ bool Ruleeng::handle_uve_statistics(const pugi::xml_node& parent,
             // Process this UVE's Stat attributes.
             // We will always index by Source and UVE key (name)
             // Other indexes depend on the "tags" attribute
-            if (!DomTopStatWalker(object, db, ts, node,
+            if (!DomTopStatWalker(object, &stat_tags_cache_, db, ts, node,
                     m1, source, db_cb)) {
                 continue;
             }
@@ -899,14 +927,21 @@ bool Ruleeng::handle_session_object(const pugi::xml_node &parent,
 
 bool Ruleeng::rule_execute(const VizMsg *vmsgp, bool uveproc, DbHandler *db,
     GenDb::GenDbIf::DbAddColumnCb db_cb) {
+    StageLatencyTimer timer(StageLatency::RULE_EXECUTE);
     DbHandler::ObjectNamesVec object_names;
     const SandeshXMLMessage *sxmsg =
         static_cast<const SandeshXMLMessage *>(vmsgp->msg);
     const SandeshHeader &header(sxmsg->GetHeader());
     const pugi::xml_node &parent(sxmsg->GetMessageNode());
-    remove_identifier(parent);
+    {
+        StageLatencyTimer stimer(StageLatency::REMOVE_IDENTIFIER);
+        remove_identifier(parent);
+    }
     // First publish to redis and kafka
-    if (uveproc) handle_uve_publish(parent, vmsgp, db, header, db_cb);
+    if (uveproc) {
+        StageLatencyTimer stimer(StageLatency::UVE_PUBLISH);
+        handle_uve_publish(parent, vmsgp, db, header, db_cb);
+    }
     // Check if the message needs to be dropped
     if (db && db->DropMessage(header, vmsgp)) {
         return true;
@@ -915,17 +950,33 @@ bool Ruleeng::rule_execute(const VizMsg *vmsgp, bool uveproc, DbHandler *db,
     if (db) {
         // 1. make entry in OBJECT_VALUE_TABLE if needed
         // 2. get object-type:name{1-6}
-        handle_object_log(parent, vmsgp, db, header, &object_names, db_cb);
+        {
+            StageLatencyTimer stimer(StageLatency::OBJECT_LOG);
+            handle_object_log(parent, vmsgp, db, header, &object_names,
+                db_cb);
+        }
 
         // Insert into the message table
-        db->MessageTableInsert(vmsgp, object_names, db_cb);
+        {
+            StageLatencyTimer stimer(StageLatency::MESSAGE_TABLE_INSERT);
+            db->MessageTableInsert(vmsgp, object_names, db_cb);
+        }
 
-        if (uveproc) handle_uve_statistics(parent, vmsgp, db, header, db_cb);
+        if (uveproc) {
+            StageLatencyTimer stimer(StageLatency::UVE_STATISTICS);
+            handle_uve_statistics(parent, vmsgp, db, header, db_cb);
+        }
 
-        handle_session_object(parent, db, header, db_cb);
+        {
+            StageLatencyTimer stimer(StageLatency::SESSION_OBJECT);
+            handle_session_object(parent, db, header, db_cb);
+        }
     }
 
-    RuleMsg rmsg(vmsgp); 
-    rulelist_->rule_execute(rmsg);
+    // Most messages are not targeted by any rule
+    if (rule_present(vmsgp)) {
+        RuleMsg rmsg(vmsgp);
+        rulelist_->rule_execute(rmsg);
+    }
     return true;
 }
@@ -5,6 +5,10 @@
 #ifndef __RULEENG_H__
 #define __RULEENG_H__
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <tbb/mutex.h>
+#include "base/util.h"
 #include "viz_message.h"
 #include "ruleparser/t_ruleparser.h"
 #include "base/task.h"
@@ -13,6 +17,56 @@
 class DbHandler;
 class OpServerProxy;
 
+// Parsed form of the "tags" annotation of Sandesh stats attributes.
+// The annotation is fixed per Sandesh type, so it is split into terms
+// once and the resulting plan is reused for every instance of the message
+class StatTagsCache {
+public:
+    static const size_t kMaxPlans = 4096;
+
+    // One term of the annotation, "[prefix:].name"
+    struct TagSpec {
+        // Tag name, without the leading '.'
+        std::string name;
+        bool name_is_key;
+        // Prefix term as written, empty if there is no prefix
+        std::string prefix;
+        // The prefix is a child of the deepest node rather than of
+        // the current level
+        bool prefix_is_child;
+        // Last component of the prefix term
+        std::string prefix_attr;
+        bool prefix_attr_is_key;
+    };
+
+    struct Plan {
+        Plan() : valid(false), toptags_valid(false) {}
+        // No term is empty
+        bool valid;
+        // Also, no top-level tag has a prefix
+        bool toptags_valid;
+        // Tags that are attributes of the message itself
+        std::vector<std::string> toptags;
+        // Tags that are attributes of the stats elements, in the order
+        // of the annotation
+        std::vector<TagSpec> tags;
+    };
+    typedef boost::shared_ptr<const Plan> PlanPtr;
+
+    StatTagsCache() {}
+    PlanPtr Get(const std::string& tstr);
+
+    static PlanPtr Parse(const std::string& tstr);
+
+private:
+    typedef boost::unordered_map<std::string, PlanPtr> PlanMap;
+
+    mutable tbb::mutex mutex_;
+    PlanMap plans_;
+
+    DISALLOW_COPY_AND_ASSIGN(StatTagsCache);
+};
+
 class Ruleeng {
     public:
         static int RuleBuilderID;
@@ -45,6 +99,7 @@ class Ruleeng {
         OpServerProxy *osp_;
         t_rulelist *rulelist_;
         std::vector<std::string> rulesrc_;
+        StatTagsCache stat_tags_cache_;
 
         bool handle_uve_publish(const pugi::xml_node& parent,
             const VizMsg *rmsg, DbHandler *db, const SandeshHeader &header,
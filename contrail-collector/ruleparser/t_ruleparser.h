@@ -5,13 +5,16 @@
 #ifndef T_RULEENG_H
 #define T_RULEENG_H
 
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <unistd.h>
 #include "boost/lexical_cast.hpp"
 #include <boost/scoped_ptr.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "ruleutil.h"
 #include "t_doc.h"
@@ -157,15 +160,54 @@ class t_rangevalue {
         boost::ptr_vector<t_rangevalue_base> rangevalue_v;
 };
 
+/**
+ * t_rulefieldtable - interns the field names used in the conditions of a
+ * rule list, each distinct name is split once and gets the id used to
+ * cache its lookup in a RuleMsg
+ */
+class t_rulefieldtable {
+    public:
+        t_rulefieldtable() {}
+        ~t_rulefieldtable() {}
+
+        const RuleFieldPath* intern(const std::string& fieldid) {
+            boost::ptr_map<std::string, RuleFieldPath>::iterator it =
+                paths_.find(fieldid);
+            if (it != paths_.end()) {
+                return it->second;
+            }
+            std::string key(fieldid);
+            it = paths_.insert(key,
+                new RuleFieldPath(paths_.size(), fieldid)).first;
+            return it->second;
+        }
+
+    private:
+        boost::ptr_map<std::string, RuleFieldPath> paths_;
+};
+
 class t_cond_base {
     public:
-        t_cond_base(std::string fieldid) : fieldid_(fieldid) {}
+        t_cond_base(std::string fieldid) : fieldid_(fieldid), path_(NULL) {}
         virtual ~t_cond_base() {}
         virtual void print(std::ostream& os) = 0;
         virtual bool rule_match(const RuleMsg& rmsg) = 0;
 
+        void compile(t_rulefieldtable *fields) {
+            path_ = fields->intern(fieldid_);
+        }
+
     protected:
+        int field_value(const RuleMsg& rmsg, std::string& type,
+                        std::string& value) const {
+            if (path_) {
+                return rmsg.field_value(*path_, type, value);
+            }
+            return rmsg.field_value(fieldid_, type, value);
+        }
+
         std::string fieldid_;
+        const RuleFieldPath *path_;
 };
 
 class t_cond_range : public t_cond_base {
@@ -183,7 +225,7 @@ class t_cond_range : public t_cond_base {
 
     virtual bool rule_match(const RuleMsg& rmsg) {
         std::string type, value;
-        int ret = rmsg.field_value(fieldid_, type, value);
+        int ret = field_value(rmsg, type, value);
 
         if (!ret) {
             return rangevalue_->range_check(type, value);
@@ -208,7 +250,7 @@ class t_cond_simple : public t_cond_base {
 
     virtual bool rule_match(const RuleMsg& rmsg) {
         std::string type, value;
-        int ret = rmsg.field_value(fieldid_, type, value);
+        int ret = field_value(rmsg, type, value);
 
         if (!ret) {
             if (type == "string") {
@@ -268,6 +310,13 @@ class t_rulecondlist {
             return true;
         }
 
+        void compile(t_rulefieldtable *fields) {
+            boost::ptr_vector<t_cond_base>::iterator iter;
+            for (iter = conditions_.begin(); iter != conditions_.end(); iter++) {
+                (iter)->compile(fields);
+            }
+        }
+
     private:
         boost::ptr_vector<t_cond_base> conditions_;
 };
@@ -381,6 +430,16 @@ class t_rule : public t_doc {
             return rulename_;
         }
 
+        const t_rulemsgtype& get_msgtype() const {
+            return *rulemsgtype_;
+        }
+
+        void compile(t_rulefieldtable *fields) {
+            if (condlist_) {
+                condlist_->compile(fields);
+            }
+        }
+
         void print(std::ostream& os) {
             os << "Rule " << rulename_ << " :\n";
             if (rulemsgtype_->has_context_) {
@@ -449,6 +508,8 @@ class t_rule : public t_doc {
 /**
  * t_rulelist consists of all rules parsed in a file
  *
+ * Rules are indexed by the msgtype and context they apply to, messages
+ * of a type no rule is given for are dismissed with a single lookup
  */
 class t_rulelist: public t_doc {
     public:
@@ -470,6 +531,36 @@ class t_rulelist: public t_doc {
                 }
             }
             rules_.push_back(rule);
+            rule->compile(&fields_);
+            const t_rulemsgtype& msgtype(rule->get_msgtype());
+            t_ruleindexentry& entry(rule_index_[msgtype.msgtype_]);
+            if (msgtype.has_context_) {
+                entry.context_rules[msgtype.context_].push_back(rule);
+            } else {
+                entry.rules.push_back(rule);
+            }
+        }
+
+        /**
+         * Returns the rules for a message of msgtype, with context if
+         * has_context is set, or NULL if there are none
+         */
+        const std::vector<t_rule*>* find_rules(const std::string& msgtype,
+                bool has_context, const std::string& context) const {
+            t_ruleindex::const_iterator it = rule_index_.find(msgtype);
+            if (it == rule_index_.end()) {
+                return NULL;
+            }
+            const std::vector<t_rule*>* rules = &it->second.rules;
+            if (has_context) {
+                std::map<std::string, std::vector<t_rule*> >::const_iterator
+                    cit = it->second.context_rules.find(context);
+                if (cit == it->second.context_rules.end()) {
+                    return NULL;
+                }
+                rules = &cit->second;
+            }
+            return rules->empty() ? NULL : rules;
         }
 
         boost::ptr_vector<t_rule>& get_rules() {
@@ -484,21 +575,27 @@ class t_rulelist: public t_doc {
         }
 
         bool rule_present(const t_rulemsgtype& msgtype) {
-            boost::ptr_vector<t_rule>::iterator iter;
-            for (iter = rules_.begin(); iter != rules_.end(); iter++) {
-                if ((iter)->rule_present(msgtype)) {
-                    return true;
-                }
-            }
-            return false;
+            return (find_rules(msgtype.msgtype_, msgtype.has_context_,
+                               msgtype.context_) != NULL);
+        }
+
+        bool rule_present(const std::string& msgtype,
+                          const SandeshHeader& hdr) const {
+            return (find_rules(msgtype, hdr.__isset.Context,
+                               hdr.Context) != NULL);
         }
 
         bool rule_execute(const RuleMsg& rmsg) {
             t_ruleaction::RuleActionEchoResult.clear();
 
-            boost::ptr_vector<t_rule>::iterator iter;
-            for (iter = rules_.begin(); iter != rules_.end(); iter++) {
-                (iter)->rule_execute(rmsg);
+            const std::vector<t_rule*>* rules = find_rules(rmsg.messagetype,
+                rmsg.hdr.__isset.Context, rmsg.hdr.Context);
+            if (!rules) {
+                return true;
+            }
+            std::vector<t_rule*>::const_iterator iter;
+            for (iter = rules->begin(); iter != rules->end(); iter++) {
+                (*iter)->rule_execute(rmsg);
             }
             return true;
         }
@@ -512,6 +609,19 @@ class t_rulelist: public t_doc {
 
         // vector of all rules
         boost::ptr_vector<t_rule> rules_;
+
+        struct t_ruleindexentry {
+            // rules without context
+            std::vector<t_rule*> rules;
+            std::map<std::string, std::vector<t_rule*> > context_rules;
+        };
+        typedef boost::unordered_map<std::string, t_ruleindexentry>
+            t_ruleindex;
+        // rules by msgtype, in the order they were added
+        t_ruleindex rule_index_;
+
+        // field names used by the rule conditions
+        t_rulefieldtable fields_;
 };
 
 #endif
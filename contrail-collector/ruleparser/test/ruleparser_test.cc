@@ -327,6 +327,76 @@ TEST_F(RuleParserTest, RuleActionTestPy) {
     delete rulelist;
 }
 
+TEST_F(RuleParserTest, RuleIndexTest) {
+    t_rulelist *rulelist = new t_rulelist();
+    std::string rules(
+        "Rule RuleA :\n"
+        "For msgtype eq INDEX_MSG match\n"
+        "    (field2.field21 = 2121) and\n"
+        "    (field2.field21 in [2000 - 3000])\n"
+        "action echoaction RuleA\n"
+        "Rule RuleB :\n"
+        "For ((msgtype eq INDEX_MSG) and (context eq 42)) match\n"
+        "    (field2.field22 = string22)\n"
+        "action echoaction RuleB\n"
+        "Rule RuleC :\n"
+        "For msgtype eq INDEX_MSG match\n"
+        "    (field3.field21 = 2121)\n"
+        "action echoaction RuleC\n");
+    parse(rulelist, rules.c_str(), rules.length());
+
+    EXPECT_TRUE(rulelist->rule_present(t_rulemsgtype("INDEX_MSG")));
+    EXPECT_TRUE(rulelist->rule_present(t_rulemsgtype("INDEX_MSG", "42")));
+    EXPECT_FALSE(rulelist->rule_present(t_rulemsgtype("INDEX_MSG", "43")));
+    EXPECT_FALSE(rulelist->rule_present(t_rulemsgtype("OTHER_MSG")));
+
+    SandeshHeader hdr;
+    std::string xmlmessage("<INDEX_MSG type=\"sandesh\"><field2 type=\"struct\"><field21 type=\"i16\">2121</field21><field22 type=\"string\">string22</field22></field2><field3 type=\"i32\">30</field3></INDEX_MSG>");
+    boost::uuids::uuid unm(rgen_());
+    SandeshXMLMessageTest *msg1 = dynamic_cast<SandeshXMLMessageTest *>(
+        builder_->Create(
+        reinterpret_cast<const uint8_t *>(xmlmessage.c_str()),
+        xmlmessage.size()));
+    msg1->SetHeader(hdr);
+    VizMsg vmsgp1(msg1, unm);
+    RuleMsg rmsg1(&vmsgp1);
+    EXPECT_TRUE(rulelist->rule_present(rmsg1.messagetype, rmsg1.hdr));
+
+    // Only the rules without context apply, field3 is not a struct
+    rulelist->rule_execute(rmsg1);
+    EXPECT_EQ(" echoaction RuleA", t_ruleaction::RuleActionEchoResult);
+
+    // The interned field paths resolve as the field names do
+    std::string type, value;
+    RuleFieldPath path(0, "field2.field22");
+    EXPECT_EQ(0, rmsg1.field_value(path, type, value));
+    EXPECT_EQ("string", type);
+    EXPECT_EQ("string22", value);
+    RuleFieldPath bad_path(1, "field3.field21");
+    EXPECT_EQ(-1, rmsg1.field_value(bad_path, type, value));
+    EXPECT_EQ(-1, rmsg1.field_value("field3.field21", type, value));
+
+    vmsgp1.msg = NULL;
+    delete msg1;
+
+    hdr.Context = "42";
+    hdr.__isset.Context = true;
+    unm = rgen_();
+    SandeshXMLMessageTest *msg2 = dynamic_cast<SandeshXMLMessageTest *>(
+        builder_->Create(
+        reinterpret_cast<const uint8_t *>(xmlmessage.c_str()),
+        xmlmessage.size()));
+    msg2->SetHeader(hdr);
+    VizMsg vmsgp2(msg2, unm);
+    RuleMsg rmsg2(&vmsgp2);
+    rulelist->rule_execute(rmsg2);
+    EXPECT_EQ(" echoaction RuleB", t_ruleaction::RuleActionEchoResult);
+
+    vmsgp2.msg = NULL;
+    delete msg2;
+    delete rulelist;
+}
+
 int main(int argc, char **argv) {
     int a = 1;
     while (a < argc) {
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <base/logging.h>
+#include <sandesh/sandesh_message_builder.h>
+
+#include "sandesh_corpus.h"
+
+namespace {
+
+// SandeshHeader fields set in the recorded header, the rule engine
+// dispatches on them
+enum HeaderFlags {
+    HEADER_IPADDRESS = 1 << 0,
+    HEADER_PID = 1 << 1,
+    HEADER_TIMESTAMP = 1 << 2,
+    HEADER_MODULE = 1 << 3,
+    HEADER_SOURCE = 1 << 4,
+    HEADER_CONTEXT = 1 << 5,
+    HEADER_SEQUENCENUM = 1 << 6,
+    HEADER_VERSIONSIG = 1 << 7,
+    HEADER_TYPE = 1 << 8,
+    HEADER_HINTS = 1 << 9,
+    HEADER_LEVEL = 1 << 10,
+    HEADER_CATEGORY = 1 << 11,
+    HEADER_NODETYPE = 1 << 12,
+    HEADER_INSTANCEID = 1 << 13,
+};
+
+template <typename T>
+void Put(std::string *buf, T value) {
+    buf->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void PutString(std::string *buf, const std::string &value) {
+    Put(buf, static_cast<uint32_t>(value.size()));
+    buf->append(value);
+}
+
+class Reader {
+public:
+    Reader(const uint8_t *data, size_t len) :
+        data_(data), len_(len), offset_(0) {
+    }
+
+    template <typename T>
+    bool Get(T *value) {
+        if (len_ - offset_ < sizeof(T)) {
+            return false;
+        }
+        memcpy(value, data_ + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return true;
+    }
+
+    bool GetString(std::string *value) {
+        uint32_t slen;
+        if (!Get(&slen) || len_ - offset_ < slen) {
+            return false;
+        }
+        value->assign(reinterpret_cast<const char *>(data_ + offset_), slen);
+        offset_ += slen;
+        return true;
+    }
+
+    bool done() const { return offset_ == len_; }
+
+private:
+    const uint8_t *data_;
+    const size_t len_;
+    size_t offset_;
+};
+
+}  // namespace
+
+SandeshCorpusWriter::SandeshCorpusWriter(const std::string &path,
+    uint64_t max_size) :
+    path_(path),
+    max_size_(max_size),
+    file_(NULL),
+    records_(0),
+    size_(0),
+    full_(false) {
+}
+
+SandeshCorpusWriter::~SandeshCorpusWriter() {
+    Close();
+}
+
+bool SandeshCorpusWriter::Open() {
+    tbb::mutex::scoped_lock lock(mutex_);
+    file_ = fopen(path_.c_str(), "w");
+    if (file_ == NULL) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": Open FAILED: " <<
+            strerror(errno));
+        return false;
+    }
+    std::string buf;
+    Put(&buf, kMagic);
+    Put(&buf, kVersion);
+    if (fwrite(buf.data(), 1, buf.size(), file_) != buf.size()) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": Write FAILED: " <<
+            strerror(errno));
+        fclose(file_);
+        file_ = NULL;
+        return false;
+    }
+    size_ = buf.size();
+    return true;
+}
+
+void SandeshCorpusWriter::Close() {
+    tbb::mutex::scoped_lock lock(mutex_);
+    if (file_ == NULL) {
+        return;
+    }
+    fclose(file_);
+    file_ = NULL;
+    LOG(INFO, "SandeshCorpus: " << path_ << ": " << records_ <<
+        " messages, " << size_ << " bytes");
+}
+
+void SandeshCorpusWriter::Encode(const SandeshHeader &header,
+    const std::string &xml, std::string *buf) {
+    uint16_t flags(0);
+    flags |= header.__isset.IPAddress ? HEADER_IPADDRESS : 0;
+    flags |= header.__isset.Pid ? HEADER_PID : 0;
+    flags |= header.__isset.Timestamp ? HEADER_TIMESTAMP : 0;
+    flags |= header.__isset.Module ? HEADER_MODULE : 0;
+    flags |= header.__isset.Source ? HEADER_SOURCE : 0;
+    flags |= header.__isset.Context ? HEADER_CONTEXT : 0;
+    flags |= header.__isset.SequenceNum ? HEADER_SEQUENCENUM : 0;
+    flags |= header.__isset.VersionSig ? HEADER_VERSIONSIG : 0;
+    flags |= header.__isset.Type ? HEADER_TYPE : 0;
+    flags |= header.__isset.Hints ? HEADER_HINTS : 0;
+    flags |= header.__isset.Level ? HEADER_LEVEL : 0;
+    flags |= header.__isset.Category ? HEADER_CATEGORY : 0;
+    flags |= header.__isset.NodeType ? HEADER_NODETYPE : 0;
+    flags |= header.__isset.InstanceId ? HEADER_INSTANCEID : 0;
+    Put(buf, flags);
+    Put(buf, static_cast<int64_t>(header.get_Timestamp()));
+    Put(buf, static_cast<int32_t>(header.get_SequenceNum()));
+    Put(buf, static_cast<int32_t>(header.get_VersionSig()));
+    Put(buf, static_cast<int32_t>(header.get_Type()));
+    Put(buf, static_cast<int32_t>(header.get_Hints()));
+    Put(buf, static_cast<int32_t>(header.get_Level()));
+    Put(buf, static_cast<int32_t>(header.get_Pid()));
+    PutString(buf, header.get_Module());
+    PutString(buf, header.get_Source());
+    PutString(buf, header.get_Context());
+    PutString(buf, header.get_Category());
+    PutString(buf, header.get_NodeType());
+    PutString(buf, header.get_InstanceId());
+    PutString(buf, header.get_IPAddress());
+    PutString(buf, xml);
+}
+
+bool SandeshCorpusWriter::Write(const SandeshHeader &header,
+    const std::string &xml) {
+    std::string buf;
+    // Room for the record length
+    Put(&buf, static_cast<uint32_t>(0));
+    Encode(header, xml, &buf);
+    uint32_t len(buf.size() - sizeof(uint32_t));
+    memcpy(&buf[0], &len, sizeof(len));
+
+    tbb::mutex::scoped_lock lock(mutex_);
+    if (file_ == NULL || full_) {
+        return false;
+    }
+    if (size_ + buf.size() > max_size_) {
+        full_ = true;
+        LOG(INFO, "SandeshCorpus: " << path_ << ": Maximum size " <<
+            max_size_ << " reached after " << records_ << " messages");
+        fflush(file_);
+        return false;
+    }
+    if (fwrite(buf.data(), 1, buf.size(), file_) != buf.size()) {
+        full_ = true;
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": Write FAILED: " <<
+            strerror(errno));
+        return false;
+    }
+    records_++;
+    size_ += buf.size();
+    return true;
+}
+
+uint64_t SandeshCorpusWriter::records() const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return records_;
+}
+
+uint64_t SandeshCorpusWriter::size() const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return size_;
+}
+
+SandeshCorpusReader::SandeshCorpusReader(const std::string &path) :
+    path_(path),
+    file_(NULL) {
+}
+
+SandeshCorpusReader::~SandeshCorpusReader() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool SandeshCorpusReader::Open() {
+    file_ = fopen(path_.c_str(), "r");
+    if (file_ == NULL) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": Open FAILED: " <<
+            strerror(errno));
+        return false;
+    }
+    return Rewind();
+}
+
+bool SandeshCorpusReader::Rewind() {
+    if (file_ == NULL) {
+        return false;
+    }
+    rewind(file_);
+    uint32_t magic, version;
+    if (fread(&magic, sizeof(magic), 1, file_) != 1 ||
+        fread(&version, sizeof(version), 1, file_) != 1 ||
+        magic != SandeshCorpusWriter::kMagic ||
+        version != SandeshCorpusWriter::kVersion) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": INVALID header");
+        return false;
+    }
+    return true;
+}
+
+bool SandeshCorpusReader::Decode(const uint8_t *data, size_t len,
+    SandeshHeader *header, std::string *xml) {
+    Reader reader(data, len);
+    uint16_t flags;
+    int64_t timestamp;
+    int32_t seqnum, version_sig, type, hints, level, pid;
+    std::string module, source, context, category, node_type, instance_id,
+        ip_address;
+    if (!reader.Get(&flags) || !reader.Get(&timestamp) ||
+        !reader.Get(&seqnum) || !reader.Get(&version_sig) ||
+        !reader.Get(&type) || !reader.Get(&hints) || !reader.Get(&level) ||
+        !reader.Get(&pid) || !reader.GetString(&module) ||
+        !reader.GetString(&source) || !reader.GetString(&context) ||
+        !reader.GetString(&category) || !reader.GetString(&node_type) ||
+        !reader.GetString(&instance_id) || !reader.GetString(&ip_address) ||
+        !reader.GetString(xml) || !reader.done()) {
+        return false;
+    }
+    // Only the fields set in the recorded header are set, as in the
+    // header decoded from the generator
+    *header = SandeshHeader();
+    if (flags & HEADER_TIMESTAMP) {
+        header->set_Timestamp(timestamp);
+    }
+    if (flags & HEADER_MODULE) {
+        header->set_Module(module);
+    }
+    if (flags & HEADER_SOURCE) {
+        header->set_Source(source);
+    }
+    if (flags & HEADER_CONTEXT) {
+        header->set_Context(context);
+    }
+    if (flags & HEADER_SEQUENCENUM) {
+        header->set_SequenceNum(seqnum);
+    }
+    if (flags & HEADER_VERSIONSIG) {
+        header->set_VersionSig(version_sig);
+    }
+    if (flags & HEADER_TYPE) {
+        header->set_Type(static_cast<SandeshType::type>(type));
+    }
+    if (flags & HEADER_HINTS) {
+        header->set_Hints(hints);
+    }
+    if (flags & HEADER_LEVEL) {
+        header->set_Level(level);
+    }
+    if (flags & HEADER_CATEGORY) {
+        header->set_Category(category);
+    }
+    if (flags & HEADER_NODETYPE) {
+        header->set_NodeType(node_type);
+    }
+    if (flags & HEADER_INSTANCEID) {
+        header->set_InstanceId(instance_id);
+    }
+    if (flags & HEADER_IPADDRESS) {
+        header->set_IPAddress(ip_address);
+    }
+    if (flags & HEADER_PID) {
+        header->set_Pid(pid);
+    }
+    return true;
+}
+
+bool SandeshCorpusReader::Read(SandeshHeader *header, std::string *xml) {
+    if (file_ == NULL) {
+        return false;
+    }
+    uint32_t len;
+    if (fread(&len, sizeof(len), 1, file_) != 1) {
+        return false;
+    }
+    buf_.resize(len);
+    if (len == 0 || fread(&buf_[0], 1, len, file_) != len) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": Truncated record");
+        return false;
+    }
+    if (!Decode(reinterpret_cast<const uint8_t *>(buf_.data()), len, header,
+                xml)) {
+        LOG(ERROR, "SandeshCorpus: " << path_ << ": INVALID record");
+        return false;
+    }
+    return true;
+}
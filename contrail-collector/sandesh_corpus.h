@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __SANDESH_CORPUS_H__
+#define __SANDESH_CORPUS_H__
+
+#include <cstdio>
+#include <string>
+
+#include <tbb/mutex.h>
+
+#include <base/util.h>
+
+class SandeshHeader;
+
+//
+// Corpus of Sandesh messages received by the collector, captured so that
+// they can be replayed later through the collector write path at a
+// controlled rate (see bench/ingest_bench.cc).
+//
+// The corpus is a file starting with a magic and a version, followed by
+// one record per message: length (4 bytes), payload. The payload holds
+// the fields of the SandeshHeader followed by the message XML as
+// returned by SandeshMessage::ExtractMessage.
+//
+class SandeshCorpusWriter {
+public:
+    static const uint64_t kDefaultMaxSize = 1024ULL * 1024 * 1024;
+    static const uint32_t kMagic = 0x53524f43; // "CORS"
+    // Version 2 records which SandeshHeader fields are set
+    static const uint32_t kVersion = 2;
+
+    explicit SandeshCorpusWriter(const std::string &path,
+        uint64_t max_size = kDefaultMaxSize);
+    ~SandeshCorpusWriter();
+
+    bool Open();
+    void Close();
+    // Fails once the corpus has reached its maximum size
+    bool Write(const SandeshHeader &header, const std::string &xml);
+    uint64_t records() const;
+    uint64_t size() const;
+
+    static void Encode(const SandeshHeader &header, const std::string &xml,
+        std::string *buf);
+
+private:
+    const std::string path_;
+    const uint64_t max_size_;
+    mutable tbb::mutex mutex_;
+    FILE *file_;
+    uint64_t records_;
+    uint64_t size_;
+    bool full_;
+
+    DISALLOW_COPY_AND_ASSIGN(SandeshCorpusWriter);
+};
+
+class SandeshCorpusReader {
+public:
+    explicit SandeshCorpusReader(const std::string &path);
+    ~SandeshCorpusReader();
+
+    bool Open();
+    // Reads the next message, returns false at the end of the corpus or
+    // on a truncated or malformed record
+    bool Read(SandeshHeader *header, std::string *xml);
+    // Restarts from the first message
+    bool Rewind();
+
+    static bool Decode(const uint8_t *data, size_t len,
+        SandeshHeader *header, std::string *xml);
+
+private:
+    const std::string path_;
+    FILE *file_;
+    std::string buf_;
+
+    DISALLOW_COPY_AND_ASSIGN(SandeshCorpusReader);
+};
+
+#endif // __SANDESH_CORPUS_H__
@@ -10,6 +10,7 @@
 #include "collector.h"
 #include "db_handler.h"
 #include "viz_collector.h"
+#include "stage_latency.h"
 #include <analytics/collector_uve_types.h>
 #include <analytics/analytics_types.h>
 
@@ -179,6 +180,15 @@ void DatabaseWritesStatusRequest::HandleRequest() const {
     SendDatabaseWritesStatusResponse(client_context(), context());
 }
 
+void ShowCollectorStageLatencyReq::HandleRequest() const {
+    std::map<std::string, StageLatencyInfo> stage_latency;
+    StageLatency::GetInstance()->GetStageLatencyInfo(&stage_latency);
+    ShowCollectorStageLatencyResp *resp(new ShowCollectorStageLatencyResp);
+    resp->set_stage_latency(stage_latency);
+    resp->set_context(context());
+    resp->Response();
+}
+
 static void SendDbInfoResponse(Collector *collector, std::string context) {
     DbInfoResponse *fcsr(new DbInfoResponse);
     DbInfo db_info;
@@ -183,3 +183,19 @@ std::ostream &operator<<(std::ostream &out,
     }
     return out;
 }
+
+bool SFlowData::operator==(const SFlowData& rhs) const {
+    return (sflow_header == rhs.sflow_header &&
+            flow_samples == rhs.flow_samples);
+}
+
+std::ostream &operator<<(std::ostream &out,
+                         const SFlowData &sflow_data) {
+    out << sflow_data.sflow_header;
+    boost::ptr_vector<SFlowFlowSample>::const_iterator it =
+        sflow_data.flow_samples.begin();
+    for (; it != sflow_data.flow_samples.end(); ++it) {
+        out << *it;
+    }
+    return out;
+}
@@ -43,7 +43,8 @@ struct SFlowFlowRecord {
 
 enum SFlowFlowHeaderProtocol {
     SFLOW_FLOW_HEADER_ETHERNET_ISO8023 = 1,
-    SFLOW_FLOW_HEADER_IPV4 = 11
+    SFLOW_FLOW_HEADER_IPV4 = 11,
+    SFLOW_FLOW_HEADER_IPV6 = 12
 };
 
 struct SFlowFlowEthernetData {
@@ -181,4 +182,18 @@ struct SFlowHeader {
                                     const SFlowHeader &sflow_header);
 };
 
+struct SFlowData {
+    SFlowHeader sflow_header;
+    boost::ptr_vector<SFlowFlowSample> flow_samples;
+
+    explicit SFlowData()
+        : sflow_header(), flow_samples() {
+    }
+    ~SFlowData() {
+    }
+    bool operator==(const SFlowData& rhs) const;
+    friend std::ostream &operator<<(std::ostream &out,
+                                    const SFlowData &sflow_data);
+};
+
 #endif // __SFLOW_H__
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2015 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <base/logging.h>
+#include <base/string_util.h>
+#include <base/task.h>
+#include <base/time_util.h>
+#include <base/timer.h>
+#include <io/event_manager.h>
+#include <sandesh/sandesh.h>
+#include <analytics/uflow_constants.h>
+
+#include "sflow_collector.h"
+#include "sflow_parser.h"
+
+using boost::asio::ip::udp;
+
+namespace {
+
+size_t IpAddressHash(const IpAddress& addr) {
+    if (addr.is_v4()) {
+        return boost::hash_value(addr.to_v4().to_ulong());
+    }
+    Ip6Address::bytes_type bytes(addr.to_v6().to_bytes());
+    return boost::hash_range(bytes.begin(), bytes.end());
+}
+
+}  // namespace
+
+bool SFlowFlowAggregator::FlowKey::operator==(const FlowKey& rhs) const {
+    return (agent_ip == rhs.agent_ip &&
+            pifindex == rhs.pifindex &&
+            sip == rhs.sip &&
+            dip == rhs.dip &&
+            protocol == rhs.protocol &&
+            sport == rhs.sport &&
+            dport == rhs.dport &&
+            vlan == rhs.vlan);
+}
+
+size_t SFlowFlowAggregator::FlowKeyHash::operator()(
+        const FlowKey& key) const {
+    size_t seed = IpAddressHash(key.agent_ip);
+    boost::hash_combine(seed, key.pifindex);
+    boost::hash_combine(seed, IpAddressHash(key.sip));
+    boost::hash_combine(seed, IpAddressHash(key.dip));
+    boost::hash_combine(seed, key.protocol);
+    boost::hash_combine(seed, key.sport);
+    boost::hash_combine(seed, key.dport);
+    boost::hash_combine(seed, key.vlan);
+    return seed;
+}
+
+SFlowFlowAggregator::SFlowFlowAggregator(UFlowDataInsertFn insert_fn)
+    : insert_fn_(insert_fn) {
+}
+
+SFlowFlowAggregator::~SFlowFlowAggregator() {
+}
+
+// Whether seqno moves forward from last, and if so the number of sequence
+// numbers missing in between. A sequence number that does not move forward
+// means a duplicate, a late datagram or a restarted agent.
+bool SFlowFlowAggregator::SequenceGap(uint32_t last, uint32_t seqno,
+                                      uint32_t* gap) {
+    uint32_t delta = seqno - last;
+    if (delta == 0 || delta > 0x80000000) {
+        return false;
+    }
+    *gap = delta - 1;
+    return true;
+}
+
+// Whether the agent restarted, given a sequence number that went backwards.
+// A late datagram carries an older uptime as well, but only older by the
+// time it was delayed. A sequence number that went backwards with a newer
+// uptime is a restart not told apart from a late datagram before.
+bool SFlowFlowAggregator::AgentRestarted(const AgentState& agent,
+                                         const SFlowHeader& header) {
+    if (header.uptime > agent.uptime) {
+        return true;
+    }
+    return agent.uptime - header.uptime > kMaxReorderDelayMSec;
+}
+
+void SFlowFlowAggregator::AddSFlowData(const SFlowData& sflow_data) {
+    const SFlowHeader& header = sflow_data.sflow_header;
+    tbb::mutex::scoped_lock lock(mutex_);
+    std::pair<AgentMap::iterator, bool> ret = agents_.insert(
+        std::make_pair(AgentId(header.agent_ip_address, header.agent_subid),
+                       AgentState()));
+    AgentState& agent = ret.first->second;
+    uint32_t gap;
+    if (ret.second) {
+        agent.seqno = header.seqno;
+        agent.uptime = header.uptime;
+    } else if (SequenceGap(agent.seqno, header.seqno, &gap)) {
+        agent.stats.lost_datagrams += gap;
+        agent.seqno = header.seqno;
+        agent.uptime = header.uptime;
+    } else if (header.seqno != agent.seqno &&
+               AgentRestarted(agent, header)) {
+        // Start tracking the sequences of the agent afresh
+        agent.source_seqno.clear();
+        agent.seqno = header.seqno;
+        agent.uptime = header.uptime;
+    } else if (header.seqno != agent.seqno) {
+        // Late datagram, counted as lost when the datagrams after it came
+        agent.stats.reordered_datagrams++;
+        if (agent.stats.lost_datagrams) {
+            agent.stats.lost_datagrams--;
+        }
+    }
+    agent.stats.datagrams++;
+    boost::ptr_vector<SFlowFlowSample>::const_iterator it =
+        sflow_data.flow_samples.begin();
+    for (; it != sflow_data.flow_samples.end(); ++it) {
+        AddFlowSample(header.agent_ip_address, *it, &agent);
+    }
+}
+
+void SFlowFlowAggregator::AddFlowSample(const IpAddress& agent_ip,
+                                        const SFlowFlowSample& flow_sample,
+                                        AgentState* agent) {
+    agent->stats.flow_samples++;
+    agent->stats.dropped_flow_samples += flow_sample.drops;
+    std::pair<std::map<SourceId, uint32_t>::iterator, bool> ret =
+        agent->source_seqno.insert(std::make_pair(
+            SourceId(flow_sample.sourceid_type, flow_sample.sourceid_index),
+            flow_sample.seqno));
+    if (!ret.second) {
+        uint32_t gap;
+        if (SequenceGap(ret.first->second, flow_sample.seqno, &gap)) {
+            agent->stats.lost_flow_samples += gap;
+            ret.first->second = flow_sample.seqno;
+        } else if (ret.first->second != flow_sample.seqno &&
+                   agent->stats.lost_flow_samples) {
+            // Sample of a late datagram
+            agent->stats.lost_flow_samples--;
+        }
+    }
+
+    boost::ptr_vector<SFlowFlowRecord>::const_iterator it =
+        flow_sample.flow_records.begin();
+    for (; it != flow_sample.flow_records.end(); ++it) {
+        if (it->type != SFLOW_FLOW_HEADER) {
+            continue;
+        }
+        const SFlowFlowHeader& flow_header =
+            static_cast<const SFlowFlowHeader&>(*it);
+        if (!flow_header.is_ip_data_set) {
+            agent->stats.undecoded_flow_samples++;
+            continue;
+        }
+        const SFlowFlowIpData& ip_data = flow_header.decoded_ip_data;
+        FlowKey key;
+        key.agent_ip = agent_ip;
+        // Only ifIndex (format 0) identifies the physical interface
+        if (flow_sample.input_port_format == 0) {
+            key.pifindex = flow_sample.input_port;
+        }
+        key.sip = ip_data.src_ip;
+        key.dip = ip_data.dst_ip;
+        key.protocol = ip_data.protocol;
+        key.sport = ip_data.src_port;
+        key.dport = ip_data.dst_port;
+        if (flow_header.is_eth_data_set) {
+            key.vlan = flow_header.decoded_eth_data.vlan_id;
+        }
+        uint64_t sample_rate = flow_sample.sample_rate ?
+            flow_sample.sample_rate : 1;
+        FlowCounters& counters = flows_[key];
+        counters.samples++;
+        counters.packets += sample_rate;
+        counters.bytes += sample_rate * flow_header.frame_length;
+        // Only the first packet header record of a sample is used
+        break;
+    }
+}
+
+size_t SFlowFlowAggregator::Flush(uint64_t timestamp) {
+    FlowMap flows;
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        flows_.swap(flows);
+    }
+    if (flows.empty()) {
+        return 0;
+    }
+    const std::string& flowtype(
+        g_uflow_constants.FlowTypeName.find(FlowType::SFLOW)->second);
+    std::map<IpAddress, std::vector<UFlowSample> > agent_flows;
+    for (FlowMap::const_iterator it = flows.begin(); it != flows.end();
+         ++it) {
+        const FlowKey& key = it->first;
+        UFlowSample sample;
+        sample.set_pifindex(key.pifindex);
+        sample.set_sip(key.sip.to_string());
+        sample.set_dip(key.dip.to_string());
+        sample.set_sport(key.sport);
+        sample.set_dport(key.dport);
+        sample.set_protocol(key.protocol);
+        sample.set_vlan(key.vlan);
+        sample.set_flowtype(flowtype);
+        sample.set_samples(it->second.samples);
+        sample.set_packets(it->second.packets);
+        sample.set_bytes(it->second.bytes);
+        agent_flows[key.agent_ip].push_back(sample);
+    }
+    for (std::map<IpAddress, std::vector<UFlowSample> >::const_iterator it =
+         agent_flows.begin(); it != agent_flows.end(); ++it) {
+        UFlowData flow_data;
+        flow_data.set_name(it->first.to_string());
+        flow_data.set_flow(it->second);
+        insert_fn_(flow_data, timestamp);
+    }
+    return flows.size();
+}
+
+size_t SFlowFlowAggregator::size() const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return flows_.size();
+}
+
+bool SFlowFlowAggregator::GetAgentStats(const IpAddress& agent_ip,
+                                        uint32_t agent_subid,
+                                        AgentStats* stats) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    AgentMap::const_iterator it = agents_.find(AgentId(agent_ip,
+                                                       agent_subid));
+    if (it == agents_.end()) {
+        return false;
+    }
+    *stats = it->second.stats;
+    return true;
+}
+
+void SFlowFlowAggregator::GetAgentStatsInfo(
+        std::map<std::string, SFlowAgentInfo>* agent_stats) const {
+    agent_stats->clear();
+    tbb::mutex::scoped_lock lock(mutex_);
+    for (AgentMap::const_iterator it = agents_.begin(); it != agents_.end();
+         ++it) {
+        const AgentStats& stats(it->second.stats);
+        SFlowAgentInfo info;
+        info.set_datagrams(stats.datagrams);
+        info.set_lost_datagrams(stats.lost_datagrams);
+        info.set_reordered_datagrams(stats.reordered_datagrams);
+        info.set_flow_samples(stats.flow_samples);
+        info.set_lost_flow_samples(stats.lost_flow_samples);
+        info.set_dropped_flow_samples(stats.dropped_flow_samples);
+        info.set_undecoded_flow_samples(stats.undecoded_flow_samples);
+        agent_stats->insert(std::make_pair(it->first.first.to_string() +
+            ":" + integerToString(it->first.second), info));
+    }
+}
+
+SFlowCollector::SFlowCollector(EventManager* evm,
+        const std::string& ipaddress, int port,
+        SFlowFlowAggregator::UFlowDataInsertFn insert_fn)
+    : evm_(evm),
+      ipaddress_(ipaddress),
+      port_(port),
+      socket_(*evm->io_service()),
+      buffer_(kMaxBatchSize * kMaxDatagramSize),
+      aggregator_(insert_fn),
+      flush_timer_(NULL),
+      trace_buf_(SandeshTraceBufferCreate("SFlowTraceBuf", 1000)) {
+    parse_errors_ = 0;
+}
+
+SFlowCollector::~SFlowCollector() {
+    assert(flush_timer_ == NULL);
+}
+
+bool SFlowCollector::Initialize() {
+    boost::system::error_code ec;
+    IpAddress ip(IpAddress::from_string(ipaddress_, ec));
+    if (ec) {
+        LOG(ERROR, "sFlow collector: invalid address " << ipaddress_ <<
+            ": " << ec.message());
+        return false;
+    }
+    udp::endpoint local_endpoint(ip, port_);
+    socket_.open(local_endpoint.protocol(), ec);
+    if (!ec) {
+        socket_.bind(local_endpoint, ec);
+    }
+    if (ec) {
+        LOG(ERROR, "sFlow collector: failed to listen on " <<
+            local_endpoint << ": " << ec.message());
+        socket_.close(ec);
+        return false;
+    }
+    // Absorb bursts from many agents between two read events
+    socket_.set_option(udp::socket::receive_buffer_size(4 * 1024 * 1024),
+                       ec);
+    flush_timer_ = TimerManager::CreateTimer(*evm_->io_service(),
+        "sFlow flush timer",
+        TaskScheduler::GetInstance()->GetTaskId("sflow::FlushTimer"));
+    flush_timer_->Start(kFlushIntervalMSec,
+        boost::bind(&SFlowCollector::FlushTimerExpired, this),
+        boost::bind(&SFlowCollector::FlushTimerErrorHandler, this, _1, _2));
+    StartReceive();
+    LOG(INFO, "sFlow collector listening on " << local_endpoint);
+    return true;
+}
+
+void SFlowCollector::Shutdown() {
+    boost::system::error_code ec;
+    socket_.close(ec);
+    if (flush_timer_) {
+        TimerManager::DeleteTimer(flush_timer_);
+        flush_timer_ = NULL;
+    }
+    aggregator_.Flush(UTCTimestampUsec());
+}
+
+void SFlowCollector::SendStatistics() const {
+    std::map<std::string, SFlowAgentInfo> agent_stats;
+    aggregator_.GetAgentStatsInfo(&agent_stats);
+    SFlowCollectorStats stats;
+    stats.set_name(Sandesh::source());
+    stats.set_agent_stats(agent_stats);
+    stats.set_parse_errors(parse_errors_);
+    SFlowCollectorStatsTrace::Send(stats);
+}
+
+int SFlowCollector::GetLocalEndpointPort() const {
+    boost::system::error_code ec;
+    udp::endpoint local_endpoint(socket_.local_endpoint(ec));
+    if (ec) {
+        return -1;
+    }
+    return local_endpoint.port();
+}
+
+// Wait for the socket to become readable without handing asio a buffer,
+// the datagrams are then read in batches by ReceiveBatch()
+void SFlowCollector::StartReceive() {
+    socket_.async_receive(boost::asio::null_buffers(),
+        boost::bind(&SFlowCollector::HandleReadable, this,
+                    boost::asio::placeholders::error));
+}
+
+void SFlowCollector::HandleReadable(const boost::system::error_code& error) {
+    if (error) {
+        if (error != boost::asio::error::operation_aborted) {
+            LOG(ERROR, "sFlow collector receive error: " << error.message());
+        }
+        if (!socket_.is_open()) {
+            return;
+        }
+    } else {
+        // Bound the work done per read event, the rest is picked up on
+        // the next one
+        for (size_t i = 0; i < kMaxBatchesPerRead; ++i) {
+            if (ReceiveBatch() < kMaxBatchSize) {
+                break;
+            }
+        }
+    }
+    StartReceive();
+}
+
+size_t SFlowCollector::ReceiveBatch() {
+    int fd = socket_.native_handle();
+#ifdef __linux__
+    struct mmsghdr msgs[kMaxBatchSize];
+    struct iovec iovs[kMaxBatchSize];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < kMaxBatchSize; ++i) {
+        iovs[i].iov_base = &buffer_[i * kMaxDatagramSize];
+        iovs[i].iov_len = kMaxDatagramSize;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(fd, msgs, kMaxBatchSize, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+        return 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        ProcessSFlowPacket(&buffer_[i * kMaxDatagramSize], msgs[i].msg_len);
+    }
+    return count;
+#else
+    size_t count = 0;
+    for (; count < kMaxBatchSize; ++count) {
+        ssize_t len = recv(fd, &buffer_[count * kMaxDatagramSize],
+                           kMaxDatagramSize, MSG_DONTWAIT);
+        if (len < 0) {
+            break;
+        }
+        ProcessSFlowPacket(&buffer_[count * kMaxDatagramSize], len);
+    }
+    return count;
+#endif
+}
+
+void SFlowCollector::ProcessSFlowPacket(const uint8_t* data, size_t len) {
+    SFlowData sflow_data;
+    SFlowParser parser(data, len, trace_buf_);
+    if (parser.Parse(&sflow_data) < 0) {
+        parse_errors_++;
+        return;
+    }
+    aggregator_.AddSFlowData(sflow_data);
+}
+
+bool SFlowCollector::FlushTimerExpired() {
+    aggregator_.Flush(UTCTimestampUsec());
+    return true;
+}
+
+void SFlowCollector::FlushTimerErrorHandler(std::string error_name,
+                                            std::string error_message) {
+    LOG(ERROR, "sFlow flush timer error: " << error_name << " " <<
+        error_message);
+}
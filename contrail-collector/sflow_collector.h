@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2015 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __SFLOW_COLLECTOR_H__
+#define __SFLOW_COLLECTOR_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/udp.hpp>
+#include <boost/function.hpp>
+#include <boost/unordered_map.hpp>
+#include <tbb/atomic.h>
+#include <tbb/mutex.h>
+
+#include <base/util.h>
+#include <sandesh/sandesh_trace.h>
+#include <analytics/uflow_types.h>
+#include <analytics/sflow_types.h>
+
+#include "sflow.h"
+
+class EventManager;
+class Timer;
+
+//
+// Aggregates the flow samples received from the sFlow agents per
+// (agent, pifindex, 5-tuple, vlan) so that the underlay flow table gets
+// one row per flow per interval instead of one per sampled packet.
+//
+// Each sample stands for sample_rate packets of the flow, the packet
+// and byte counts are scaled up accordingly. Datagram and flow sample
+// sequence numbers are tracked per agent to account for lost samples.
+//
+class SFlowFlowAggregator {
+public:
+    typedef boost::function<void(const UFlowData&, uint64_t)>
+        UFlowDataInsertFn;
+
+    // A datagram whose sequence number went backwards is taken for a late
+    // one unless its uptime is older than the last one's by more than this
+    static const uint32_t kMaxReorderDelayMSec = 10000;
+
+    struct AgentStats {
+        AgentStats()
+            : datagrams(), lost_datagrams(), reordered_datagrams(),
+              flow_samples(),
+              lost_flow_samples(), dropped_flow_samples(),
+              undecoded_flow_samples() {
+        }
+        uint64_t datagrams;
+        uint64_t lost_datagrams;
+        // datagrams received after a later one, no longer counted as lost
+        uint64_t reordered_datagrams;
+        uint64_t flow_samples;
+        // samples missing from the flow sample sequence
+        uint64_t lost_flow_samples;
+        // samples dropped by the agent for lack of resources
+        uint64_t dropped_flow_samples;
+        // samples without a decodable IP header
+        uint64_t undecoded_flow_samples;
+    };
+
+    explicit SFlowFlowAggregator(UFlowDataInsertFn insert_fn);
+    ~SFlowFlowAggregator();
+    void AddSFlowData(const SFlowData& sflow_data);
+    // Writes the flows aggregated since the last flush, returns the
+    // number of flows written
+    size_t Flush(uint64_t timestamp);
+    size_t size() const;
+    bool GetAgentStats(const IpAddress& agent_ip, uint32_t agent_subid,
+                       AgentStats* stats) const;
+    // Counters of all the agents, keyed by "agent_ip:agent_subid"
+    void GetAgentStatsInfo(
+        std::map<std::string, SFlowAgentInfo>* agent_stats) const;
+
+private:
+    struct FlowKey {
+        FlowKey()
+            : agent_ip(), pifindex(), sip(), dip(), protocol(), sport(),
+              dport(), vlan() {
+        }
+        bool operator==(const FlowKey& rhs) const;
+
+        IpAddress agent_ip;
+        uint32_t pifindex;
+        IpAddress sip;
+        IpAddress dip;
+        uint32_t protocol;
+        uint32_t sport;
+        uint32_t dport;
+        uint16_t vlan;
+    };
+    struct FlowKeyHash {
+        size_t operator()(const FlowKey& key) const;
+    };
+    struct FlowCounters {
+        FlowCounters()
+            : samples(), packets(), bytes() {
+        }
+        uint64_t samples;
+        uint64_t packets;
+        uint64_t bytes;
+    };
+    typedef boost::unordered_map<FlowKey, FlowCounters, FlowKeyHash>
+        FlowMap;
+
+    // Sub agents keep their own datagram sequence
+    typedef std::pair<IpAddress, uint32_t> AgentId;
+    // (source id type, source id index)
+    typedef std::pair<uint32_t, uint32_t> SourceId;
+    struct AgentState {
+        AgentState()
+            : seqno(), uptime(), source_seqno(), stats() {
+        }
+        uint32_t seqno;
+        uint32_t uptime;
+        std::map<SourceId, uint32_t> source_seqno;
+        AgentStats stats;
+    };
+    typedef std::map<AgentId, AgentState> AgentMap;
+
+    static bool SequenceGap(uint32_t last, uint32_t seqno, uint32_t* gap);
+    static bool AgentRestarted(const AgentState& agent,
+                               const SFlowHeader& header);
+    void AddFlowSample(const IpAddress& agent_ip,
+                       const SFlowFlowSample& flow_sample,
+                       AgentState* agent);
+
+    UFlowDataInsertFn insert_fn_;
+    mutable tbb::mutex mutex_;
+    FlowMap flows_;
+    AgentMap agents_;
+
+    DISALLOW_COPY_AND_ASSIGN(SFlowFlowAggregator);
+};
+
+//
+// Receives sFlow datagrams on a UDP port and feeds them to the
+// SFlowFlowAggregator, flushing the aggregated flows periodically.
+//
+// On every read event the socket is drained in batches of up to
+// kMaxBatchSize datagrams per system call.
+//
+class SFlowCollector {
+public:
+    static const int kDefaultSFlowPort = 6343;
+    static const int kFlushIntervalMSec = 5000;
+    static const size_t kMaxBatchSize = 64;
+    static const size_t kMaxBatchesPerRead = 16;
+    static const size_t kMaxDatagramSize = 9216;
+
+    SFlowCollector(EventManager* evm, const std::string& ipaddress, int port,
+                   SFlowFlowAggregator::UFlowDataInsertFn insert_fn);
+    ~SFlowCollector();
+    bool Initialize();
+    void Shutdown();
+    int GetLocalEndpointPort() const;
+    const SFlowFlowAggregator& aggregator() const { return aggregator_; }
+    uint64_t parse_errors() const { return parse_errors_; }
+    // Sends the SFlowCollectorStats UVE
+    void SendStatistics() const;
+
+private:
+    void StartReceive();
+    void HandleReadable(const boost::system::error_code& error);
+    size_t ReceiveBatch();
+    void ProcessSFlowPacket(const uint8_t* data, size_t len);
+    bool FlushTimerExpired();
+    void FlushTimerErrorHandler(std::string error_name,
+                                std::string error_message);
+
+    EventManager* const evm_;
+    const std::string ipaddress_;
+    const int port_;
+    boost::asio::ip::udp::socket socket_;
+    std::vector<uint8_t> buffer_;
+    SFlowFlowAggregator aggregator_;
+    Timer* flush_timer_;
+    SandeshTraceBufferPtr trace_buf_;
+    tbb::atomic<uint64_t> parse_errors_;
+
+    DISALLOW_COPY_AND_ASSIGN(SFlowCollector);
+};
+
+#endif // __SFLOW_COLLECTOR_H__
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2015 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include <analytics/sflow_types.h>
+
+#include "sflow_parser.h"
+
+#define SFLOW_PARSE_ERROR(_msg)                                   \
+    do {                                                          \
+        std::ostringstream _ss;                                   \
+        _ss << _msg << " [offset: "                               \
+            << (decode_ptr_ - raw_datagram_) << "]";              \
+        SFLOW_PACKET_TRACE(trace_buf_, _ss.str());                \
+    } while (0)
+
+namespace {
+
+inline uint16_t Get16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+inline uint32_t Get32(const uint8_t* p) {
+    uint32_t data;
+    memcpy(&data, p, sizeof(data));
+    return ntohl(data);
+}
+
+// XDR opaque data is padded to a multiple of 4 bytes
+inline size_t XdrPad(size_t len) {
+    return (len + 3) & ~static_cast<size_t>(3);
+}
+
+}  // namespace
+
+SFlowParser::SFlowParser(const uint8_t* buf, size_t len,
+                         SandeshTraceBufferPtr trace_buf)
+    : raw_datagram_(buf),
+      decode_ptr_(buf),
+      end_ptr_(buf + len),
+      trace_buf_(trace_buf) {
+}
+
+SFlowParser::~SFlowParser() {
+}
+
+int SFlowParser::Parse(SFlowData* const sflow_data) {
+    if (ReadSFlowHeader(sflow_data->sflow_header) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < sflow_data->sflow_header.nsamples; ++i) {
+        uint32_t sample_type, sample_len;
+        if (ReadData32(sample_type) < 0 || ReadData32(sample_len) < 0) {
+            SFLOW_PARSE_ERROR("Failed to read sample type/length");
+            return -1;
+        }
+        if (!VerifyLength(sample_len)) {
+            SFLOW_PARSE_ERROR("Invalid sample length: " << sample_len);
+            return -1;
+        }
+        switch (sample_type) {
+        case SFLOW_FLOW_SAMPLE:
+        case SFLOW_FLOW_SAMPLE_EXPANDED: {
+            std::auto_ptr<SFlowFlowSample> flow_sample(
+                new SFlowFlowSample(
+                    static_cast<SFlowSampleType>(sample_type), sample_len));
+            // Bound the decode to the sample
+            const uint8_t* const end_ptr = end_ptr_;
+            end_ptr_ = decode_ptr_ + sample_len;
+            int ret = ReadSFlowFlowSample(*flow_sample);
+            if (ret == 0 && decode_ptr_ != end_ptr_) {
+                SFLOW_PARSE_ERROR("Flow sample length mismatch: " <<
+                    sample_len);
+                ret = -1;
+            }
+            end_ptr_ = end_ptr;
+            if (ret < 0) {
+                return -1;
+            }
+            sflow_data->flow_samples.push_back(flow_sample.release());
+            break;
+        }
+        default:
+            // Counter samples are not used
+            SkipBytes(sample_len);
+            break;
+        }
+    }
+    return 0;
+}
+
+int SFlowParser::ReadSFlowHeader(SFlowHeader& sflow_header) {
+    if (ReadData32(sflow_header.version) < 0) {
+        SFLOW_PARSE_ERROR("Failed to read sFlow version");
+        return -1;
+    }
+    if (sflow_header.version != kSFlowVersion5) {
+        SFLOW_PARSE_ERROR("Unsupported sFlow version: " <<
+            sflow_header.version);
+        return -1;
+    }
+    if (ReadIpaddress(sflow_header.agent_ip_address) < 0) {
+        SFLOW_PARSE_ERROR("Failed to read agent ip address");
+        return -1;
+    }
+    if (ReadData32(sflow_header.agent_subid) < 0 ||
+        ReadData32(sflow_header.seqno) < 0 ||
+        ReadData32(sflow_header.uptime) < 0 ||
+        ReadData32(sflow_header.nsamples) < 0) {
+        SFLOW_PARSE_ERROR("Failed to read sFlow header");
+        return -1;
+    }
+    return 0;
+}
+
+int SFlowParser::ReadSFlowFlowSample(SFlowFlowSample& flow_sample) {
+    if (flow_sample.type == SFLOW_FLOW_SAMPLE_EXPANDED) {
+        if (!VerifyLength(SFlowFlowSample::kMinExpandedFlowSampleLen)) {
+            SFLOW_PARSE_ERROR("Expanded flow sample too short: " <<
+                flow_sample.length);
+            return -1;
+        }
+        ReadData32(flow_sample.seqno);
+        ReadData32(flow_sample.sourceid_type);
+        ReadData32(flow_sample.sourceid_index);
+        ReadData32(flow_sample.sample_rate);
+        ReadData32(flow_sample.sample_pool);
+        ReadData32(flow_sample.drops);
+        ReadData32(flow_sample.input_port_format);
+        ReadData32(flow_sample.input_port);
+        ReadData32(flow_sample.output_port_format);
+        ReadData32(flow_sample.output_port);
+    } else {
+        if (!VerifyLength(SFlowFlowSample::kMinFlowSampleLen)) {
+            SFLOW_PARSE_ERROR("Flow sample too short: " <<
+                flow_sample.length);
+            return -1;
+        }
+        uint32_t sourceid, input, output;
+        ReadData32(flow_sample.seqno);
+        ReadData32(sourceid);
+        flow_sample.sourceid_type = sourceid >> 24;
+        flow_sample.sourceid_index = sourceid & 0x00FFFFFF;
+        ReadData32(flow_sample.sample_rate);
+        ReadData32(flow_sample.sample_pool);
+        ReadData32(flow_sample.drops);
+        ReadData32(input);
+        flow_sample.input_port_format = input >> 30;
+        flow_sample.input_port = input & 0x3FFFFFFF;
+        ReadData32(output);
+        flow_sample.output_port_format = output >> 30;
+        flow_sample.output_port = output & 0x3FFFFFFF;
+    }
+    ReadData32(flow_sample.nflow_records);
+    for (uint32_t i = 0; i < flow_sample.nflow_records; ++i) {
+        uint32_t record_type, record_len;
+        if (ReadData32(record_type) < 0 || ReadData32(record_len) < 0) {
+            SFLOW_PARSE_ERROR("Failed to read flow record type/length");
+            return -1;
+        }
+        if (!VerifyLength(record_len)) {
+            SFLOW_PARSE_ERROR("Invalid flow record length: " << record_len);
+            return -1;
+        }
+        switch (record_type) {
+        case SFLOW_FLOW_HEADER: {
+            std::auto_ptr<SFlowFlowHeader> flow_header(
+                new SFlowFlowHeader(record_len));
+            if (ReadSFlowFlowHeader(*flow_header) < 0) {
+                return -1;
+            }
+            flow_sample.flow_records.push_back(flow_header.release());
+            break;
+        }
+        default:
+            SkipBytes(record_len);
+            break;
+        }
+    }
+    return 0;
+}
+
+int SFlowParser::ReadSFlowFlowHeader(SFlowFlowHeader& flow_header) {
+    if (flow_header.length < SFlowFlowHeader::kFlowHeaderInfoLen) {
+        SFLOW_PARSE_ERROR("Flow header record too short: " <<
+            flow_header.length);
+        return -1;
+    }
+    ReadData32(flow_header.protocol);
+    ReadData32(flow_header.frame_length);
+    ReadData32(flow_header.stripped);
+    ReadData32(flow_header.header_length);
+    if (XdrPad(flow_header.header_length) !=
+        flow_header.length - SFlowFlowHeader::kFlowHeaderInfoLen) {
+        SFLOW_PARSE_ERROR("Flow header length mismatch: " <<
+            flow_header.header_length << ", record length: " <<
+            flow_header.length);
+        return -1;
+    }
+    flow_header.header = const_cast<uint8_t*>(decode_ptr_);
+    SkipBytes(XdrPad(flow_header.header_length));
+    switch (flow_header.protocol) {
+    case SFLOW_FLOW_HEADER_ETHERNET_ISO8023:
+        DecodeLayer2Header(flow_header);
+        break;
+    case SFLOW_FLOW_HEADER_IPV4:
+        flow_header.is_ip_data_set = DecodeIpv4Header(flow_header.header,
+            flow_header.header_length, flow_header.decoded_ip_data);
+        break;
+    case SFLOW_FLOW_HEADER_IPV6:
+        flow_header.is_ip_data_set = DecodeIpv6Header(flow_header.header,
+            flow_header.header_length, flow_header.decoded_ip_data);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+// A truncated packet header is not an error, the parts that are present
+// are decoded.
+void SFlowParser::DecodeLayer2Header(SFlowFlowHeader& flow_header) const {
+    const uint8_t* hdr = flow_header.header;
+    size_t len = flow_header.header_length;
+    if (len < ETHER_HDR_LEN) {
+        return;
+    }
+    SFlowFlowEthernetData& eth_data = flow_header.decoded_eth_data;
+    eth_data.dst_mac = MacAddress(hdr);
+    eth_data.src_mac = MacAddress(hdr + ETHER_ADDR_LEN);
+    eth_data.ether_type = Get16(hdr + ETHER_ADDR_LEN * 2);
+    size_t offset = ETHER_HDR_LEN;
+    if (eth_data.ether_type == ETHERTYPE_VLAN) {
+        if (len < ETHER_HDR_LEN + 4) {
+            return;
+        }
+        eth_data.vlan_id = Get16(hdr + ETHER_HDR_LEN) & 0xFFF;
+        eth_data.ether_type = Get16(hdr + ETHER_HDR_LEN + 2);
+        offset += 4;
+    }
+    flow_header.is_eth_data_set = true;
+    switch (eth_data.ether_type) {
+    case ETHERTYPE_IP:
+        flow_header.is_ip_data_set = DecodeIpv4Header(hdr + offset,
+            len - offset, flow_header.decoded_ip_data);
+        break;
+    case ETHERTYPE_IPV6:
+        flow_header.is_ip_data_set = DecodeIpv6Header(hdr + offset,
+            len - offset, flow_header.decoded_ip_data);
+        break;
+    default:
+        break;
+    }
+}
+
+bool SFlowParser::DecodeIpv4Header(const uint8_t* hdr, size_t len,
+                                   SFlowFlowIpData& ip_data) const {
+    if (len < sizeof(struct ip)) {
+        return false;
+    }
+    size_t hdr_len = (hdr[0] & 0x0F) * 4;
+    if ((hdr[0] >> 4) != 4 || hdr_len < sizeof(struct ip) || len < hdr_len) {
+        return false;
+    }
+    ip_data.tos = hdr[1];
+    ip_data.length = Get16(hdr + 2);
+    ip_data.protocol = hdr[9];
+    ip_data.src_ip = Ip4Address(Get32(hdr + 12));
+    ip_data.dst_ip = Ip4Address(Get32(hdr + 16));
+    // Only the first fragment carries the layer 4 header
+    if (Get16(hdr + 6) & IP_OFFMASK) {
+        return true;
+    }
+    return DecodeLayer4Header(hdr + hdr_len, len - hdr_len, ip_data);
+}
+
+bool SFlowParser::DecodeIpv6Header(const uint8_t* hdr, size_t len,
+                                   SFlowFlowIpData& ip_data) const {
+    if (len < sizeof(struct ip6_hdr) || (hdr[0] >> 4) != 6) {
+        return false;
+    }
+    Ip6Address::bytes_type src, dst;
+    memcpy(src.data(), hdr + 8, src.size());
+    memcpy(dst.data(), hdr + 24, dst.size());
+    ip_data.tos = (Get16(hdr) >> 4) & 0xFF;
+    ip_data.length = Get16(hdr + 4) + sizeof(struct ip6_hdr);
+    ip_data.protocol = hdr[6];
+    ip_data.src_ip = Ip6Address(src);
+    ip_data.dst_ip = Ip6Address(dst);
+    return DecodeLayer4Header(hdr + sizeof(struct ip6_hdr),
+                              len - sizeof(struct ip6_hdr), ip_data);
+}
+
+bool SFlowParser::DecodeLayer4Header(const uint8_t* hdr, size_t len,
+                                     SFlowFlowIpData& ip_data) const {
+    switch (ip_data.protocol) {
+    case IPPROTO_TCP:
+        if (len < sizeof(struct tcphdr)) {
+            return false;
+        }
+        ip_data.src_port = Get16(hdr);
+        ip_data.dst_port = Get16(hdr + 2);
+        ip_data.tcp_flags = hdr[13];
+        break;
+    case IPPROTO_UDP:
+        if (len < sizeof(struct udphdr)) {
+            return false;
+        }
+        ip_data.src_port = Get16(hdr);
+        ip_data.dst_port = Get16(hdr + 2);
+        break;
+    case IPPROTO_ICMP:
+        if (len < sizeof(struct icmp)) {
+            return false;
+        }
+        // Use the icmp type as the destination port
+        ip_data.src_port = 0;
+        ip_data.dst_port = hdr[0];
+        break;
+    default:
+        ip_data.src_port = 0;
+        ip_data.dst_port = 0;
+        break;
+    }
+    return true;
+}
+
+int SFlowParser::ReadData32(uint32_t& data) {
+    if (!VerifyLength(sizeof(data))) {
+        return -1;
+    }
+    data = Get32(decode_ptr_);
+    decode_ptr_ += sizeof(data);
+    return 0;
+}
+
+int SFlowParser::ReadIpaddress(IpAddress& ipaddr) {
+    uint32_t ipaddr_type;
+    if (ReadData32(ipaddr_type) < 0) {
+        return -1;
+    }
+    switch (ipaddr_type) {
+    case SFLOW_IPADDR_V4: {
+        uint32_t addr;
+        if (ReadData32(addr) < 0) {
+            return -1;
+        }
+        ipaddr = Ip4Address(addr);
+        return 0;
+    }
+    case SFLOW_IPADDR_V6: {
+        Ip6Address::bytes_type addr;
+        if (!VerifyLength(addr.size())) {
+            return -1;
+        }
+        memcpy(addr.data(), decode_ptr_, addr.size());
+        decode_ptr_ += addr.size();
+        ipaddr = Ip6Address(addr);
+        return 0;
+    }
+    default:
+        SFLOW_PARSE_ERROR("Invalid ip address type: " << ipaddr_type);
+        return -1;
+    }
+}
+
+int SFlowParser::SkipBytes(size_t len) {
+    if (!VerifyLength(len)) {
+        return -1;
+    }
+    decode_ptr_ += len;
+    return 0;
+}
+
+bool SFlowParser::VerifyLength(size_t len) const {
+    return len <= static_cast<size_t>(end_ptr_ - decode_ptr_);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2015 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __SFLOW_PARSER_H__
+#define __SFLOW_PARSER_H__
+
+#include <base/util.h>
+#include <sandesh/sandesh_trace.h>
+
+#include "sflow.h"
+
+//
+// Decodes an sFlow v5 datagram [http://sflow.org/sflow_version_5.txt].
+//
+// Flow samples carrying a raw packet header are decoded up to layer 4;
+// all other samples and flow records are skipped. The decoded raw
+// packet header (SFlowFlowHeader::header) points into the datagram, so
+// the datagram must outlive the parsed SFlowData.
+//
+class SFlowParser {
+public:
+    static const uint32_t kSFlowVersion5 = 5;
+
+    explicit SFlowParser(const uint8_t* buf, size_t len,
+                         SandeshTraceBufferPtr trace_buf);
+    ~SFlowParser();
+    // Returns 0 on success and -1 if the datagram is malformed
+    int Parse(SFlowData* const sflow_data);
+
+private:
+    int ReadSFlowHeader(SFlowHeader& sflow_header);
+    int ReadSFlowFlowSample(SFlowFlowSample& flow_sample);
+    int ReadSFlowFlowHeader(SFlowFlowHeader& flow_header);
+    void DecodeLayer2Header(SFlowFlowHeader& flow_header) const;
+    bool DecodeIpv4Header(const uint8_t* hdr, size_t len,
+                          SFlowFlowIpData& ip_data) const;
+    bool DecodeIpv6Header(const uint8_t* hdr, size_t len,
+                          SFlowFlowIpData& ip_data) const;
+    bool DecodeLayer4Header(const uint8_t* hdr, size_t len,
+                            SFlowFlowIpData& ip_data) const;
+    int ReadData32(uint32_t& data);
+    int ReadIpaddress(IpAddress& ipaddr);
+    int SkipBytes(size_t len);
+    bool VerifyLength(size_t len) const;
+
+    const uint8_t* const raw_datagram_;
+    const uint8_t* decode_ptr_;
+    const uint8_t* end_ptr_;
+    SandeshTraceBufferPtr trace_buf_;
+
+    DISALLOW_COPY_AND_ASSIGN(SFlowParser);
+};
+
+#endif // __SFLOW_PARSER_H__
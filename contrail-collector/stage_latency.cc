@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <analytics/collector_uve_types.h>
+
+#include "stage_latency.h"
+
+StageLatency StageLatency::instance_;
+
+namespace {
+
+const char *kStageNames[] = {
+    "ReceiveSandeshMsg",
+    "rule_execute",
+    "remove_identifier",
+    "handle_uve_publish",
+    "handle_object_log",
+    "MessageTableInsert",
+    "handle_uve_statistics",
+    "handle_session_object",
+    "DbWrite",
+};
+
+// Only the owning thread updates the counter, a relaxed load and store
+// does not need a locked instruction
+inline void Add(tbb::atomic<uint64_t> *counter, uint64_t value) {
+    counter->store<tbb::relaxed>(counter->load<tbb::relaxed>() + value);
+}
+
+}  // namespace
+
+StageLatency::ThreadHistograms::ThreadHistograms() {
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        count[stage] = 0;
+        sum_usec[stage] = 0;
+        max_usec[stage] = 0;
+        for (size_t idx = 0; idx < kNumBuckets; idx++) {
+            buckets[stage][idx] = 0;
+        }
+    }
+}
+
+uint64_t StageLatency::Histogram::Percentile(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank(static_cast<uint64_t>(p * count));
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen(0);
+    for (size_t idx = 0; idx < kNumBuckets - 1; idx++) {
+        seen += buckets[idx];
+        if (seen >= rank) {
+            // Upper bound of the bucket
+            uint64_t usec(BucketLowerBound(idx + 1) - 1);
+            return usec < max_usec ? usec : max_usec;
+        }
+    }
+    return max_usec;
+}
+
+void StageLatency::Histogram::Subtract(const Histogram &rhs) {
+    count -= rhs.count;
+    sum_usec -= rhs.sum_usec;
+    size_t last(0);
+    for (size_t idx = 0; idx < kNumBuckets; idx++) {
+        buckets[idx] -= rhs.buckets[idx];
+        if (buckets[idx]) {
+            last = idx;
+        }
+    }
+    // The maximum is not known per interval, bound it by the highest
+    // bucket of the interval
+    if (count && last < kNumBuckets - 1) {
+        uint64_t usec(BucketLowerBound(last + 1) - 1);
+        if (usec < max_usec) {
+            max_usec = usec;
+        }
+    } else if (count == 0) {
+        max_usec = 0;
+    }
+}
+
+StageLatency::StageLatency() :
+    last_histograms_(NUM_STAGES) {
+}
+
+StageLatency::~StageLatency() {
+}
+
+const char *StageLatency::StageName(Stage stage) {
+    return kStageNames[stage];
+}
+
+size_t StageLatency::BucketIndex(uint64_t usec) {
+    if (usec < kSubBuckets) {
+        return usec;
+    }
+    int msb(63 - __builtin_clzll(usec));
+    size_t idx((msb - kSubBucketBits + 1) * kSubBuckets +
+        ((usec >> (msb - kSubBucketBits)) & (kSubBuckets - 1)));
+    return idx < kNumBuckets ? idx : kNumBuckets - 1;
+}
+
+uint64_t StageLatency::BucketLowerBound(size_t idx) {
+    if (idx < kSubBuckets) {
+        return idx;
+    }
+    size_t group(idx / kSubBuckets);
+    return (kSubBuckets + idx % kSubBuckets) << (group - 1);
+}
+
+void StageLatency::Record(Stage stage, uint64_t usec) {
+    bool exists;
+    ThreadHistograms &histograms(thread_histograms_.local(exists));
+    if (!exists) {
+        tbb::mutex::scoped_lock lock(mutex_);
+        threads_.push_back(&histograms);
+    }
+    Add(&histograms.count[stage], 1);
+    Add(&histograms.sum_usec[stage], usec);
+    if (usec > histograms.max_usec[stage].load<tbb::relaxed>()) {
+        histograms.max_usec[stage].store<tbb::relaxed>(usec);
+    }
+    Add(&histograms.buckets[stage][BucketIndex(usec)], 1);
+}
+
+void StageLatency::Merge(std::vector<Histogram> *histograms) const {
+    histograms->assign(NUM_STAGES, Histogram());
+    for (size_t tidx = 0; tidx < threads_.size(); tidx++) {
+        const ThreadHistograms *thistograms(threads_[tidx]);
+        for (int stage = 0; stage < NUM_STAGES; stage++) {
+            Histogram &histogram((*histograms)[stage]);
+            histogram.count += thistograms->count[stage];
+            histogram.sum_usec += thistograms->sum_usec[stage];
+            uint64_t max_usec(thistograms->max_usec[stage]);
+            if (max_usec > histogram.max_usec) {
+                histogram.max_usec = max_usec;
+            }
+            for (size_t idx = 0; idx < kNumBuckets; idx++) {
+                histogram.buckets[idx] += thistograms->buckets[stage][idx];
+            }
+        }
+    }
+}
+
+void StageLatency::GetHistograms(std::vector<Histogram> *histograms) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    Merge(histograms);
+}
+
+void StageLatency::GetDiffs(std::vector<Histogram> *histograms) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    std::vector<Histogram> current;
+    Merge(&current);
+    *histograms = current;
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        (*histograms)[stage].Subtract(last_histograms_[stage]);
+    }
+    last_histograms_.swap(current);
+}
+
+void StageLatency::FillInfo(const std::vector<Histogram> &histograms,
+    bool with_buckets, std::map<std::string, StageLatencyInfo> *info) {
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        const Histogram &histogram(histograms[stage]);
+        StageLatencyInfo sinfo;
+        sinfo.set_count(histogram.count);
+        sinfo.set_avg_usec(histogram.count ?
+            histogram.sum_usec / histogram.count : 0);
+        sinfo.set_p50_usec(histogram.Percentile(0.50));
+        sinfo.set_p99_usec(histogram.Percentile(0.99));
+        sinfo.set_max_usec(histogram.max_usec);
+        if (with_buckets) {
+            std::vector<StageLatencyBucket> buckets;
+            for (size_t idx = 0; idx < kNumBuckets; idx++) {
+                if (histogram.buckets[idx] == 0) {
+                    continue;
+                }
+                StageLatencyBucket bucket;
+                bucket.set_lower_usec(BucketLowerBound(idx));
+                bucket.set_count(histogram.buckets[idx]);
+                buckets.push_back(bucket);
+            }
+            sinfo.set_buckets(buckets);
+        }
+        info->insert(std::make_pair(StageName(static_cast<Stage>(stage)),
+            sinfo));
+    }
+}
+
+void StageLatency::GetStageLatencyInfo(
+    std::map<std::string, StageLatencyInfo> *info) const {
+    std::vector<Histogram> histograms;
+    GetHistograms(&histograms);
+    FillInfo(histograms, true, info);
+}
+
+void StageLatency::GetStageLatencyDiffs(
+    std::map<std::string, StageLatencyInfo> *info) {
+    std::vector<Histogram> histograms;
+    GetDiffs(&histograms);
+    FillInfo(histograms, false, info);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __STAGE_LATENCY_H__
+#define __STAGE_LATENCY_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <tbb/atomic.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/mutex.h>
+
+#include <base/time_util.h>
+#include <base/util.h>
+
+class StageLatencyInfo;
+
+//
+// Latency histograms of the collector processing stages, from the
+// reception of a Sandesh message down to the completion of its database
+// writes.
+//
+// The histograms are log-linear: every power of two range of latencies,
+// in usec, is split in kSubBuckets buckets of equal width, so that the
+// relative error of a percentile is bounded by 1 / kSubBuckets. Each
+// thread records in histograms of its own, the histograms of all the
+// threads are merged when read.
+//
+class StageLatency {
+public:
+    enum Stage {
+        RECEIVE_SANDESH_MSG,
+        RULE_EXECUTE,
+        REMOVE_IDENTIFIER,
+        UVE_PUBLISH,
+        OBJECT_LOG,
+        MESSAGE_TABLE_INSERT,
+        UVE_STATISTICS,
+        SESSION_OBJECT,
+        // From the database write enqueue to its callback
+        DB_WRITE,
+        NUM_STAGES,
+    };
+
+    static const int kSubBucketBits = 2;
+    static const uint64_t kSubBuckets = 1 << kSubBucketBits;
+    // Latencies of 2^32 usec and more fall in the last bucket
+    static const size_t kNumBuckets = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+    struct Histogram {
+        Histogram() : count(0), sum_usec(0), max_usec(0),
+            buckets(kNumBuckets, 0) {
+        }
+        uint64_t Percentile(double p) const;
+        void Subtract(const Histogram &rhs);
+
+        uint64_t count;
+        uint64_t sum_usec;
+        uint64_t max_usec;
+        std::vector<uint64_t> buckets;
+    };
+
+    StageLatency();
+    ~StageLatency();
+
+    static StageLatency *GetInstance() { return &instance_; }
+    static const char *StageName(Stage stage);
+    static size_t BucketIndex(uint64_t usec);
+    static uint64_t BucketLowerBound(size_t idx);
+
+    void Record(Stage stage, uint64_t usec);
+    // Histograms since the collector started, indexed by Stage
+    void GetHistograms(std::vector<Histogram> *histograms) const;
+    // Histograms since the last call, indexed by Stage
+    void GetDiffs(std::vector<Histogram> *histograms);
+
+    // Latencies since the collector started, with the histograms
+    void GetStageLatencyInfo(
+        std::map<std::string, StageLatencyInfo> *info) const;
+    // Latencies since the last call, without the histograms
+    void GetStageLatencyDiffs(std::map<std::string, StageLatencyInfo> *info);
+
+private:
+    // Written by the owning thread only, the atomics let the readers load
+    // the counters while they are updated
+    struct ThreadHistograms {
+        ThreadHistograms();
+        tbb::atomic<uint64_t> count[NUM_STAGES];
+        tbb::atomic<uint64_t> sum_usec[NUM_STAGES];
+        tbb::atomic<uint64_t> max_usec[NUM_STAGES];
+        tbb::atomic<uint64_t> buckets[NUM_STAGES][kNumBuckets];
+    };
+    typedef tbb::enumerable_thread_specific<ThreadHistograms>
+        ThreadHistogramsMap;
+
+    // Sums the histograms of all the threads, called with mutex_ held
+    void Merge(std::vector<Histogram> *histograms) const;
+    static void FillInfo(const std::vector<Histogram> &histograms,
+        bool with_buckets, std::map<std::string, StageLatencyInfo> *info);
+
+    static StageLatency instance_;
+
+    ThreadHistogramsMap thread_histograms_;
+    // Protects the threads and histograms below
+    mutable tbb::mutex mutex_;
+    std::vector<ThreadHistograms *> threads_;
+    // Histograms reported by the last GetDiffs
+    std::vector<Histogram> last_histograms_;
+
+    DISALLOW_COPY_AND_ASSIGN(StageLatency);
+};
+
+//
+// Records the time spent in its scope as the latency of a stage
+//
+class StageLatencyTimer {
+public:
+    explicit StageLatencyTimer(StageLatency::Stage stage) :
+        stage_(stage),
+        start_usec_(UTCTimestampUsec()) {
+    }
+    ~StageLatencyTimer() {
+        uint64_t now_usec(UTCTimestampUsec());
+        StageLatency::GetInstance()->Record(stage_,
+            now_usec > start_usec_ ? now_usec - start_usec_ : 0);
+    }
+
+private:
+    const StageLatency::Stage stage_;
+    const uint64_t start_usec_;
+
+    DISALLOW_COPY_AND_ASSIGN(StageLatencyTimer);
+};
+
+#endif // __STAGE_LATENCY_H__
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <boost/bind.hpp>
+
+#include <base/logging.h>
+#include <base/task.h>
+#include <base/time_util.h>
+#include <base/timer.h>
+#include <io/event_manager.h>
+
+#include "viz_constants.h"
+#include "stat_table_store.h"
+#include "stat_table_db_if.h"
+
+const std::string StatTableDbIf::kTaskName("analytics::StatTableStore");
+
+namespace {
+
+// Reads a StatTable partition from the store, the callback is invoked
+// from the task rather than from the caller of Db_GetRowAsync, as it is
+// for the database reads
+class StatTableReadTask : public Task {
+public:
+    StatTableReadTask(StatTableStore *store, const std::string &cfname,
+        const GenDb::DbDataValueVec &rowkey,
+        const GenDb::ColumnNameRange &crange,
+        const GenDb::WhereIndexInfoVec &where_vec,
+        GenDb::GenDbIf::DbGetRowCb cb) :
+        Task(TaskScheduler::GetInstance()->GetTaskId(
+            StatTableDbIf::kTaskName)),
+        store_(store), cfname_(cfname), rowkey_(rowkey), crange_(crange),
+        where_vec_(where_vec), cb_(cb) {
+    }
+
+    virtual bool Run() {
+        std::auto_ptr<GenDb::ColList> col_list(new GenDb::ColList);
+        col_list->cfname_ = cfname_;
+        col_list->rowkey_ = rowkey_;
+        if (!store_->Read(rowkey_, crange_, where_vec_, col_list.get())) {
+            cb_(GenDb::DbOpResult::ERROR, std::auto_ptr<GenDb::ColList>());
+            return true;
+        }
+        cb_(GenDb::DbOpResult::OK, col_list);
+        return true;
+    }
+    std::string Description() const { return "StatTableReadTask"; }
+
+private:
+    StatTableStore *store_;
+    const std::string cfname_;
+    const GenDb::DbDataValueVec rowkey_;
+    const GenDb::ColumnNameRange crange_;
+    const GenDb::WhereIndexInfoVec where_vec_;
+    GenDb::GenDbIf::DbGetRowCb cb_;
+};
+
+}  // namespace
+
+StatTableDbIf::StatTableDbIf(EventManager *evm,
+    const std::vector<std::string> &cassandra_ips,
+    int cassandra_port,
+    const std::string &cassandra_user,
+    const std::string &cassandra_password,
+    bool use_ssl,
+    const std::string &ca_certs_path,
+    bool create_schema,
+    const std::string &stats_directory) :
+    cass::cql::CqlIf(evm, cassandra_ips, cassandra_port, cassandra_user,
+        cassandra_password, use_ssl, ca_certs_path, create_schema),
+    store_(new StatTableStore(stats_directory)),
+    flush_timer_(TimerManager::CreateTimer(*evm->io_service(),
+        "StatTableStore Flush Timer",
+        TaskScheduler::GetInstance()->GetTaskId(kTaskName))),
+    last_purge_usec_(0) {
+    max_ttl_ = 0;
+    flush_timer_->Start(kFlushInterval,
+        boost::bind(&StatTableDbIf::FlushTimerExpired, this),
+        boost::bind(&StatTableDbIf::FlushTimerErrorHandler, this, _1, _2));
+}
+
+StatTableDbIf::~StatTableDbIf() {
+    TimerManager::DeleteTimer(flush_timer_);
+    flush_timer_ = NULL;
+    store_->Flush();
+}
+
+bool StatTableDbIf::Db_Init() {
+    if (!store_->Initialize()) {
+        return false;
+    }
+    return cass::cql::CqlIf::Db_Init();
+}
+
+void StatTableDbIf::Db_Uninit() {
+    store_->Flush();
+    cass::cql::CqlIf::Db_Uninit();
+}
+
+bool StatTableDbIf::Db_AddColumn(std::auto_ptr<GenDb::ColList> cl,
+    GenDb::DbConsistency::type dconsistency,
+    GenDb::GenDbIf::DbAddColumnCb cb) {
+    if (cl->cfname_ != g_viz_constants.STATS_TABLE) {
+        return cass::cql::CqlIf::Db_AddColumn(cl, dconsistency, cb);
+    }
+    if (!Db_AddColumnSync(cl, dconsistency)) {
+        return false;
+    }
+    if (!cb.empty()) {
+        cb(GenDb::DbOpResult::OK);
+    }
+    return true;
+}
+
+bool StatTableDbIf::Db_AddColumnSync(std::auto_ptr<GenDb::ColList> cl,
+    GenDb::DbConsistency::type dconsistency) {
+    if (cl->cfname_ != g_viz_constants.STATS_TABLE) {
+        return cass::cql::CqlIf::Db_AddColumnSync(cl, dconsistency);
+    }
+    for (GenDb::NewColVec::const_iterator it = cl->columns_.begin();
+         it != cl->columns_.end(); ++it) {
+        if (it->ttl > max_ttl_) {
+            max_ttl_ = it->ttl;
+        }
+    }
+    return store_->Write(*cl);
+}
+
+bool StatTableDbIf::Db_GetRowAsync(const std::string &cfname,
+    const GenDb::DbDataValueVec &rowkey,
+    const GenDb::ColumnNameRange &crange,
+    GenDb::DbConsistency::type dconsistency,
+    GenDb::GenDbIf::DbGetRowCb cb) {
+    return Db_GetRowAsync(cfname, rowkey, crange, GenDb::WhereIndexInfoVec(),
+        dconsistency, cb);
+}
+
+bool StatTableDbIf::Db_GetRowAsync(const std::string &cfname,
+    const GenDb::DbDataValueVec &rowkey,
+    const GenDb::ColumnNameRange &crange,
+    const GenDb::WhereIndexInfoVec &where_vec,
+    GenDb::DbConsistency::type dconsistency,
+    GenDb::GenDbIf::DbGetRowCb cb) {
+    if (cfname != g_viz_constants.STATS_TABLE) {
+        if (where_vec.empty()) {
+            return cass::cql::CqlIf::Db_GetRowAsync(cfname, rowkey, crange,
+                dconsistency, cb);
+        }
+        return cass::cql::CqlIf::Db_GetRowAsync(cfname, rowkey, crange,
+            where_vec, dconsistency, cb);
+    }
+    TaskScheduler::GetInstance()->Enqueue(new StatTableReadTask(store_.get(),
+        cfname, rowkey, crange, where_vec, cb));
+    return true;
+}
+
+bool StatTableDbIf::FlushTimerExpired() {
+    store_->Flush();
+    uint64_t now_usec(UTCTimestampUsec());
+    if (max_ttl_ > 0 &&
+        now_usec - last_purge_usec_ >= kPurgeInterval * 1000ULL) {
+        last_purge_usec_ = now_usec;
+        // Partitions whose last row expired before now
+        uint64_t expired_usec(now_usec - max_ttl_ * 1000000ULL);
+        store_->Purge(expired_usec >> g_viz_constants.RowTimeInBits);
+    }
+    return true;
+}
+
+void StatTableDbIf::FlushTimerErrorHandler(std::string error_name,
+    std::string error_message) {
+    LOG(ERROR, "StatTableDbIf: Flush Timer Error: " << error_name << " " <<
+        error_message);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __STAT_TABLE_DB_IF_H__
+#define __STAT_TABLE_DB_IF_H__
+
+#include <boost/scoped_ptr.hpp>
+#include <tbb/atomic.h>
+
+#include <database/cassandra/cql/cql_if.h>
+
+class EventManager;
+class StatTableStore;
+class Timer;
+
+//
+// Database interface keeping the StatTable in a local StatTableStore,
+// the other tables are kept in the database.
+//
+// The rows written are flushed to the store periodically, and the
+// partitions are removed once all their rows have expired.
+//
+class StatTableDbIf : public cass::cql::CqlIf {
+public:
+    static const int kFlushInterval = 1000; // ms
+    static const int kPurgeInterval = 60 * 1000; // ms
+    static const std::string kTaskName;
+
+    StatTableDbIf(EventManager *evm,
+        const std::vector<std::string> &cassandra_ips,
+        int cassandra_port,
+        const std::string &cassandra_user,
+        const std::string &cassandra_password,
+        bool use_ssl,
+        const std::string &ca_certs_path,
+        bool create_schema,
+        const std::string &stats_directory);
+    virtual ~StatTableDbIf();
+
+    virtual bool Db_Init();
+    virtual void Db_Uninit();
+    virtual bool Db_AddColumn(std::auto_ptr<GenDb::ColList> cl,
+        GenDb::DbConsistency::type dconsistency,
+        GenDb::GenDbIf::DbAddColumnCb cb);
+    virtual bool Db_AddColumnSync(std::auto_ptr<GenDb::ColList> cl,
+        GenDb::DbConsistency::type dconsistency);
+    virtual bool Db_GetRowAsync(const std::string &cfname,
+        const GenDb::DbDataValueVec &rowkey,
+        const GenDb::ColumnNameRange &crange,
+        GenDb::DbConsistency::type dconsistency,
+        GenDb::GenDbIf::DbGetRowCb cb);
+    virtual bool Db_GetRowAsync(const std::string &cfname,
+        const GenDb::DbDataValueVec &rowkey,
+        const GenDb::ColumnNameRange &crange,
+        const GenDb::WhereIndexInfoVec &where_vec,
+        GenDb::DbConsistency::type dconsistency,
+        GenDb::GenDbIf::DbGetRowCb cb);
+
+    StatTableStore *store() { return store_.get(); }
+
+private:
+    bool FlushTimerExpired();
+    void FlushTimerErrorHandler(std::string error_name,
+        std::string error_message);
+
+    boost::scoped_ptr<StatTableStore> store_;
+    Timer *flush_timer_;
+    uint64_t last_purge_usec_;
+    // Largest TTL of the rows written, in seconds
+    tbb::atomic<int> max_ttl_;
+};
+
+#endif // __STAT_TABLE_DB_IF_H__
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <boost/functional/hash.hpp>
+
+#include "stat_table_db_stats.h"
+
+namespace {
+
+// Looks up a table without building a StatTableDbStats::TableKey
+struct TableKeyRef {
+    TableKeyRef(const std::string &name, const std::string &attr) :
+        name(name), attr(attr) {
+    }
+    const std::string &name;
+    const std::string &attr;
+};
+
+size_t TableHash(const std::string &name, const std::string &attr) {
+    size_t seed(0);
+    boost::hash_combine(seed, name);
+    boost::hash_combine(seed, attr);
+    return seed;
+}
+
+struct TableKeyRefHash {
+    size_t operator()(const TableKeyRef &key) const {
+        return TableHash(key.name, key.attr);
+    }
+};
+
+struct TableKeyRefEqual {
+    bool operator()(const TableKeyRef &lhs,
+        const std::pair<std::string, std::string> &rhs) const {
+        return lhs.name == rhs.first && lhs.attr == rhs.second;
+    }
+    bool operator()(const std::pair<std::string, std::string> &lhs,
+        const TableKeyRef &rhs) const {
+        return (*this)(rhs, lhs);
+    }
+};
+
+}  // namespace
+
+size_t StatTableDbStats::TableKeyHash::operator()(const TableKey &key) const {
+    return TableHash(key.first, key.second);
+}
+
+StatTableDbStats::StatTableDbStats() {
+}
+
+StatTableDbStats::~StatTableDbStats() {
+}
+
+uint32_t StatTableDbStats::TableId(ThreadStats *tstats,
+    const std::string &stat_name, const std::string &stat_attr) {
+    TableIdMap::const_iterator it(tstats->ids.find(
+        TableKeyRef(stat_name, stat_attr), TableKeyRefHash(),
+        TableKeyRefEqual()));
+    if (it != tstats->ids.end()) {
+        return it->second;
+    }
+    // First write of the table by the thread
+    TableKey key(stat_name, stat_attr);
+    uint32_t id;
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        std::pair<TableIdMap::iterator, bool> result(table_ids_.insert(
+            std::make_pair(key, static_cast<uint32_t>(table_names_.size()))));
+        if (result.second) {
+            table_names_.push_back(stat_name + ":" + stat_attr);
+        }
+        id = result.first->second;
+    }
+    tstats->ids.insert(std::make_pair(key, id));
+    return id;
+}
+
+void StatTableDbStats::Update(const std::string &stat_name,
+    const std::string &stat_attr, bool write_fail) {
+    bool exists;
+    ThreadStats &tstats(thread_stats_.local(exists));
+    if (!exists) {
+        tbb::mutex::scoped_lock lock(mutex_);
+        threads_.push_back(&tstats);
+    }
+    uint32_t id(TableId(&tstats, stat_name, stat_attr));
+    tbb::spin_mutex::scoped_lock lock(tstats.mutex);
+    if (id >= tstats.counters.size()) {
+        tstats.counters.resize(id + 1);
+    }
+    Counters &counters(tstats.counters[id]);
+    if (write_fail) {
+        counters.write_fails++;
+    } else {
+        counters.writes++;
+    }
+}
+
+void StatTableDbStats::Merge(CountersVec *counters) const {
+    counters->assign(table_names_.size(), Counters());
+    for (size_t idx = 0; idx < threads_.size(); idx++) {
+        ThreadStats *tstats(threads_[idx]);
+        tbb::spin_mutex::scoped_lock lock(tstats->mutex);
+        for (size_t id = 0; id < tstats->counters.size(); id++) {
+            (*counters)[id].writes += tstats->counters[id].writes;
+            (*counters)[id].write_fails += tstats->counters[id].write_fails;
+        }
+    }
+}
+
+void StatTableDbStats::Fill(const CountersVec &counters,
+    const CountersVec *last, std::vector<GenDb::DbTableInfo> *vdbti) const {
+    for (size_t id = 0; id < counters.size(); id++) {
+        uint64_t writes(counters[id].writes);
+        uint64_t write_fails(counters[id].write_fails);
+        if (last) {
+            if (id < last->size()) {
+                writes -= (*last)[id].writes;
+                write_fails -= (*last)[id].write_fails;
+            }
+            if (writes == 0 && write_fails == 0) {
+                continue;
+            }
+        }
+        GenDb::DbTableInfo info;
+        info.set_table_name(table_names_[id]);
+        info.set_reads(0);
+        info.set_read_fails(0);
+        info.set_writes(writes);
+        info.set_write_fails(write_fails);
+        info.set_write_back_pressure_fails(0);
+        vdbti->push_back(info);
+    }
+}
+
+void StatTableDbStats::GetDiffs(std::vector<GenDb::DbTableInfo> *vdbti) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    CountersVec counters;
+    Merge(&counters);
+    Fill(counters, &last_counters_, vdbti);
+    last_counters_.swap(counters);
+}
+
+void StatTableDbStats::GetCumulative(
+    std::vector<GenDb::DbTableInfo> *vdbti) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    CountersVec counters;
+    Merge(&counters);
+    Fill(counters, NULL, vdbti);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __STAT_TABLE_DB_STATS_H__
+#define __STAT_TABLE_DB_STATS_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+
+#include <base/util.h>
+#include "gendb_if.h"
+
+//
+// Database statistics of the StatTable writes, per (statName, statAttr).
+//
+// A write is counted by the writing thread in counters of its own,
+// indexed by an id interned for the (statName, statAttr) pair, so that
+// counting a write neither builds the table name nor takes a lock shared
+// with the other writers. The counters of all the threads are merged
+// when the statistics are read.
+//
+class StatTableDbStats {
+public:
+    StatTableDbStats();
+    ~StatTableDbStats();
+
+    void Update(const std::string &stat_name, const std::string &stat_attr,
+        bool write_fail);
+    // Tables written since the last call, with the writes since then
+    void GetDiffs(std::vector<GenDb::DbTableInfo> *vdbti);
+    void GetCumulative(std::vector<GenDb::DbTableInfo> *vdbti) const;
+
+private:
+    struct Counters {
+        Counters() : writes(0), write_fails(0) {
+        }
+        uint64_t writes;
+        uint64_t write_fails;
+    };
+    typedef std::vector<Counters> CountersVec;
+    typedef std::pair<std::string, std::string> TableKey;
+
+    struct TableKeyHash {
+        size_t operator()(const TableKey &key) const;
+    };
+    typedef boost::unordered_map<TableKey, uint32_t, TableKeyHash> TableIdMap;
+
+    struct ThreadStats {
+        // Ids already interned by the thread
+        TableIdMap ids;
+        // Taken by the thread to count, and by the readers to merge
+        tbb::spin_mutex mutex;
+        CountersVec counters;
+    };
+    typedef tbb::enumerable_thread_specific<ThreadStats> ThreadStatsMap;
+
+    uint32_t TableId(ThreadStats *tstats, const std::string &stat_name,
+        const std::string &stat_attr);
+    // Sums the counters of all the threads, called with mutex_ held
+    void Merge(CountersVec *counters) const;
+    void Fill(const CountersVec &counters, const CountersVec *last,
+        std::vector<GenDb::DbTableInfo> *vdbti) const;
+
+    ThreadStatsMap thread_stats_;
+    // Protects the tables and threads below
+    mutable tbb::mutex mutex_;
+    TableIdMap table_ids_;
+    // Table names, "statName:statAttr", indexed by id
+    std::vector<std::string> table_names_;
+    std::vector<ThreadStats *> threads_;
+    // Counters reported by the last GetDiffs
+    CountersVec last_counters_;
+
+    DISALLOW_COPY_AND_ASSIGN(StatTableDbStats);
+};
+
+#endif // __STAT_TABLE_DB_STATS_H__
@@ -0,0 +1,781 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+
+#include <base/logging.h>
+
+#include "stat_table_store.h"
+
+namespace {
+
+// Index of the first tag column, column4, in the StatTable column names
+const size_t kTagColumnBase = 3;
+const size_t kColumnNameSize = 10;
+const char kFileSuffix[] = ".sts";
+
+// Offsets in the block header
+const size_t kHeaderMagic = 0;
+const size_t kHeaderRows = 4;
+const size_t kHeaderBodyLen = 8;
+const size_t kHeaderCrc = 12;
+const size_t kHeaderValuesLen = 16;
+const size_t kHeaderValuesCompLen = 20;
+
+template <typename T>
+void Put(std::string *buf, T value) {
+    buf->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+T Load(const uint8_t *data) {
+    T value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Checksum(const uint8_t *data, size_t len) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, len);
+    return crc.checksum();
+}
+
+// Byte-wise comparison, the order of the UTF8 columns in the database
+int Compare(const char *lhs, size_t lhs_len, const std::string &rhs) {
+    size_t len(lhs_len < rhs.size() ? lhs_len : rhs.size());
+    int result(memcmp(lhs, rhs.data(), len));
+    if (result != 0) {
+        return result < 0 ? -1 : 1;
+    }
+    if (lhs_len == rhs.size()) {
+        return 0;
+    }
+    return lhs_len < rhs.size() ? -1 : 1;
+}
+
+// Database LIKE semantics, a leading or trailing % matches any string
+bool Like(const char *str, size_t len, const std::string &pattern) {
+    size_t begin(0), end(pattern.size());
+    bool prefix(false), suffix(false);
+    if (end > begin && pattern[end - 1] == '%') {
+        prefix = true;
+        end--;
+    }
+    if (end > begin && pattern[begin] == '%') {
+        suffix = true;
+        begin++;
+    }
+    size_t plen(end - begin);
+    const char *pstr(pattern.data() + begin);
+    if (plen > len) {
+        return false;
+    }
+    if (prefix && suffix) {
+        return std::search(str, str + len, pstr, pstr + plen) != str + len;
+    }
+    if (prefix) {
+        return memcmp(str, pstr, plen) == 0;
+    }
+    if (suffix) {
+        return memcmp(str + len - plen, pstr, plen) == 0;
+    }
+    return plen == len && memcmp(str, pstr, plen) == 0;
+}
+
+std::string Escape(const std::string &str) {
+    std::string escaped;
+    escaped.reserve(str.size());
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char c(str[i]);
+        if (isalnum(c) || c == '_' || c == '-') {
+            escaped += c;
+        } else {
+            char hex[4];
+            snprintf(hex, sizeof(hex), "%%%02X", c);
+            escaped += hex;
+        }
+    }
+    return escaped;
+}
+
+class Reader {
+public:
+    Reader(const uint8_t *data, size_t len) :
+        data_(data), len_(len), offset_(0) {
+    }
+
+    // Returns a pointer to the next len bytes
+    const uint8_t *Get(size_t len) {
+        if (len_ - offset_ < len) {
+            return NULL;
+        }
+        const uint8_t *data(data_ + offset_);
+        offset_ += len;
+        return data;
+    }
+
+    bool GetU32(uint32_t *value) {
+        const uint8_t *data(Get(sizeof(*value)));
+        if (data == NULL) {
+            return false;
+        }
+        *value = Load<uint32_t>(data);
+        return true;
+    }
+
+    size_t remaining() const { return len_ - offset_; }
+
+private:
+    const uint8_t *data_;
+    const size_t len_;
+    size_t offset_;
+};
+
+}  // namespace
+
+// Block mapped from a partition file
+struct StatTableStore::Block {
+    Block() :
+        rows(0), names(NULL), t1s(NULL), uuids(NULL), values_offsets(NULL),
+        values(NULL), values_len(0), values_comp_len(0) {
+        for (int i = 0; i < kTagColumns; i++) {
+            tags[i] = NULL;
+        }
+    }
+
+    bool Parse(const uint8_t *body, size_t body_len);
+    uint32_t Id(const uint8_t *column, uint32_t row) const {
+        return Load<uint32_t>(column + row * sizeof(uint32_t));
+    }
+
+    uint32_t rows;
+    // Dictionary strings
+    std::vector<std::pair<const char *, size_t> > dictionary;
+    const uint8_t *names;
+    const uint8_t *t1s;
+    const uint8_t *uuids;
+    const uint8_t *tags[kTagColumns];
+    const uint8_t *values_offsets;
+    const uint8_t *values;
+    uint32_t values_len;
+    uint32_t values_comp_len;
+};
+
+bool StatTableStore::Block::Parse(const uint8_t *body, size_t body_len) {
+    Reader reader(body, body_len);
+    uint32_t count;
+    if (!reader.GetU32(&count)) {
+        return false;
+    }
+    dictionary.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        const uint8_t *data;
+        if (!reader.GetU32(&len) || (data = reader.Get(len)) == NULL) {
+            return false;
+        }
+        dictionary.push_back(std::make_pair(
+            reinterpret_cast<const char *>(data), static_cast<size_t>(len)));
+    }
+    const size_t column_len(rows * sizeof(uint32_t));
+    if ((names = reader.Get(column_len)) == NULL ||
+        (t1s = reader.Get(column_len)) == NULL ||
+        (uuids = reader.Get(rows * boost::uuids::uuid::static_size())) ==
+            NULL) {
+        return false;
+    }
+    for (int i = 0; i < kTagColumns; i++) {
+        if ((tags[i] = reader.Get(column_len)) == NULL) {
+            return false;
+        }
+    }
+    if ((values_offsets = reader.Get(column_len)) == NULL ||
+        (values = reader.Get(values_comp_len)) == NULL ||
+        reader.remaining() != 0) {
+        return false;
+    }
+    // Check the dictionary ids and the value offsets once, so that the
+    // scan does not have to
+    uint32_t dictionary_size(dictionary.size());
+    uint32_t last_offset(0);
+    for (uint32_t row = 0; row < rows; row++) {
+        if (Id(names, row) >= dictionary_size) {
+            return false;
+        }
+        for (int i = 0; i < kTagColumns; i++) {
+            if (Id(tags[i], row) >= dictionary_size) {
+                return false;
+            }
+        }
+        uint32_t offset(Id(values_offsets, row));
+        if (offset < last_offset || offset > values_len) {
+            return false;
+        }
+        last_offset = offset;
+    }
+    return true;
+}
+
+// Where condition on one of the tag columns
+struct StatTableStore::Condition {
+    int column;
+    GenDb::Op::type op;
+    std::string value;
+    // Whether each dictionary string of the block being scanned matches
+    std::vector<bool> matches;
+};
+
+bool StatTableStore::Key::operator<(const Key &rhs) const {
+    if (t2 != rhs.t2) {
+        return t2 < rhs.t2;
+    }
+    if (partition != rhs.partition) {
+        return partition < rhs.partition;
+    }
+    if (name != rhs.name) {
+        return name < rhs.name;
+    }
+    return attr < rhs.attr;
+}
+
+StatTableStore::StatTableStore(const std::string &directory,
+    uint32_t max_block_rows) :
+    directory_(directory),
+    max_block_rows_(max_block_rows) {
+}
+
+StatTableStore::~StatTableStore() {
+}
+
+bool StatTableStore::Initialize() {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory_, ec);
+    if (ec) {
+        LOG(ERROR, "StatTableStore: " << directory_ <<
+            " create FAILED: " << ec.message());
+        return false;
+    }
+    return true;
+}
+
+bool StatTableStore::ParseKey(const GenDb::DbDataValueVec &rowkey,
+    Key *key) {
+    if (rowkey.size() != 4) {
+        return false;
+    }
+    const uint32_t *t2(boost::get<uint32_t>(&rowkey[0]));
+    const uint8_t *partition(boost::get<uint8_t>(&rowkey[1]));
+    const std::string *name(boost::get<std::string>(&rowkey[2]));
+    const std::string *attr(boost::get<std::string>(&rowkey[3]));
+    if (t2 == NULL || partition == NULL || name == NULL || attr == NULL) {
+        return false;
+    }
+    key->t2 = *t2;
+    key->partition = *partition;
+    key->name = *name;
+    key->attr = *attr;
+    return true;
+}
+
+bool StatTableStore::Write(const GenDb::ColList &col_list) {
+    Key key;
+    if (!ParseKey(col_list.rowkey_, &key)) {
+        LOG(ERROR, "StatTableStore: " << col_list.cfname_ <<
+            ": Invalid row key");
+        return false;
+    }
+    RowVec rows;
+    rows.reserve(col_list.columns_.size());
+    for (GenDb::NewColVec::const_iterator it = col_list.columns_.begin();
+         it != col_list.columns_.end(); ++it) {
+        const GenDb::DbDataValueVec &name(*it->name);
+        const GenDb::DbDataValueVec &value(*it->value);
+        if (name.size() != kColumnNameSize || value.size() != 1) {
+            LOG(ERROR, "StatTableStore: " << key.name << ":" << key.attr <<
+                ": Invalid column");
+            return false;
+        }
+        rows.push_back(Row());
+        Row &row(rows.back());
+        const std::string *sname(boost::get<std::string>(&name[0]));
+        const uint32_t *t1(boost::get<uint32_t>(&name[1]));
+        const boost::uuids::uuid *uuid(
+            boost::get<boost::uuids::uuid>(&name[2]));
+        const std::string *svalue(boost::get<std::string>(&value[0]));
+        if (sname == NULL || t1 == NULL || uuid == NULL || svalue == NULL) {
+            LOG(ERROR, "StatTableStore: " << key.name << ":" << key.attr <<
+                ": Invalid column type");
+            return false;
+        }
+        row.name = *sname;
+        row.t1 = *t1;
+        row.uuid = *uuid;
+        row.value = *svalue;
+        for (int i = 0; i < kTagColumns; i++) {
+            const std::string *tag(
+                boost::get<std::string>(&name[kTagColumnBase + i]));
+            if (tag == NULL) {
+                LOG(ERROR, "StatTableStore: " << key.name << ":" <<
+                    key.attr << ": Invalid column type");
+                return false;
+            }
+            row.tags[i] = *tag;
+        }
+    }
+    tbb::mutex::scoped_lock lock(mutex_);
+    RowVec &pending(rows_[key]);
+    pending.insert(pending.end(), rows.begin(), rows.end());
+    return true;
+}
+
+bool StatTableStore::Flush() {
+    tbb::mutex::scoped_lock flush_lock(flush_mutex_);
+    RowMap rows;
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        rows.swap(rows_);
+    }
+    bool success(true);
+    for (RowMap::const_iterator it = rows.begin(); it != rows.end(); ++it) {
+        const RowVec &krows(it->second);
+        for (size_t begin = 0; begin < krows.size();
+             begin += max_block_rows_) {
+            size_t end(begin + max_block_rows_);
+            if (end > krows.size()) {
+                end = krows.size();
+            }
+            if (!WriteBlock(it->first, krows, begin, end)) {
+                tbb::mutex::scoped_lock lock(mutex_);
+                stats_.write_fails += end - begin;
+                success = false;
+            }
+        }
+    }
+    return success;
+}
+
+bool StatTableStore::WriteBlock(const Key &key, const RowVec &rows,
+    size_t begin, size_t end) {
+    typedef std::map<std::string, uint32_t> Dictionary;
+    Dictionary dictionary;
+    std::vector<const std::string *> strings;
+    uint32_t nrows(end - begin);
+    std::vector<uint32_t> ids((1 + kTagColumns) * nrows);
+    std::string values;
+    std::string values_offsets;
+    for (size_t i = begin; i < end; i++) {
+        const Row &row(rows[i]);
+        for (int column = 0; column <= kTagColumns; column++) {
+            const std::string &str(column == 0 ? row.name :
+                row.tags[column - 1]);
+            std::pair<Dictionary::iterator, bool> result(dictionary.insert(
+                std::make_pair(str, static_cast<uint32_t>(strings.size()))));
+            if (result.second) {
+                strings.push_back(&result.first->first);
+            }
+            ids[column * nrows + i - begin] = result.first->second;
+        }
+        values.append(row.value);
+        Put(&values_offsets, static_cast<uint32_t>(values.size()));
+    }
+
+    uLongf values_comp_len(compressBound(values.size()));
+    std::string values_comp(values_comp_len, '\0');
+    if (compress2(reinterpret_cast<Bytef *>(&values_comp[0]),
+            &values_comp_len, reinterpret_cast<const Bytef *>(values.data()),
+            values.size(), Z_BEST_SPEED) != Z_OK) {
+        LOG(ERROR, "StatTableStore: " << key.name << ":" << key.attr <<
+            ": Compress FAILED");
+        return false;
+    }
+    values_comp.resize(values_comp_len);
+
+    std::string block(kBlockHeaderSize, '\0');
+    Put(&block, static_cast<uint32_t>(strings.size()));
+    for (size_t i = 0; i < strings.size(); i++) {
+        Put(&block, static_cast<uint32_t>(strings[i]->size()));
+        block.append(*strings[i]);
+    }
+    block.append(reinterpret_cast<const char *>(&ids[0]),
+        nrows * sizeof(uint32_t));
+    for (size_t i = begin; i < end; i++) {
+        Put(&block, rows[i].t1);
+    }
+    for (size_t i = begin; i < end; i++) {
+        block.append(reinterpret_cast<const char *>(rows[i].uuid.data),
+            rows[i].uuid.size());
+    }
+    block.append(reinterpret_cast<const char *>(&ids[nrows]),
+        kTagColumns * nrows * sizeof(uint32_t));
+    block.append(values_offsets);
+    block.append(values_comp);
+
+    uint8_t *header(reinterpret_cast<uint8_t *>(&block[0]));
+    uint32_t body_len(block.size() - kBlockHeaderSize);
+    uint32_t header_values[] = { kMagic, nrows, body_len,
+        Checksum(header + kBlockHeaderSize, body_len),
+        static_cast<uint32_t>(values.size()),
+        static_cast<uint32_t>(values_comp.size()) };
+    memcpy(header, header_values, sizeof(header_values));
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(PartitionPath(key.t2), ec);
+    const std::string path(FilePath(key));
+    int fd(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644));
+    if (fd < 0) {
+        LOG(ERROR, "StatTableStore: " << path << " open FAILED: " <<
+            strerror(errno));
+        return false;
+    }
+    // A single write, so that readers see either none or all of a block
+    // once it is written
+    ssize_t written(write(fd, block.data(), block.size()));
+    int write_errno(errno);
+    close(fd);
+    if (written != static_cast<ssize_t>(block.size())) {
+        LOG(ERROR, "StatTableStore: " << path << " write FAILED: " <<
+            (written < 0 ? strerror(write_errno) : "short write"));
+        return false;
+    }
+    tbb::mutex::scoped_lock lock(mutex_);
+    stats_.rows_written += nrows;
+    stats_.blocks_written++;
+    stats_.bytes_written += block.size();
+    return true;
+}
+
+bool StatTableStore::Read(const GenDb::DbDataValueVec &rowkey,
+    const GenDb::ColumnNameRange &crange,
+    const GenDb::WhereIndexInfoVec &where_vec, GenDb::ColList *result) {
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.reads++;
+    }
+    Key key;
+    std::vector<Condition> conditions;
+    bool valid(ParseKey(rowkey, &key));
+    for (GenDb::WhereIndexInfoVec::const_iterator it = where_vec.begin();
+         valid && it != where_vec.end(); ++it) {
+        // Only the indexed columns, column4 to column10, have conditions
+        const std::string &column(it->get<0>());
+        const std::string *value(boost::get<std::string>(&it->get<2>()));
+        int index(column.compare(0, 6, "column") == 0 ?
+            atoi(column.c_str() + 6) - 4 : -1);
+        GenDb::Op::type op(it->get<1>());
+        if (value == NULL || index < 0 || index >= kTagColumns ||
+            (op != GenDb::Op::EQ && op != GenDb::Op::LIKE &&
+             op != GenDb::Op::GE && op != GenDb::Op::LE)) {
+            valid = false;
+            break;
+        }
+        Condition condition;
+        condition.column = index;
+        condition.op = op;
+        condition.value = *value;
+        conditions.push_back(condition);
+    }
+    if (!valid) {
+        LOG(ERROR, "StatTableStore: Invalid row key or where condition");
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.read_fails++;
+        return false;
+    }
+
+    const std::string path(FilePath(key));
+    int fd(open(path.c_str(), O_RDONLY));
+    if (fd < 0) {
+        // Nothing was written to the partition
+        if (errno == ENOENT) {
+            return true;
+        }
+        LOG(ERROR, "StatTableStore: " << path << " open FAILED: " <<
+            strerror(errno));
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.read_fails++;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.read_fails++;
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    void *addr(mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG(ERROR, "StatTableStore: " << path << " mmap FAILED: " <<
+            strerror(errno));
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.read_fails++;
+        return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    const uint8_t *data(static_cast<const uint8_t *>(addr));
+    const size_t len(st.st_size);
+    bool success(true);
+    size_t offset(0);
+    // A block being appended may be partially visible at the end of the
+    // file, the scan stops there
+    while (len - offset >= kBlockHeaderSize) {
+        const uint8_t *header(data + offset);
+        uint32_t body_len(Load<uint32_t>(header + kHeaderBodyLen));
+        if (Load<uint32_t>(header + kHeaderMagic) != kMagic) {
+            LOG(ERROR, "StatTableStore: " << path << ": Bad block at " <<
+                offset);
+            tbb::mutex::scoped_lock lock(mutex_);
+            stats_.corrupt_blocks++;
+            break;
+        }
+        if (len - offset - kBlockHeaderSize < body_len) {
+            break;
+        }
+        const uint8_t *body(header + kBlockHeaderSize);
+        offset += kBlockHeaderSize + body_len;
+        Block block;
+        block.rows = Load<uint32_t>(header + kHeaderRows);
+        block.values_len = Load<uint32_t>(header + kHeaderValuesLen);
+        block.values_comp_len = Load<uint32_t>(header + kHeaderValuesCompLen);
+        if (Checksum(body, body_len) != Load<uint32_t>(header + kHeaderCrc) ||
+            !block.Parse(body, body_len)) {
+            LOG(ERROR, "StatTableStore: " << path << ": Corrupt block at " <<
+                offset - kBlockHeaderSize - body_len);
+            tbb::mutex::scoped_lock lock(mutex_);
+            stats_.corrupt_blocks++;
+            continue;
+        }
+        if (!ScanBlock(block, crange, &conditions, result)) {
+            success = false;
+            break;
+        }
+    }
+    munmap(addr, st.st_size);
+    if (!success) {
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.read_fails++;
+    }
+    return success;
+}
+
+namespace {
+
+// Compares the clustering columns of a row, (name, T1, uuid), to a
+// column name range bound. The bound may cover only the leading columns.
+// name_cmp is the result of the name comparison.
+bool CompareRow(int name_cmp, uint32_t t1, const uint8_t *uuid,
+    const GenDb::DbDataValueVec &bound, int *result) {
+    *result = name_cmp;
+    if (name_cmp != 0 || bound.size() < 2) {
+        return true;
+    }
+    const uint32_t *bt1(boost::get<uint32_t>(&bound[1]));
+    if (bt1 == NULL) {
+        return false;
+    }
+    if (t1 != *bt1) {
+        *result = t1 < *bt1 ? -1 : 1;
+        return true;
+    }
+    if (bound.size() < 3) {
+        return true;
+    }
+    const boost::uuids::uuid *buuid(
+        boost::get<boost::uuids::uuid>(&bound[2]));
+    if (buuid == NULL) {
+        return false;
+    }
+    int cmp(memcmp(uuid, buuid->data, buuid->size()));
+    *result = cmp == 0 ? 0 : (cmp < 0 ? -1 : 1);
+    return true;
+}
+
+bool BoundName(const GenDb::DbDataValueVec &bound,
+    const std::string **name) {
+    *name = NULL;
+    if (bound.empty()) {
+        return true;
+    }
+    *name = boost::get<std::string>(&bound[0]);
+    return *name != NULL;
+}
+
+}  // namespace
+
+bool StatTableStore::ScanBlock(const Block &block,
+    const GenDb::ColumnNameRange &crange,
+    std::vector<Condition> *conditions, GenDb::ColList *result) {
+    const size_t dictionary_size(block.dictionary.size());
+    const std::string *start_name, *finish_name;
+    if (!BoundName(crange.start_, &start_name) ||
+        !BoundName(crange.finish_, &finish_name)) {
+        LOG(ERROR, "StatTableStore: Invalid column name range");
+        return false;
+    }
+    // Evaluate the conditions and the name range once per string
+    for (size_t i = 0; i < conditions->size(); i++) {
+        Condition &condition((*conditions)[i]);
+        condition.matches.assign(dictionary_size, false);
+        bool any(false);
+        for (size_t id = 0; id < dictionary_size; id++) {
+            const char *str(block.dictionary[id].first);
+            size_t len(block.dictionary[id].second);
+            bool match;
+            switch (condition.op) {
+            case GenDb::Op::EQ:
+                match = Compare(str, len, condition.value) == 0;
+                break;
+            case GenDb::Op::GE:
+                match = Compare(str, len, condition.value) >= 0;
+                break;
+            case GenDb::Op::LE:
+                match = Compare(str, len, condition.value) <= 0;
+                break;
+            default:
+                match = Like(str, len, condition.value);
+                break;
+            }
+            condition.matches[id] = match;
+            any |= match;
+        }
+        if (!any) {
+            tbb::mutex::scoped_lock lock(mutex_);
+            stats_.blocks_skipped++;
+            return true;
+        }
+    }
+    std::vector<int> start_cmp(dictionary_size, 1);
+    std::vector<int> finish_cmp(dictionary_size, -1);
+    for (size_t id = 0; id < dictionary_size; id++) {
+        const char *str(block.dictionary[id].first);
+        size_t len(block.dictionary[id].second);
+        if (start_name) {
+            start_cmp[id] = Compare(str, len, *start_name);
+        }
+        if (finish_name) {
+            finish_cmp[id] = Compare(str, len, *finish_name);
+        }
+    }
+
+    std::vector<uint32_t> matched;
+    for (uint32_t row = 0; row < block.rows; row++) {
+        uint32_t name_id(block.Id(block.names, row));
+        if (start_cmp[name_id] < 0 || finish_cmp[name_id] > 0) {
+            continue;
+        }
+        uint32_t t1(block.Id(block.t1s, row));
+        const uint8_t *uuid(block.uuids +
+            row * boost::uuids::uuid::static_size());
+        int cmp;
+        if (!CompareRow(start_cmp[name_id], t1, uuid, crange.start_, &cmp) ||
+            cmp < 0) {
+            continue;
+        }
+        if (!CompareRow(finish_cmp[name_id], t1, uuid, crange.finish_,
+                &cmp) || cmp > 0) {
+            continue;
+        }
+        bool match(true);
+        for (size_t i = 0; match && i < conditions->size(); i++) {
+            const Condition &condition((*conditions)[i]);
+            match = condition.matches[
+                block.Id(block.tags[condition.column], row)];
+        }
+        if (match) {
+            matched.push_back(row);
+        }
+    }
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        stats_.blocks_scanned++;
+        stats_.rows_scanned += block.rows;
+        stats_.rows_read += matched.size();
+    }
+    if (matched.empty()) {
+        return true;
+    }
+
+    std::string values(block.values_len, '\0');
+    uLongf values_len(block.values_len);
+    if (block.values_len != 0 &&
+        uncompress(reinterpret_cast<Bytef *>(&values[0]), &values_len,
+            block.values, block.values_comp_len) != Z_OK) {
+        LOG(ERROR, "StatTableStore: Uncompress FAILED");
+        return false;
+    }
+    for (size_t i = 0; i < matched.size(); i++) {
+        uint32_t row(matched[i]);
+        const std::pair<const char *, size_t> &name(
+            block.dictionary[block.Id(block.names, row)]);
+        boost::uuids::uuid uuid;
+        memcpy(uuid.data, block.uuids + row * uuid.size(), uuid.size());
+        uint32_t begin(row == 0 ? 0 : block.Id(block.values_offsets, row - 1));
+        uint32_t end(block.Id(block.values_offsets, row));
+        GenDb::DbDataValueVec *col_name(new GenDb::DbDataValueVec);
+        col_name->reserve(3);
+        col_name->push_back(std::string(name.first, name.second));
+        col_name->push_back(block.Id(block.t1s, row));
+        col_name->push_back(uuid);
+        GenDb::DbDataValueVec *col_value(new GenDb::DbDataValueVec(1,
+            values.substr(begin, end - begin)));
+        result->columns_.push_back(new GenDb::NewCol(col_name, col_value, 0));
+    }
+    return true;
+}
+
+void StatTableStore::Purge(uint32_t t2) {
+    tbb::mutex::scoped_lock flush_lock(flush_mutex_);
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(directory_, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        const std::string name(it->path().filename().string());
+        char *endp;
+        unsigned long pt2(strtoul(name.c_str(), &endp, 10));
+        if (name.empty() || *endp != '\0' || pt2 >= t2) {
+            continue;
+        }
+        boost::system::error_code rec;
+        boost::filesystem::remove_all(it->path(), rec);
+        if (rec) {
+            LOG(ERROR, "StatTableStore: " << it->path().string() <<
+                " remove FAILED: " << rec.message());
+        }
+    }
+}
+
+void StatTableStore::GetStats(Stats *stats) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    *stats = stats_;
+}
+
+std::string StatTableStore::PartitionPath(uint32_t t2) const {
+    std::ostringstream ostr;
+    ostr << directory_ << "/" << t2;
+    return ostr.str();
+}
+
+std::string StatTableStore::FilePath(const Key &key) const {
+    std::ostringstream ostr;
+    ostr << PartitionPath(key.t2) << "/" << static_cast<int>(key.partition) <<
+        "." << Escape(key.name) << "." << Escape(key.attr) << kFileSuffix;
+    return ostr.str();
+}
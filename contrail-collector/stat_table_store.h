@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef __STAT_TABLE_STORE_H__
+#define __STAT_TABLE_STORE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+#include <tbb/mutex.h>
+
+#include <base/util.h>
+#include "gendb_if.h"
+
+//
+// Local on-disk store of the StatTable, used instead of the database
+// in single node deployments.
+//
+// The rows of a StatTable partition (T2, partition, statName, statAttr)
+// are kept in a file of their own under a directory per T2, so that
+// expired partitions are removed as whole directories and a query reads
+// only the files of the partitions it asks for. Writes are buffered and
+// appended to the files as self-contained column blocks, readers map the
+// files and scan the blocks in place.
+//
+// Block layout: header (magic, rows, body length, crc32 of the body,
+// raw and compressed length of the values), then the body:
+//   - dictionary of the strings of the block: count, then length and
+//     bytes of each string
+//   - column1 (name), dictionary ids
+//   - column2 (T1)
+//   - column3 (uuid)
+//   - column4 to column10 (source, key, proxy and tags), dictionary ids
+//   - end offsets of the values
+//   - values, zlib compressed
+// The where conditions are evaluated once per dictionary string, so
+// blocks with no matching string are skipped and only the values of
+// the matching rows are decompressed.
+//
+class StatTableStore {
+public:
+    static const uint32_t kDefaultMaxBlockRows = 4096;
+    static const uint32_t kMagic = 0x42535453; // "STSB"
+
+    struct Stats {
+        Stats() :
+            rows_written(0), blocks_written(0), bytes_written(0),
+            write_fails(0), reads(0), read_fails(0), blocks_scanned(0),
+            blocks_skipped(0), rows_scanned(0), rows_read(0),
+            corrupt_blocks(0) {
+        }
+        uint64_t rows_written;
+        uint64_t blocks_written;
+        uint64_t bytes_written;
+        uint64_t write_fails;
+        uint64_t reads;
+        uint64_t read_fails;
+        uint64_t blocks_scanned;
+        // Blocks with no string matching the where conditions
+        uint64_t blocks_skipped;
+        uint64_t rows_scanned;
+        uint64_t rows_read;
+        uint64_t corrupt_blocks;
+    };
+
+    explicit StatTableStore(const std::string &directory,
+        uint32_t max_block_rows = kDefaultMaxBlockRows);
+    ~StatTableStore();
+
+    bool Initialize();
+    // Buffers the rows of a StatTable column list, they are visible to
+    // readers once flushed
+    bool Write(const GenDb::ColList &col_list);
+    // Appends the buffered rows to the partition files
+    bool Flush();
+    // Reads the rows of a partition in the column name range matching
+    // all the where conditions, in the layout returned by the database
+    bool Read(const GenDb::DbDataValueVec &rowkey,
+        const GenDb::ColumnNameRange &crange,
+        const GenDb::WhereIndexInfoVec &where_vec,
+        GenDb::ColList *result);
+    // Removes the partitions with T2 less than t2
+    void Purge(uint32_t t2);
+    void GetStats(Stats *stats) const;
+
+private:
+    static const size_t kBlockHeaderSize = 24;
+    static const int kTagColumns = 7;
+
+    struct Key {
+        Key() : t2(0), partition(0) {
+        }
+        bool operator<(const Key &rhs) const;
+        uint32_t t2;
+        uint8_t partition;
+        std::string name;
+        std::string attr;
+    };
+
+    struct Row {
+        std::string name;
+        uint32_t t1;
+        boost::uuids::uuid uuid;
+        std::string tags[kTagColumns];
+        std::string value;
+    };
+
+    typedef std::vector<Row> RowVec;
+    typedef std::map<Key, RowVec> RowMap;
+
+    struct Block;
+    struct Condition;
+
+    static bool ParseKey(const GenDb::DbDataValueVec &rowkey, Key *key);
+    bool WriteBlock(const Key &key, const RowVec &rows, size_t begin,
+        size_t end);
+    bool ScanBlock(const Block &block, const GenDb::ColumnNameRange &crange,
+        std::vector<Condition> *conditions, GenDb::ColList *result);
+    std::string PartitionPath(uint32_t t2) const;
+    std::string FilePath(const Key &key) const;
+
+    const std::string directory_;
+    const uint32_t max_block_rows_;
+    // Protects the buffered rows and the stats
+    mutable tbb::mutex mutex_;
+    // Serializes the flushes, so that blocks are appended in order
+    tbb::mutex flush_mutex_;
+    RowMap rows_;
+    Stats stats_;
+
+    DISALLOW_COPY_AND_ASSIGN(StatTableStore);
+};
+
+#endif // __STAT_TABLE_STORE_H__
@@ -9,86 +9,107 @@ using std::string;
 using std::vector;
 using std::make_pair;
 
+StatWalker::StatWalker(StatTableInsertFn fn, const uint64_t &timestamp,
+                       const std::string& statName, const TagMap& tags) :
+        timestamp_(timestamp),
+        stat_name_(statName),
+        fn_(fn) {
+    // Nodes hold maps, avoid copying them as the stack grows
+    nodes_.reserve(kInitialDepth);
+    for (TagMap::const_iterator ti = tags.begin();
+            ti != tags.end(); ti++) {
+        FillTag(&tags_, ti->first, ti->second, NULL);
+    }
+}
+
 void
 StatWalker::Push(const std::string& name,
         const TagMap& tags,
         const DbHandler::AttribMap& attribs) {
 
-    string prename("");
-    for (vector<StatNode>::const_iterator ni = nodes_.begin();
-            ni != nodes_.end(); ni++) {
-        const StatNode& ancestor = *ni;
-        if (!prename.empty()) {
-            prename.append(".");
-        }
-        prename.append(ancestor.name);
-    }
-
-    StatNode sn;
-    sn.name = name;
+    nodes_.resize(nodes_.size() + 1);
+    StatNode& sn = nodes_.back();
+    sn.prefix_len = prefix_.length();
 
-    if (!prename.empty()) {
-        prename.append(".");
+    if (!prefix_.empty()) {
+        prefix_.append(".");
     }
-    prename.append(sn.name);
+    prefix_.append(name);
 
     // For both tag names and attribute names, we need to convert
     // from local name to fully-qualified name
+    string fqname(prefix_);
+    fqname.append(".");
+    const size_t fqlen = fqname.length();
     for (TagMap::const_iterator ti = tags.begin();
             ti != tags.end(); ti++) {
-        std::string tname;
-
         VIZD_ASSERT(ti->first.find('.') == string::npos);
-        tname = prename + "." + ti->first;
+        fqname.resize(fqlen);
+        fqname.append(ti->first);
 
         // For prefixes, the tag prefix name is already fully-qualified
-        sn.tags.insert(make_pair(tname, ti->second));
+        FillTag(&tags_, fqname, ti->second, &sn.tag_undo);
     }
+    DbHandler::AttribMap::iterator hint = sn.attribs.end();
     for (DbHandler::AttribMap::const_iterator ai = attribs.begin();
             ai != attribs.end(); ai++) {
-        std::string aname;
-
         VIZD_ASSERT(ai->first.find('.') == string::npos);
-        aname = prename + "." + ai->first;
-        sn.attribs.insert(make_pair(aname, ai->second));
+        fqname.resize(fqlen);
+        fqname.append(ai->first);
+        // attribs is sorted and so are the qualified names
+        hint = sn.attribs.insert(hint, make_pair(fqname, ai->second));
     }
-    nodes_.push_back(sn);
 }
 
 void
 StatWalker::FillTag(DbHandler::TagMap *attribs_tag,
-        const std::pair<const std::string, TagVal>* ti) {
-    DbHandler::Var pval, sval;
-    std::string pname, sname;
-    if (ti->second.prefix.second.type == DbHandler::INVALID) {
+        const std::string& name, const TagVal& tag,
+        std::vector<TagUndo> *tag_undo) {
+    const std::string *pname, *sname = NULL;
+    const DbHandler::Var *pval, *sval = NULL;
+    if (tag.prefix.second.type == DbHandler::INVALID) {
         // There is no prefix supplied
-        pname = ti->first;
-        pval = ti->second.val;
+        pname = &name;
+        pval = &tag.val;
     } else {
         // Use the prefix
-        pname = ti->second.prefix.first;
-        pval = ti->second.prefix.second;
-        sname = ti->first;
-        sval = ti->second.val;
+        pname = &tag.prefix.first;
+        pval = &tag.prefix.second;
+        if (tag.val.type != DbHandler::INVALID) {
+            sname = &name;
+            sval = &tag.val;
+        }
     }
 
-    DbHandler::TagMap::iterator di = attribs_tag->find(pname);
+    TagUndo undo;
+    DbHandler::TagMap::iterator di = attribs_tag->find(*pname);
     if (di == attribs_tag->end()) {
         // This 1st level tag is absent
         DbHandler::AttribMap amap;
-        if (sval.type != DbHandler::INVALID) {
-            amap.insert(make_pair(sname, sval));
+        if (sval) {
+            amap.insert(make_pair(*sname, *sval));
         }
-        attribs_tag->insert(make_pair(pname, make_pair(pval, amap)));
+        undo.tag = attribs_tag->insert(make_pair(*pname,
+                                                 make_pair(*pval, amap)));
+        undo.inserted_tag = true;
     } else {
         // The 1st level tag is already present
         // Add the 2nd level tag if needed
+        if (!sval) {
+            return;
+        }
         DbHandler::AttribMap &amap = di->second.second;
-        if (sval.type != DbHandler::INVALID) {
-            if (amap.find(sname) == amap.end()) {
-                amap.insert(make_pair(sname, sval));
-            }
+        std::pair<DbHandler::AttribMap::iterator, bool> ret =
+            amap.insert(make_pair(*sname, *sval));
+        if (!ret.second) {
+            return;
         }
+        undo.tag = di;
+        undo.inserted_tag = false;
+        undo.subtag = ret.first;
+    }
+    if (tag_undo) {
+        tag_undo->push_back(undo);
     }
 }
 
@@ -96,38 +117,29 @@ StatWalker::FillTag(DbHandler::TagMap *attribs_tag,
 void
 StatWalker::Pop(void) {
     VIZD_ASSERT(!nodes_.empty());
-    DbHandler::AttribMap attribs = nodes_.back().attribs;
-    DbHandler::TagMap attribs_tag;
-
-    for (TagMap::const_iterator ti = top_tags_.begin();
-            ti != top_tags_.end(); ti++) {
-        FillTag(&attribs_tag, &(*ti));
-    }
-    
-    string prename("");
-    for (vector<StatNode>::const_iterator ni = nodes_.begin();
-            ni != nodes_.end(); ni++) {
-
-        const StatNode& ancestor = *ni;
-        if (!prename.empty()) {
-            prename.append(".");
-        }
-        prename.append(ancestor.name);
-
-        for (TagMap::const_iterator ti = ancestor.tags.begin();
-                ti != ancestor.tags.end(); ti++) {
-            FillTag(&attribs_tag, &(*ti));
-        }
-    }
+    StatNode& sn = nodes_.back();
+    // The node is done with, its attribs get the tags added in place
+    DbHandler::AttribMap& attribs = sn.attribs;
 
     // Take the final tags and also insert them as attribs
     // We may get duplicates ; the last value read will get used
-    for (DbHandler::TagMap::const_iterator fi = attribs_tag.begin();
-         fi != attribs_tag.end(); fi++) {
+    for (DbHandler::TagMap::const_iterator fi = tags_.begin();
+         fi != tags_.end(); fi++) {
         attribs.insert(make_pair(fi->first, fi->second.first));
         attribs.insert(fi->second.second.begin(), fi->second.second.end());
     }
-    fn_(timestamp_, stat_name_, prename, attribs_tag, attribs);
+    fn_(timestamp_, stat_name_, prefix_, tags_, attribs);
+
+    // Remove the tags of this node, newest first
+    for (vector<TagUndo>::reverse_iterator ui = sn.tag_undo.rbegin();
+         ui != sn.tag_undo.rend(); ui++) {
+        if (ui->inserted_tag) {
+            tags_.erase(ui->tag);
+        } else {
+            ui->tag->second.second.erase(ui->subtag);
+        }
+    }
+    prefix_.resize(sn.prefix_len);
     nodes_.pop_back();
 }
 
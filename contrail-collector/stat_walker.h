@@ -8,6 +8,7 @@
 #include <boost/function.hpp>
 #include <string>
 #include <map>
+#include <vector>
 #include "db_handler.h"
 
 /* This class provides a higher-level interface for DbHandler's StatTableInsert
@@ -17,6 +18,10 @@
  * 
  * This class will call StatTableInsert with the right tags and attribs when 
  * "Pop" is called.
+ *
+ * The prefix of the current node and the aggregated tags are maintained
+ * incrementally as nodes are pushed and popped, StatTableInsert is passed
+ * references to them rather than maps rebuilt from all the ancestors.
  */
 class StatWalker {
 public:
@@ -46,27 +51,38 @@ public:
     void Pop(void);
 
     StatWalker(StatTableInsertFn fn, const uint64_t &timestamp,
-               const std::string& statName, const TagMap& tags) :
-            timestamp_(timestamp),
-            stat_name_(statName),
-            fn_(fn),
-            top_tags_(tags)  {}
+               const std::string& statName, const TagMap& tags);
     ~StatWalker();
 private:
+    // Undoes one change that FillTag made to tags_ : either the insertion
+    // of a 1st level tag, or of a 2nd level tag under an existing one
+    struct TagUndo {
+        DbHandler::TagMap::iterator tag;
+        bool inserted_tag;
+        DbHandler::AttribMap::iterator subtag;
+    };
     struct StatNode {
-        std::string name;
-        TagMap tags;
+        // Length of prefix_ before this node was pushed
+        size_t prefix_len;
         DbHandler::AttribMap attribs;
+        std::vector<TagUndo> tag_undo;
     };
 
     // Utility function for aggregating StatWalker::TagMap into DbHandler::TagMap
     static void FillTag(DbHandler::TagMap *attribs_tag,
-        const std::pair<const std::string, TagVal>* tag);
+        const std::string& name, const TagVal& tag,
+        std::vector<TagUndo> *tag_undo);
+
+    static const size_t kInitialDepth = 8;
 
     const uint64_t timestamp_;
     const std::string stat_name_;
     const StatTableInsertFn fn_;
-    const TagMap top_tags_;
+    // Fully-qualified name of the current node
+    std::string prefix_;
+    // Tags of the top level and of every node on the stack, each node
+    // undoes its own changes when it is popped
+    DbHandler::TagMap tags_;
     std::vector<StatNode> nodes_;
 };
 
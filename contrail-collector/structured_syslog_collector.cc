@@ -14,6 +14,8 @@ StructuredSyslogCollector::StructuredSyslogCollector(EventManager *evm,
     const std::string &structured_syslog_kafka_topic,
     uint16_t structured_syslog_kafka_partitions,
     uint64_t structured_syslog_active_session_map_limit,
+    uint64_t structured_syslog_active_session_timeout,
+    uint32_t structured_syslog_uve_aggregation_interval,
     const Options::Kafka &kafka_options,
     DbHandlerPtr db_handler,
     ConfigClientCollector *config_client) {
@@ -27,6 +29,8 @@ StructuredSyslogCollector::StructuredSyslogCollector(EventManager *evm,
                     structured_syslog_kafka_topic,
                     structured_syslog_kafka_partitions,
                     structured_syslog_active_session_map_limit,
+                    structured_syslog_active_session_timeout,
+                    structured_syslog_uve_aggregation_interval,
                     kafka_options,
                     config_client,
                     stat_db_cb));
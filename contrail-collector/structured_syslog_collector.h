@@ -18,6 +18,8 @@ class StructuredSyslogCollector {
         const std::string &structured_syslog_kafka_topic,
         uint16_t structured_syslog_kafka_partitions,
         uint64_t structured_syslog_active_session_map_limit,
+        uint64_t structured_syslog_active_session_timeout,
+        uint32_t structured_syslog_uve_aggregation_interval,
         const Options::Kafka &kafka_options,
         DbHandlerPtr db_handler,
         ConfigClientCollector *config_client);
@@ -12,6 +12,7 @@
 #include "structured_syslog_config.h"
 #include "options.h"
 #include <base/logging.h>
+#include <base/time_util.h>
 #include <boost/bind.hpp>
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
@@ -22,9 +23,14 @@ using contrail::regex;
 using contrail::regex_match;
 using contrail::regex_search;
 
-StructuredSyslogConfig::StructuredSyslogConfig(ConfigClientCollector *config_client, uint64_t structured_syslog_active_session_map_limit) {
-    activeSessionConfigMapLIMIT = structured_syslog_active_session_map_limit;
-    LOG(INFO, "StructuredSyslogConfig:Num of active session LIMIT in session config map: " << activeSessionConfigMapLIMIT);
+StructuredSyslogConfig::StructuredSyslogConfig(ConfigClientCollector *config_client, uint64_t structured_syslog_active_session_map_limit,
+                                               uint64_t structured_syslog_active_session_timeout) :
+    activeSessionConfigMapLIMIT(structured_syslog_active_session_map_limit),
+    session_counters_(structured_syslog_active_session_map_limit,
+                      structured_syslog_active_session_timeout * 1000000),
+    uve_aggregator_(NULL) {
+    LOG(INFO, "StructuredSyslogConfig:Num of active session LIMIT in session config map: " << activeSessionConfigMapLIMIT <<
+        " timeout: " << structured_syslog_active_session_timeout << "s");
     if (config_client) {
         config_client->RegisterConfigReceive("structured-systemlog", boost::bind(
                                  &StructuredSyslogConfig::ReceiveConfig, this, _1, _2));
@@ -41,67 +47,152 @@ StructuredSyslogConfig::~StructuredSyslogConfig() {
     tenant_application_records_.erase(tenant_application_records_.begin(),
                                       tenant_application_records_.end());
     networks_map_.erase(networks_map_.begin(), networks_map_.end());
-    session_config_map_.erase(session_config_map_.begin(),
-                                session_config_map_.end());
 }
 
 
-bool 
-StructuredSyslogConfig::AddSyslogSessionCounter(const std::string session_unique_key, 
-                                                std::map<std::string, uint64_t> session_traffic_counters) {
-    try {
-        SyslogSessionConfig::iterator it = session_config_map_.find(session_unique_key);
-        if (it != session_config_map_.end()) {
-            LOG(DEBUG, "Session key found in session counter map.");
-        }
-        else {
-            LOG(DEBUG, "Session key NOT found in session counter map.");
-            //Put a Limit to num of session entries in the map.
-            if(session_config_map_.size() >= activeSessionConfigMapLIMIT) {
-                LOG(ERROR, "active sessions Config Map LIMIT reached. Current active session count: "<< session_config_map_.size());
-                return false;
-            }
-        }
-        LOG(DEBUG, "Adding/Replacing session traffic counters for session key " << session_unique_key);
-        session_config_map_[session_unique_key] = session_traffic_counters;
+SyslogSessionCounterStore::SyslogSessionCounterStore(uint64_t limit,
+                                                     uint64_t timeout_usec) :
+    limit_(limit),
+    timeout_usec_(timeout_usec) {
+    size_ = 0;
+    evicted_ = 0;
+    next_full_eviction_usec_ = 0;
+}
+
+/*  FNV-1a hash of uvename::session_id */
+uint64_t
+SyslogSessionCounterStore::SessionKey(const std::string &uvename,
+                                      const std::string &session_id) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::string::const_iterator it = uvename.begin();
+         it != uvename.end(); ++it) {
+        hash = (hash ^ static_cast<uint8_t>(*it)) * 1099511628211ULL;
+    }
+    hash = (hash ^ ':') * 1099511628211ULL;
+    for (std::string::const_iterator it = session_id.begin();
+         it != session_id.end(); ++it) {
+        hash = (hash ^ static_cast<uint8_t>(*it)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool
+SyslogSessionCounterStore::Add(uint64_t key,
+                               const SyslogSessionCounters &counters,
+                               uint64_t now_usec) {
+    if (size_ >= limit_ && timeout_usec_ &&
+        now_usec >= next_full_eviction_usec_) {
+        // Sweep at most a few times per timeout while the store is full
+        next_full_eviction_usec_ = now_usec + timeout_usec_ / 16;
+        Evict(now_usec);
+    }
+    Shard &shard(GetShard(key));
+    tbb::mutex::scoped_lock lock(shard.mutex);
+    EntryMap::iterator it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        LOG(DEBUG, "Session key found in session counter map.");
+        it->second.counters = counters;
+        it->second.last_update_usec = now_usec;
         return true;
     }
-    catch (std::exception &e) {
-        LOG(ERROR, "Adding session traffic counters failed for session key: " << session_unique_key);
+    LOG(DEBUG, "Session key NOT found in session counter map.");
+    if (timeout_usec_ && now_usec >= shard.next_eviction_usec) {
+        EvictShard(&shard, now_usec);
+    }
+    //Put a Limit to num of session entries in the map.
+    if (size_ >= limit_) {
+        LOG(ERROR, "active sessions Config Map LIMIT reached. Current active session count: "<< static_cast<uint64_t>(size_));
         return false;
     }
- }
+    Entry &entry(shard.entries[key]);
+    entry.counters = counters;
+    entry.last_update_usec = now_usec;
+    size_++;
+    return true;
+}
 
-int 
-StructuredSyslogConfig::RemoveSyslogSessionCounter(const std::string &session_unique_key) {
-    try {
-        LOG(DEBUG, "Removing Syslog Session Counter for " << session_unique_key);
-        return session_config_map_.erase(session_unique_key);
-    }
-    catch (std::exception &e) {
-        LOG(ERROR, "Removing session traffic counters failed for session key: " << session_unique_key);
-        return 0;
+bool
+SyslogSessionCounterStore::Fetch(uint64_t key,
+                                 SyslogSessionCounters *counters) const {
+    const Shard &shard(GetShard(key));
+    tbb::mutex::scoped_lock lock(shard.mutex);
+    EntryMap::const_iterator it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        return false;
     }
+    *counters = it->second.counters;
+    return true;
 }
 
 bool
-StructuredSyslogConfig::FetchSyslogSessionCounters(const std::string &session_unique_key,
-                                                    std::map<std::string, uint64_t> &session_traffic_counters) {
-    try {
-        SyslogSessionConfig::iterator itr = session_config_map_.find(session_unique_key);
-        if (itr != session_config_map_.end()) {
-            session_traffic_counters = itr->second;
-            return true;
-        }
-        else{
-            LOG(DEBUG, "Session counters not found for session key: " << session_unique_key);
-            return false;
+SyslogSessionCounterStore::Remove(uint64_t key) {
+    Shard &shard(GetShard(key));
+    tbb::mutex::scoped_lock lock(shard.mutex);
+    if (shard.entries.erase(key) == 0) {
+        return false;
+    }
+    size_--;
+    return true;
+}
+
+size_t
+SyslogSessionCounterStore::Evict(uint64_t now_usec) {
+    size_t evicted = 0;
+    for (size_t i = 0; i < kNumShards; i++) {
+        tbb::mutex::scoped_lock lock(shards_[i].mutex);
+        evicted += EvictShard(&shards_[i], now_usec);
+    }
+    return evicted;
+}
+
+// Called with the shard mutex held
+size_t
+SyslogSessionCounterStore::EvictShard(Shard *shard, uint64_t now_usec) {
+    size_t evicted = 0;
+    shard->next_eviction_usec = now_usec + timeout_usec_;
+    if (now_usec < timeout_usec_) {
+        return 0;
+    }
+    uint64_t expiry_usec = now_usec - timeout_usec_;
+    for (EntryMap::iterator it = shard->entries.begin();
+         it != shard->entries.end();) {
+        if (it->second.last_update_usec < expiry_usec) {
+            it = shard->entries.erase(it);
+            evicted++;
+        } else {
+            ++it;
         }
     }
-    catch (std::exception &e) {
-        LOG(ERROR, "ERROR in fetching Session traffic counters for session key: " << session_unique_key);
+    if (evicted) {
+        size_ -= evicted;
+        evicted_ += evicted;
+        LOG(INFO, "Evicted " << evicted << " inactive sessions from session counter map");
+    }
+    return evicted;
+}
+
+bool
+StructuredSyslogConfig::AddSyslogSessionCounter(uint64_t session_key,
+                                                const SyslogSessionCounters &session_traffic_counters) {
+    LOG(DEBUG, "Adding/Replacing session traffic counters for session key " << session_key);
+    return session_counters_.Add(session_key, session_traffic_counters,
+                                 UTCTimestampUsec());
+}
+
+int
+StructuredSyslogConfig::RemoveSyslogSessionCounter(uint64_t session_key) {
+    LOG(DEBUG, "Removing Syslog Session Counter for " << session_key);
+    return session_counters_.Remove(session_key) ? 1 : 0;
+}
+
+bool
+StructuredSyslogConfig::FetchSyslogSessionCounters(uint64_t session_key,
+                                                   SyslogSessionCounters *session_traffic_counters) {
+    if (!session_counters_.Fetch(session_key, session_traffic_counters)) {
+        LOG(DEBUG, "Session counters not found for session key: " << session_key);
         return false;
     }
+    return true;
 }
 
 /*  Return int 4 when IP belongs to protocol IPv4 or
@@ -123,21 +214,6 @@ StructuredSyslogConfig::get_ip_version (const std::string ip) {
     return version;
 }
 
-uint32_t
-StructuredSyslogConfig::IPToUInt(std::string ip) {
-    int a, b, c, d;
-    uint32_t addr = 0;
-
-    if (sscanf(ip.c_str(), "%d.%d.%d.%d", &a, &b, &c, &d) != 4)
-        return 0;
-
-    addr = a << 24;
-    addr |= b << 16;
-    addr |= c << 8;
-    addr |= d;
-    return addr;
-}
-
 std::vector<std::string>
 StructuredSyslogConfig::split_into_vector(std::string  str, char delimiter) {
     std::vector<std::string> list;
@@ -151,32 +227,74 @@ StructuredSyslogConfig::split_into_vector(std::string  str, char delimiter) {
 
 
 
+/*  Copy the address into bytes in network order, return its length in bits */
+static int
+AddressToBytes(const boost::asio::ip::address &addr, uint8_t *bytes) {
+    if (addr.is_v4()) {
+        boost::asio::ip::address_v4::bytes_type b(addr.to_v4().to_bytes());
+        std::copy(b.begin(), b.end(), bytes);
+        return 32;
+    }
+    boost::asio::ip::address_v6::bytes_type b(addr.to_v6().to_bytes());
+    std::copy(b.begin(), b.end(), bytes);
+    return 128;
+}
+
+/*  Return the prefix length for a dotted netmask, an IPv6 mask or a plain
+    prefix length, or -1 if the mask is not valid */
+static int NetmaskToPrefixLength(const std::string &mask, int max_len) {
+    if (mask.find_first_of(".:") == std::string::npos) {
+        char *end;
+        long plen = strtol(mask.c_str(), &end, 10);
+        if (mask.empty() || *end != '\0' || plen < 0 || plen > max_len) {
+            return -1;
+        }
+        return plen;
+    }
+    boost::system::error_code ec;
+    boost::asio::ip::address mask_addr =
+        boost::asio::ip::address::from_string(mask, ec);
+    if (ec) {
+        return -1;
+    }
+    uint8_t bytes[16];
+    int nbits = AddressToBytes(mask_addr, bytes);
+    int plen = 0;
+    while (plen < nbits && (bytes[plen >> 3] & (0x80 >> (plen & 7)))) {
+        plen++;
+    }
+    // A mask with ones after its first zero is not a prefix
+    for (int i = plen; i < nbits; i++) {
+        if (bytes[i >> 3] & (0x80 >> (i & 7))) {
+            return -1;
+        }
+    }
+    return plen <= max_len ? plen : -1;
+}
+
 bool
 StructuredSyslogConfig::AddNetwork(const std::string& key, const std::string& network, const std::string& mask, const std::string& location)
 {
-    uint32_t network_addr = IPToUInt(network);
-    uint32_t mask_addr = IPToUInt(mask);
-
-    uint32_t net_lower = (network_addr & mask_addr);
-    uint32_t net_upper = (net_lower | (~mask_addr));
+    boost::system::error_code ec;
+    boost::asio::ip::address network_addr =
+        boost::asio::ip::address::from_string(network, ec);
+    if (ec) {
+        LOG(ERROR, "Invalid network address " << network << " for Tenant::VPN " << key);
+        return false;
+    }
+    int plen = NetmaskToPrefixLength(mask, network_addr.is_v4() ? 32 : 128);
+    if (plen < 0) {
+        LOG(ERROR, "Invalid netmask " << mask << " for network " << network <<
+            " in Tenant::VPN " << key);
+        return false;
+    }
 
     std::string id = location;
-    IPNetwork net(net_lower, net_upper, id);
+    IPNetwork net(network_addr, plen, id);
     boost::mutex::scoped_lock lock(networks_map_refresh_mutex);
-
-    IPNetworks_map::iterator it = networks_map_.find(key);
-    if (it  != networks_map_.end()) {
-        LOG(DEBUG, "VPN name found in Networks MAP while adding network. Appending to existing values of VPN key... ");
-        //sorted insertion into vector
-        it->second.insert(std::upper_bound(it->second.begin(), it->second.end(), net), net);
-        LOG(DEBUG, "IPNetwork with destination address " << network_addr << " added in networks_map with VPN key " << key);
-    } else {
-        LOG(DEBUG, "VPN name NOT found in Networks MAP while adding network. Creating a new entry in Networks MAP ...");
-        IPNetworks  new_network;
-        new_network.push_back(net);
-        networks_map_.insert(std::make_pair(key, new_network) );
-        LOG(DEBUG, "IPNetwork with destination address " << network_addr << " added in networks_map with VPN key " << key);
-    }
+    networks_map_[key].push_back(net);
+    networks_map_changed_.insert(key);
+    LOG(DEBUG, "IPNetwork " << network << "/" << plen << " added in networks_map with VPN key " << key);
     return true;
 }
 
@@ -193,6 +311,9 @@ StructuredSyslogConfig::RefreshNetworksMap(const std::string location){
                 indexes_to_be_deleted.push_back(i - it->second.begin());
             }
         }
+        if (!indexes_to_be_deleted.empty()) {
+            networks_map_changed_.insert(it->first);
+        }
         for(std::vector<int>::reverse_iterator v = indexes_to_be_deleted.rbegin(); v != indexes_to_be_deleted.rend(); ++v) {
             IPNetworks::iterator i = it->second.begin();
             it->second.erase(*v + i);
@@ -202,60 +323,128 @@ StructuredSyslogConfig::RefreshNetworksMap(const std::string location){
     return true;
 }
 
+void
+StructuredSyslogConfig::UpdateNetworkTries() {
+    // Updates are serialized by the mutex, so that none is lost
+    boost::mutex::scoped_lock lock(networks_map_refresh_mutex);
+    boost::shared_ptr<const IPNetworkTries_map> current(
+        boost::atomic_load(&network_tries_));
+    size_t changed = networks_map_changed_.size();
+    if (changed == 0 && current) {
+        return;
+    }
+    boost::shared_ptr<IPNetworkTries_map> tries(current ?
+        new IPNetworkTries_map(*current) : new IPNetworkTries_map);
+    // Only the tries of the changed Tenant::VPN are rebuilt, the others
+    // are shared with the current tries
+    for (std::set<std::string>::const_iterator key =
+         networks_map_changed_.begin();
+         key != networks_map_changed_.end(); key++) {
+        IPNetworks_map::const_iterator it = networks_map_.find(*key);
+        if (it == networks_map_.end()) {
+            tries->erase(*key);
+            continue;
+        }
+        boost::shared_ptr<IPNetworkTries> key_tries(new IPNetworkTries);
+        for (IPNetworks::const_iterator i = it->second.begin();
+             i != it->second.end(); i++) {
+            uint8_t bytes[16];
+            AddressToBytes(i->prefix, bytes);
+            IPNetworkTrie &trie(i->prefix.is_v4() ? key_tries->ipv4 :
+                                key_tries->ipv6);
+            trie.Insert(bytes, i->prefix_len, i->id);
+        }
+        (*tries)[*key] = key_tries;
+    }
+    networks_map_changed_.clear();
+    boost::atomic_store(&network_tries_,
+        boost::shared_ptr<const IPNetworkTries_map>(tries));
+    LOG(INFO, "Networks tries updated for " << changed << " of " <<
+        tries->size() << " Tenant::VPN");
+}
+
 std::string
-StructuredSyslogConfig::FindNetwork(std::string ip,  std::string key, std::string src_location)
+StructuredSyslogConfig::FindNetwork(const std::string &ip, const std::string &key,
+                                    const std::string &src_location)
 {
-    uint32_t network_addr = IPToUInt(ip);
-    IPNetwork ip_network(network_addr, 0, ip);
     std::string unknown_location;
+    boost::shared_ptr<const IPNetworkTries_map> tries(
+        boost::atomic_load(&network_tries_));
+    if (!tries) {
+        LOG(DEBUG, "Tenant::VPN "<< key << " NOT found in Network MAP!");
+        return unknown_location;
+    }
+    IPNetworkTries_map::const_iterator it = tries->find(key);
+    if (it == tries->end()) {
+        LOG(DEBUG, "Tenant::VPN "<< key << " NOT found in Network MAP!");
+        return unknown_location;
+    }
+    boost::system::error_code ec;
+    boost::asio::ip::address addr(boost::asio::ip::address::from_string(ip, ec));
+    if (ec) {
+        LOG(DEBUG, "Invalid network address " << ip << " in Tenant::VPN " << key);
+        return unknown_location;
+    }
+    uint8_t bytes[16];
+    int nbits = AddressToBytes(addr, bytes);
+    const IPNetworkTrie &trie(addr.is_v4() ? it->second->ipv4 : it->second->ipv6);
+    const std::string *location = trie.Find(bytes, nbits, src_location);
+    if (location != NULL) {
+        LOG(DEBUG, "Network found for " << ip << " from Tenant::VPN " <<  key <<
+            " in Site : " << *location);
+        return *location;
+    }
+    LOG(DEBUG,"Network range not found for " << ip << " in Tenant::VPN " << key );
+    return unknown_location;
+}
 
-    IPNetworks_map::iterator it = networks_map_.find(key);
-    if (it  != networks_map_.end()) {
-        IPNetworks::iterator upper = std::upper_bound(it->second.begin(), it->second.end(), ip_network);
-
-        uint32_t idx = upper - it->second.begin();
-        if (idx <= it->second.size() && idx != 0){
-            IPNetwork found_network_obj(0, 0, unknown_location);
-            uint32_t min_range = UINT32_MAX;
-            //check for last idx (idx-1) before upper_bound idx.
-            //check for overlapping IP ranges in loop.
-            //network with min. range should take priority.
-            for (int i = idx - 1; i >= 0; i--) {
-                IPNetwork possible_network_obj = it->second[i];
-                LOG(DEBUG, "Checking for possible network-range match location " << possible_network_obj.id);
-                uint32_t possible_network_range = possible_network_obj.address_end - possible_network_obj.address_begin;
-                if ((network_addr >= possible_network_obj.address_begin)
-                    && (network_addr <= possible_network_obj.address_end)) {
-                    if (possible_network_range < min_range) {
-                        if (possible_network_obj.id != src_location) {
-                            found_network_obj = possible_network_obj;
-                            min_range = possible_network_range;
-                            LOG(DEBUG, "Possible Network found for " << ip << " from Tenant::VPN " <<  key << 
-                                " in Site : " << found_network_obj.id  << " with range : " << possible_network_range);
-                        }
-                    }
-                }
+IPNetworkTrie::IPNetworkTrie() :
+    nodes_(1) {
+}
 
-            }
-            if (!(found_network_obj.id.empty())) {
-                LOG(DEBUG, "Network found for " << ip << " from Tenant::VPN " <<  key << 
-                    " in Site : " << found_network_obj.id );
-                return found_network_obj.id;
-            }
-            else {
-                LOG(DEBUG,"Network address "<< ip <<" doesnt not belong to the found range " 
-                    << found_network_obj.address_begin << " - " << found_network_obj.address_end << " in Tenant::VPN " << key);
+void
+IPNetworkTrie::Insert(const uint8_t *addr, uint8_t plen, const std::string &location) {
+    uint32_t node = 0;
+    for (int i = 0; i < plen; i++) {
+        int bit = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+        if (nodes_[node].child[bit] == kInvalidIndex) {
+            nodes_[node].child[bit] = nodes_.size();
+            nodes_.push_back(Node());
+        }
+        node = nodes_[node].child[bit];
+    }
+    if (nodes_[node].locations == kInvalidIndex) {
+        nodes_[node].locations = locations_.size();
+        locations_.push_back(std::vector<std::string>());
+    }
+    locations_[nodes_[node].locations].push_back(location);
+}
+
+const std::string *
+IPNetworkTrie::Find(const uint8_t *addr, uint8_t nbits,
+                    const std::string &exclude_location) const {
+    const std::string *found = NULL;
+    uint32_t node = 0;
+    for (int i = 0; node != kInvalidIndex; i++) {
+        const Node &n(nodes_[node]);
+        if (n.locations != kInvalidIndex) {
+            //network added last for the prefix takes priority
+            const std::vector<std::string> &locations(locations_[n.locations]);
+            for (std::vector<std::string>::const_reverse_iterator it =
+                 locations.rbegin(); it != locations.rend(); ++it) {
+                if (*it != exclude_location) {
+                    found = &*it;
+                    break;
+                }
             }
         }
-        else{
-            LOG(DEBUG,"Network range not found for " << ip << " in Tenant::VPN " << key );
+        if (i == nbits) {
+            break;
         }
+        node = n.child[(addr[i >> 3] >> (7 - (i & 7))) & 1];
     }
-    else {
-        LOG(DEBUG, "Tenant::VPN "<< key << " NOT found in Network MAP!");
-    }
-    return unknown_location;
- }
+    return found;
+}
 
 void
 StructuredSyslogConfig::HostnameRecordsHandler(const contrail_rapidjson::Document &jdoc,
@@ -330,9 +519,14 @@ StructuredSyslogConfig::HostnameRecordsHandler(const contrail_rapidjson::Documen
                     iter != network_range_list.end(); iter++){
                     std::vector<std::string> ip_and_subnet = split_into_vector(*iter,'/');
                     std::string network_key = tenant + "::" + vpn;
+                    if (ip_and_subnet.size() != 2) {
+                        LOG(ERROR, "Invalid network range " << *iter << " for VPN: " << vpn);
+                        continue;
+                    }
                     AddNetwork (network_key, ip_and_subnet[0], ip_and_subnet[1], location);
                 }
             }
+            UpdateNetworkTries();
         }
         if (add_update) {
             LOG(DEBUG, "Adding HostnameRecord: " << name);
@@ -344,6 +538,7 @@ StructuredSyslogConfig::HostnameRecordsHandler(const contrail_rapidjson::Documen
                 LOG(DEBUG, "Erasing LAN MAP for location : "<< cit->second->location());
                 if (!cit->second->location().empty()){
                    RefreshNetworksMap(location);
+                   UpdateNetworkTries();
                 }
                 LOG(DEBUG, "Erasing HostnameRecord: " << cit->second->name());
                 hostname_records_.erase(cit);
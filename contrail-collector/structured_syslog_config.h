@@ -6,6 +6,7 @@
 
 
 #include <map>
+#include <set>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -13,40 +14,73 @@
 #include <stdint.h>
 #include <cstdio>
 #include <tbb/atomic.h>
+#include <tbb/mutex.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/asio/ip/address.hpp>
 #include <boost/regex.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 #include "config_client_collector.h"
 #include "parser_util.h"
 
 class Options;
 
+namespace structured_syslog {
+namespace impl {
+class StructuredSyslogUVEAggregator;
+}  // namespace impl
+}  // namespace structured_syslog
+
 
 
 struct IPNetwork
 {
-  IPNetwork(uint32_t lower, uint32_t upper, std::string net_name) {
-    address_begin = lower;
-    address_end   = upper;
-    id            = net_name;
+  IPNetwork(const boost::asio::ip::address &address, uint8_t plen,
+            std::string net_name) {
+    prefix     = address;
+    prefix_len = plen;
+    id         = net_name;
   }
 
-  bool operator < (const IPNetwork& other) const{
-    return address_begin < other.address_begin;
-  }
+  boost::asio::ip::address prefix;
+  uint8_t prefix_len;
+  std::string id;
 
-  IPNetwork& operator = (const IPNetwork& other) {
-    this->address_begin = other.address_begin;
-    this->address_end = other.address_end;
-    this->id = other.id;
-    return *this;
-  }
+};
 
-  uint32_t address_begin;
-  uint32_t address_end;
-  std::string id;
+//
+// Binary trie for longest prefix match of IPv4 or IPv6 networks. Nodes are
+// kept in a flat vector and linked by index; every node for which a network
+// was inserted holds the locations (sites) of that network in insertion
+// order. The trie is immutable once published and may be searched
+// concurrently.
+//
+class IPNetworkTrie {
+    public:
+        IPNetworkTrie();
+        void Insert(const uint8_t *addr, uint8_t plen, const std::string &location);
+        // Location of the longest prefix containing addr, skipping networks
+        // of exclude_location. Returns NULL if there is no such network.
+        const std::string *Find(const uint8_t *addr, uint8_t nbits,
+                                const std::string &exclude_location) const;
+        size_t size() const { return nodes_.size(); }
+    private:
+        static const uint32_t kInvalidIndex = 0xFFFFFFFF;
+        struct Node {
+            Node() { child[0] = child[1] = locations = kInvalidIndex; }
+            uint32_t child[2];
+            uint32_t locations;
+        };
+        std::vector<Node> nodes_;
+        std::vector<std::vector<std::string> > locations_;
+};
 
+// Per Tenant::VPN tries, rebuilt from networks_map_ for the Tenant::VPN
+// changed by the config and swapped in with the tries of the others
+struct IPNetworkTries {
+    IPNetworkTrie ipv4;
+    IPNetworkTrie ipv6;
 };
 
 class HostnameRecord {
@@ -376,23 +410,98 @@ typedef std::map<std::string, boost::shared_ptr<MessageConfig> > Cmc_t;
 typedef std::map<std::string, boost::shared_ptr<SlaProfileRecord> > Csr_t;
 typedef std::vector<IPNetwork> IPNetworks;
 typedef std::map<std::string, IPNetworks> IPNetworks_map;
-typedef std::map<std::string, std::map<std::string, uint64_t> > SyslogSessionConfig;
+typedef std::map<std::string, boost::shared_ptr<const IPNetworkTries> > IPNetworkTries_map;
+
+// Cumulative traffic counters last reported for an active session
+struct SyslogSessionCounters {
+    SyslogSessionCounters() :
+        total_bytes(0), bytes_from_client(0), bytes_from_server(0),
+        packets_from_client(0), packets_from_server(0) {
+    }
+    uint64_t total_bytes;
+    uint64_t bytes_from_client;
+    uint64_t bytes_from_server;
+    uint64_t packets_from_client;
+    uint64_t packets_from_server;
+};
+
+//
+// Counters of active sessions keyed by a 64 bit hash of the session unique
+// key. Entries are spread over shards, each with its own mutex, so that
+// sessions of different devices do not serialize on a single lock. Sessions
+// which are not updated within the timeout, for example because their
+// CLOSE syslog was lost, are evicted lazily: each shard is swept when it is
+// next written after the timeout, and all shards are swept when the limit
+// on the number of sessions is reached.
+//
+class SyslogSessionCounterStore {
+    public:
+        SyslogSessionCounterStore(uint64_t limit, uint64_t timeout_usec);
+        static uint64_t SessionKey(const std::string &uvename,
+                                   const std::string &session_id);
+        bool Add(uint64_t key, const SyslogSessionCounters &counters,
+                 uint64_t now_usec);
+        bool Fetch(uint64_t key, SyslogSessionCounters *counters) const;
+        bool Remove(uint64_t key);
+        size_t Evict(uint64_t now_usec);
+        size_t size() const { return size_; }
+        uint64_t evicted() const { return evicted_; }
+        static const size_t kNumShards = 64;
+    private:
+        struct Entry {
+            SyslogSessionCounters counters;
+            uint64_t last_update_usec;
+        };
+        typedef boost::unordered_map<uint64_t, Entry> EntryMap;
+        struct Shard {
+            Shard() : next_eviction_usec(0) {}
+            mutable tbb::mutex mutex;
+            EntryMap entries;
+            uint64_t next_eviction_usec;
+        };
+        Shard &GetShard(uint64_t key) { return shards_[key % kNumShards]; }
+        const Shard &GetShard(uint64_t key) const {
+            return shards_[key % kNumShards];
+        }
+        size_t EvictShard(Shard *shard, uint64_t now_usec);
+
+        Shard shards_[kNumShards];
+        tbb::atomic<uint64_t> size_;
+        tbb::atomic<uint64_t> evicted_;
+        tbb::atomic<uint64_t> next_full_eviction_usec_;
+        const uint64_t limit_;
+        const uint64_t timeout_usec_;
+};
 
 class StructuredSyslogConfig {
     public:
-        StructuredSyslogConfig(ConfigClientCollector *config_client, uint64_t structured_syslog_active_session_map_limit);
+        StructuredSyslogConfig(ConfigClientCollector *config_client, uint64_t structured_syslog_active_session_map_limit,
+                               uint64_t structured_syslog_active_session_timeout = kDefaultActiveSessionTimeout);
         ~StructuredSyslogConfig();
-        uint32_t IPToUInt(std::string ip);
         int get_ip_version (const std::string ip);
-        bool AddSyslogSessionCounter(const std::string session_unique_key,
-                                        std::map<std::string, uint64_t> session_traffic_counters);
-        int RemoveSyslogSessionCounter(const std::string &session_unique_key);
-        bool FetchSyslogSessionCounters(const std::string &session_unique_key,
-                                                    std::map<std::string, uint64_t> &session_traffic_counters);
+        bool AddSyslogSessionCounter(uint64_t session_key,
+                                     const SyslogSessionCounters &session_traffic_counters);
+        int RemoveSyslogSessionCounter(uint64_t session_key);
+        bool FetchSyslogSessionCounters(uint64_t session_key,
+                                        SyslogSessionCounters *session_traffic_counters);
+        uint64_t SyslogSessionCount() const { return session_counters_.size(); }
+        // SD-WAN UVEs are published through the aggregator when one is
+        // set, and sent for every syslog otherwise
+        structured_syslog::impl::StructuredSyslogUVEAggregator *uve_aggregator() const {
+            return uve_aggregator_;
+        }
+        void set_uve_aggregator(structured_syslog::impl::StructuredSyslogUVEAggregator *aggregator) {
+            uve_aggregator_ = aggregator;
+        }
+        // seconds
+        static const uint64_t kDefaultActiveSessionTimeout = 3600;
         std::vector<std::string> split_into_vector(std::string  str, char delimiter) ;
         bool AddNetwork(const std::string& key, const std::string& network, const std::string& mask, const std::string& location);
         bool RefreshNetworksMap(const std::string location);
-        std::string FindNetwork(std::string ip, std::string key, std::string src_location);
+        // Publish networks added or removed since the last call to FindNetwork
+        void UpdateNetworkTries();
+        std::string FindNetwork(const std::string &ip, const std::string &key,
+                                const std::string &src_location);
         void AddHostnameRecord(const std::string &name, const std::string &hostaddr,
                                   const std::string &tenant, const std::string &location,
                                   const std::string &device, const std::string &tags,
@@ -439,8 +548,13 @@ class StructuredSyslogConfig {
         //networks_map_refresh_mutex should be used only to refresh networks map
         boost::mutex networks_map_refresh_mutex;
         IPNetworks_map networks_map_;
-        SyslogSessionConfig session_config_map_;
+        //Tenant::VPN changed in networks_map_ since the tries were updated
+        std::set<std::string> networks_map_changed_;
+        //Lookup tries built from networks_map_, read without the mutex
+        boost::shared_ptr<const IPNetworkTries_map> network_tries_;
         uint64_t activeSessionConfigMapLIMIT;
+        SyslogSessionCounterStore session_counters_;
+        structured_syslog::impl::StructuredSyslogUVEAggregator *uve_aggregator_;
 };
 
 
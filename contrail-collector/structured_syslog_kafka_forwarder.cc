@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <utility>
 #include <algorithm>
+#include <map>
 
 #include <tbb/mutex.h>
 #include <tbb/atomic.h>
@@ -15,14 +16,27 @@
 #include <base/time_util.h>
 #include <base/timer.h>
 #include <base/logging.h>
+#include <base/string_util.h>
 
 #include <librdkafka/rdkafkacpp.h>
+#include <sandesh/sandesh.h>
+#include <analytics/collector_uve_types.h>
 #include "structured_syslog_kafka_forwarder.h"
 
 using std::map;
 using std::string;
 using boost::system::error_code;
 
+// Produced with the message as opaque, keeps the payload alive until the
+// delivery report since the producer does not copy it
+struct KafkaForwarderMessage {
+    KafkaForwarderMessage(boost::shared_ptr<std::string> v,
+                          KafkaForwarder::PartitionCounters *c) :
+        value(v), counters(c) {}
+    boost::shared_ptr<std::string> value;
+    KafkaForwarder::PartitionCounters *counters;
+};
+
 class KafkaForwarderDeliveryReportCb : public RdKafka::DeliveryReportCb {
  public:
   tbb::atomic<size_t> count;
@@ -33,20 +47,21 @@ class KafkaForwarderDeliveryReportCb : public RdKafka::DeliveryReportCb {
   }
 
   void dr_cb(RdKafka::Message &message) {
+    KafkaForwarderMessage *fmsg =
+        static_cast<KafkaForwarderMessage *>(message.msg_opaque());
     if (message.err() != RdKafka::ERR_NO_ERROR) {
-        if (message.msg_opaque() != NULL) {
-            LOG(ERROR, "KafkaForwarder: Message delivery for " << message.key()
-                << ": FAILED: " << message.errstr() << ": gen: " <<
-                string((char *)(message.msg_opaque())));
-        } else {
-            LOG(ERROR, "KafkaForwarder: Message delivery for " << message.key()
-                << ": FAILED: " << message.errstr());
+        LOG(ERROR, "KafkaForwarder: Message delivery to partition " <<
+            message.partition() << ": FAILED: " << message.errstr());
+        if (fmsg != NULL) {
+            fmsg->counters->delivery_failures++;
         }
     } else {
         count.fetch_and_increment();
+        if (fmsg != NULL) {
+            fmsg->counters->delivered++;
+        }
     }
-    char * cc = (char *)message.msg_opaque();
-    delete[] cc;
+    delete fmsg;
   }
 };
 
@@ -84,46 +99,101 @@ static inline unsigned int djb_hash(const char *str, size_t len) {
     return hash;
 }
 
-class KafkaForwarderPartitionerCb : public RdKafka::PartitionerCb {
-  public:
-    tbb::atomic<size_t> count;
-    KafkaForwarderPartitionerCb() {
-        count = 0;
-    }
-    int32_t partitioner_cb(const RdKafka::Topic *topic,
-                                  const std::string *key,
-                                  int32_t partition_cnt,
-                                  void *msg_opaque) {
-        int32_t pt = djb_hash(key->c_str(), key->size()) % partition_cnt;
-        LOG(DEBUG,"KafkaForwarder PartitionerCb key " << key->c_str()  <<
-            " len " << key->size() << " count " << partition_cnt << " pt " <<
-            pt);
-        count.fetch_and_increment();
-        return pt;
-    }
-};
-
 KafkaForwarderEventCb k_forwarder_event_cb;
 KafkaForwarderDeliveryReportCb k_forwarder_dr_cb;
-KafkaForwarderPartitionerCb k_forwarder_part_cb;
 
 void
-KafkaForwarder::Send(const string& value, const string& skey) {
+KafkaForwarder::Send(boost::shared_ptr<std::string> value,
+                     const string& skey) {
     if (k_forwarder_event_cb.disableKafka) {
         LOG(INFO, "KafkaForwarder ignoring Send");
         return;
     }
 
     if (producer_) {
-        int32_t partition = k_forwarder_part_cb.partitioner_cb(NULL, &skey,
-                        partitions_ , NULL);
-        producer_->produce(topic_.get(), partition,
-            RdKafka::Producer::MSG_COPY,
-            const_cast<char *>(value.c_str()), value.length(),
-            NULL, NULL);
+        // Partition on the key ourselves so that the syslogs of a host
+        // always land on the same partition
+        int32_t partition = djb_hash(skey.c_str(), skey.size()) % partitions_;
+        PartitionCounters &counters(partition_counters_[partition]);
+        KafkaForwarderMessage *fmsg = new KafkaForwarderMessage(value,
+                                                                &counters);
+        // Neither MSG_COPY nor MSG_FREE, the payload stays owned by fmsg
+        RdKafka::ErrorCode err = producer_->produce(topic_.get(), partition,
+            0, const_cast<char *>(value->data()), value->length(),
+            NULL, fmsg);
+        if (err != RdKafka::ERR_NO_ERROR) {
+            delete fmsg;
+            if (err == RdKafka::ERR__QUEUE_FULL) {
+                counters.queue_full_drops++;
+            } else {
+                LOG(ERROR, "KafkaForwarder: produce to partition " <<
+                    partition << " FAILED: " << RdKafka::err2str(err));
+                counters.delivery_failures++;
+                counters.messages++;
+            }
+            return;
+        }
+        counters.messages++;
+        counters.bytes += value->length();
+        send_count_.fetch_and_increment();
+        // Serve the delivery reports after every batch rather than only
+        // from the timer, so that delivered payloads are released soon
+        if (produced_.fetch_and_increment() % kPollBatchMessages ==
+            kPollBatchMessages - 1) {
+            producer_->poll(0);
+        }
+    }
+}
+
+void
+KafkaForwarder::GetPartitionStats(std::vector<PartitionStats> *stats) const {
+    stats->clear();
+    stats->resize(partitions_);
+    for (unsigned int i = 0; i < partitions_; i++) {
+        const PartitionCounters &counters(partition_counters_[i]);
+        PartitionStats &pstats((*stats)[i]);
+        pstats.messages = counters.messages;
+        pstats.bytes = counters.bytes;
+        pstats.delivered = counters.delivered;
+        pstats.delivery_failures = counters.delivery_failures;
+        pstats.queue_full_drops = counters.queue_full_drops;
     }
 }
 
+void
+KafkaForwarder::SendPartitionStats() const {
+    std::vector<PartitionStats> stats;
+    GetPartitionStats(&stats);
+    PartitionStats total;
+    std::map<std::string, KafkaForwarderPartitionInfo> partition_info;
+    for (size_t i = 0; i < stats.size(); i++) {
+        const PartitionStats &pstats(stats[i]);
+        if (pstats.messages != 0 || pstats.queue_full_drops != 0) {
+            KafkaForwarderPartitionInfo info;
+            info.set_messages(pstats.messages);
+            info.set_bytes(pstats.bytes);
+            info.set_queued(pstats.queued());
+            info.set_delivery_failures(pstats.delivery_failures);
+            info.set_queue_full_drops(pstats.queue_full_drops);
+            partition_info.insert(std::make_pair(integerToString(i), info));
+        }
+        total.messages += pstats.messages;
+        total.bytes += pstats.bytes;
+        total.delivered += pstats.delivered;
+        total.delivery_failures += pstats.delivery_failures;
+        total.queue_full_drops += pstats.queue_full_drops;
+    }
+    LOG(INFO, "KafkaForwarder: messages " << total.messages << " bytes " <<
+        total.bytes << " queued " << total.queued() <<
+        " delivery_failures " << total.delivery_failures <<
+        " queue_full_drops " << total.queue_full_drops);
+
+    KafkaForwarderStats kfs;
+    kfs.set_name(Sandesh::source());
+    kfs.set_partition_stats(partition_info);
+    KafkaForwarderStatsTrace::Send(kfs);
+}
+
 bool
 KafkaForwarder::KafkaTimer() {
     {
@@ -146,16 +216,17 @@ KafkaForwarder::KafkaTimer() {
 
         kafka_elapsed_ms_ = 0;
 
-        if ((k_forwarder_dr_cb.count==0) && (k_forwarder_part_cb.count!=0)) {
+        if ((k_forwarder_dr_cb.count==0) && (send_count_!=0)) {
             LOG(INFO, "No KafkaForwarder Callbacks");
-        } else if (k_forwarder_dr_cb.count==k_forwarder_part_cb.count) {
+        } else if (k_forwarder_dr_cb.count==send_count_) {
             LOG(INFO, "Got KafkaForwarder Callbacks " << k_forwarder_dr_cb.count);
         } else {
             LOG(INFO, "Some KafkaForwarder Callbacks missed - got " << k_forwarder_dr_cb.count
-                       << "/" << k_forwarder_part_cb.count);
+                       << "/" << send_count_);
         }
         k_forwarder_dr_cb.count = 0;
-        k_forwarder_part_cb.count = 0;
+        send_count_ = 0;
+        SendPartitionStats();
 
         if (k_forwarder_event_cb.disableKafka) {
             LOG(ERROR, "KafkaForwarder Needs Restart");
@@ -197,6 +268,10 @@ KafkaForwarder::KafkaForwarder(EventManager *evm,
     ssl_keyfile_(kafka_options.keyfile),
     ssl_certfile_(kafka_options.certfile),
     ssl_cacert_(kafka_options.ca_cert),
+    linger_ms_(kafka_options.forwarder_linger_ms),
+    batch_num_messages_(kafka_options.forwarder_batch_num_messages),
+    compression_codec_(kafka_options.forwarder_compression_codec),
+    partition_counters_(new PartitionCounters[partitions]),
     kafka_elapsed_ms_(0),
     kafka_start_ms_(UTCTimestampUsec()/1000),
     kafka_tick_ms_(0),
@@ -205,6 +280,8 @@ KafkaForwarder::KafkaForwarder(EventManager *evm,
                  TaskScheduler::GetInstance()->GetTaskId(
                  "KafkaForwarder Timer"))) {
 
+    send_count_ = 0;
+    produced_ = 0;
     kafka_timer_->Start(1000,
         boost::bind(&KafkaForwarder::KafkaTimer, this), NULL);
     if (brokers.empty()) return;
@@ -214,6 +291,18 @@ KafkaForwarder::KafkaForwarder(EventManager *evm,
 void
 KafkaForwarder::Stop(void) {
     if (producer_) {
+        // Wait for the queued messages to be delivered, their delivery
+        // reports release the payloads
+        uint64_t deadline_ms = ClockMonotonicUsec() / 1000 +
+            kFlushTimeout_ms_;
+        while (producer_->outq_len() > 0 &&
+               ClockMonotonicUsec() / 1000 < deadline_ms) {
+            producer_->poll(100);
+        }
+        if (producer_->outq_len() > 0) {
+            LOG(ERROR, "KafkaForwarder: " << producer_->outq_len() <<
+                " messages not delivered at stop");
+        }
         topic_.reset();
         producer_.reset();
         assert(RdKafka::wait_destroyed(8000) == 0);
@@ -228,6 +317,16 @@ KafkaForwarder::Init(void) {
     conf->set("metadata.broker.list", brokers_, errstr);
     conf->set("event_cb", &k_forwarder_event_cb, errstr);
     conf->set("dr_cb", &k_forwarder_dr_cb, errstr);
+    if (linger_ms_ != Options::Kafka::kUnset) {
+        SetConf(conf, "queue.buffering.max.ms", integerToString(linger_ms_));
+    }
+    if (batch_num_messages_ != Options::Kafka::kUnset) {
+        SetConf(conf, "batch.num.messages",
+                integerToString(batch_num_messages_));
+    }
+    if (!compression_codec_.empty()) {
+        SetConf(conf, "compression.codec", compression_codec_);
+    }
     if (ssl_enable_) {
         conf->set("security.protocol", "SSL", errstr);
         conf->set("ssl.key.location", ssl_keyfile_, errstr);
@@ -245,6 +344,16 @@ KafkaForwarder::Init(void) {
     return true;
 }
 
+void
+KafkaForwarder::SetConf(RdKafka::Conf *conf, const string &name,
+                        const string &value) {
+    string errstr;
+    if (conf->set(name, value, errstr) != RdKafka::Conf::CONF_OK) {
+        LOG(ERROR, "KafkaForwarder: invalid " << name << " " << value <<
+            ": " << errstr);
+    }
+}
+
 void
 KafkaForwarder::Shutdown() {
     TimerManager::DeleteTimer(kafka_timer_);
@@ -6,6 +6,10 @@
 #define __STRUCTURED_SYSLOG_KAFKAFORWARDER_H__
 
 #include <string>
+#include <vector>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <tbb/atomic.h>
 #include <librdkafka/rdkafkacpp.h>
 #include "io/event_manager.h"
 #include "options.h"
@@ -14,10 +18,49 @@ class KafkaForwarder {
     public:
 
         static const int kActivityCheckPeriod_ms_ = 30000;
+        static const int kFlushTimeout_ms_ = 5000;
+        // Delivery reports are served after this many messages produced
+        static const size_t kPollBatchMessages = 256;
+
+        struct PartitionStats {
+            PartitionStats() :
+                messages(0), bytes(0), delivered(0), delivery_failures(0),
+                queue_full_drops(0) {}
+            // messages handed to the producer and not yet acknowledged
+            uint64_t queued() const {
+                return messages - delivered - delivery_failures;
+            }
+            uint64_t messages;
+            uint64_t bytes;
+            uint64_t delivered;
+            uint64_t delivery_failures;
+            uint64_t queue_full_drops;
+        };
+
+        // Per partition counters updated from the producer and the
+        // delivery report callback
+        struct PartitionCounters {
+            PartitionCounters() {
+                messages = 0;
+                bytes = 0;
+                delivered = 0;
+                delivery_failures = 0;
+                queue_full_drops = 0;
+            }
+            tbb::atomic<uint64_t> messages;
+            tbb::atomic<uint64_t> bytes;
+            tbb::atomic<uint64_t> delivered;
+            tbb::atomic<uint64_t> delivery_failures;
+            tbb::atomic<uint64_t> queue_full_drops;
+        };
 
         const unsigned int partitions_;
 
-        void Send(const std::string& value, const std::string& skey);
+        // The producer does not copy value, it holds a reference to it
+        // until the message is delivered
+        void Send(boost::shared_ptr<std::string> value,
+                  const std::string& skey);
+        void GetPartitionStats(std::vector<PartitionStats> *stats) const;
 
         KafkaForwarder(EventManager *evm,
                      const std::string brokers,
@@ -31,11 +74,16 @@ class KafkaForwarder {
 
     private:
         bool KafkaTimer();
+        // Logs the totals and sends the per partition counters in the
+        // KafkaForwarderStats UVE
+        void SendPartitionStats() const;
         void Stop(void);
         bool Init(void);
+        void SetConf(RdKafka::Conf *conf, const std::string &name,
+                     const std::string &value);
 
         EventManager *evm_;
-        
+
         boost::shared_ptr<RdKafka::Producer> producer_;
         std::string brokers_;
         std::string topic_str_;
@@ -43,7 +91,13 @@ class KafkaForwarder {
         std::string ssl_keyfile_;
         std::string ssl_certfile_;
         std::string ssl_cacert_;
+        uint32_t linger_ms_;
+        uint32_t batch_num_messages_;
+        std::string compression_codec_;
         boost::shared_ptr<RdKafka::Topic> topic_;
+        boost::scoped_array<PartitionCounters> partition_counters_;
+        tbb::atomic<size_t> send_count_;
+        tbb::atomic<size_t> produced_;
         uint64_t kafka_elapsed_ms_;
         const uint64_t kafka_start_ms_;
         uint64_t kafka_tick_ms_;
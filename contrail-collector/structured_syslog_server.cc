@@ -2,11 +2,15 @@
 // Copyright (c) 2017 Juniper Networks, Inc. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstring>
 #include <utility>
 #include <string>
 #include <vector>
 #include <boost/asio/buffer.hpp>
 #include <boost/intrusive_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <sandesh/sandesh_message_builder.h>
@@ -18,9 +22,9 @@
 #include <io/tcp_session.h>
 #include <io/udp_server.h>
 
-#include <rapidjson/document.h>
-#include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
 
 #include "structured_syslog_server.h"
 #include "structured_syslog_server_impl.h"
@@ -42,7 +46,7 @@ void StructuredSyslogDecorate(SyslogParser::syslog_m_t &v, StructuredSyslogConfi
 void StructuredSyslogPush(SyslogParser::syslog_m_t v, StatWalker::StatTableInsertFn stat_db_callback,
     std::vector<std::string> tagged_fields);
 void StructuredSyslogUVESummarize(SyslogParser::syslog_m_t v, bool summarize_user, StructuredSyslogConfig *config_obj);
-boost::shared_ptr<std::string> StructuredSyslogJsonMessage(SyslogParser::syslog_m_t v);
+boost::shared_ptr<std::string> StructuredSyslogJsonMessage(const SyslogParser::syslog_m_t &v);
 
 size_t DecorateMsg(boost::shared_ptr<std::string> msg, const std::string &key, const std::string &val, size_t prev_pos) {
     if (msg == NULL) {
@@ -365,35 +369,320 @@ void StructuredSyslogPush(SyslogParser::syslog_m_t v, StatWalker::StatTableInser
     PushStructuredSyslogStats(v, std::string(), &stat_walker, tagged_fields);
 }
 
+// rapidjson output stream appending to a std::string, lets the writer
+// generate the forwarded message in place
+struct JsonStringStream {
+    typedef char Ch;
+    explicit JsonStringStream(std::string *str) : str_(str) {}
+    void Put(Ch c) { str_->push_back(c); }
+    void Flush() {}
+    std::string *str_;
+};
+
+// The kafka producer holds a forwarded message until its delivery report,
+// the buffer of the message then goes back to a pool for a later message.
+// Each thread formats the messages with a writer of its own, reset for
+// every message.
+static const size_t kJsonBufferPoolSize = 1024;
+static const size_t kJsonBufferMaxCapacity = 16 * 1024;
+static tbb::concurrent_queue<std::string *> json_buffers;
+static tbb::atomic<size_t> json_buffers_count;
+
+static void ReleaseJsonBuffer(std::string *str) {
+    if (str->capacity() <= kJsonBufferMaxCapacity) {
+        if (json_buffers_count.fetch_and_increment() < kJsonBufferPoolSize) {
+            json_buffers.push(str);
+            return;
+        }
+        json_buffers_count.fetch_and_decrement();
+    }
+    delete str;
+}
+
+static boost::shared_ptr<std::string> AllocateJsonBuffer() {
+    std::string *str;
+    if (json_buffers.try_pop(str)) {
+        json_buffers_count.fetch_and_decrement();
+        str->clear();
+    } else {
+        str = new std::string;
+    }
+    return boost::shared_ptr<std::string>(str, ReleaseJsonBuffer);
+}
+
+class JsonMessageWriter {
+public:
+    JsonMessageWriter() : stream_(NULL), writer_(stream_) {}
+    contrail_rapidjson::Writer<JsonStringStream> &Reset(std::string *str) {
+        stream_.str_ = str;
+        writer_.Reset(stream_);
+        return writer_;
+    }
+private:
+    JsonStringStream stream_;
+    contrail_rapidjson::Writer<JsonStringStream> writer_;
+};
+
+static boost::thread_specific_ptr<JsonMessageWriter> json_writer;
+
 boost::shared_ptr<std::string>
-StructuredSyslogJsonMessage(SyslogParser::syslog_m_t v) {
-    contrail_rapidjson::Document doc;
-    doc.SetObject();
-    for (std::map<std::string, SyslogParser::Holder>::iterator i=v.begin(); i!=v.end(); ++i) {
-        SyslogParser::Holder val = i->second;
-        const std::string &key(val.key);
+StructuredSyslogJsonMessage(const SyslogParser::syslog_m_t &v) {
+    static const size_t kJsonFieldSizeEstimate = 32;
+    boost::shared_ptr<std::string> json_msg(AllocateJsonBuffer());
+    json_msg->reserve(v.size() * kJsonFieldSizeEstimate);
+    if (json_writer.get() == NULL) {
+        json_writer.reset(new JsonMessageWriter);
+    }
+    contrail_rapidjson::Writer<JsonStringStream> &writer(
+        json_writer->Reset(json_msg.get()));
+    writer.StartObject();
+    for (SyslogParser::syslog_m_t::const_iterator i = v.begin();
+         i != v.end(); ++i) {
+        const SyslogParser::Holder &val(i->second);
         if (val.type == SyslogParser::str_type) {
-            contrail_rapidjson::Value vk;
-            contrail_rapidjson::Value value(contrail_rapidjson::kStringType);
-            value.SetString(val.s_val.c_str(), doc.GetAllocator());
-            doc.AddMember(vk.SetString(key.c_str(),
-                                 doc.GetAllocator()), value, doc.GetAllocator());
+            writer.String(val.key.c_str(), val.key.length());
+            writer.String(val.s_val.c_str(), val.s_val.length());
         }
         else if (val.type == SyslogParser::int_type) {
-            contrail_rapidjson::Value vk;
-            contrail_rapidjson::Value value(contrail_rapidjson::kNumberType);
-            value.SetUint64(val.i_val);
-            doc.AddMember(vk.SetString(key.c_str(),
-                                 doc.GetAllocator()), value, doc.GetAllocator());
+            writer.String(val.key.c_str(), val.key.length());
+            writer.Uint64(val.i_val);
         }
     }
-    contrail_rapidjson::StringBuffer buffer;
-    contrail_rapidjson::Writer<contrail_rapidjson::StringBuffer> writer(buffer);
-    doc.Accept(writer);
-    boost::shared_ptr<std::string> json_msg(new std::string(buffer.GetString()));
+    writer.EndObject();
     return json_msg;
 }
 
+//
+// StructuredSyslogUVEAggregator
+//
+#define SDWAN_METRIC_SUM(field)                                \
+    if (src.__isset.field) {                                   \
+        dst->set_##field(dst->field + src.field);              \
+    }
+#define SDWAN_METRIC_LATEST(field)                             \
+    if (src.__isset.field) {                                   \
+        dst->set_##field(src.field);                           \
+    }
+
+static void MergeSDWANMetrics(SDWANMetrics_diff *dst,
+                              const SDWANMetrics_diff &src) {
+    SDWAN_METRIC_SUM(session_duration);
+    SDWAN_METRIC_SUM(session_count);
+    SDWAN_METRIC_SUM(total_bytes);
+    SDWAN_METRIC_SUM(input_bytes);
+    SDWAN_METRIC_SUM(output_bytes);
+    SDWAN_METRIC_SUM(total_pkts);
+    SDWAN_METRIC_SUM(input_pkts);
+    SDWAN_METRIC_SUM(output_pkts);
+    SDWAN_METRIC_SUM(sla_violation_duration);
+    SDWAN_METRIC_SUM(sla_violation_count);
+    SDWAN_METRIC_SUM(session_switch_count);
+    SDWAN_METRIC_SUM(jitter_violation_count);
+    SDWAN_METRIC_SUM(rtt_violation_count);
+    SDWAN_METRIC_SUM(pkt_loss_violation_count);
+    SDWAN_METRIC_SUM(minor_alarms_raised);
+    SDWAN_METRIC_SUM(major_alarms_raised);
+    SDWAN_METRIC_SUM(critical_alarms_raised);
+    SDWAN_METRIC_SUM(total_alarms_raised);
+    SDWAN_METRIC_SUM(total_alarms_cleared);
+}
+
+static void MergeSDWANMetrics(SDWANMetrics_dial *dst,
+                              const SDWANMetrics_dial &src) {
+    SDWAN_METRIC_LATEST(txbps);
+    SDWAN_METRIC_LATEST(rxbps);
+    SDWAN_METRIC_LATEST(rtt);
+    SDWAN_METRIC_LATEST(pkt_loss);
+    SDWAN_METRIC_LATEST(rtt_jitter);
+    SDWAN_METRIC_LATEST(egress_jitter);
+    SDWAN_METRIC_LATEST(ingress_jitter);
+    SDWAN_METRIC_LATEST(sampling_percentage);
+    SDWAN_METRIC_LATEST(score);
+}
+
+static void MergeSDWANMetrics(SDWANKPIMetrics_diff *dst,
+                              const SDWANKPIMetrics_diff &src) {
+    SDWAN_METRIC_SUM(session_close_count);
+    SDWAN_METRIC_SUM(bps);
+}
+
+#undef SDWAN_METRIC_SUM
+#undef SDWAN_METRIC_LATEST
+
+template <typename MetricsT>
+static void MergeSDWANMetricsMap(std::map<std::string, MetricsT> *dst,
+                                 const std::map<std::string, MetricsT> &src) {
+    for (typename std::map<std::string, MetricsT>::const_iterator it =
+             src.begin(); it != src.end(); ++it) {
+        std::pair<typename std::map<std::string, MetricsT>::iterator, bool>
+            ret(dst->insert(*it));
+        if (!ret.second) {
+            MergeSDWANMetrics(&ret.first->second, it->second);
+        }
+    }
+}
+
+#define SDWAN_RECORD_MERGE(field)                              \
+    if (src.__isset.field) {                                   \
+        MergeSDWANMetricsMap(&dst->field, src.field);          \
+        dst->__isset.field = true;                             \
+    }
+
+static void MergeSDWANRecord(SDWANMetricsRecord *dst,
+                             const SDWANMetricsRecord &src) {
+    SDWAN_RECORD_MERGE(app_metrics_diff_sla);
+    SDWAN_RECORD_MERGE(app_metrics_dial_sla);
+    SDWAN_RECORD_MERGE(app_metrics_diff_link);
+    SDWAN_RECORD_MERGE(app_metrics_dial_link);
+    SDWAN_RECORD_MERGE(app_metrics_diff_user);
+    SDWAN_RECORD_MERGE(app_metrics_dial_user);
+    SDWAN_RECORD_MERGE(link_metrics_diff_traffic_type);
+    SDWAN_RECORD_MERGE(link_metrics_dial_traffic_type);
+}
+
+static void MergeSDWANRecord(SDWANTenantMetricsRecord *dst,
+                             const SDWANTenantMetricsRecord &src) {
+    SDWAN_RECORD_MERGE(tenant_metrics_diff_sla);
+    SDWAN_RECORD_MERGE(tenant_metrics_dial_sla);
+}
+
+static void MergeSDWANRecord(SDWANKPIMetricsRecord *dst,
+                             const SDWANKPIMetricsRecord &src) {
+    SDWAN_RECORD_MERGE(kpi_metrics_greater_diff);
+    SDWAN_RECORD_MERGE(kpi_metrics_lesser_diff);
+}
+
+#undef SDWAN_RECORD_MERGE
+
+template <typename RecordMapT, typename RecordT>
+static void AddSDWANRecord(RecordMapT *records, const RecordT &record) {
+    std::pair<typename RecordMapT::iterator, bool> ret(
+        records->insert(std::make_pair(record.name, record)));
+    if (!ret.second) {
+        MergeSDWANRecord(&ret.first->second, record);
+    }
+}
+
+template <typename RecordMapT, typename RecordT>
+static bool GetSDWANRecord(const RecordMapT &records, const std::string &name,
+                           RecordT *record) {
+    typename RecordMapT::const_iterator it = records.find(name);
+    if (it == records.end()) {
+        return false;
+    }
+    *record = it->second;
+    return true;
+}
+
+StructuredSyslogUVEAggregator::StructuredSyslogUVEAggregator() :
+    added_(0),
+    sent_(0) {
+}
+
+void StructuredSyslogUVEAggregator::Add(const SDWANMetricsRecord &record) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    AddSDWANRecord(&metrics_, record);
+    added_++;
+}
+
+void StructuredSyslogUVEAggregator::Add(const SDWANTenantMetricsRecord &record) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    AddSDWANRecord(&tenant_metrics_, record);
+    added_++;
+}
+
+void StructuredSyslogUVEAggregator::Add(const SDWANKPIMetricsRecord &record) {
+    tbb::mutex::scoped_lock lock(mutex_);
+    AddSDWANRecord(&kpi_metrics_, record);
+    added_++;
+}
+
+void StructuredSyslogUVEAggregator::Flush() {
+    // Swap the pending records out so that the receive path is not
+    // blocked while the UVEs are sent
+    MetricsRecordMap metrics;
+    TenantMetricsRecordMap tenant_metrics;
+    KPIMetricsRecordMap kpi_metrics;
+    {
+        tbb::mutex::scoped_lock lock(mutex_);
+        metrics.swap(metrics_);
+        tenant_metrics.swap(tenant_metrics_);
+        kpi_metrics.swap(kpi_metrics_);
+        sent_ += metrics.size() + tenant_metrics.size() + kpi_metrics.size();
+    }
+    for (MetricsRecordMap::const_iterator it = metrics.begin();
+         it != metrics.end(); ++it) {
+        SDWANMetrics::Send(it->second, "ObjectCPETable");
+    }
+    for (TenantMetricsRecordMap::const_iterator it = tenant_metrics.begin();
+         it != tenant_metrics.end(); ++it) {
+        SDWANTenantMetrics::Send(it->second, "ObjectCPETable");
+    }
+    for (KPIMetricsRecordMap::const_iterator it = kpi_metrics.begin();
+         it != kpi_metrics.end(); ++it) {
+        SDWANKPIMetrics::Send(it->second, "ObjectCPETable");
+    }
+    LOG(DEBUG, "UVE: flushed " << metrics.size() << " SDWANMetrics, " <<
+        tenant_metrics.size() << " SDWANTenantMetrics, " <<
+        kpi_metrics.size() << " SDWANKPIMetrics UVEs");
+}
+
+bool StructuredSyslogUVEAggregator::GetMetricsRecord(const std::string &name,
+        SDWANMetricsRecord *record) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return GetSDWANRecord(metrics_, name, record);
+}
+
+bool StructuredSyslogUVEAggregator::GetTenantMetricsRecord(
+        const std::string &name, SDWANTenantMetricsRecord *record) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return GetSDWANRecord(tenant_metrics_, name, record);
+}
+
+bool StructuredSyslogUVEAggregator::GetKPIMetricsRecord(
+        const std::string &name, SDWANKPIMetricsRecord *record) const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return GetSDWANRecord(kpi_metrics_, name, record);
+}
+
+size_t StructuredSyslogUVEAggregator::size() const {
+    tbb::mutex::scoped_lock lock(mutex_);
+    return metrics_.size() + tenant_metrics_.size() + kpi_metrics_.size();
+}
+
+static void StructuredSyslogUVESend(StructuredSyslogConfig *config_obj,
+                                    const SDWANMetricsRecord &record) {
+    StructuredSyslogUVEAggregator *aggregator =
+        config_obj ? config_obj->uve_aggregator() : NULL;
+    if (aggregator) {
+        aggregator->Add(record);
+    } else {
+        SDWANMetrics::Send(record, "ObjectCPETable");
+    }
+}
+
+static void StructuredSyslogUVESend(StructuredSyslogConfig *config_obj,
+                                    const SDWANTenantMetricsRecord &record) {
+    StructuredSyslogUVEAggregator *aggregator =
+        config_obj ? config_obj->uve_aggregator() : NULL;
+    if (aggregator) {
+        aggregator->Add(record);
+    } else {
+        SDWANTenantMetrics::Send(record, "ObjectCPETable");
+    }
+}
+
+static void StructuredSyslogUVESend(StructuredSyslogConfig *config_obj,
+                                    const SDWANKPIMetricsRecord &record) {
+    StructuredSyslogUVEAggregator *aggregator =
+        config_obj ? config_obj->uve_aggregator() : NULL;
+    if (aggregator) {
+        aggregator->Add(record);
+    } else {
+        SDWANKPIMetrics::Send(record, "ObjectCPETable");
+    }
+}
+
 //Identify the prefix and return the VPN name if nothing matches then return routing_instance
 const std::string get_VPNName(const std::string &routing_instance){
     if (routing_instance.size() > 16 && (routing_instance.compare(0, 16, "Default-reverse-") == 0)){
@@ -509,18 +798,19 @@ void StructuredSyslogUVESummarizeData(SyslogParser::syslog_m_t v, bool summarize
     to just diff computation (in case of session-close only).
     */
     const std::string session_id_32(SyslogParser::GetMapVals(v, "session-id-32", "-1"));
-    const std::string session_unique_key = uvename + "::" + session_id_32;
-    std::map<std::string, uint64_t> session_prev_traffic_counters;
+    const uint64_t session_key =
+            SyslogSessionCounterStore::SessionKey(uvename, session_id_32);
+    SyslogSessionCounters session_prev_traffic_counters;
     bool found_session_prev_counters =
-            config_obj->FetchSyslogSessionCounters(session_unique_key,
-                                            session_prev_traffic_counters);
+            config_obj->FetchSyslogSessionCounters(session_key,
+                                            &session_prev_traffic_counters);
     if (found_session_prev_counters) {
         // read previous counters
-        prev_total_bytes = session_prev_traffic_counters["total-bytes"];
-        prev_bytes_from_client = session_prev_traffic_counters["bytes-from-client"];
-        prev_bytes_from_server = session_prev_traffic_counters["bytes-from-server"];
-        prev_packets_from_server = session_prev_traffic_counters["packets-from-server"];
-        prev_packets_from_client = session_prev_traffic_counters["packets-from-client"];
+        prev_total_bytes = session_prev_traffic_counters.total_bytes;
+        prev_bytes_from_client = session_prev_traffic_counters.bytes_from_client;
+        prev_bytes_from_server = session_prev_traffic_counters.bytes_from_server;
+        prev_packets_from_server = session_prev_traffic_counters.packets_from_server;
+        prev_packets_from_client = session_prev_traffic_counters.packets_from_client;
 
         // update & process the counter which are new and greater than before.
         if ((prev_total_bytes > SyslogParser::GetMapVal(v, "total-bytes", 0)) ||
@@ -533,9 +823,10 @@ void StructuredSyslogUVESummarizeData(SyslogParser::syslog_m_t v, bool summarize
             // session is closed.
             // Remove session counters from syslog session counter map.
             int removed_sess_counter =
-                config_obj->RemoveSyslogSessionCounter(session_unique_key);
+                config_obj->RemoveSyslogSessionCounter(session_key);
             if (removed_sess_counter == 0) {
-                LOG(ERROR, "Syslog Session Counter NOT removed for key " << session_unique_key);
+                LOG(ERROR, "Syslog Session Counter NOT removed for key " << uvename <<
+                    "::" << session_id_32);
             }
         }
     }
@@ -546,13 +837,13 @@ void StructuredSyslogUVESummarizeData(SyslogParser::syslog_m_t v, bool summarize
     // processing vol update is enabled.
     if (!is_close && boost::iequals(process_vol_update, "True")) {
         if (process_curr_counter) {
-            std::map<std::string, uint64_t> session_curr_traffic_counters;
-            session_curr_traffic_counters["total-bytes"] = SyslogParser::GetMapVal(v, "total-bytes", 0);
-            session_curr_traffic_counters["bytes-from-client"] = SyslogParser::GetMapVal(v, "bytes-from-client", 0);
-            session_curr_traffic_counters["bytes-from-server"] = SyslogParser::GetMapVal(v, "bytes-from-server", 0);
-            session_curr_traffic_counters["packets-from-server"] = SyslogParser::GetMapVal(v, "packets-from-server", 0);
-            session_curr_traffic_counters["packets-from-client"] = SyslogParser::GetMapVal(v, "packets-from-client", 0);
-            bool addSessionCounter = config_obj->AddSyslogSessionCounter(session_unique_key, session_curr_traffic_counters);
+            SyslogSessionCounters session_curr_traffic_counters;
+            session_curr_traffic_counters.total_bytes = SyslogParser::GetMapVal(v, "total-bytes", 0);
+            session_curr_traffic_counters.bytes_from_client = SyslogParser::GetMapVal(v, "bytes-from-client", 0);
+            session_curr_traffic_counters.bytes_from_server = SyslogParser::GetMapVal(v, "bytes-from-server", 0);
+            session_curr_traffic_counters.packets_from_server = SyslogParser::GetMapVal(v, "packets-from-server", 0);
+            session_curr_traffic_counters.packets_from_client = SyslogParser::GetMapVal(v, "packets-from-client", 0);
+            bool addSessionCounter = config_obj->AddSyslogSessionCounter(session_key, session_curr_traffic_counters);
             if (!addSessionCounter) {
                 LOG(ERROR, "StructuredSyslogUVESummarizeData - Syslog message rejected.");
                 return;
@@ -675,7 +966,7 @@ void StructuredSyslogUVESummarizeData(SyslogParser::syslog_m_t v, bool summarize
             sdwankpimetricrecord_source.set_kpi_metrics_lesser_diff(sdwan_kpi_metrics_diff_source);
         }
     }//End of Update maps for SDWANKPI metrics record
-    SDWANKPIMetrics::Send(sdwankpimetricrecord_source,"ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwankpimetricrecord_source);
 
     std::string link1, link2, link1_info, link2_info, traffic_destination_link1, traffic_destination_link2, link_type_link1, link_type_link2;
     int64_t link1_bytes = SyslogParser::GetMapVal(v, "uplink-tx-bytes", -1);
@@ -944,8 +1235,8 @@ void StructuredSyslogUVESummarizeData(SyslogParser::syslog_m_t v, bool summarize
         */
     }
 
-    SDWANMetrics::Send(sdwanmetricrecord, "ObjectCPETable");
-    SDWANTenantMetrics::Send(sdwantenantmetricrecord, "ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwanmetricrecord);
+    StructuredSyslogUVESend(config_obj, sdwantenantmetricrecord);
 
     return;
 }
@@ -1003,7 +1294,8 @@ double calculate_link_score(int64_t latency, int64_t packet_loss, int64_t jitter
 }
 
 
-void StructuredSyslogUVESummarizeAppQoePSMR(SyslogParser::syslog_m_t v, bool summarize_user) {
+void StructuredSyslogUVESummarizeAppQoePSMR(SyslogParser::syslog_m_t v, bool summarize_user,
+                                           StructuredSyslogConfig *config_obj) {
     SDWANMetricsRecord sdwanmetricrecord;
     SDWANTenantMetricsRecord sdwantenantmetricrecord;
     const std::string location(SyslogParser::GetMapVals(v, "location", "UNKNOWN"));
@@ -1146,12 +1438,13 @@ void StructuredSyslogUVESummarizeAppQoePSMR(SyslogParser::syslog_m_t v, bool sum
     tenant_metrics_dial_sla.insert(std::make_pair(tenantmetric_key, sdwanmetric));
     sdwantenantmetricrecord.set_tenant_metrics_dial_sla(tenant_metrics_dial_sla);
 
-    SDWANTenantMetrics::Send(sdwantenantmetricrecord, "ObjectCPETable");
-    SDWANMetrics::Send(sdwanmetricrecord, "ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwantenantmetricrecord);
+    StructuredSyslogUVESend(config_obj, sdwanmetricrecord);
     return;
 }
 
-void StructuredSyslogUVESummarizeAppQoeBPS(SyslogParser::syslog_m_t v, bool summarize_user) {
+void StructuredSyslogUVESummarizeAppQoeBPS(SyslogParser::syslog_m_t v, bool summarize_user,
+                                           StructuredSyslogConfig *config_obj) {
     SDWANMetricsRecord sdwanmetricrecord;
     SDWANTenantMetricsRecord sdwantenantmetricrecord;
     const std::string location(SyslogParser::GetMapVals(v, "location", "UNKNOWN"));
@@ -1254,13 +1547,14 @@ void StructuredSyslogUVESummarizeAppQoeBPS(SyslogParser::syslog_m_t v, bool summ
     link_metrics_diff_traffic_type.insert(std::make_pair(linkmetricmap_key, sdwanmetric));
     sdwanmetricrecord.set_link_metrics_diff_traffic_type(link_metrics_diff_traffic_type);
 
-    SDWANMetrics::Send(sdwanmetricrecord, "ObjectCPETable");
-    SDWANTenantMetrics::Send(sdwantenantmetricrecord, "ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwanmetricrecord);
+    StructuredSyslogUVESend(config_obj, sdwantenantmetricrecord);
 
     return;
 }
 
-void StructuredSyslogUVESummarizeAppQoeSMV(SyslogParser::syslog_m_t v, bool summarize_user) {
+void StructuredSyslogUVESummarizeAppQoeSMV(SyslogParser::syslog_m_t v, bool summarize_user,
+                                           StructuredSyslogConfig *config_obj) {
     SDWANMetricsRecord sdwanmetricrecord;
     SDWANTenantMetricsRecord sdwantenantmetricrecord;
     const std::string location(SyslogParser::GetMapVals(v, "location", "UNKNOWN"));
@@ -1397,13 +1691,14 @@ void StructuredSyslogUVESummarizeAppQoeSMV(SyslogParser::syslog_m_t v, bool summ
     sdwanmetricrecord.set_link_metrics_diff_traffic_type(link_metrics_diff_traffic_type);
     //sdwanmetricrecord.set_link_metrics_dial_traffic_type(link_metrics_dial_traffic_type);
 
-    SDWANMetrics::Send(sdwanmetricrecord, "ObjectCPETable");
-    SDWANTenantMetrics::Send(sdwantenantmetricrecord, "ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwanmetricrecord);
+    StructuredSyslogUVESend(config_obj, sdwantenantmetricrecord);
 
     return;
 }
 
-void StructuredSyslogUVESummarizeAppQoeASMR(SyslogParser::syslog_m_t v, bool summarize_user) {
+void StructuredSyslogUVESummarizeAppQoeASMR(SyslogParser::syslog_m_t v, bool summarize_user,
+                                           StructuredSyslogConfig *config_obj) {
     SDWANMetricsRecord sdwanmetricrecord;
     SDWANTenantMetricsRecord sdwantenantmetricrecord;
     const std::string location(SyslogParser::GetMapVals(v, "location", "UNKNOWN"));
@@ -1487,8 +1782,8 @@ void StructuredSyslogUVESummarizeAppQoeASMR(SyslogParser::syslog_m_t v, bool sum
     tenant_metrics_dial_sla.insert(std::make_pair(tenantmetric_key, sdwanmetric));
     sdwantenantmetricrecord.set_tenant_metrics_dial_sla(tenant_metrics_dial_sla);
 
-    SDWANMetrics::Send(sdwanmetricrecord, "ObjectCPETable");
-    SDWANTenantMetrics::Send(sdwantenantmetricrecord, "ObjectCPETable");
+    StructuredSyslogUVESend(config_obj, sdwanmetricrecord);
+    StructuredSyslogUVESend(config_obj, sdwantenantmetricrecord);
     return;
 }
 
@@ -1505,17 +1800,17 @@ void StructuredSyslogUVESummarize(SyslogParser::syslog_m_t v, bool summarize_use
         StructuredSyslogUVESummarizeData(v, summarize_user, config_obj);
     }
     else if (boost::equals(tag, "APPQOE_BEST_PATH_SELECTED")) {
-        StructuredSyslogUVESummarizeAppQoeBPS(v, summarize_user);
+        StructuredSyslogUVESummarizeAppQoeBPS(v, summarize_user, config_obj);
     }
     else if (boost::equals(tag, "APPQOE_PASSIVE_SLA_METRIC_REPORT") ||
              boost::equals(tag, "APPQOE_APP_PASSIVE_SLA_METRIC_REPORT")) {
-        StructuredSyslogUVESummarizeAppQoePSMR(v, summarize_user);
+        StructuredSyslogUVESummarizeAppQoePSMR(v, summarize_user, config_obj);
     }
     else if (boost::equals(tag, "APPQOE_ACTIVE_SLA_METRIC_REPORT")) {
-        StructuredSyslogUVESummarizeAppQoeASMR(v, summarize_user);
+        StructuredSyslogUVESummarizeAppQoeASMR(v, summarize_user, config_obj);
     }
     else if (boost::equals(tag, "APPQOE_SLA_METRIC_VIOLATION")) {
-        StructuredSyslogUVESummarizeAppQoeSMV(v, summarize_user);
+        StructuredSyslogUVESummarizeAppQoeSMV(v, summarize_user, config_obj);
     }
 }
 
@@ -1775,171 +2070,295 @@ void StructuredSyslogDecorate (SyslogParser::syslog_m_t &v, StructuredSyslogConf
 }
 
 
-/* -------Structured syslog parsing.
+/* -------Structured syslog framing.
    -------For newly received tcp message on port 3514(structured-syslog port),
 
-1. Check if there is old buffer from previous message (start ptr = 0)
-    a. If yes,
-    then append newly received tcp message to old buffer, and take forward
-    appended message for further processing, otherwise take forward just
-    the received message
-
-2. Identifying the start and end of the message, ( Len = received buffer length
-    or the appended buffer + received buffer length)
-    a. Find the first space (" ")
-    from the start, and take up the word from the start (pointer) to the space
-    for parsing prepended syslog message length.
-    b. If message length conversion doesn't turn up to be 0,
-        - then end pointer is pointed to message length + no. of
-          bytes after space and start pointer to first char after space.
-    c. But if message length conversion is 0, determination of start and end of
-    syslog message is done by parsing each byte/char of the message till either
-    the start and end are found or we run our of Len.
-        - The position of char '<' is taken as start pointer and
-          char ']' is taken as end pointer.
-
-3. If end char of structured syslog ']' is not found upon parsing the complete
-received message, the message from the start till the end of received message is
-put into session buffer anticipating the remaining part of structured syslog in
-next tcp buffer which will be appended to session buffer as pointedin step 1.
-The necessary condition here is that the end pointer index should be either
-greater than the received tcp buffer length (len, in this case we will directly
-put the message into buffer) or it should point to received tcp buffer length
-(len), in this case will check for last element to have end delimiter ']'. check
-for following condition below in code for step 3.  (((end > len) || ((end ==
-len) && (*(p + end - 1) != ']') )) && (sess_buf != NULL))
-
-4. If the above step (step 3) holds true, i.e. complete syslog message remains
-to be be received, the process follows again from step 1. Else next step (step
-5) follows for parsing the identified structured  syslog message.
-
-5. The identified structured syslog message is first parsed for syslog part of
-message and then structured part of syslog.
-
-6. Upon parsing of syslog message in step 5, check for the remaining message in
-received tcp buffer (multiple syslog messages can be in single buffer) and shift
-start and end pointers as follows below.
-    a. Shift the start pointer to 1 + end pointer of previously parsed message,
-    if parsing the syslog in step 5 is unsuccessful.
-    b. Shift the start pointer to previous start pointer + message length of
-    previously parsed message, if parsing the syslog in step 5 is successful.
-
-7. Check if start pointer index is equal to received tcp buffer length (meaning
-the complete received tcp buffer is parsed), otherwise flow jumps to step 2 with
-new (shifted) start pointer till we parse complete received tcp buffer. */
+1. Frames are delimited either by octet counting (RFC 6587 3.4.1), where the
+   message is prefixed by its length in decimal followed by a space, or by
+   non-transparent framing, where the message runs up to the closing ']' of
+   its structured data. Separators (space, CR, LF, NUL) between frames are
+   skipped.
+
+2. Octet counting is checked first: the length prefix is parsed in place and
+   the end of the frame is known without looking at the message body. Only if
+   there is no valid prefix is the body searched for ']' using memchr. Any
+   bytes in front of the '<' of the PRI are skipped in that case.
+
+3. If the end of the received buffer is reached before the frame is
+   complete, the partial frame is saved in the per session buffer along with
+   how far it has been framed (the octet count if known, otherwise how far
+   it has already been searched for ']').
+
+4. On the next read only the bytes needed to complete the pending frame are
+   appended to the session buffer: the remaining octets if the length is
+   known, the rest of the length prefix if it was split, or everything up to
+   the next ']'. The pending frame is then processed from the session buffer
+   and the rest of the received buffer is framed in place without copying.
+
+5. For UDP there is no session buffer, every datagram is expected to carry
+   whole messages and a trailing partial frame is processed as is. */
+
+StructuredSyslogSessionBuffer::StructuredSyslogSessionBuffer() :
+    buf_(kInitialSize),
+    head_(0),
+    tail_(0),
+    frame_length_(0),
+    scan_offset_(0) {
+}
 
+void StructuredSyslogSessionBuffer::Append(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (tail_ + len > buf_.size()) {
+        // Reclaim the space already consumed at the head
+        size_t pending = tail_ - head_;
+        if (head_ != 0) {
+            if (pending) {
+                memmove(&buf_[0], &buf_[head_], pending);
+            }
+            head_ = 0;
+            tail_ = pending;
+        }
+        if (tail_ + len > buf_.size()) {
+            size_t size = buf_.size();
+            while (size < tail_ + len) {
+                size *= 2;
+            }
+            buf_.resize(size);
+        }
+    }
+    memcpy(&buf_[tail_], data, len);
+    tail_ += len;
+}
+
+void StructuredSyslogSessionBuffer::Consume(size_t len) {
+    assert(len <= size());
+    head_ += len;
+    frame_length_ = 0;
+    scan_offset_ = 0;
+    if (head_ == tail_) {
+        head_ = tail_ = 0;
+        // Give back the memory grown for a large frame
+        if (buf_.size() > kInitialSize) {
+            std::vector<uint8_t>(kInitialSize).swap(buf_);
+        }
+    }
+}
+
+void StructuredSyslogSessionBuffer::Clear() {
+    Consume(size());
+}
+
+std::string StructuredSyslogSessionBuffer::ToString() const {
+    return std::string(data(), data() + size());
+}
+
+// Longest accepted octet count prefix and frame
+static const size_t kMaxOctetCountDigits = 9;
+static const size_t kMaxFrameLength = 1024 * 1024;
+
+enum FrameStatus {
+    FRAME_COMPLETE,
+    FRAME_INCOMPLETE,
+    FRAME_TOO_LONG
+};
+
+struct StructuredSyslogFrame {
+    StructuredSyslogFrame() :
+        start(0), body(0), end(0), octet_counted(false), scanned(false) {
+    }
+    size_t start;       // First byte of the frame, including length prefix
+    size_t body;        // First byte of the syslog message
+    size_t end;         // One past the last byte of the frame
+    bool octet_counted; // Frame length is known from the prefix
+    bool scanned;       // [start, end) has been searched for ']'
+};
+
+static inline bool IsFrameSeparator(uint8_t c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\0';
+}
+
+static FrameStatus FindStructuredSyslogFrame(const uint8_t *p, size_t len,
+    size_t start, size_t scan_from, StructuredSyslogFrame *frame) {
+    while (start < len && IsFrameSeparator(p[start])) {
+        ++start;
+    }
+    *frame = StructuredSyslogFrame();
+    frame->start = frame->body = frame->end = start;
+    if (start == len) {
+        return FRAME_INCOMPLETE;
+    }
+    // Octet counting: MSG-LEN SP SYSLOG-MSG
+    size_t idx = start;
+    size_t digits_end = std::min(len, start + kMaxOctetCountDigits + 1);
+    size_t mlen = 0;
+    while (idx < digits_end && isdigit(p[idx])) {
+        mlen = mlen * 10 + (p[idx] - '0');
+        ++idx;
+    }
+    if (idx > start) {
+        if (idx == len) {
+            // Length prefix split across reads
+            return FRAME_INCOMPLETE;
+        }
+        if (p[idx] == ' ' && mlen != 0) {
+            if (mlen > kMaxFrameLength) {
+                return FRAME_TOO_LONG;
+            }
+            frame->octet_counted = true;
+            frame->body = idx + 1;
+            frame->end = frame->body + mlen;
+            return frame->end <= len ? FRAME_COMPLETE : FRAME_INCOMPLETE;
+        }
+    }
+    // Non-transparent framing, up to and including the closing ']'
+    FrameStatus status = FRAME_INCOMPLETE;
+    size_t from = std::max(start, scan_from);
+    const uint8_t *close = static_cast<const uint8_t *>(
+        memchr(p + from, ']', len - from));
+    frame->scanned = true;
+    if (close != NULL) {
+        frame->end = close - p + 1;
+        status = FRAME_COMPLETE;
+    } else {
+        frame->end = len;
+    }
+    const uint8_t *pri = static_cast<const uint8_t *>(
+        memchr(p + start, '<', frame->end - start));
+    if (pri != NULL) {
+        frame->start = frame->body = pri - p;
+    }
+    return status;
+}
+
+// Returns the number of bytes from data needed to complete the frame
+// pending in the session buffer, or to make progress in framing it
+static size_t PendingFrameBytes(const StructuredSyslogSessionBuffer *sess_buf,
+    const uint8_t *data, size_t len) {
+    if (sess_buf->frame_length() != 0) {
+        return std::min(sess_buf->frame_length() - sess_buf->size(), len);
+    }
+    if (sess_buf->scan_offset() == 0) {
+        // Rest of the length prefix and the separator
+        size_t idx = 0;
+        while (idx < len && idx <= kMaxOctetCountDigits && isdigit(data[idx])) {
+            ++idx;
+        }
+        return std::min(idx + 1, len);
+    }
+    const uint8_t *close = static_cast<const uint8_t *>(
+        memchr(data, ']', len));
+    return close != NULL ? close - data + 1 : len;
+}
+
+static void SavePendingFrameState(StructuredSyslogSessionBuffer *sess_buf,
+    const StructuredSyslogFrame &frame) {
+    if (frame.octet_counted) {
+        sess_buf->set_frame_length(frame.end - frame.start);
+    } else if (frame.scanned) {
+        sess_buf->set_scan_offset(sess_buf->size());
+    }
+}
+
+static bool ProcessStructuredSyslogFrame(const uint8_t *p,
+    const StructuredSyslogFrame &frame, const std::string &ip,
+    StatWalker::StatTableInsertFn stat_db_callback, StructuredSyslogConfig *config_obj,
+    boost::shared_ptr<StructuredSyslogForwarder> forwarder) {
+  SyslogParser::syslog_m_t v;
+  bool r = SyslogParser::parse_syslog (p + frame.start, p + frame.end, v);
+  LOG(DEBUG, "structured_syslog: " << std::string(p + frame.start, p + frame.end) <<
+             " start: " << frame.start << " end: " << frame.end << " parsed " << r);
+  if (!r) {
+      LOG(ERROR, "structured_syslog parse failed for: " <<
+          std::string(p + frame.start, p + frame.end));
+      return false;
+  }
+  v.insert(std::pair<std::string, SyslogParser::Holder>("ip",
+        SyslogParser::Holder("ip", ip)));
+  LOG(DEBUG, "structured_syslog message_len: " << frame.end - frame.body);
+  SyslogParser::PostParsing(v);
+  if (StructuredSyslogPostParsing(v, config_obj, stat_db_callback, p + frame.body,
+          frame.end - frame.body, forwarder) == false) {
+      LOG(DEBUG, "structured_syslog not handled");
+  }
+  return true;
+}
 
 bool ProcessStructuredSyslog(const uint8_t *data, size_t len,
     const boost::asio::ip::address remote_address,
     StatWalker::StatTableInsertFn stat_db_callback, StructuredSyslogConfig *config_obj,
-    boost::shared_ptr<StructuredSyslogForwarder> forwarder, boost::shared_ptr<std::string> sess_buf) {
+    boost::shared_ptr<StructuredSyslogForwarder> forwarder,
+    StructuredSyslogSessionBufferPtr sess_buf) {
   boost::system::error_code ec;
   const std::string ip(remote_address.to_string(ec));
-  const uint8_t *p;
-  std::string full_log;
+  StructuredSyslogFrame frame;
+  FrameStatus status;
+  size_t start = 0;
+  bool r = true;
 
-  size_t end, len_end, start = 0;
-  bool r;
-
-  while (!*(data + len - 1))
+  while (len && !*(data + len - 1))
       --len;
-  LOG(DEBUG, "full structured_syslog: " << std::string(data + start, data + len) << " len: " << len);
-  if (sess_buf != NULL) {
-    full_log = *sess_buf + std::string(data + start, data + len);
-    p = reinterpret_cast<const uint8_t*>(full_log.data());
-    len += sess_buf->length();
-    LOG(DEBUG, "structured_syslog sess_buf + new buf: " << full_log << " len: " <<  len);
-    sess_buf->clear();
-  } else {
-    p = data;
+  LOG(DEBUG, "full structured_syslog: " << std::string(data, data + len) << " len: " << len);
+
+  // Complete the frame left over from the previous read
+  while (sess_buf != NULL && !sess_buf->empty()) {
+      if (start == len) {
+          return true;
+      }
+      size_t needed = PendingFrameBytes(sess_buf.get(), data + start, len - start);
+      sess_buf->Append(data + start, needed);
+      start += needed;
+      status = FindStructuredSyslogFrame(sess_buf->data(), sess_buf->size(), 0,
+          sess_buf->scan_offset(), &frame);
+      if (status == FRAME_TOO_LONG ||
+          (status == FRAME_INCOMPLETE && sess_buf->size() > kMaxFrameLength)) {
+          LOG(ERROR, "structured_syslog frame length too high, discarding "
+              "session buffer of length: " << sess_buf->size());
+          sess_buf->Clear();
+          return false;
+      }
+      if (status == FRAME_INCOMPLETE) {
+          sess_buf->Consume(frame.start);
+          SavePendingFrameState(sess_buf.get(), frame);
+          continue;
+      }
+      r = ProcessStructuredSyslogFrame(sess_buf->data(), frame, ip,
+          stat_db_callback, config_obj, forwarder);
+      sess_buf->Consume(frame.end);
   }
-  
-  do {
-      SyslogParser::syslog_m_t v;
-      end = start + 1;
-      len_end = start + 1;
-      while ((*(p + len_end - 1) != ' ') && (len_end < len))
-        ++len_end;
-
-      /* use prepended msg len to find the end of msg, if it exists */
-      if (len_end != len) {
-          bool is_msg_len = true;
-          int mlen_idx = start;
-          long int mlen = 0;
-          while (is_msg_len && ((p + mlen_idx) < (p + len_end - 1))) {
-              if (!(isdigit(*(p + mlen_idx)))) {is_msg_len = false;}
-              mlen_idx++;
-          }
-          if (is_msg_len) {
-              std::string mlenstr  = std::string(p + start, p + len_end);
-              mlen = strtol(mlenstr.c_str(), NULL, 10);
+
+  // Frame the rest of the received buffer in place
+  while (start < len) {
+      status = FindStructuredSyslogFrame(data, len, start, start, &frame);
+      if (status == FRAME_TOO_LONG) {
+          LOG(ERROR, "structured_syslog frame length too high, discarding: "
+              << std::string(data + start, data + std::min(len, start + 2048)));
+          return false;
+      }
+      if (status == FRAME_INCOMPLETE) {
+          if (frame.start == len) {
+              break;
           }
-          LOG (DEBUG, "prepended message length: " << mlen);
-          if (mlen != 0) {
-            len_end += mlen;
-          } else {
-              while ((*(p + len_end - 1) != ']') && (len_end < len)){
-                /* check for start of message if message length doesn't exist */
-                if (*(p + end - 1 ) == '<'){
-                  start = end - 1;
-                }
-                ++end;
-                ++len_end;
+          if (sess_buf != NULL) {
+              if (len - frame.start > kMaxFrameLength) {
+                  LOG(ERROR, "structured_syslog frame length too high, "
+                      "discarding buffer of length: " << len - frame.start);
+                  return false;
               }
-          }
-      }
-      end = len_end;
-
-      // check if end of tcp buffer is reached and message delimiter ']' has arrived,
-      // if not, wait till it comes in next tcp buffer
-      if (((end > len) ||
-         ((end == len) && (*(p + end - 1) != ']') )) && (sess_buf != NULL)) {
-          /* limiting session buffer to 5KB */
-          if (len-start < 5120) {
-              sess_buf->append(std::string(p + start, p + len));
-              LOG(DEBUG, "structured_syslog next sess_buf: "
-                << *sess_buf << " len: "<< len-start);
+              sess_buf->Append(data + frame.start, len - frame.start);
+              SavePendingFrameState(sess_buf.get(), frame);
+              LOG(DEBUG, "structured_syslog next sess_buf len: " <<
+                  sess_buf->size());
               return true;
           }
-          else {
-              LOG(ERROR, "next session buffer length too high, discarding buffer!!"
-                "[log msg buf truncated to 2048 bytes] next sess_buf: "
-                << std::string(p + start, p + 2048) << " length: "<< len-start);
-              return false;
-          }
-      }
-      r = SyslogParser::parse_syslog (p + start, p + end, v);
-      LOG(DEBUG, "structured_syslog: " << std::string(p + start, p + end) <<
-                 " start: " << start << " end: " << end << " parsed " << r);
-      if (r) {
-          v.insert(std::pair<std::string, SyslogParser::Holder>("ip",
-                SyslogParser::Holder("ip", ip)));
-          std::stringstream lenss;
-          lenss << SyslogParser::GetMapVal(v, "msglen", 0);
-          std::string lenstr = lenss.str();
-          int message_len = SyslogParser::GetMapVal(v, "msglen", len);
-          if (message_len != (int)len) {
-            start += lenstr.length() + 1;
-          }
-          LOG(DEBUG, "structured_syslog message_len: " << message_len);
-          SyslogParser::PostParsing(v);
-          if (StructuredSyslogPostParsing(v, config_obj, stat_db_callback, p + start, end-start, forwarder) == false)
-          {
-            LOG(DEBUG, "structured_syslog not handled");
-          }
-          if (message_len == (int)len) {
-            start = end + 1;
-          } else {
-            start += message_len;
-          }
-      } else {
-          LOG(ERROR, "structured_syslog parse failed for: " << std::string(p + start, p + end));
-          start = end;
-      }
-      while (!v.empty()) {
-          v.erase(v.begin());
+          // No session to carry the rest over, process what is there
+          frame.end = len;
       }
-  } while (start<len);
+      r = ProcessStructuredSyslogFrame(data, frame, ip, stat_db_callback,
+          config_obj, forwarder);
+      start = frame.end;
+  }
   return r;
 }
 
@@ -1954,13 +2373,28 @@ public:
         const Options::Kafka &kafka_options,
         uint16_t structured_syslog_kafka_partitions,
         uint64_t structured_syslog_active_session_map_limit,
+        uint64_t structured_syslog_active_session_timeout,
+        uint32_t structured_syslog_uve_aggregation_interval,
         ConfigClientCollector *config_client,
         StatWalker::StatTableInsertFn stat_db_callback) :
         udp_server_(new StructuredSyslogUdpServer(evm, port,
             stat_db_callback)),
         tcp_server_(new StructuredSyslogTcpServer(evm, port,
             stat_db_callback)),
-        structured_syslog_config_(new StructuredSyslogConfig(config_client, structured_syslog_active_session_map_limit)) {
+        structured_syslog_config_(new StructuredSyslogConfig(config_client, structured_syslog_active_session_map_limit,
+                                                             structured_syslog_active_session_timeout)),
+        uve_flush_timer_(NULL) {
+        if (structured_syslog_uve_aggregation_interval != 0) {
+            uve_aggregator_.reset(new structured_syslog::impl::StructuredSyslogUVEAggregator());
+            structured_syslog_config_->set_uve_aggregator(uve_aggregator_.get());
+            uve_flush_timer_ = TimerManager::CreateTimer(*evm->io_service(),
+                                   "structured syslog UVE flush timer",
+                                   TaskScheduler::GetInstance()->GetTaskId("structured syslog UVE flusher"));
+            uve_flush_timer_->Start(structured_syslog_uve_aggregation_interval * 1000,
+                boost::bind(&StructuredSyslogServerImpl::FlushUVEs, this),
+                boost::bind(&StructuredSyslogServerImpl::FlushUVEsErrorHandler, this, _1, _2));
+            LOG(INFO, "SD-WAN UVEs aggregated over " << structured_syslog_uve_aggregation_interval << "s");
+        }
         if ((structured_syslog_tcp_forward_dst.size() != 0) || structured_syslog_kafka_broker != "") {
             forwarder_.reset(new StructuredSyslogForwarder (evm, structured_syslog_tcp_forward_dst,
                                                             structured_syslog_kafka_broker,
@@ -1997,6 +2431,14 @@ public:
         udp_server_ = NULL;
         tcp_server_->Shutdown();
         TcpServerManager::DeleteServer(tcp_server_);
+        if (uve_flush_timer_) {
+            TimerManager::DeleteTimer(uve_flush_timer_);
+            uve_flush_timer_ = NULL;
+        }
+        if (uve_aggregator_) {
+            structured_syslog_config_->set_uve_aggregator(NULL);
+            uve_aggregator_->Flush();
+        }
         if (forwarder_ != NULL)
             forwarder_->Shutdown();
     }
@@ -2007,6 +2449,15 @@ public:
     }
 
 private:
+    bool FlushUVEs() {
+        uve_aggregator_->Flush();
+        return true;
+    }
+
+    void FlushUVEsErrorHandler(string error_name, string error_message) {
+        LOG(ERROR, "FlushUVEs Timer Err: " << error_name << " " << error_message);
+    }
+
     //
     // StructuredSyslogUdpServer
     //
@@ -2044,7 +2495,7 @@ private:
             size_t recv_buffer_size(boost::asio::buffer_size(recv_buffer));
             if (!structured_syslog::impl::ProcessStructuredSyslog(boost::asio::buffer_cast<const uint8_t *>(recv_buffer),
                     recv_buffer_size, remote_endpoint.address(), stat_db_callback_, config_obj_, forwarder_,
-                    boost::shared_ptr<std::string>())) {
+                    structured_syslog::impl::StructuredSyslogSessionBufferPtr())) {
                 LOG(ERROR, "ProcessStructuredSyslog UDP FAILED for : " << remote_endpoint);
             } else {
                 LOG(DEBUG, "ProcessStructuredSyslog UDP SUCCESS for : " << remote_endpoint);
@@ -2071,7 +2522,7 @@ private:
         typedef boost::intrusive_ptr<StructuredSyslogTcpSession> StructuredSyslogTcpSessionPtr;
         StructuredSyslogTcpSession (StructuredSyslogTcpServer *server, Socket *socket) :
             TcpSession(server, socket) {
-            sess_buf.reset(new std::string(""));
+            sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
             //set_observer(boost::bind(&SyslogTcpSession::OnEvent, this, _1, _2));
         }
         virtual void OnRead (const boost::asio::const_buffer buf) {
@@ -2080,7 +2531,7 @@ private:
             //TODO: handle error
             sserver->ReadMsg(StructuredSyslogTcpSessionPtr(this), buf, socket ()->remote_endpoint(ec));
         }
-        boost::shared_ptr<std::string> sess_buf;
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
     };
 
     //
@@ -2139,6 +2590,8 @@ private:
     StructuredSyslogTcpServer *tcp_server_;
     boost::shared_ptr<StructuredSyslogForwarder> forwarder_;
     StructuredSyslogConfig *structured_syslog_config_;
+    boost::scoped_ptr<structured_syslog::impl::StructuredSyslogUVEAggregator> uve_aggregator_;
+    Timer *uve_flush_timer_;
 };
 
 StructuredSyslogServer::StructuredSyslogServer(EventManager *evm,
@@ -2147,6 +2600,8 @@ StructuredSyslogServer::StructuredSyslogServer(EventManager *evm,
     const std::string &structured_syslog_kafka_topic,
     uint16_t structured_syslog_kafka_partitions,
     uint64_t structured_syslog_active_session_map_limit,
+    uint64_t structured_syslog_active_session_timeout,
+    uint32_t structured_syslog_uve_aggregation_interval,
     const Options::Kafka &kafka_options,
     ConfigClientCollector *config_client,
     StatWalker::StatTableInsertFn stat_db_fn) {
@@ -2156,6 +2611,8 @@ StructuredSyslogServer::StructuredSyslogServer(EventManager *evm,
                                            kafka_options,
                                            structured_syslog_kafka_partitions,
                                            structured_syslog_active_session_map_limit,
+                                           structured_syslog_active_session_timeout,
+                                           structured_syslog_uve_aggregation_interval,
                                            config_client, stat_db_fn);
 }
 
@@ -2356,7 +2813,7 @@ void StructuredSyslogForwarder::Forward(boost::shared_ptr<StructuredSyslogQueueE
     }
     if (kafkaForwarder_ != NULL) {
         LOG(DEBUG, "forwarding json  - " << *(sqe->json_data));
-        kafkaForwarder_->Send(*(sqe->json_data), *(sqe->skey));
+        kafkaForwarder_->Send(sqe->json_data, *(sqe->skey));
     }
 }
 
@@ -5,18 +5,121 @@
 #ifndef ANALYTICS_STRUCTURED_SYSLOG_SERVER_IMPL_H_
 #define ANALYTICS_STRUCTURED_SYSLOG_SERVER_IMPL_H_
 
+#include <string>
+#include <vector>
+#include <tbb/mutex.h>
+#include <boost/unordered_map.hpp>
+
+#include <analytics/sdwan_uve_types.h>
 #include "stat_walker.h"
 
 namespace structured_syslog {
 namespace impl {
 
+//
+// Per TCP session reassembly buffer for structured syslog framing.
+//
+// Bytes are appended at the tail and consumed from the head. The storage
+// is reused across reads: consumed space at the head is reclaimed by
+// sliding the pending bytes back to the start of the buffer only when the
+// tail runs out of room, so a frame that spans several reads is copied
+// once instead of being rebuilt from scratch on every read. Contiguous
+// storage is kept (rather than a wrapping ring) so that a frame can be
+// handed to the syslog parser as a single [begin, end) range.
+//
+class StructuredSyslogSessionBuffer {
+ public:
+    StructuredSyslogSessionBuffer();
+
+    const uint8_t *data() const { return &buf_[0] + head_; }
+    size_t size() const { return tail_ - head_; }
+    bool empty() const { return head_ == tail_; }
+    size_t capacity() const { return buf_.size(); }
+
+    void Append(const uint8_t *data, size_t len);
+    void Consume(size_t len);
+    void Clear();
+    std::string ToString() const;
+
+    // Length of the pending octet counted frame, including the length
+    // prefix, or 0 if it is not known yet
+    size_t frame_length() const { return frame_length_; }
+    void set_frame_length(size_t frame_length) {
+        frame_length_ = frame_length;
+    }
+    // Offset from data() up to which the pending frame has already been
+    // searched for a delimiter
+    size_t scan_offset() const { return scan_offset_; }
+    void set_scan_offset(size_t scan_offset) { scan_offset_ = scan_offset; }
+
+    static const size_t kInitialSize = 8 * 1024;
+
+ private:
+    std::vector<uint8_t> buf_;
+    size_t head_;
+    size_t tail_;
+    size_t frame_length_;
+    size_t scan_offset_;
+};
+
+typedef boost::shared_ptr<StructuredSyslogSessionBuffer>
+    StructuredSyslogSessionBufferPtr;
+
+//
+// In memory aggregation of the SD-WAN UVEs summarized from structured
+// syslogs.
+//
+// Records are merged per UVE name and per metric map key, and published
+// once per aggregation interval instead of once per syslog. Attributes of
+// SDWANMetrics_diff and SDWANKPIMetrics_diff are counters and are summed;
+// attributes of SDWANMetrics_dial are gauges and keep the latest reported
+// value. Add may be called concurrently from the UDP and TCP receive
+// paths while Flush runs on the flush timer.
+//
+class StructuredSyslogUVEAggregator {
+ public:
+    StructuredSyslogUVEAggregator();
+
+    void Add(const SDWANMetricsRecord &record);
+    void Add(const SDWANTenantMetricsRecord &record);
+    void Add(const SDWANKPIMetricsRecord &record);
+    // Sends all pending UVEs and starts a new interval
+    void Flush();
+
+    // Pending records, for tests
+    bool GetMetricsRecord(const std::string &name,
+                          SDWANMetricsRecord *record) const;
+    bool GetTenantMetricsRecord(const std::string &name,
+                                SDWANTenantMetricsRecord *record) const;
+    bool GetKPIMetricsRecord(const std::string &name,
+                             SDWANKPIMetricsRecord *record) const;
+    size_t size() const;
+    uint64_t added() const { return added_; }
+    uint64_t sent() const { return sent_; }
+
+ private:
+    typedef boost::unordered_map<std::string, SDWANMetricsRecord>
+        MetricsRecordMap;
+    typedef boost::unordered_map<std::string, SDWANTenantMetricsRecord>
+        TenantMetricsRecordMap;
+    typedef boost::unordered_map<std::string, SDWANKPIMetricsRecord>
+        KPIMetricsRecordMap;
+
+    mutable tbb::mutex mutex_;
+    MetricsRecordMap metrics_;
+    TenantMetricsRecordMap tenant_metrics_;
+    KPIMetricsRecordMap kpi_metrics_;
+    uint64_t added_;
+    uint64_t sent_;
+};
+
 bool ProcessStructuredSyslog(const uint8_t *data, size_t len,
     const boost::asio::ip::address remote_address,
     StatWalker::StatTableInsertFn stat_db_callback, StructuredSyslogConfig *config_obj,
-    boost::shared_ptr<StructuredSyslogForwarder> forwarder, boost::shared_ptr<std::string> sess_buf);
+    boost::shared_ptr<StructuredSyslogForwarder> forwarder,
+    StructuredSyslogSessionBufferPtr sess_buf);
 
 }  // namespace impl
 }  // namespace structured_syslog
 
 #endif  // ANALYTICS_STRUCTURED_SYSLOG_SERVER_IMPL_H_
-
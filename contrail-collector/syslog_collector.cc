@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
 #include <map>
 
@@ -40,6 +41,7 @@
 #include <sandesh/sandesh_message_builder.h>
 
 #include "generator.h"
+#include "parser_util.h"
 #include "syslog_collector.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -420,28 +422,41 @@ std::string SyslogParser::GetSyslogFacilityName (uint64_t f)
 
 std::string SyslogParser::EscapeXmlTags (std::string text)
 {
-    std::ostringstream s;
+    // Copy runs that need no escaping in bulk, most messages have none
+    size_t pos = LineParser::FindXmlSpecial(text.data(), text.size());
+    std::string s;
+    if (pos == text.size()) {
+        s = text;
+    } else {
+        s.reserve(text.size() + 16);
+        size_t start = 0;
+        while (pos < text.size()) {
+            s.append(text, start, pos - start);
+            switch(text[pos]) {
+                case '&':  s.append("&amp;");  break;
+                case '\'': s.append("&apos;"); break;
+                case '<':  s.append("&lt;");   break;
+                case '>':  s.append("&gt;");   break;
+                default: {
+                    char ref[8];
+                    int len = snprintf(ref, sizeof(ref), "&#%u;",
+                                       (uint8_t)text[pos]);
+                    s.append(ref, len);
+                }
+            }
+            start = pos + 1;
+            pos = start + LineParser::FindXmlSpecial(text.data() + start,
+                    text.size() - start);
+        }
+        s.append(text, start, std::string::npos);
+    }
 #ifdef SYSLOG_DEBUG
     std::ostringstream ff, bb, ft;
     int i = 0;
 
     ft << "|" << text << "|\n";
-#endif
-
     for (std::string::const_iterator it = text.begin();
                                      it != text.end(); ++it) {
-        switch(*it) {
-            case '&':  s << "&amp;";  continue;
-            //case '"':  s << "&quot;"; continue;
-            case '\'': s << "&apos;"; continue;
-            case '<':  s << "&lt;";   continue;
-            case '>':  s << "&gt;";   continue;
-            default:   if (!(0x80 & *it))
-                            s << *it;
-                       else
-                            s << "&#" << (int)((uint8_t)*it) << ";";
-        }
-#ifdef SYSLOG_DEBUG
         if (!(i % 16)) {
             ft << std::endl << ff.str() + "    " + bb.str();
             ff.str("");
@@ -465,9 +480,7 @@ std::string SyslogParser::EscapeXmlTags (std::string text)
             }
         }
         i++;
-#endif
     }
-#ifdef SYSLOG_DEBUG
     int j, r = i % 16;
     ft << std::endl << ff.str();
     for (j = r; j < 16; j++)
@@ -476,11 +489,11 @@ std::string SyslogParser::EscapeXmlTags (std::string text)
         ft << " ";
     if (r < 15)
         ft << " ";
-    ft << "    " + bb.str() + "\n[" + s.str() + "]";
+    ft << "    " + bb.str() + "\n[" + s + "]";
     LOG(ERROR, __func__ << ft.str());
 #endif
 
-    return s.str();
+    return s;
 }
 
 std::string SyslogParser::GetMsgBody (syslog_m_t v) {
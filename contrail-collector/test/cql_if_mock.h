@@ -5,13 +5,16 @@
 #ifndef ANALYTICS_TEST_CQL_IF_MOCK_H_
 #define ANALYTICS_TEST_CQL_IF_MOCK_H_
 
+#include <map>
+
 #include <database/cassandra/cql/cql_if.h>
 #include <database/gendb_if.h>
 
 class CqlIfMock : public cass::cql::CqlIf {
  public:
     CqlIfMock() :
-        CqlIf() {
+        CqlIf(),
+        queue_count_(0) {
     }
 
     ~CqlIfMock() {}
@@ -27,6 +30,41 @@ class CqlIfMock : public cass::cql::CqlIf {
         return Db_AddColumnSyncProxy(cl.get());
     }
 
+    // Emulates the database queue watermarks; like the queue, a single
+    // callback is kept per count
+    void Db_SetQueueWaterMark(bool high, size_t queue_count,
+        GenDb::GenDbIf::DbQueueWaterMarkCb cb) {
+        WaterMarks &watermarks(high ? high_watermarks_ : low_watermarks_);
+        watermarks.insert(std::make_pair(queue_count, cb));
+    }
+
+    void Db_ResetQueueWaterMarks() {
+        high_watermarks_.clear();
+        low_watermarks_.clear();
+    }
+
+    // Moves the emulated queue to queue_count, invoking the callbacks of
+    // the watermarks crossed on the way
+    void SetQueueCount(size_t queue_count) {
+        if (queue_count > queue_count_) {
+            for (WaterMarks::const_iterator it =
+                     high_watermarks_.upper_bound(queue_count_);
+                 it != high_watermarks_.end() && it->first <= queue_count;
+                 ++it) {
+                it->second(it->first);
+            }
+        } else {
+            for (WaterMarks::const_reverse_iterator it =
+                     WaterMarks::const_reverse_iterator(
+                         low_watermarks_.lower_bound(queue_count_));
+                 it != low_watermarks_.rend() && it->first >= queue_count;
+                 ++it) {
+                it->second(it->first);
+            }
+        }
+        queue_count_ = queue_count;
+    }
+
     MOCK_METHOD0(Db_Init, bool());
     MOCK_METHOD0(Db_Uninit, void());
 
@@ -36,6 +74,14 @@ class CqlIfMock : public cass::cql::CqlIf {
     MOCK_METHOD1(Db_FindTablespace, bool(const std::string&));
 
     MOCK_METHOD1(Db_AddColumnfamily, bool(const GenDb::NewCf&));
+    MOCK_METHOD2(Db_AddColumnfamily, bool(const GenDb::NewCf&,
+        const std::string&));
+    MOCK_METHOD1(Db_UseColumnfamily, bool(const GenDb::NewCf&));
+    MOCK_METHOD4(Db_CreateIndex, bool(const std::string&, const std::string&,
+        const std::string&, const GenDb::ColIndexMode::type));
+    MOCK_METHOD1(Db_SetInitDone, void(bool));
+    MOCK_METHOD4(Db_GetRow, bool(GenDb::ColList *, const std::string&,
+        const GenDb::DbDataValueVec&, GenDb::DbConsistency::type));
     MOCK_METHOD1(Db_AddColumnProxy, bool(GenDb::ColList *cl));
     MOCK_METHOD1(Db_AddColumnSyncProxy, bool(GenDb::ColList *cl));
     MOCK_METHOD5(Db_GetRowAsync, bool(const std::string& cfname,
@@ -46,6 +92,11 @@ class CqlIfMock : public cass::cql::CqlIf {
         const GenDb::WhereIndexInfoVec& where_vec,
         GenDb::DbConsistency::type dconsistency, DbGetRowCb cb));
 
+ private:
+    typedef std::map<size_t, GenDb::GenDbIf::DbQueueWaterMarkCb> WaterMarks;
+    WaterMarks high_watermarks_;
+    WaterMarks low_watermarks_;
+    size_t queue_count_;
 };
 
 #endif // ANALYTICS_TEST_CQL_IF_MOCK_H_
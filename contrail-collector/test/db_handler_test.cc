@@ -3,12 +3,15 @@
  */
 
 #include <pthread.h>
+#include <unistd.h>
 
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/assign/list_of.hpp>
 #include <boost/assign/ptr_list_of.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
 
 #include <testing/gunit.h>
 #include <base/logging.h>
@@ -17,7 +20,10 @@
 
 #include <analytics/viz_types.h>
 #include <analytics/viz_constants.h>
+#include <database/gendb_constants.h>
+#include "contrail-collector/collector.h"
 #include "contrail-collector/db_handler.h"
+#include "contrail-collector/db_spool.h"
 #include "contrail-collector/db_handler_impl.h"
 #include "contrail-collector/vizd_table_desc.h"
 #include "contrail-collector/usrdef_counters.h"
@@ -26,6 +32,8 @@
 #include "contrail-collector/test/usrdef_counters_mock.h"
 
 using ::testing::Return;
+using ::testing::AtLeast;
+using ::testing::Invoke;
 using ::testing::Field;
 using ::testing::AnyOf;
 using ::testing::AnyNumber;
@@ -121,6 +129,103 @@ public:
         return db_handler()->CanRecordDataForT2(temp_t2, fc_entry);
     }
 
+    void SetWriteClassDrop(DbHandler::WriteClass wclass, bool drop) {
+        db_handler()->SetWriteClassDrop(0, wclass, drop);
+    }
+
+    void SetWriteClassWaterMarks(DbHandler::WriteClass wclass,
+        uint32_t high, uint32_t low) {
+        db_handler()->write_class_high_watermark_[wclass] = high;
+        db_handler()->write_class_low_watermark_[wclass] = low;
+    }
+
+    bool EnableSpool(const std::string &directory) {
+        db_handler()->spool_.reset(new DbSpool(directory, 1024 * 1024,
+                                               64 * 1024));
+        if (!db_handler()->spool_->Initialize()) {
+            return false;
+        }
+        db_handler()->db_init_done_ = true;
+        return true;
+    }
+
+    // Registers the database queue watermarks in the order Init does
+    void SetQueueWaterMarks() {
+        db_handler()->SetWriteClassWaterMarks();
+        db_handler()->SetSpoolWaterMarks();
+    }
+
+    bool IsSpooling() {
+        return db_handler()->spooling_;
+    }
+
+    void SpoolReplay() {
+        db_handler()->SpoolReplayTimerExpired();
+    }
+
+    bool InsertIntoDb(uint32_t key, GenDb::GenDbIf::DbAddColumnCb db_cb) {
+        std::auto_ptr<GenDb::ColList> col_list(new GenDb::ColList);
+        col_list->cfname_ = g_viz_constants.COLLECTOR_GLOBAL_TABLE;
+        col_list->rowkey_.push_back(key);
+        GenDb::DbDataValueVec *name(new GenDb::DbDataValueVec(1,
+            std::string("name")));
+        GenDb::DbDataValueVec *value(new GenDb::DbDataValueVec(1,
+            std::string("value")));
+        col_list->columns_.push_back(new GenDb::NewCol(name, value, 0));
+        return db_handler()->InsertIntoDb(col_list,
+            GenDb::DbConsistency::LOCAL_ONE, DbHandler::MESSAGE_WRITES,
+            db_cb);
+    }
+
+    void DbOpResultCb(std::vector<GenDb::DbOpResult::type> *results,
+        GenDb::DbOpResult::type dresult) {
+        results->push_back(dresult);
+    }
+
+    void GeneratorDeferCb(int *count) {
+        (*count)++;
+    }
+
+    void SchemaLockCb(int *locks) {
+        (*locks)++;
+    }
+
+    void SetCompactionStrategy(const std::string &compaction_strategy) {
+        db_handler()->compaction_strategy_ = compaction_strategy;
+    }
+
+    // Db_GetRow of SchemaVersionTable
+    bool StoredSchemaVersion(const std::string &version,
+        GenDb::ColList *col_list) {
+        col_list->cfname_ = g_viz_constants.SCHEMA_VERSION_TABLE;
+        col_list->columns_.push_back(new GenDb::NewCol(
+            g_viz_constants.SCHEMA_VERSION, version, 0));
+        return true;
+    }
+
+    bool CheckSchemaLocked(const int *locks) {
+        EXPECT_EQ(1, *locks);
+        return true;
+    }
+
+    // Expectations shared by the schema initialization tests
+    void ExpectSchemaInit() {
+        EXPECT_CALL(*dbif_mock(), Db_Init())
+            .WillOnce(Return(true));
+        EXPECT_CALL(*dbif_mock(), Db_FindTablespace(_))
+            .WillOnce(Return(true));
+        EXPECT_CALL(*dbif_mock(), Db_SetTablespace(_))
+            .WillRepeatedly(Return(true));
+        EXPECT_CALL(*dbif_mock(), Db_GetRow(_,
+                g_viz_constants.SYSTEM_OBJECT_TABLE, _, _))
+            .WillOnce(Return(false));
+        EXPECT_CALL(*dbif_mock(), Db_AddColumnSyncProxy(Pointee(Field(
+                &GenDb::ColList::cfname_,
+                g_viz_constants.SYSTEM_OBJECT_TABLE))))
+            .WillRepeatedly(Return(true));
+        EXPECT_CALL(*dbif_mock(), Db_SetInitDone(true));
+    }
+
 protected:
     SandeshMessageBuilder *builder_;
     boost::uuids::random_generator rgen_;
@@ -772,6 +877,187 @@ TEST_F(DbHandlerTest, SessionTableInsertTest) {
     }
 }
 
+TEST_F(DbHandlerTest, WriteClassDropTest) {
+    DbHandler::TagMap tmap;
+    DbHandler::AttribMap sm, attribs;
+    tmap.insert(make_pair("Source", make_pair(DbHandler::Var("127.0.0.1"),
+        sm)));
+    attribs.insert(make_pair("Source", DbHandler::Var("127.0.0.1")));
+    attribs.insert(make_pair("stat.value", DbHandler::Var((uint64_t)1)));
+    std::map<std::string, DbWriteClassInfo> write_class_info;
+
+    // Statistics are dropped above the watermark, messages are not
+    SetWriteClassDrop(DbHandler::STATISTICS_WRITES, true);
+    EXPECT_TRUE(db_handler()->IsWriteClassDropped(
+        DbHandler::STATISTICS_WRITES));
+    EXPECT_FALSE(db_handler()->IsWriteClassDropped(
+        DbHandler::MESSAGE_WRITES));
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnProxy(_))
+        .Times(0);
+    db_handler()->StatTableInsert(UTCTimestampUsec(), "WriteClassDropTest",
+        "stat", tmap, attribs, GenDb::GenDbIf::DbAddColumnCb());
+    db_handler()->GetDbWriteClassInfo(&write_class_info);
+    const DbWriteClassInfo &stats_info(write_class_info[
+        DbHandler::kWriteClassNames[DbHandler::STATISTICS_WRITES]]);
+    EXPECT_EQ(1, stats_info.get_drops());
+    EXPECT_EQ(0, stats_info.get_writes());
+    EXPECT_TRUE(stats_info.get_dropping());
+    EXPECT_EQ(0, write_class_info[DbHandler::kWriteClassNames[
+        DbHandler::SESSION_WRITES]].get_drops());
+    ::testing::Mock::VerifyAndClearExpectations(dbif_mock());
+
+    // Below the low watermark statistics are written again
+    SetWriteClassDrop(DbHandler::STATISTICS_WRITES, false);
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnProxy(_))
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+    db_handler()->StatTableInsert(UTCTimestampUsec(), "WriteClassDropTest",
+        "stat", tmap, attribs, GenDb::GenDbIf::DbAddColumnCb());
+    write_class_info.clear();
+    db_handler()->GetDbWriteClassInfo(&write_class_info);
+    const DbWriteClassInfo &stats_info2(write_class_info[
+        DbHandler::kWriteClassNames[DbHandler::STATISTICS_WRITES]]);
+    EXPECT_EQ(0, stats_info2.get_drops());
+    EXPECT_LT(0, stats_info2.get_writes());
+    EXPECT_EQ(stats_info2.get_writes(), stats_info2.get_pending());
+    EXPECT_FALSE(stats_info2.get_dropping());
+}
+
+TEST_F(DbHandlerTest, SpoolWaterMarkTest) {
+    std::ostringstream ostr;
+    ostr << "/tmp/db_handler_test." << getpid();
+    std::string directory(ostr.str());
+    boost::filesystem::remove_all(directory);
+    ASSERT_TRUE(EnableSpool(directory));
+    // Default DATABASE.{statistics,session}_writes watermarks
+    SetWriteClassWaterMarks(DbHandler::STATISTICS_WRITES, 5 * 1024 * 1024,
+        7 * 512 * 1024);
+    SetWriteClassWaterMarks(DbHandler::SESSION_WRITES, 4 * 1024 * 1024,
+        2 * 1024 * 1024);
+    SetQueueWaterMarks();
+    // Followed by the generator defer watermarks
+    int defers(0);
+    Sandesh::QueueWaterMarkInfo high_wm(
+        static_cast<size_t>(Collector::kQSizeHighWaterMark),
+        SandeshLevel::INVALID, true, true);
+    Sandesh::QueueWaterMarkInfo low_wm(
+        static_cast<size_t>(Collector::kQSizeLowWaterMark),
+        SandeshLevel::INVALID, false, true);
+    db_handler()->SetDbQueueWaterMarkInfo(high_wm,
+        boost::bind(&DbHandlerTest::GeneratorDeferCb, this, &defers));
+    db_handler()->SetDbQueueWaterMarkInfo(low_wm,
+        boost::bind(&DbHandlerTest::GeneratorDeferCb, this, &defers));
+
+    // Above the spool high watermark writes are spooled, and completed
+    dbif_mock()->SetQueueCount(DbHandler::kSpoolHighWaterMark);
+    EXPECT_TRUE(IsSpooling());
+    EXPECT_TRUE(db_handler()->IsWriteClassDropped(
+        DbHandler::STATISTICS_WRITES));
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnProxy(_))
+        .Times(0);
+    std::vector<GenDb::DbOpResult::type> results;
+    GenDb::GenDbIf::DbAddColumnCb db_cb(boost::bind(
+        &DbHandlerTest::DbOpResultCb, this, &results, _1));
+    EXPECT_TRUE(InsertIntoDb(1, db_cb));
+    EXPECT_TRUE(InsertIntoDb(2, db_cb));
+    EXPECT_THAT(results, ElementsAre(GenDb::DbOpResult::OK,
+        GenDb::DbOpResult::OK));
+    DbSpoolInfo spool_info;
+    ASSERT_TRUE(db_handler()->GetDbSpoolInfo(&spool_info));
+    EXPECT_EQ(2, spool_info.get_records());
+    // The table families and generators resume first, the spool is not
+    // replayed while the queue is above its low watermark
+    dbif_mock()->SetQueueCount(DbHandler::kSpoolLowWaterMark + 1);
+    EXPECT_FALSE(db_handler()->IsWriteClassDropped(
+        DbHandler::STATISTICS_WRITES));
+    EXPECT_FALSE(db_handler()->IsWriteClassDropped(
+        DbHandler::SESSION_WRITES));
+    EXPECT_EQ(1, defers);
+    EXPECT_TRUE(IsSpooling());
+    SpoolReplay();
+    ASSERT_TRUE(db_handler()->GetDbSpoolInfo(&spool_info));
+    EXPECT_EQ(2, spool_info.get_records());
+    ::testing::Mock::VerifyAndClearExpectations(dbif_mock());
+
+    // Below the spool low watermark the spool is replayed
+    dbif_mock()->SetQueueCount(0);
+    EXPECT_FALSE(IsSpooling());
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnProxy(_))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    SpoolReplay();
+    SpoolReplay();
+    ASSERT_TRUE(db_handler()->GetDbSpoolInfo(&spool_info));
+    EXPECT_EQ(0, spool_info.get_records());
+    EXPECT_EQ(2, spool_info.get_replays());
+    db_handler()->spool_.reset();
+    boost::filesystem::remove_all(directory);
+}
+
+TEST_F(DbHandlerTest, SchemaVersionTest) {
+    std::string version(db_handler()->SchemaVersion());
+    EXPECT_EQ(16, version.size());
+    EXPECT_EQ(std::string::npos, version.find_first_not_of("0123456789abcdef"));
+    // Stable across calls, the collectors compare it with the one stored
+    EXPECT_EQ(version, db_handler()->SchemaVersion());
+    // A compaction strategy change updates the tables
+    SetCompactionStrategy(
+        GenDb::g_gendb_constants.LEVELED_COMPACTION_STRATEGY);
+    EXPECT_NE(version, db_handler()->SchemaVersion());
+}
+
+TEST_F(DbHandlerTest, SchemaCurrentTest) {
+    int locks(0);
+    ExpectSchemaInit();
+    EXPECT_CALL(*dbif_mock(), Db_GetRow(_,
+            g_viz_constants.SCHEMA_VERSION_TABLE, _, _))
+        .WillOnce(Invoke(boost::bind(&DbHandlerTest::StoredSchemaVersion,
+            this, db_handler()->SchemaVersion(), _1)));
+    // The tables are only prepared, without the lock
+    EXPECT_CALL(*dbif_mock(), Db_AddSetTablespace(_, _))
+        .Times(0);
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnfamily(_, _))
+        .Times(0);
+    EXPECT_CALL(*dbif_mock(), Db_UseColumnfamily(_))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnSyncProxy(Pointee(Field(
+            &GenDb::ColList::cfname_,
+            g_viz_constants.SCHEMA_VERSION_TABLE))))
+        .Times(0);
+    EXPECT_TRUE(db_handler()->Init(true,
+        boost::bind(&DbHandlerTest::SchemaLockCb, this, &locks)));
+    EXPECT_EQ(0, locks);
+}
+
+TEST_F(DbHandlerTest, SchemaMismatchTest) {
+    int locks(0);
+    ExpectSchemaInit();
+    EXPECT_CALL(*dbif_mock(), Db_GetRow(_,
+            g_viz_constants.SCHEMA_VERSION_TABLE, _, _))
+        .WillOnce(Invoke(boost::bind(&DbHandlerTest::StoredSchemaVersion,
+            this, std::string("0000000000000000"), _1)));
+    // The lock is taken before the keyspace is created
+    EXPECT_CALL(*dbif_mock(), Db_AddSetTablespace(_, _))
+        .WillOnce(Invoke(boost::bind(&DbHandlerTest::CheckSchemaLocked,
+            this, &locks)));
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnfamily(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*dbif_mock(), Db_CreateIndex(_, _, _, _))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*dbif_mock(), Db_UseColumnfamily(_))
+        .Times(0);
+    // The new version is stored once the tables are created
+    EXPECT_CALL(*dbif_mock(), Db_AddColumnSyncProxy(Pointee(Field(
+            &GenDb::ColList::cfname_,
+            g_viz_constants.SCHEMA_VERSION_TABLE))))
+        .WillOnce(Return(true));
+    EXPECT_TRUE(db_handler()->Init(true,
+        boost::bind(&DbHandlerTest::SchemaLockCb, this, &locks)));
+    EXPECT_EQ(1, locks);
+}
+
 TEST_F(DbHandlerTest, CanRecordDataForT2Test) {
     /* start w/ some random number*/
     uint32_t t2 = UTCTimestampUsec() >> g_viz_constants.RowTimeInBits;
@@ -953,6 +1239,88 @@ TEST_F(UUIDRandomGenTest, DISABLED_MultiThreadedNoLock) {
     t2.Join();
 }
 
+class UserDefinedCountersTest : public ::testing::Test {
+};
+
+TEST_F(UserDefinedCountersTest, RequiredLiteral) {
+    EXPECT_EQ("error", UserDefinedCounterMatcher::RequiredLiteral("error"));
+    EXPECT_EQ("Link down on ",
+        UserDefinedCounterMatcher::RequiredLiteral("^Link down on .*"));
+    EXPECT_EQ("c interface ",
+        UserDefinedCounterMatcher::RequiredLiteral("ab*c interface [0-9]+"));
+    EXPECT_EQ(" file.conf",
+        UserDefinedCounterMatcher::RequiredLiteral("x\\d file\\.conf"));
+    EXPECT_EQ("abc", UserDefinedCounterMatcher::RequiredLiteral("abcd?"));
+    EXPECT_EQ("abc", UserDefinedCounterMatcher::RequiredLiteral("a{2}abc"));
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("error|fail"));
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("(?i)error"));
+    EXPECT_EQ("x", UserDefinedCounterMatcher::RequiredLiteral("(ab|cd)x"));
+    // The operands of numeric and control escapes are not literals
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("a\\x41BC"));
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("\\0101BC"));
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("\\cJ12"));
+    EXPECT_EQ("", UserDefinedCounterMatcher::RequiredLiteral("(a)\\12b"));
+}
+
+TEST_F(UserDefinedCountersTest, MatchEscapes) {
+    // Whatever literal is extracted, the prefiltered matches are the
+    // matches of the plain regular expressions
+    std::vector<std::string> patterns = boost::assign::list_of
+        ("a\\x41BC")("x\\x{42}y")("\\0101BC")("\\cJ12")("(a)\\1b")
+        ("file\\.conf")("Link down");
+    std::vector<std::string> texts = boost::assign::list_of
+        ("aABC")("41BC")("a41BC")("xBy")("x42y")("ABC")("0101BC")("\n12")
+        ("cJ12")("aab")("file.conf")("fileXconf")("Link down")("");
+    Cfg_t config;
+    for (size_t i = 0; i < patterns.size(); i++) {
+        config[patterns[i]] = boost::shared_ptr<UserDefinedCounterData>(
+            new UserDefinedCounterData(patterns[i], patterns[i]));
+    }
+    UserDefinedCounterMatcher matcher(config);
+    for (size_t t = 0; t < texts.size(); t++) {
+        LineParser::WordListType words;
+        matcher.Match(texts[t], &words);
+        for (size_t i = 0; i < patterns.size(); i++) {
+            EXPECT_EQ(regex_search(texts[t], contrail::regex(patterns[i])),
+                      words.find(patterns[i]) != words.end())
+                << "pattern " << patterns[i] << " text " << texts[t];
+        }
+    }
+}
+
+TEST_F(UserDefinedCountersTest, Match) {
+    Cfg_t config;
+    config["link"] = boost::shared_ptr<UserDefinedCounterData>(
+        new UserDefinedCounterData("link", "Link (up|down)"));
+    config["down"] = boost::shared_ptr<UserDefinedCounterData>(
+        new UserDefinedCounterData("down", "own$"));
+    config["any"] = boost::shared_ptr<UserDefinedCounterData>(
+        new UserDefinedCounterData("any", "[0-9]+|fail"));
+    config["nomatch"] = boost::shared_ptr<UserDefinedCounterData>(
+        new UserDefinedCounterData("nomatch", "Link sideways"));
+    UserDefinedCounterMatcher matcher(config);
+
+    LineParser::WordListType words;
+    matcher.Match("Link down", &words);
+    EXPECT_EQ(2U, words.size());
+    EXPECT_TRUE(words.find("link") != words.end());
+    EXPECT_TRUE(words.find("down") != words.end());
+    words.clear();
+    matcher.Match("Link up 10 times", &words);
+    EXPECT_EQ(2U, words.size());
+    EXPECT_TRUE(words.find("link") != words.end());
+    EXPECT_TRUE(words.find("any") != words.end());
+    words.clear();
+    matcher.Match("Lin", &words);
+    EXPECT_TRUE(words.empty());
+
+    // Matches are counted until collected
+    EXPECT_EQ(2U, config["link"]->Collect());
+    EXPECT_EQ(0U, config["link"]->Collect());
+    EXPECT_EQ(1U, config["down"]->Collect());
+    EXPECT_EQ(0U, config["nomatch"]->Collect());
+}
+
 int main(int argc, char **argv) {
     LoggingInit();
     ::testing::InitGoogleTest(&argc, argv);
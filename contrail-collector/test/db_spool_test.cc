@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include <boost/filesystem.hpp>
+#include <boost/uuid/random_generator.hpp>
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+
+#include "contrail-collector/db_spool.h"
+
+static const uint32_t kSegmentSize = 4096;
+
+class DbSpoolTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        std::ostringstream ostr;
+        ostr << "/tmp/db_spool_test." << getpid();
+        directory_ = ostr.str();
+        boost::filesystem::remove_all(directory_);
+    }
+
+    virtual void TearDown() {
+        boost::filesystem::remove_all(directory_);
+    }
+
+    std::auto_ptr<GenDb::ColList> MakeColList(uint32_t key) const {
+        std::auto_ptr<GenDb::ColList> col_list(new GenDb::ColList);
+        col_list->cfname_ = "StatsTableByStrTagV4";
+        col_list->rowkey_.push_back(key);
+        col_list->rowkey_.push_back(static_cast<uint8_t>(3));
+        col_list->rowkey_.push_back(std::string("name"));
+        GenDb::DbDataValueVec *name(new GenDb::DbDataValueVec);
+        name->push_back(std::string("source"));
+        name->push_back(GenDb::DbDataValue());
+        name->push_back(static_cast<uint16_t>(7));
+        GenDb::DbDataValueVec *value(new GenDb::DbDataValueVec);
+        value->push_back(std::string("{\"cpu\":5}"));
+        col_list->columns_.push_back(new GenDb::NewCol(name, value, 3600));
+        return col_list;
+    }
+
+    // Mounts a tmpfs of size bytes on the spool directory, in a mount
+    // namespace of the calling process, of a user namespace of its own
+    // unless running as root
+    bool MountTmpfs(size_t size) const {
+        uid_t uid(geteuid());
+        gid_t gid(getegid());
+        if (uid != 0) {
+            if (unshare(CLONE_NEWUSER | CLONE_NEWNS) != 0) {
+                return false;
+            }
+            std::ostringstream uid_map, gid_map;
+            uid_map << uid << " " << uid << " 1";
+            gid_map << gid << " " << gid << " 1";
+            if (!WriteFile("/proc/self/uid_map", uid_map.str()) ||
+                !WriteFile("/proc/self/setgroups", "deny") ||
+                !WriteFile("/proc/self/gid_map", gid_map.str())) {
+                return false;
+            }
+        } else if (unshare(CLONE_NEWNS) != 0) {
+            return false;
+        }
+        std::ostringstream options;
+        options << "size=" << size;
+        return mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == 0 &&
+            mount("tmpfs", directory_.c_str(), "tmpfs", 0,
+                  options.str().c_str()) == 0;
+    }
+
+    static bool WriteFile(const char *path, const std::string &data) {
+        int fd(open(path, O_WRONLY));
+        if (fd < 0) {
+            return false;
+        }
+        bool written(write(fd, data.data(), data.size()) ==
+                     static_cast<ssize_t>(data.size()));
+        close(fd);
+        return written;
+    }
+
+    void FillFileSystem(size_t fs_size) const {
+        DbSpool spool(directory_, 64 * kSegmentSize, kSegmentSize);
+        ASSERT_TRUE(spool.Initialize());
+        uint32_t appended(0);
+        while (spool.Append(*MakeColList(appended),
+                            GenDb::DbConsistency::LOCAL_ONE, 0)) {
+            appended++;
+        }
+        DbSpool::Stats stats;
+        spool.GetStats(&stats);
+        EXPECT_LT(0, appended);
+        EXPECT_EQ(appended, stats.records);
+        EXPECT_LT(0, stats.segments);
+        EXPECT_LE(stats.segments * kSegmentSize, fs_size);
+        EXPECT_EQ(1, stats.append_fails);
+        // No segment is left behind by the failed one
+        EXPECT_EQ(stats.segments, static_cast<uint64_t>(std::distance(
+            boost::filesystem::directory_iterator(directory_),
+            boost::filesystem::directory_iterator())));
+        EXPECT_FALSE(spool.Append(*MakeColList(appended),
+                                  GenDb::DbConsistency::LOCAL_ONE, 0));
+        // Room is made as the records are consumed
+        std::auto_ptr<GenDb::ColList> col_list;
+        GenDb::DbConsistency::type dconsistency;
+        uint8_t tag;
+        const uint64_t segments(stats.segments);
+        while (stats.segments == segments) {
+            ASSERT_TRUE(spool.Front(&col_list, &dconsistency, &tag));
+            spool.Pop();
+            spool.GetStats(&stats);
+        }
+        EXPECT_TRUE(spool.Append(*MakeColList(appended),
+                                 GenDb::DbConsistency::LOCAL_ONE, 0));
+    }
+
+    std::string directory_;
+};
+
+TEST_F(DbSpoolTest, EncodeDecode) {
+    GenDb::ColList col_list;
+    col_list.cfname_ = "MessageTable";
+    boost::uuids::random_generator uuid_generator;
+    boost::uuids::uuid uuid(uuid_generator());
+    col_list.rowkey_.push_back(uuid);
+    GenDb::DbDataValueVec *name(new GenDb::DbDataValueVec);
+    name->push_back(std::string("IPAddress"));
+    GenDb::DbDataValueVec *value(new GenDb::DbDataValueVec);
+    value->push_back(static_cast<uint8_t>(1));
+    value->push_back(static_cast<uint16_t>(2));
+    value->push_back(static_cast<uint32_t>(3));
+    value->push_back(static_cast<uint64_t>(4));
+    value->push_back(2.5);
+    value->push_back(IpAddress::from_string("10.1.1.1"));
+    value->push_back(IpAddress::from_string("2001:db8::1"));
+    value->push_back(GenDb::DbDataValue());
+    col_list.columns_.push_back(new GenDb::NewCol(name, value, 0));
+
+    std::string buf;
+    ASSERT_TRUE(DbSpool::Encode(col_list, GenDb::DbConsistency::LOCAL_ONE,
+                                5, &buf));
+    std::auto_ptr<GenDb::ColList> decoded;
+    GenDb::DbConsistency::type dconsistency;
+    uint8_t tag;
+    ASSERT_TRUE(DbSpool::Decode(reinterpret_cast<const uint8_t *>(buf.data()),
+                                buf.size(), &decoded, &dconsistency, &tag));
+    EXPECT_EQ(GenDb::DbConsistency::LOCAL_ONE, dconsistency);
+    EXPECT_EQ(5, tag);
+    EXPECT_EQ("MessageTable", decoded->cfname_);
+    EXPECT_TRUE(col_list.rowkey_ == decoded->rowkey_);
+    ASSERT_EQ(1, decoded->columns_.size());
+    EXPECT_TRUE(*col_list.columns_[0].name == *decoded->columns_[0].name);
+    EXPECT_TRUE(*col_list.columns_[0].value == *decoded->columns_[0].value);
+    EXPECT_EQ(0, decoded->columns_[0].ttl);
+
+    // Truncated record
+    EXPECT_FALSE(DbSpool::Decode(
+        reinterpret_cast<const uint8_t *>(buf.data()), buf.size() - 1,
+        &decoded, &dconsistency, &tag));
+}
+
+TEST_F(DbSpoolTest, AppendPopRecover) {
+    {
+        DbSpool spool(directory_, 16 * kSegmentSize, kSegmentSize);
+        ASSERT_TRUE(spool.Initialize());
+        EXPECT_TRUE(spool.IsEmpty());
+        for (uint32_t i = 0; i < 100; i++) {
+            ASSERT_TRUE(spool.Append(*MakeColList(i),
+                                     GenDb::DbConsistency::LOCAL_ONE, 1));
+        }
+        DbSpool::Stats stats;
+        spool.GetStats(&stats);
+        EXPECT_EQ(100, stats.records);
+        EXPECT_EQ(100, stats.appends);
+        EXPECT_LT(1, stats.segments);
+        // Consume the first 40
+        for (uint32_t i = 0; i < 40; i++) {
+            std::auto_ptr<GenDb::ColList> col_list;
+            GenDb::DbConsistency::type dconsistency;
+            uint8_t tag;
+            ASSERT_TRUE(spool.Front(&col_list, &dconsistency, &tag));
+            EXPECT_TRUE(MakeColList(i)->rowkey_ == col_list->rowkey_);
+            EXPECT_EQ(3600, col_list->columns_[0].ttl);
+            spool.Pop();
+        }
+        spool.Shutdown();
+    }
+    // A restarted spool resumes with the records not yet consumed
+    DbSpool spool(directory_, 16 * kSegmentSize, kSegmentSize);
+    ASSERT_TRUE(spool.Initialize());
+    DbSpool::Stats stats;
+    spool.GetStats(&stats);
+    EXPECT_EQ(60, stats.records);
+    ASSERT_TRUE(spool.Append(*MakeColList(100),
+                             GenDb::DbConsistency::LOCAL_ONE, 1));
+    for (uint32_t i = 40; i <= 100; i++) {
+        std::auto_ptr<GenDb::ColList> col_list;
+        GenDb::DbConsistency::type dconsistency;
+        uint8_t tag;
+        ASSERT_TRUE(spool.Front(&col_list, &dconsistency, &tag));
+        EXPECT_TRUE(MakeColList(i)->rowkey_ == col_list->rowkey_);
+        EXPECT_EQ(1, tag);
+        spool.Pop();
+    }
+    EXPECT_TRUE(spool.IsEmpty());
+    spool.GetStats(&stats);
+    EXPECT_EQ(1, stats.segments);
+    EXPECT_EQ(0, stats.size);
+}
+
+TEST_F(DbSpoolTest, MaxSize) {
+    DbSpool spool(directory_, 2 * kSegmentSize, kSegmentSize);
+    ASSERT_TRUE(spool.Initialize());
+    uint32_t appended(0);
+    while (spool.Append(*MakeColList(appended),
+                        GenDb::DbConsistency::LOCAL_ONE, 0)) {
+        appended++;
+    }
+    DbSpool::Stats stats;
+    spool.GetStats(&stats);
+    EXPECT_EQ(2, stats.segments);
+    EXPECT_EQ(appended, stats.records);
+    EXPECT_EQ(1, stats.append_fails);
+    EXPECT_LE(stats.size, 2 * kSegmentSize);
+    // Room is made as the records are consumed
+    std::auto_ptr<GenDb::ColList> col_list;
+    GenDb::DbConsistency::type dconsistency;
+    uint8_t tag;
+    while (stats.segments == 2) {
+        ASSERT_TRUE(spool.Front(&col_list, &dconsistency, &tag));
+        spool.Pop();
+        spool.GetStats(&stats);
+    }
+    EXPECT_TRUE(spool.Append(*MakeColList(appended),
+                             GenDb::DbConsistency::LOCAL_ONE, 0));
+}
+
+TEST_F(DbSpoolTest, MaxSizeBelowSegmentSize) {
+    DbSpool spool(directory_, kSegmentSize / 2, kSegmentSize);
+    ASSERT_TRUE(spool.Initialize());
+    uint32_t appended(0);
+    while (spool.Append(*MakeColList(appended),
+                        GenDb::DbConsistency::LOCAL_ONE, 0)) {
+        appended++;
+    }
+    DbSpool::Stats stats;
+    spool.GetStats(&stats);
+    EXPECT_LT(0, appended);
+    EXPECT_EQ(1, stats.segments);
+    EXPECT_LE(stats.size, kSegmentSize / 2);
+    EXPECT_EQ(kSegmentSize / 2, boost::filesystem::file_size(
+        boost::filesystem::directory_iterator(directory_)->path()));
+}
+
+// Appends fail once the file system of the spool is full, instead of the
+// writes to a segment the file system has no blocks for raising SIGBUS.
+// The spool directory is a small tmpfs, mounted by a child process.
+TEST_F(DbSpoolTest, FileSystemFull) {
+    static const int kSkipped = 77;
+    static const size_t kFileSystemSize = 8 * kSegmentSize;
+    boost::filesystem::create_directories(directory_);
+    pid_t pid(fork());
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        if (!MountTmpfs(kFileSystemSize)) {
+            _exit(kSkipped);
+        }
+        FillFileSystem(kFileSystemSize);
+        fflush(stdout);
+        _exit(HasFailure() ? 1 : 0);
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status)) << "Terminated by signal " <<
+        WTERMSIG(status);
+    if (WEXITSTATUS(status) == kSkipped) {
+        LOG(ERROR, "Skipping FileSystemFull: cannot mount a tmpfs");
+        return;
+    }
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST_F(DbSpoolTest, Corruption) {
+    {
+        DbSpool spool(directory_, 16 * kSegmentSize, kSegmentSize);
+        ASSERT_TRUE(spool.Initialize());
+        for (uint32_t i = 0; i < 3; i++) {
+            ASSERT_TRUE(spool.Append(*MakeColList(i),
+                                     GenDb::DbConsistency::LOCAL_ONE, 0));
+        }
+        spool.Shutdown();
+    }
+    // Flip a byte in the last record
+    boost::filesystem::directory_iterator it(directory_);
+    ASSERT_TRUE(it != boost::filesystem::directory_iterator());
+    const std::string path(it->path().string());
+    std::string data;
+    {
+        FILE *file(fopen(path.c_str(), "r+"));
+        ASSERT_TRUE(file != NULL);
+        data.resize(kSegmentSize);
+        ASSERT_EQ(kSegmentSize, fread(&data[0], 1, kSegmentSize, file));
+        size_t last(data.rfind("cpu"));
+        ASSERT_NE(std::string::npos, last);
+        fseek(file, last, SEEK_SET);
+        fputc('x', file);
+        fclose(file);
+    }
+    DbSpool spool(directory_, 16 * kSegmentSize, kSegmentSize);
+    ASSERT_TRUE(spool.Initialize());
+    DbSpool::Stats stats;
+    spool.GetStats(&stats);
+    EXPECT_EQ(2, stats.records);
+    EXPECT_EQ(1, stats.corrupt_records);
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -69,6 +69,7 @@ TEST_F(OptionsTest, NoArguments) {
     EXPECT_EQ(options_.hostname(), hostname_);
     EXPECT_EQ(options_.host_ip(), host_ip_);
     EXPECT_EQ(options_.http_server_port(), default_http_server_port);
+    EXPECT_EQ(options_.sflow_port(), -1);
     EXPECT_EQ(options_.log_category(), "");
     EXPECT_EQ(options_.log_disable(), false);
     EXPECT_EQ(options_.log_file(), "<stdout>");
@@ -76,6 +77,8 @@ TEST_F(OptionsTest, NoArguments) {
     EXPECT_EQ(options_.log_file_size(), 1024*1024);
     EXPECT_EQ(options_.log_level(), "SYS_NOTICE");
     EXPECT_EQ(options_.log_local(), false);
+    EXPECT_EQ(options_.sandesh_capture_file(), "");
+    EXPECT_EQ(options_.sandesh_capture_size(), 1024*1024*1024);
     EXPECT_EQ(options_.analytics_data_ttl(), g_viz_constants.TtlValuesDefault.find(TtlType::GLOBAL_TTL)->second);
     EXPECT_EQ(options_.analytics_config_audit_ttl(), g_viz_constants.TtlValuesDefault.find(TtlType::CONFIGAUDIT_TTL)->second);
     EXPECT_EQ(options_.analytics_statistics_ttl(), g_viz_constants.TtlValuesDefault.find(TtlType::STATSDATA_TTL)->second);
@@ -90,9 +93,28 @@ TEST_F(OptionsTest, NoArguments) {
     EXPECT_EQ(options_.disable_all_db_writes(), false);
     EXPECT_FALSE(options_.sandesh_config().disable_object_logs);
     EXPECT_EQ(options_.cluster_id(), "");
+    EXPECT_EQ(options_.get_cassandra_options().
+        statistics_writes_high_watermark_, 5 * 1024 * 1024);
+    EXPECT_EQ(options_.get_cassandra_options().
+        statistics_writes_low_watermark_, 7 * 512 * 1024);
+    EXPECT_EQ(options_.get_cassandra_options().
+        session_writes_high_watermark_, 4 * 1024 * 1024);
+    EXPECT_EQ(options_.get_cassandra_options().
+        session_writes_low_watermark_, 2 * 1024 * 1024);
+    EXPECT_EQ(options_.get_cassandra_options().spool_directory_, "");
+    EXPECT_EQ(options_.get_cassandra_options().spool_max_size_mb_, 4096);
+    EXPECT_EQ(options_.get_cassandra_options().spool_replay_rate_, 5000);
+    EXPECT_EQ(options_.get_cassandra_options().local_stats_directory_, "");
     uint16_t structured_syslog_port(0);
     EXPECT_FALSE(options_.collector_structured_syslog_port(&structured_syslog_port));
     EXPECT_EQ(options_.collector_active_session_map_limit(), 1000000);
+    EXPECT_EQ(options_.collector_active_session_timeout(), 3600);
+    EXPECT_EQ(options_.collector_uve_aggregation_interval(), 10);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_linger_ms, 100);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_batch_num_messages,
+              10000);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_compression_codec,
+              "none");
     EXPECT_FALSE(options_.get_cassandra_options().use_ssl_);
     EXPECT_FALSE(options_.configdb_options().config_db_use_ssl);
 }
@@ -120,6 +142,7 @@ TEST_F(OptionsTest, DefaultConfFile) {
     EXPECT_EQ(options_.hostname(), hostname_);
     EXPECT_EQ(options_.host_ip(), host_ip_);
     EXPECT_EQ(options_.http_server_port(), default_http_server_port);
+    EXPECT_EQ(options_.sflow_port(), -1);
     EXPECT_EQ(options_.log_category(), "");
     EXPECT_EQ(options_.log_disable(), false);
     EXPECT_EQ(options_.log_file(), "/var/log/contrail/contrail-collector.log");
@@ -173,6 +196,7 @@ TEST_F(OptionsTest, OverrideStringFromCommandLine) {
     EXPECT_EQ(options_.hostname(), hostname_);
     EXPECT_EQ(options_.host_ip(), host_ip_);
     EXPECT_EQ(options_.http_server_port(), default_http_server_port);
+    EXPECT_EQ(options_.sflow_port(), -1);
     EXPECT_EQ(options_.log_category(), "");
     EXPECT_EQ(options_.log_disable(), false);
     EXPECT_EQ(options_.log_file(), "test.log"); // Overridden from cmd line.
@@ -197,6 +221,62 @@ TEST_F(OptionsTest, OverrideStringFromCommandLine) {
     EXPECT_FALSE(options_.configdb_options().config_db_use_ssl);
 }
 
+TEST_F(OptionsTest, KafkaForwarderZeroLinger) {
+    int argc = 3;
+    char *argv[argc];
+    char argv_0[] = "options_test";
+    char argv_1[] = "--conf_file=src/contrail-analytics/contrail-collector/contrail-collector.conf";
+    char argv_2[] = "--STRUCTURED_SYSLOG_COLLECTOR.kafka_linger_ms=0";
+    argv[0] = argv_0;
+    argv[1] = argv_1;
+    argv[2] = argv_2;
+
+    // Unset is distinct from 0, which disables the linger
+    EXPECT_EQ(Options::Kafka::kUnset, Options::Kafka().forwarder_linger_ms);
+    options_.Parse(evm_, argc, argv);
+    EXPECT_EQ(0, options_.get_kafka_options().forwarder_linger_ms);
+    EXPECT_EQ(10000,
+              options_.get_kafka_options().forwarder_batch_num_messages);
+}
+
+TEST_F(OptionsTest, DbQueueWaterMarkCollision) {
+    char argv_0[] = "options_test";
+    char argv_1[] = "--conf_file=src/contrail-analytics/contrail-collector/contrail-collector.conf";
+    // Same low watermark as the generator undefer
+    char argv_2[] = "--DATABASE.statistics_writes.low_watermark=3145728";
+    char *argv[] = { argv_0, argv_1, argv_2 };
+    EXPECT_EXIT(options_.Parse(evm_, 3, argv),
+                ::testing::ExitedWithCode(255), "");
+
+    // Same high watermark as the statistics writes
+    char argv_3[] = "--DATABASE.session_writes.high_watermark=5242880";
+    argv[2] = argv_3;
+    EXPECT_EXIT(options_.Parse(evm_, 3, argv),
+                ::testing::ExitedWithCode(255), "");
+
+    // Low watermark not below the high watermark
+    char argv_4[] = "--DATABASE.session_writes.low_watermark=4194304";
+    argv[2] = argv_4;
+    EXPECT_EXIT(options_.Parse(evm_, 3, argv),
+                ::testing::ExitedWithCode(255), "");
+
+    // Same low watermark as the write spool
+    char argv_5[] = "--DATABASE.session_writes.low_watermark=1048576";
+    argv[2] = argv_5;
+    EXPECT_EXIT(options_.Parse(evm_, 3, argv),
+                ::testing::ExitedWithCode(255), "");
+
+    // Distinct counts, and disabled statistics drops are accepted
+    char argv_6[] = "--DATABASE.session_writes.low_watermark=1572864";
+    char argv_7[] = "--DATABASE.statistics_writes.high_watermark=0";
+    char *argv_ok[] = { argv_0, argv_1, argv_6, argv_7 };
+    options_.Parse(evm_, 4, argv_ok);
+    EXPECT_EQ(1572864U,
+        options_.get_cassandra_options().session_writes_low_watermark_);
+    EXPECT_EQ(0U,
+        options_.get_cassandra_options().statistics_writes_high_watermark_);
+}
+
 TEST_F(OptionsTest, OverrideBooleanFromCommandLine) {
     int argc = 10;
     char *argv[argc];
@@ -236,6 +316,7 @@ TEST_F(OptionsTest, OverrideBooleanFromCommandLine) {
     EXPECT_EQ(options_.hostname(), hostname_);
     EXPECT_EQ(options_.host_ip(), host_ip_);
     EXPECT_EQ(options_.http_server_port(), default_http_server_port);
+    EXPECT_EQ(options_.sflow_port(), -1);
     EXPECT_EQ(options_.log_category(), "");
     EXPECT_EQ(options_.log_disable(), false);
     EXPECT_EQ(options_.log_file(), "/var/log/contrail/contrail-collector.log");
@@ -275,6 +356,7 @@ TEST_F(OptionsTest, CustomConfigFile) {
         "hostip=1.2.3.4\n"
         "hostname=test\n"
         "http_server_port=800\n"
+        "sflow_port=6343\n"
         "log_category=bgp\n"
         "log_disable=1\n"
         "log_file=test.log\n"
@@ -293,11 +375,26 @@ TEST_F(OptionsTest, CustomConfigFile) {
         "[STRUCTURED_SYSLOG_COLLECTOR]\n"
         "port=3514\n"
         "active_session_map_limit=100000\n"
+        "active_session_timeout=600\n"
+        "uve_aggregation_interval=30\n"
+        "kafka_linger_ms=5\n"
+        "kafka_batch_num_messages=500\n"
+        "kafka_compression_codec=lz4\n"
         "\n"
         "[REDIS]\n"
         "server=1.2.3.4\n"
         "port=200\n"
         "\n"
+        "[DATABASE]\n"
+        "statistics_writes.high_watermark=50000\n"
+        "statistics_writes.low_watermark=30000\n"
+        "session_writes.high_watermark=40000\n"
+        "session_writes.low_watermark=20000\n"
+        "spool_directory=/tmp/spool\n"
+        "spool_max_size_mb=100\n"
+        "spool_replay_rate=200\n"
+        "local_stats_directory=/tmp/stats\n"
+        "\n"
         "[SANDESH]\n"
         "disable_object_logs=0\n"
         "[CONFIGDB]\n"
@@ -354,6 +451,7 @@ TEST_F(OptionsTest, CustomConfigFile) {
     EXPECT_EQ(options_.hostname(), "test");
     EXPECT_EQ(options_.host_ip(), "1.2.3.4");
     EXPECT_EQ(options_.http_server_port(), 800);
+    EXPECT_EQ(options_.sflow_port(), 6343);
     EXPECT_EQ(options_.log_category(), "bgp");
     EXPECT_EQ(options_.log_disable(), true);
     EXPECT_EQ(options_.log_file(), "test.log");
@@ -372,6 +470,13 @@ TEST_F(OptionsTest, CustomConfigFile) {
     EXPECT_TRUE(options_.collector_structured_syslog_port(&structured_syslog_port));
     EXPECT_EQ(structured_syslog_port, 3514);
     EXPECT_EQ(options_.collector_active_session_map_limit(), 100000);
+    EXPECT_EQ(options_.collector_active_session_timeout(), 600);
+    EXPECT_EQ(options_.collector_uve_aggregation_interval(), 30);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_linger_ms, 5);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_batch_num_messages,
+              500);
+    EXPECT_EQ(options_.get_kafka_options().forwarder_compression_codec,
+              "lz4");
     Options::Cassandra cassandra_options(options_.get_cassandra_options());
     EXPECT_EQ(cassandra_options.user_, "cassandra1");
     EXPECT_EQ(cassandra_options.password_, "cassandra1");
@@ -379,6 +484,14 @@ TEST_F(OptionsTest, CustomConfigFile) {
         "LeveledCompactionStrategy");
     EXPECT_EQ(cassandra_options.flow_tables_compaction_strategy_,
         "SizeTieredCompactionStrategy");
+    EXPECT_EQ(cassandra_options.statistics_writes_high_watermark_, 50000);
+    EXPECT_EQ(cassandra_options.statistics_writes_low_watermark_, 30000);
+    EXPECT_EQ(cassandra_options.session_writes_high_watermark_, 40000);
+    EXPECT_EQ(cassandra_options.session_writes_low_watermark_, 20000);
+    EXPECT_EQ(cassandra_options.spool_directory_, "/tmp/spool");
+    EXPECT_EQ(cassandra_options.spool_max_size_mb_, 100);
+    EXPECT_EQ(cassandra_options.spool_replay_rate_, 200);
+    EXPECT_EQ(cassandra_options.local_stats_directory_, "/tmp/stats");
     EXPECT_EQ(options_.cluster_id(), "");
     EXPECT_EQ(options_.sandesh_config().system_logs_rate_limit, 5);
     EXPECT_FALSE(options_.sandesh_config().disable_object_logs);
@@ -397,6 +510,7 @@ TEST_F(OptionsTest, CustomConfigFileAndOverrideFromCommandLine) {
         "hostip=1.2.3.4\n"
         "hostname=test\n"
         "http_server_port=800\n"
+        "sflow_port=6343\n"
         "log_category=bgp\n"
         "log_disable=1\n"
         "log_file=test.log\n"
@@ -499,6 +613,7 @@ TEST_F(OptionsTest, CustomConfigFileAndOverrideFromCommandLine) {
     EXPECT_EQ(options_.hostname(), "test");
     EXPECT_EQ(options_.host_ip(), "1.2.3.4");
     EXPECT_EQ(options_.http_server_port(), 800);
+    EXPECT_EQ(options_.sflow_port(), 6343);
     EXPECT_EQ(options_.log_category(), "bgp");
     EXPECT_EQ(options_.log_disable(), true);
     EXPECT_EQ(options_.log_file(), "new_test.log");
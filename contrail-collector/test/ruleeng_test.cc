@@ -5,6 +5,8 @@
 #include <boost/scoped_array.hpp>
 #include "testing/gunit.h"
 #include "base/logging.h"
+#include "base/string_util.h"
+#include <analytics/viz_constants.h>
 #include "../ruleeng.h"
 
 const char *rules =
@@ -237,6 +239,78 @@ TEST_F(RuleengObjTrTest, MultiKey) {
     }
 }
 
+class StatTagsCacheTest : public ::testing::Test {
+};
+
+TEST_F(StatTagsCacheTest, Tags) {
+    StatTagsCache::PlanPtr plan(StatTagsCache::Parse(""));
+    EXPECT_TRUE(plan->valid);
+    EXPECT_TRUE(plan->toptags_valid);
+    EXPECT_TRUE(plan->toptags.empty());
+    EXPECT_TRUE(plan->tags.empty());
+
+    // Top-level tags, and tags of the stats elements
+    plan = StatTagsCache::Parse("Source,.name," + std::string(".") +
+                                g_viz_constants.STAT_KEY_FIELD);
+    EXPECT_TRUE(plan->valid);
+    EXPECT_TRUE(plan->toptags_valid);
+    ASSERT_EQ(1U, plan->toptags.size());
+    EXPECT_EQ("Source", plan->toptags[0]);
+    ASSERT_EQ(2U, plan->tags.size());
+    EXPECT_EQ("name", plan->tags[0].name);
+    EXPECT_FALSE(plan->tags[0].name_is_key);
+    EXPECT_TRUE(plan->tags[0].prefix.empty());
+    EXPECT_TRUE(plan->tags[1].name_is_key);
+}
+
+TEST_F(StatTagsCacheTest, PrefixSuffix) {
+    StatTagsCache::PlanPtr plan(StatTagsCache::Parse(
+        "Source:.name,.vn:.ip," + std::string(".") +
+        g_viz_constants.STAT_KEY_FIELD + ":.port"));
+    EXPECT_TRUE(plan->valid);
+    EXPECT_TRUE(plan->toptags_valid);
+    ASSERT_EQ(3U, plan->tags.size());
+    // Prefix of the current level
+    EXPECT_EQ("name", plan->tags[0].name);
+    EXPECT_EQ("Source", plan->tags[0].prefix);
+    EXPECT_FALSE(plan->tags[0].prefix_is_child);
+    EXPECT_EQ("Source", plan->tags[0].prefix_attr);
+    // Prefix child of the deepest node
+    EXPECT_EQ("ip", plan->tags[1].name);
+    EXPECT_EQ(".vn", plan->tags[1].prefix);
+    EXPECT_TRUE(plan->tags[1].prefix_is_child);
+    EXPECT_EQ("vn", plan->tags[1].prefix_attr);
+    EXPECT_FALSE(plan->tags[1].prefix_attr_is_key);
+    EXPECT_EQ("port", plan->tags[2].name);
+    EXPECT_TRUE(plan->tags[2].prefix_attr_is_key);
+
+    // Top-level tags may not have a prefix
+    plan = StatTagsCache::Parse("vn:Source");
+    EXPECT_TRUE(plan->valid);
+    EXPECT_FALSE(plan->toptags_valid);
+    // No term may be empty
+    EXPECT_FALSE(StatTagsCache::Parse("Source,")->valid);
+    EXPECT_FALSE(StatTagsCache::Parse(".vn:")->valid);
+}
+
+TEST_F(StatTagsCacheTest, Get) {
+    StatTagsCache cache;
+    StatTagsCache::PlanPtr plan(cache.Get("Source,.name"));
+    ASSERT_EQ(1U, plan->tags.size());
+    // Hits return the cached plan
+    EXPECT_EQ(plan.get(), cache.Get("Source,.name").get());
+    EXPECT_NE(plan.get(), cache.Get(".name").get());
+    // Once full, plans are parsed but not cached
+    for (size_t i = 0; i < StatTagsCache::kMaxPlans; i++) {
+        cache.Get(".name" + integerToString(i));
+    }
+    std::string extra(".extra");
+    StatTagsCache::PlanPtr uncached(cache.Get(extra));
+    EXPECT_EQ("extra", uncached->tags[0].name);
+    EXPECT_NE(uncached.get(), cache.Get(extra).get());
+    EXPECT_EQ(plan.get(), cache.Get("Source,.name").get());
+}
+
 int main(int argc, char **argv) {
     LoggingInit();
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <unistd.h>
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+#include <sandesh/sandesh_message_builder.h>
+
+#include "contrail-collector/sandesh_corpus.h"
+
+class SandeshCorpusTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        std::ostringstream ostr;
+        ostr << "/tmp/sandesh_corpus_test." << getpid();
+        path_ = ostr.str();
+    }
+
+    virtual void TearDown() {
+        unlink(path_.c_str());
+    }
+
+    SandeshHeader Header(int32_t seqnum) const {
+        SandeshHeader header;
+        header.set_Timestamp(1000000 + seqnum);
+        header.set_Module("VizdTest");
+        header.set_Source("127.0.0.1");
+        header.set_SequenceNum(seqnum);
+        header.set_Type(SandeshType::UVE);
+        header.set_Hints(1);
+        header.set_Level(4);
+        header.set_NodeType("Test");
+        header.set_InstanceId("0");
+        return header;
+    }
+
+    std::string path_;
+};
+
+static const std::string kMessage("<UveTest type=\"sandesh\"><data "
+    "type=\"struct\" identifier=\"1\"><UveData><name type=\"string\" "
+    "identifier=\"1\" key=\"ObjectTest\">uve1</name></UveData></data>"
+    "</UveTest>");
+
+TEST_F(SandeshCorpusTest, WriteRead) {
+    SandeshCorpusWriter writer(path_);
+    ASSERT_TRUE(writer.Open());
+    SandeshHeader header(Header(1));
+    header.set_IPAddress("10.1.1.1");
+    header.set_Pid(100);
+    header.set_Context("context");
+    EXPECT_TRUE(writer.Write(header, kMessage));
+    EXPECT_TRUE(writer.Write(Header(2), kMessage));
+    EXPECT_EQ(2, writer.records());
+    writer.Close();
+
+    SandeshCorpusReader reader(path_);
+    ASSERT_TRUE(reader.Open());
+    for (int pass = 0; pass < 2; pass++) {
+        SandeshHeader rheader;
+        std::string xml;
+        ASSERT_TRUE(reader.Read(&rheader, &xml));
+        EXPECT_EQ(kMessage, xml);
+        EXPECT_EQ(1000001, rheader.get_Timestamp());
+        EXPECT_EQ("VizdTest", rheader.get_Module());
+        EXPECT_EQ(SandeshType::UVE, rheader.get_Type());
+        EXPECT_TRUE(rheader.__isset.IPAddress);
+        EXPECT_EQ("10.1.1.1", rheader.get_IPAddress());
+        EXPECT_TRUE(rheader.__isset.Pid);
+        EXPECT_EQ(100, rheader.get_Pid());
+        // Fields not set in the written header are not set either
+        EXPECT_TRUE(rheader.__isset.Level);
+        EXPECT_EQ(4, rheader.get_Level());
+        EXPECT_TRUE(rheader.__isset.Context);
+        EXPECT_EQ("context", rheader.get_Context());
+        EXPECT_FALSE(rheader.__isset.Category);
+        ASSERT_TRUE(reader.Read(&rheader, &xml));
+        EXPECT_EQ(2, rheader.get_SequenceNum());
+        EXPECT_FALSE(rheader.__isset.Context);
+        EXPECT_FALSE(rheader.__isset.IPAddress);
+        EXPECT_FALSE(rheader.__isset.Pid);
+        EXPECT_FALSE(reader.Read(&rheader, &xml));
+        ASSERT_TRUE(reader.Rewind());
+    }
+}
+
+TEST_F(SandeshCorpusTest, MaxSize) {
+    SandeshCorpusWriter writer(path_, 2 * kMessage.size());
+    ASSERT_TRUE(writer.Open());
+    EXPECT_TRUE(writer.Write(Header(1), kMessage));
+    EXPECT_FALSE(writer.Write(Header(2), kMessage));
+    EXPECT_FALSE(writer.Write(Header(3), std::string()));
+    EXPECT_EQ(1, writer.records());
+    writer.Close();
+
+    // A partially written record is not read
+    ASSERT_EQ(0, truncate(path_.c_str(), writer.size() - 1));
+    SandeshCorpusReader reader(path_);
+    ASSERT_TRUE(reader.Open());
+    SandeshHeader header;
+    std::string xml;
+    EXPECT_FALSE(reader.Read(&header, &xml));
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
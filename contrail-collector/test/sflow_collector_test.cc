@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+
+#include "contrail-collector/sflow_collector.h"
+
+static const uint64_t kTimestamp = 1234567890;
+
+class SFlowFlowAggregatorTest : public ::testing::Test {
+protected:
+    SFlowFlowAggregatorTest()
+        : aggregator_(boost::bind(&SFlowFlowAggregatorTest::UFlowDataInsert,
+                                  this, _1, _2)) {
+    }
+
+    void UFlowDataInsert(const UFlowData& flow_data, uint64_t timestamp) {
+        flow_data_.push_back(flow_data);
+        EXPECT_EQ(kTimestamp, timestamp);
+    }
+
+    void InitSFlowHeader(SFlowData* sflow_data, const std::string& agent_ip,
+                         uint32_t seqno, uint32_t uptime) const {
+        sflow_data->sflow_header.version = 5;
+        sflow_data->sflow_header.agent_ip_address =
+            IpAddress::from_string(agent_ip);
+        sflow_data->sflow_header.seqno = seqno;
+        sflow_data->sflow_header.uptime = uptime;
+    }
+
+    SFlowFlowSample* AddFlowSample(SFlowData* sflow_data, uint32_t seqno,
+                                   uint32_t sample_rate, uint32_t pifindex,
+                                   const std::string& sip,
+                                   const std::string& dip,
+                                   uint32_t frame_length) const {
+        SFlowFlowSample* flow_sample =
+            new SFlowFlowSample(SFLOW_FLOW_SAMPLE, 0);
+        flow_sample->seqno = seqno;
+        flow_sample->sourceid_index = pifindex;
+        flow_sample->sample_rate = sample_rate;
+        flow_sample->input_port = pifindex;
+        SFlowFlowHeader* flow_header = new SFlowFlowHeader(0);
+        flow_header->frame_length = frame_length;
+        flow_header->is_ip_data_set = true;
+        flow_header->decoded_ip_data.protocol = 6;
+        flow_header->decoded_ip_data.src_ip = IpAddress::from_string(sip);
+        flow_header->decoded_ip_data.dst_ip = IpAddress::from_string(dip);
+        flow_header->decoded_ip_data.src_port = 10000;
+        flow_header->decoded_ip_data.dst_port = 80;
+        flow_sample->flow_records.push_back(flow_header);
+        flow_sample->nflow_records = 1;
+        sflow_data->flow_samples.push_back(flow_sample);
+        sflow_data->sflow_header.nsamples++;
+        return flow_sample;
+    }
+
+    SFlowFlowAggregator aggregator_;
+    std::vector<UFlowData> flow_data_;
+};
+
+TEST_F(SFlowFlowAggregatorTest, AggregateFlowSamples) {
+    SFlowData sflow_data1;
+    InitSFlowHeader(&sflow_data1, "10.1.1.1", 1, 1000);
+    AddFlowSample(&sflow_data1, 1, 100, 3, "1.1.1.1", "2.2.2.2", 1500);
+    AddFlowSample(&sflow_data1, 2, 100, 3, "1.1.1.1", "2.2.2.2", 500);
+    AddFlowSample(&sflow_data1, 3, 100, 3, "1.1.1.1", "3.3.3.3", 64);
+    aggregator_.AddSFlowData(sflow_data1);
+    SFlowData sflow_data2;
+    InitSFlowHeader(&sflow_data2, "10.1.1.2", 1, 1000);
+    AddFlowSample(&sflow_data2, 1, 10, 4, "1.1.1.1", "2.2.2.2", 100);
+    aggregator_.AddSFlowData(sflow_data2);
+    EXPECT_EQ(3, aggregator_.size());
+
+    EXPECT_EQ(3, aggregator_.Flush(kTimestamp));
+    EXPECT_EQ(0, aggregator_.size());
+    // One UFlowData per agent
+    ASSERT_EQ(2, flow_data_.size());
+    EXPECT_EQ("10.1.1.1", flow_data_[0].get_name());
+    ASSERT_EQ(2, flow_data_[0].get_flow().size());
+    EXPECT_EQ("10.1.1.2", flow_data_[1].get_name());
+    ASSERT_EQ(1, flow_data_[1].get_flow().size());
+    const UFlowSample& sample = flow_data_[1].get_flow()[0];
+    EXPECT_EQ(4, sample.get_pifindex());
+    EXPECT_EQ("1.1.1.1", sample.get_sip());
+    EXPECT_EQ("2.2.2.2", sample.get_dip());
+    EXPECT_EQ(10000, sample.get_sport());
+    EXPECT_EQ(80, sample.get_dport());
+    EXPECT_EQ(6, sample.get_protocol());
+    EXPECT_EQ("SFLOW", sample.get_flowtype());
+    EXPECT_EQ(1, sample.get_samples());
+    EXPECT_EQ(10, sample.get_packets());
+    EXPECT_EQ(1000, sample.get_bytes());
+    for (size_t i = 0; i < flow_data_[0].get_flow().size(); i++) {
+        const UFlowSample& sample = flow_data_[0].get_flow()[i];
+        if (sample.get_dip() == "2.2.2.2") {
+            EXPECT_EQ(2, sample.get_samples());
+            EXPECT_EQ(200, sample.get_packets());
+            EXPECT_EQ(200000, sample.get_bytes());
+        } else {
+            EXPECT_EQ("3.3.3.3", sample.get_dip());
+            EXPECT_EQ(1, sample.get_samples());
+            EXPECT_EQ(100, sample.get_packets());
+            EXPECT_EQ(6400, sample.get_bytes());
+        }
+    }
+
+    // Nothing left to flush
+    flow_data_.clear();
+    EXPECT_EQ(0, aggregator_.Flush(kTimestamp));
+    EXPECT_TRUE(flow_data_.empty());
+}
+
+TEST_F(SFlowFlowAggregatorTest, SequenceGaps) {
+    SFlowData sflow_data1;
+    InitSFlowHeader(&sflow_data1, "10.1.1.1", 10, 100000);
+    AddFlowSample(&sflow_data1, 100, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data1);
+    // 2 datagrams and 4 flow samples lost
+    SFlowData sflow_data2;
+    InitSFlowHeader(&sflow_data2, "10.1.1.1", 13, 101000);
+    AddFlowSample(&sflow_data2, 105, 1, 3, "1.1.1.1", "2.2.2.2", 64)->drops
+        = 7;
+    // Undecoded packet header
+    AddFlowSample(&sflow_data2, 106, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    static_cast<SFlowFlowHeader&>(
+        sflow_data2.flow_samples.back().flow_records.back()).is_ip_data_set =
+            false;
+    aggregator_.AddSFlowData(sflow_data2);
+    // Reordered datagram, with an older uptime
+    SFlowData sflow_data3;
+    InitSFlowHeader(&sflow_data3, "10.1.1.1", 12, 100900);
+    AddFlowSample(&sflow_data3, 104, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data3);
+
+    SFlowFlowAggregator::AgentStats stats;
+    ASSERT_TRUE(aggregator_.GetAgentStats(IpAddress::from_string("10.1.1.1"),
+                                          0, &stats));
+    EXPECT_EQ(3, stats.datagrams);
+    EXPECT_EQ(1, stats.lost_datagrams);
+    EXPECT_EQ(1, stats.reordered_datagrams);
+    EXPECT_EQ(4, stats.flow_samples);
+    EXPECT_EQ(3, stats.lost_flow_samples);
+    EXPECT_EQ(7, stats.dropped_flow_samples);
+    EXPECT_EQ(1, stats.undecoded_flow_samples);
+
+    // The sequence goes on from the latest datagram, not the late one
+    SFlowData sflow_data4;
+    InitSFlowHeader(&sflow_data4, "10.1.1.1", 14, 101100);
+    AddFlowSample(&sflow_data4, 107, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data4);
+    ASSERT_TRUE(aggregator_.GetAgentStats(IpAddress::from_string("10.1.1.1"),
+                                          0, &stats));
+    EXPECT_EQ(4, stats.datagrams);
+    EXPECT_EQ(1, stats.lost_datagrams);
+    EXPECT_EQ(3, stats.lost_flow_samples);
+
+    // Restarted agent, the sequence numbers start over
+    SFlowData sflow_data5;
+    InitSFlowHeader(&sflow_data5, "10.1.1.1", 1, 10);
+    AddFlowSample(&sflow_data5, 1, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data5);
+    SFlowData sflow_data6;
+    InitSFlowHeader(&sflow_data6, "10.1.1.1", 3, 30);
+    AddFlowSample(&sflow_data6, 2, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data6);
+    ASSERT_TRUE(aggregator_.GetAgentStats(IpAddress::from_string("10.1.1.1"),
+                                          0, &stats));
+    EXPECT_EQ(6, stats.datagrams);
+    EXPECT_EQ(2, stats.lost_datagrams);
+    EXPECT_EQ(1, stats.reordered_datagrams);
+    EXPECT_EQ(3, stats.lost_flow_samples);
+
+    // Restarted again soon after, the sequence numbers going backwards
+    // while the uptime moves forward
+    SFlowData sflow_data7;
+    InitSFlowHeader(&sflow_data7, "10.1.1.1", 2, 40);
+    aggregator_.AddSFlowData(sflow_data7);
+    SFlowData sflow_data8;
+    InitSFlowHeader(&sflow_data8, "10.1.1.1", 3, 50);
+    aggregator_.AddSFlowData(sflow_data8);
+    ASSERT_TRUE(aggregator_.GetAgentStats(IpAddress::from_string("10.1.1.1"),
+                                          0, &stats));
+    EXPECT_EQ(8, stats.datagrams);
+    EXPECT_EQ(2, stats.lost_datagrams);
+    EXPECT_EQ(1, stats.reordered_datagrams);
+
+    EXPECT_FALSE(aggregator_.GetAgentStats(
+        IpAddress::from_string("10.1.1.2"), 0, &stats));
+}
+
+// Sub agents are reported apart
+TEST_F(SFlowFlowAggregatorTest, AgentStatsInfo) {
+    SFlowData sflow_data1;
+    InitSFlowHeader(&sflow_data1, "10.1.1.1", 1, 1000);
+    AddFlowSample(&sflow_data1, 1, 1, 3, "1.1.1.1", "2.2.2.2", 64);
+    aggregator_.AddSFlowData(sflow_data1);
+    SFlowData sflow_data2;
+    InitSFlowHeader(&sflow_data2, "10.1.1.1", 5, 1000);
+    sflow_data2.sflow_header.agent_subid = 2;
+    aggregator_.AddSFlowData(sflow_data2);
+    SFlowData sflow_data3;
+    InitSFlowHeader(&sflow_data3, "10.1.1.1", 8, 1100);
+    sflow_data3.sflow_header.agent_subid = 2;
+    aggregator_.AddSFlowData(sflow_data3);
+
+    std::map<std::string, SFlowAgentInfo> agent_stats;
+    aggregator_.GetAgentStatsInfo(&agent_stats);
+    ASSERT_EQ(2, agent_stats.size());
+    const SFlowAgentInfo& info1(agent_stats["10.1.1.1:0"]);
+    EXPECT_EQ(1, info1.get_datagrams());
+    EXPECT_EQ(1, info1.get_flow_samples());
+    const SFlowAgentInfo& info2(agent_stats["10.1.1.1:2"]);
+    EXPECT_EQ(2, info2.get_datagrams());
+    EXPECT_EQ(2, info2.get_lost_datagrams());
+    EXPECT_EQ(0, info2.get_flow_samples());
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
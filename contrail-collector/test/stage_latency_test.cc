@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+#include <analytics/collector_uve_types.h>
+
+#include "contrail-collector/stage_latency.h"
+
+class StageLatencyTest : public ::testing::Test {
+protected:
+    static void RecordLatencies(StageLatency *latency, uint64_t count) {
+        for (uint64_t usec = 1; usec <= count; usec++) {
+            latency->Record(StageLatency::RULE_EXECUTE, usec);
+            latency->Record(StageLatency::DB_WRITE, 1000 * usec);
+        }
+    }
+};
+
+TEST_F(StageLatencyTest, Buckets) {
+    // Every bucket starts where the previous one ends
+    for (size_t idx = 0; idx < StageLatency::kNumBuckets; idx++) {
+        uint64_t lower(StageLatency::BucketLowerBound(idx));
+        EXPECT_EQ(idx, StageLatency::BucketIndex(lower));
+        if (idx > 0) {
+            EXPECT_EQ(idx - 1, StageLatency::BucketIndex(lower - 1));
+        }
+    }
+    EXPECT_EQ(StageLatency::kNumBuckets - 1,
+              StageLatency::BucketIndex(1ULL << 40));
+    // Relative width of a bucket
+    EXPECT_EQ(StageLatency::BucketIndex(1024),
+              StageLatency::BucketIndex(1024 + 255));
+    EXPECT_NE(StageLatency::BucketIndex(1024),
+              StageLatency::BucketIndex(1024 + 256));
+}
+
+TEST_F(StageLatencyTest, Record) {
+    StageLatency latency;
+    std::vector<boost::thread *> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.push_back(new boost::thread(
+            boost::bind(&StageLatencyTest::RecordLatencies, &latency, 1000)));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    std::vector<StageLatency::Histogram> histograms;
+    latency.GetHistograms(&histograms);
+    ASSERT_EQ(StageLatency::NUM_STAGES, histograms.size());
+    const StageLatency::Histogram &rule_execute(
+        histograms[StageLatency::RULE_EXECUTE]);
+    EXPECT_EQ(4000, rule_execute.count);
+    EXPECT_EQ(4 * 500500, rule_execute.sum_usec);
+    EXPECT_EQ(1000, rule_execute.max_usec);
+    // Within a bucket of the exact percentiles
+    EXPECT_GE(rule_execute.Percentile(0.50), 500);
+    EXPECT_LT(rule_execute.Percentile(0.50), 500 * 5 / 4);
+    EXPECT_GE(rule_execute.Percentile(0.99), 990);
+    EXPECT_LE(rule_execute.Percentile(0.99), 1000);
+    EXPECT_EQ(0, histograms[StageLatency::OBJECT_LOG].count);
+    EXPECT_EQ(0, histograms[StageLatency::OBJECT_LOG].Percentile(0.99));
+
+    std::map<std::string, StageLatencyInfo> info;
+    latency.GetStageLatencyInfo(&info);
+    EXPECT_EQ(StageLatency::NUM_STAGES, info.size());
+    EXPECT_EQ(4000, info["DbWrite"].get_count());
+    EXPECT_EQ(500500, info["DbWrite"].get_avg_usec());
+    EXPECT_FALSE(info["DbWrite"].get_buckets().empty());
+
+    // Only the latencies recorded since the last report
+    info.clear();
+    latency.GetStageLatencyDiffs(&info);
+    EXPECT_EQ(4000, info["rule_execute"].get_count());
+    EXPECT_TRUE(info["rule_execute"].get_buckets().empty());
+    latency.Record(StageLatency::RULE_EXECUTE, 10);
+    info.clear();
+    latency.GetStageLatencyDiffs(&info);
+    EXPECT_EQ(1, info["rule_execute"].get_count());
+    EXPECT_EQ(10, info["rule_execute"].get_avg_usec());
+    EXPECT_GE(info["rule_execute"].get_max_usec(), 10);
+    EXPECT_LT(info["rule_execute"].get_max_usec(), 12);
+    EXPECT_EQ(0, info["DbWrite"].get_count());
+    EXPECT_EQ(0, info["DbWrite"].get_max_usec());
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
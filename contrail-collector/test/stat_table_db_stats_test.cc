@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+
+#include "contrail-collector/stat_table_db_stats.h"
+
+static bool TableNameLess(const GenDb::DbTableInfo &lhs,
+    const GenDb::DbTableInfo &rhs) {
+    return lhs.get_table_name() < rhs.get_table_name();
+}
+
+class StatTableDbStatsTest : public ::testing::Test {
+protected:
+    static void Write(StatTableDbStats *stats, int count) {
+        for (int i = 0; i < count; i++) {
+            stats->Update("StatA", "a", false);
+            stats->Update("StatB", "b", i % 10 == 0);
+        }
+    }
+
+    std::vector<GenDb::DbTableInfo> Sorted(
+        std::vector<GenDb::DbTableInfo> vdbti) const {
+        std::sort(vdbti.begin(), vdbti.end(), TableNameLess);
+        return vdbti;
+    }
+};
+
+TEST_F(StatTableDbStatsTest, Threads) {
+    StatTableDbStats stats;
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++) {
+        threads.create_thread(boost::bind(&StatTableDbStatsTest::Write,
+                                          &stats, 1000));
+    }
+    threads.join_all();
+
+    std::vector<GenDb::DbTableInfo> vdbti;
+    stats.GetDiffs(&vdbti);
+    vdbti = Sorted(vdbti);
+    ASSERT_EQ(2, vdbti.size());
+    EXPECT_EQ("StatA:a", vdbti[0].get_table_name());
+    EXPECT_EQ(4000, vdbti[0].get_writes());
+    EXPECT_EQ(0, vdbti[0].get_write_fails());
+    EXPECT_EQ("StatB:b", vdbti[1].get_table_name());
+    EXPECT_EQ(3600, vdbti[1].get_writes());
+    EXPECT_EQ(400, vdbti[1].get_write_fails());
+
+    // Only the tables written since the last diffs
+    stats.Update("StatA", "a", false);
+    stats.Update("StatC", "c", true);
+    vdbti.clear();
+    stats.GetDiffs(&vdbti);
+    vdbti = Sorted(vdbti);
+    ASSERT_EQ(2, vdbti.size());
+    EXPECT_EQ("StatA:a", vdbti[0].get_table_name());
+    EXPECT_EQ(1, vdbti[0].get_writes());
+    EXPECT_EQ("StatC:c", vdbti[1].get_table_name());
+    EXPECT_EQ(1, vdbti[1].get_write_fails());
+    vdbti.clear();
+    stats.GetDiffs(&vdbti);
+    EXPECT_TRUE(vdbti.empty());
+
+    vdbti.clear();
+    stats.GetCumulative(&vdbti);
+    vdbti = Sorted(vdbti);
+    ASSERT_EQ(3, vdbti.size());
+    EXPECT_EQ(4001, vdbti[0].get_writes());
+    EXPECT_EQ(400, vdbti[1].get_write_fails());
+    EXPECT_EQ(1, vdbti[2].get_write_fails());
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
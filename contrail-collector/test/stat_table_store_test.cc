@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/uuid/random_generator.hpp>
+
+#include <testing/gunit.h>
+
+#include <base/logging.h>
+
+#include "contrail-collector/stat_table_store.h"
+
+static const uint32_t kT2 = 1000;
+
+class StatTableStoreTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        std::ostringstream ostr;
+        ostr << "/tmp/stat_table_store_test." << getpid();
+        directory_ = ostr.str();
+        boost::filesystem::remove_all(directory_);
+    }
+
+    virtual void TearDown() {
+        boost::filesystem::remove_all(directory_);
+    }
+
+    GenDb::DbDataValueVec RowKey(uint32_t t2) const {
+        GenDb::DbDataValueVec rowkey;
+        rowkey.push_back(t2);
+        rowkey.push_back(static_cast<uint8_t>(0));
+        rowkey.push_back(std::string("FieldNames"));
+        rowkey.push_back(std::string("fields"));
+        return rowkey;
+    }
+
+    // Column list in the layout written by DbHandler::StatTableWrite
+    void Write(StatTableStore *store, uint32_t t2, const std::string &name,
+        uint32_t t1, const std::string &source, const std::string &tags) {
+        GenDb::ColList col_list;
+        col_list.cfname_ = "StatsTableV4";
+        col_list.rowkey_ = RowKey(t2);
+        GenDb::DbDataValueVec *col_name(new GenDb::DbDataValueVec);
+        col_name->push_back(name);
+        col_name->push_back(t1);
+        col_name->push_back(uuid_generator_());
+        col_name->push_back(source);
+        col_name->push_back(std::string("1000:key"));
+        col_name->push_back(std::string("1000:"));
+        col_name->push_back(tags);
+        col_name->push_back(std::string("1000:"));
+        col_name->push_back(std::string("1000:"));
+        col_name->push_back(std::string("1000:"));
+        std::ostringstream value;
+        value << "{\"fields.value\":\"" << name << "\",\"T1\":" << t1 << "}";
+        GenDb::DbDataValueVec *col_value(
+            new GenDb::DbDataValueVec(1, value.str()));
+        col_list.columns_.push_back(
+            new GenDb::NewCol(col_name, col_value, 3600));
+        ASSERT_TRUE(store->Write(col_list));
+    }
+
+    size_t Read(StatTableStore *store, const GenDb::ColumnNameRange &crange,
+        const GenDb::WhereIndexInfoVec &where_vec) {
+        GenDb::ColList result;
+        EXPECT_TRUE(store->Read(RowKey(kT2), crange, where_vec, &result));
+        return result.columns_.size();
+    }
+
+    std::string directory_;
+    boost::uuids::random_generator uuid_generator_;
+};
+
+TEST_F(StatTableStoreTest, WriteRead) {
+    StatTableStore store(directory_, 16);
+    ASSERT_TRUE(store.Initialize());
+    for (uint32_t i = 0; i < 100; i++) {
+        std::ostringstream name, source;
+        name << "name" << i % 10;
+        source << kT2 << ":source" << i % 4;
+        Write(&store, kT2, name.str(), i, source.str(),
+              i % 2 ? "1000:vn=red;vm=a" : "1000:vn=blue;vm=b");
+    }
+    GenDb::ColumnNameRange crange;
+    // Not visible until flushed
+    EXPECT_EQ(0, Read(&store, crange, GenDb::WhereIndexInfoVec()));
+    ASSERT_TRUE(store.Flush());
+    StatTableStore::Stats stats;
+    store.GetStats(&stats);
+    EXPECT_EQ(100, stats.rows_written);
+    EXPECT_EQ(7, stats.blocks_written);
+
+    GenDb::ColList result;
+    ASSERT_TRUE(store.Read(RowKey(kT2), crange, GenDb::WhereIndexInfoVec(),
+                           &result));
+    ASSERT_EQ(100, result.columns_.size());
+    const GenDb::NewCol &column(result.columns_[42]);
+    ASSERT_EQ(3, column.name->size());
+    EXPECT_EQ("name2", boost::get<std::string>(column.name->at(0)));
+    EXPECT_EQ(42, boost::get<uint32_t>(column.name->at(1)));
+    EXPECT_EQ("{\"fields.value\":\"name2\",\"T1\":42}",
+              boost::get<std::string>(column.value->at(0)));
+
+    // Name range, as queried for a name prefix
+    crange.start_.push_back(std::string("name1"));
+    crange.finish_.push_back(std::string("name3"));
+    crange.finish_.push_back(static_cast<uint32_t>(50));
+    EXPECT_EQ(25, Read(&store, crange, GenDb::WhereIndexInfoVec()));
+
+    // Where conditions
+    GenDb::WhereIndexInfoVec where_vec;
+    GenDb::ColumnNameRange all;
+    where_vec.push_back(boost::make_tuple(std::string("column4"),
+        GenDb::Op::EQ, GenDb::DbDataValue(std::string("1000:source1"))));
+    EXPECT_EQ(25, Read(&store, all, where_vec));
+    where_vec.push_back(boost::make_tuple(std::string("column7"),
+        GenDb::Op::LIKE, GenDb::DbDataValue(std::string("%vn=red%"))));
+    EXPECT_EQ(25, Read(&store, all, where_vec));
+    where_vec[1].get<2>() = std::string("%vn=blue%");
+    EXPECT_EQ(0, Read(&store, all, where_vec));
+    where_vec.clear();
+    where_vec.push_back(boost::make_tuple(std::string("column4"),
+        GenDb::Op::LIKE, GenDb::DbDataValue(std::string("1000:sou%"))));
+    EXPECT_EQ(100, Read(&store, all, where_vec));
+    where_vec[0].get<2>() = std::string("1000:other%");
+    EXPECT_EQ(0, Read(&store, all, where_vec));
+    store.GetStats(&stats);
+    EXPECT_EQ(7, stats.blocks_skipped);
+
+    // Unknown column
+    where_vec[0].get<0>() = "column2";
+    EXPECT_FALSE(store.Read(RowKey(kT2), all, where_vec, &result));
+    // Partition not written
+    GenDb::ColList empty;
+    EXPECT_TRUE(store.Read(RowKey(kT2 + 1), all, GenDb::WhereIndexInfoVec(),
+                           &empty));
+    EXPECT_EQ(0, empty.columns_.size());
+}
+
+TEST_F(StatTableStoreTest, Corruption) {
+    StatTableStore store(directory_, 4);
+    ASSERT_TRUE(store.Initialize());
+    for (uint32_t i = 0; i < 8; i++) {
+        Write(&store, kT2, "name", i, "1000:source", "1000:");
+    }
+    ASSERT_TRUE(store.Flush());
+    boost::filesystem::recursive_directory_iterator it(directory_), end;
+    std::string path;
+    for (; it != end; ++it) {
+        if (boost::filesystem::is_regular_file(it->path())) {
+            path = it->path().string();
+        }
+    }
+    ASSERT_FALSE(path.empty());
+    // Flip a byte in the first block
+    {
+        FILE *file(fopen(path.c_str(), "r+"));
+        ASSERT_TRUE(file != NULL);
+        fseek(file, 40, SEEK_SET);
+        int c(fgetc(file));
+        fseek(file, 40, SEEK_SET);
+        fputc(c ^ 0xff, file);
+        fclose(file);
+    }
+    GenDb::ColumnNameRange crange;
+    EXPECT_EQ(4, Read(&store, crange, GenDb::WhereIndexInfoVec()));
+    StatTableStore::Stats stats;
+    store.GetStats(&stats);
+    EXPECT_EQ(1, stats.corrupt_blocks);
+    // A partially appended block is not read
+    size_t size(boost::filesystem::file_size(path));
+    ASSERT_EQ(0, truncate(path.c_str(), size - 1));
+    EXPECT_EQ(0, Read(&store, crange, GenDb::WhereIndexInfoVec()));
+    store.GetStats(&stats);
+    EXPECT_EQ(2, stats.corrupt_blocks);
+}
+
+TEST_F(StatTableStoreTest, Purge) {
+    StatTableStore store(directory_);
+    ASSERT_TRUE(store.Initialize());
+    Write(&store, kT2 - 1, "name", 0, "1000:source", "1000:");
+    Write(&store, kT2, "name", 0, "1000:source", "1000:");
+    ASSERT_TRUE(store.Flush());
+    store.Purge(kT2);
+    GenDb::ColumnNameRange crange;
+    EXPECT_EQ(1, Read(&store, crange, GenDb::WhereIndexInfoVec()));
+    GenDb::ColList result;
+    ASSERT_TRUE(store.Read(RowKey(kT2 - 1), crange,
+                           GenDb::WhereIndexInfoVec(), &result));
+    EXPECT_EQ(0, result.columns_.size());
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
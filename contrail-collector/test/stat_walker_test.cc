@@ -4,6 +4,7 @@
 
 #include "testing/gunit.h"
 #include "base/logging.h"
+#include "base/string_util.h"
 
 #include "stat_walker.h"
 #include <boost/assign/list_of.hpp>
@@ -194,6 +195,63 @@ TEST_F(StatWalkerTest, DoubleTag) {
     sw.Pop(); 
 }
 
+TEST_F(StatWalkerTest, SiblingTags) {
+    string statName = string("SiblingTags");
+    vector<ArgSet> av1;
+    DbHandler::AttribMap sm;
+    ArgSet a1;
+    a1.statAttr = string("virt.a");
+    a1.attribs = map_list_of(
+        "Source", DbHandler::Var("a6s40"))(
+        "virt.a.bank", DbHandler::Var("bank1"))
+            .convert_to_container<map<string, DbHandler::Var> >();
+    a1.attribs_tag.insert(make_pair("Source", make_pair(DbHandler::Var("a6s40"), sm)));
+    a1.attribs_tag.insert(make_pair("virt.a.bank", make_pair(DbHandler::Var("bank1"), sm)));
+    av1.push_back(a1);
+    // The tags of the first child are not inherited by its sibling
+    ArgSet a2;
+    a2.statAttr = string("virt.b");
+    a2.attribs = map_list_of(
+        "Source", DbHandler::Var("a6s40"))(
+        "virt.b.bank", DbHandler::Var("bank2"))
+            .convert_to_container<map<string, DbHandler::Var> >();
+    a2.attribs_tag.insert(make_pair("Source", make_pair(DbHandler::Var("a6s40"), sm)));
+    a2.attribs_tag.insert(make_pair("virt.b.bank", make_pair(DbHandler::Var("bank2"), sm)));
+    av1.push_back(a2);
+    // Nor by their parent
+    ArgSet a3;
+    a3.statAttr = string("virt");
+    a3.attribs = map_list_of(
+        "Source", DbHandler::Var("a6s40"))(
+        "virt.mem", DbHandler::Var((uint64_t)1000000))
+            .convert_to_container<map<string, DbHandler::Var> >();
+    a3.attribs_tag.insert(make_pair("Source", make_pair(DbHandler::Var("a6s40"), sm)));
+    av1.push_back(a3);
+
+    StatCbTester ct(av1);
+
+    StatWalker::TagMap m1;
+    StatWalker::TagVal h1;
+    h1.val = string("a6s40");
+    m1.insert(make_pair(string("Source"), h1));
+
+    StatWalker::TagMap m2;
+    StatWalker sw(boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), 0, statName, m1);
+    DbHandler::AttribMap attribs = map_list_of("mem", DbHandler::Var((uint64_t)1000000));
+    sw.Push("virt", m2, attribs);
+    for (int idx = 1; idx <= 2; idx++) {
+        std::string bank("bank" + integerToString(idx));
+        StatWalker::TagMap m3;
+        StatWalker::TagVal tv1;
+        tv1.val = bank;
+        m3.insert(make_pair("bank", tv1));
+        DbHandler::AttribMap cattribs = map_list_of("bank", DbHandler::Var(bank));
+        sw.Push(idx == 1 ? "a" : "b", m3, cattribs);
+        sw.Pop();
+    }
+    sw.Pop();
+}
+
 int main(int argc, char **argv) {
     LoggingInit();
     ::testing::InitGoogleTest(&argc, argv);
@@ -3,12 +3,14 @@
  */
 
 #include <fstream>
+#include <sstream>
 
 #include <boost/assign/list_of.hpp>
 
 #include <testing/gunit.h>
 
 #include <base/logging.h>
+#include <base/time_util.h>
 #include <base/test/task_test_util.h>
 #include <io/test/event_manager_test.h>
 #include <io/io_types.h>
@@ -202,7 +204,7 @@ TEST_F(StructuredSyslogStatWalkerTest, Basic) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     ASSERT_TRUE(r);
     if (r ==false) {
@@ -224,7 +226,7 @@ TEST_F(StructuredSyslogStatWalkerTest, DeviceMultiSyslog) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     ASSERT_TRUE(r);
     if (r ==false) {
@@ -245,7 +247,7 @@ TEST_F(StructuredSyslogStatWalkerTest, DeviceSyslog) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     ASSERT_TRUE(r);
     if (r ==false) {
@@ -267,7 +269,7 @@ TEST_F(StructuredSyslogStatWalkerTest, DeviceSyslogTz) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     ASSERT_TRUE(r);
     if (r ==false) {
@@ -289,7 +291,7 @@ TEST_F(StructuredSyslogStatWalkerTest, ParseError) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     //ASSERT_FALSE(r);
     ASSERT_TRUE(r);
@@ -309,7 +311,7 @@ TEST_F(StructuredSyslogStatWalkerTest, BadStruct) {
     bool r = structured_syslog::impl::ProcessStructuredSyslog(p, test_structured_syslog.length(), rep.address(),
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
-        boost::shared_ptr<std::string>());
+        structured_syslog::impl::StructuredSyslogSessionBufferPtr());
     delete config_obj;
     ASSERT_TRUE(r);
 
@@ -336,8 +338,8 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_1) {
     test_structured_syslog_File.close();
 
     boost::system::error_code ec;
-    boost::shared_ptr<std::string> sess_buf;
-    sess_buf.reset(new std::string(""));
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
     boost::asio::ip::address raddr(
         boost::asio::ip::address::from_string("127.0.0.1", ec));
     boost::asio::ip::udp::endpoint rep(raddr, 0);
@@ -354,7 +356,7 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_1) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    if (*sess_buf != "1") {
+    if (sess_buf->ToString() != "1") {
         r1 = false;
         LOG(ERROR, "Expected: 1, Error: \"incorrect value in session buffer\" ");
     }
@@ -363,7 +365,7 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_1) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    sess_buf->clear();
+    sess_buf->Clear();
     delete config_obj;
     bool r = r1*r2;
     ASSERT_TRUE(r);
@@ -393,8 +395,8 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_2) {
     test_structured_syslog_rest_of_buffer_File.close();
     test_structured_syslog_File.close();
     boost::system::error_code ec;
-    boost::shared_ptr<std::string> sess_buf;
-    sess_buf.reset(new std::string(""));
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
     boost::asio::ip::address raddr(
         boost::asio::ip::address::from_string("127.0.0.1", ec));
     boost::asio::ip::udp::endpoint rep(raddr, 0);
@@ -409,7 +411,7 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_2) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    if (*sess_buf != "10") {
+    if (sess_buf->ToString() != "10") {
         r1 = false;
         LOG(ERROR, "Expected: 10, Error: \"incorrect value in session buffer\" ");
     }
@@ -418,7 +420,7 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_2) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    sess_buf->clear();
+    sess_buf->Clear();
     delete config_obj;
     bool r = r1*r2;
     ASSERT_TRUE(r);
@@ -446,8 +448,8 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_3) {
     test_structured_syslog_rest_of_buffer_File.close();
     test_structured_syslog_File.close();
     boost::system::error_code ec;
-    boost::shared_ptr<std::string> sess_buf;
-    sess_buf.reset(new std::string(""));
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
     boost::asio::ip::address raddr(
         boost::asio::ip::address::from_string("127.0.0.1", ec));
     boost::asio::ip::udp::endpoint rep(raddr, 0);
@@ -462,7 +464,7 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_3) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    if (*sess_buf != "1011") {
+    if (sess_buf->ToString() != "1011") {
         r1 = false;
         LOG(ERROR, "Expected: 1011, Error: \"incorrect value in session buffer\" ");
     }
@@ -471,13 +473,60 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplit_3) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    sess_buf->clear();
+    sess_buf->Clear();
     delete config_obj;
     bool r = r1*r2;
     ASSERT_TRUE(r);
 }
 
 
+TEST_F(StructuredSyslogStatWalkerTest, MessageLengthSplitLarge) {
+    StatCbTester ct(PopulateTestMessageStatsInfo(true), true);
+    // Message larger than the initial session buffer, split over 3 reads
+    std::string test_structured_syslog_msg("<14>1 2020-05-07T16:27:40.111Z "
+        "syslog-hostname RT_FLOW - APPTRACK_SESSION_CLOSE "
+        "[junos@2636.1.1.1.2.129 reason=\"TCP RST\" "
+        "source-address=\"4.0.0.1\" source-port=\"13175\" username=\"" +
+        std::string(3 * structured_syslog::impl::StructuredSyslogSessionBuffer::
+            kInitialSize, 'u') + "\"]");
+    std::stringstream ss;
+    ss << test_structured_syslog_msg.length() << " " <<
+        test_structured_syslog_msg;
+    const std::string test_structured_syslog(ss.str());
+    size_t split = test_structured_syslog.length() / 3;
+
+    boost::system::error_code ec;
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
+    boost::asio::ip::address raddr(
+        boost::asio::ip::address::from_string("127.0.0.1", ec));
+    boost::asio::ip::udp::endpoint rep(raddr, 0);
+    const uint8_t* p =
+        reinterpret_cast<const uint8_t*>(test_structured_syslog.c_str());
+    StructuredSyslogConfig *config_obj = new StructuredSyslogConfig(NULL, 1);
+    bool r1 = structured_syslog::impl::ProcessStructuredSyslog(p,
+        split, rep.address(),
+        boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
+        boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
+        sess_buf);
+    EXPECT_EQ(split, sess_buf->size());
+    bool r2 = structured_syslog::impl::ProcessStructuredSyslog(p + split,
+        split, rep.address(),
+        boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
+        boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
+        sess_buf);
+    EXPECT_EQ(2 * split, sess_buf->size());
+    bool r3 = structured_syslog::impl::ProcessStructuredSyslog(p + 2 * split,
+        test_structured_syslog.length() - 2 * split, rep.address(),
+        boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
+        boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
+        sess_buf);
+    EXPECT_TRUE(sess_buf->empty());
+    delete config_obj;
+    bool r = r1*r2*r3;
+    ASSERT_TRUE(r);
+}
+
 TEST_F(StructuredSyslogStatWalkerTest, MessageLengthBad) {
     StatCbTester ct(PopulateTestMessageStatsInfo(true), true);
     std::string test_structured_syslog ;
@@ -497,8 +546,8 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthBad) {
     test_structured_syslog_File.close();
 
     boost::system::error_code ec;
-    boost::shared_ptr<std::string> sess_buf;
-    sess_buf.reset(new std::string(""));
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
     boost::asio::ip::address raddr(
         boost::asio::ip::address::from_string("127.0.0.1", ec));
     boost::asio::ip::udp::endpoint rep(raddr, 0);
@@ -519,12 +568,154 @@ TEST_F(StructuredSyslogStatWalkerTest, MessageLengthBad) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    sess_buf->clear();
+    sess_buf->Clear();
     delete config_obj;
     bool r = !(r1)*r2;
     ASSERT_TRUE(r);
 }
 
+TEST_F(StructuredSyslogStatWalkerTest, FindNetwork) {
+    StructuredSyslogConfig *config_obj = new StructuredSyslogConfig(NULL, 1);
+    const std::string key("tenant1::vpn1");
+    EXPECT_TRUE(config_obj->AddNetwork(key, "10.0.0.0", "255.0.0.0", "site1"));
+    EXPECT_TRUE(config_obj->AddNetwork(key, "10.1.0.0", "255.255.0.0", "site2"));
+    EXPECT_TRUE(config_obj->AddNetwork(key, "10.1.2.0", "24", "site3"));
+    EXPECT_TRUE(config_obj->AddNetwork(key, "2001:db8::", "32", "site4"));
+    EXPECT_TRUE(config_obj->AddNetwork(key, "2001:db8:1::", "48", "site5"));
+    EXPECT_FALSE(config_obj->AddNetwork(key, "10.2.0.0", "33", "site6"));
+    // Not contiguous
+    EXPECT_FALSE(config_obj->AddNetwork(key, "10.3.0.0", "255.0.255.0", "site6"));
+    EXPECT_FALSE(config_obj->AddNetwork(key, "2001:db8:3::", "ffff::ffff", "site6"));
+    // Not visible until published
+    EXPECT_EQ("", config_obj->FindNetwork("10.1.2.3", key, "site0"));
+    config_obj->UpdateNetworkTries();
+    // Longest prefix wins, source location is skipped
+    EXPECT_EQ("site3", config_obj->FindNetwork("10.1.2.3", key, "site0"));
+    EXPECT_EQ("site2", config_obj->FindNetwork("10.1.2.3", key, "site3"));
+    EXPECT_EQ("site2", config_obj->FindNetwork("10.1.3.3", key, "site0"));
+    EXPECT_EQ("site1", config_obj->FindNetwork("10.9.9.9", key, "site0"));
+    EXPECT_EQ("", config_obj->FindNetwork("11.0.0.1", key, "site0"));
+    EXPECT_EQ("", config_obj->FindNetwork("10.1.2.3", "tenant1::vpn2", "site0"));
+    EXPECT_EQ("site5", config_obj->FindNetwork("2001:db8:1::5", key, "site0"));
+    EXPECT_EQ("site4", config_obj->FindNetwork("2001:db8:2::5", key, "site0"));
+    config_obj->RefreshNetworksMap("site3");
+    config_obj->UpdateNetworkTries();
+    EXPECT_EQ("site2", config_obj->FindNetwork("10.1.2.3", key, "site0"));
+    // Only the changed Tenant::VPN is rebuilt, the others are kept
+    const std::string key2("tenant1::vpn2");
+    EXPECT_TRUE(config_obj->AddNetwork(key2, "10.1.2.0", "24", "site7"));
+    config_obj->UpdateNetworkTries();
+    EXPECT_EQ("site7", config_obj->FindNetwork("10.1.2.3", key2, "site0"));
+    EXPECT_EQ("site2", config_obj->FindNetwork("10.1.2.3", key, "site0"));
+    config_obj->RefreshNetworksMap("site7");
+    config_obj->UpdateNetworkTries();
+    EXPECT_EQ("", config_obj->FindNetwork("10.1.2.3", key2, "site0"));
+    EXPECT_EQ("site5", config_obj->FindNetwork("2001:db8:1::5", key, "site0"));
+    delete config_obj;
+}
+
+TEST_F(StructuredSyslogStatWalkerTest, SessionCounterStore) {
+    // limit of 3 sessions, 10 second inactivity timeout
+    SyslogSessionCounterStore store(3, 10 * 1000000);
+    SyslogSessionCounters counters;
+    counters.total_bytes = 100;
+    uint64_t keys[4];
+    for (int i = 0; i < 4; i++) {
+        std::stringstream ss;
+        ss << i;
+        keys[i] = SyslogSessionCounterStore::SessionKey(
+            "tenant1::site1::device1", ss.str());
+    }
+    uint64_t now = UTCTimestampUsec();
+    EXPECT_TRUE(store.Add(keys[0], counters, now));
+    EXPECT_TRUE(store.Add(keys[1], counters, now));
+    EXPECT_TRUE(store.Add(keys[2], counters, now + 5 * 1000000));
+    // Limit reached and nothing has expired yet
+    EXPECT_FALSE(store.Add(keys[3], counters, now + 5 * 1000000));
+    EXPECT_EQ(3U, store.size());
+    // Updates of existing sessions are not refused
+    counters.total_bytes = 200;
+    EXPECT_TRUE(store.Add(keys[2], counters, now + 6 * 1000000));
+    SyslogSessionCounters fetched;
+    EXPECT_TRUE(store.Fetch(keys[2], &fetched));
+    EXPECT_EQ(200U, fetched.total_bytes);
+    EXPECT_TRUE(store.Remove(keys[2]));
+    EXPECT_FALSE(store.Remove(keys[2]));
+    EXPECT_FALSE(store.Fetch(keys[2], &fetched));
+    EXPECT_EQ(2U, store.size());
+    EXPECT_TRUE(store.Add(keys[2], counters, now + 6 * 1000000));
+    // Sessions 0 and 1 never closed, they are evicted to make room
+    EXPECT_TRUE(store.Add(keys[3], counters, now + 12 * 1000000));
+    EXPECT_FALSE(store.Fetch(keys[0], &fetched));
+    EXPECT_FALSE(store.Fetch(keys[1], &fetched));
+    EXPECT_TRUE(store.Fetch(keys[2], &fetched));
+    EXPECT_EQ(2U, store.size());
+    EXPECT_EQ(2U, store.evicted());
+}
+
+TEST_F(StructuredSyslogStatWalkerTest, UVEAggregator) {
+    structured_syslog::impl::StructuredSyslogUVEAggregator aggregator;
+    SDWANMetrics_diff diff;
+    diff.set_total_bytes(100);
+    diff.set_session_count(1);
+    SDWANMetrics_dial dial;
+    dial.set_rtt(10);
+    dial.set_pkt_loss(1);
+    std::map<std::string, SDWANMetrics_diff> diff_map;
+    diff_map.insert(std::make_pair("sla1", diff));
+    std::map<std::string, SDWANMetrics_dial> dial_map;
+    dial_map.insert(std::make_pair("link1", dial));
+    SDWANMetricsRecord record;
+    record.set_name("tenant1::site1::device1");
+    record.set_app_metrics_diff_sla(diff_map);
+    record.set_link_metrics_dial_traffic_type(dial_map);
+    aggregator.Add(record);
+
+    // Counters are summed, gauges keep the latest reported value
+    SDWANMetrics_diff diff2;
+    diff2.set_total_bytes(50);
+    SDWANMetrics_dial dial2;
+    dial2.set_rtt(20);
+    diff_map.clear();
+    diff_map.insert(std::make_pair("sla1", diff2));
+    diff_map.insert(std::make_pair("sla2", diff2));
+    dial_map.clear();
+    dial_map.insert(std::make_pair("link1", dial2));
+    SDWANMetricsRecord record2;
+    record2.set_name("tenant1::site1::device1");
+    record2.set_app_metrics_diff_sla(diff_map);
+    record2.set_link_metrics_dial_traffic_type(dial_map);
+    aggregator.Add(record2);
+
+    SDWANTenantMetricsRecord tenant_record;
+    tenant_record.set_name("DEFAULT::DEFAULT::tenant1");
+    tenant_record.set_tenant_metrics_diff_sla(diff_map);
+    aggregator.Add(tenant_record);
+    EXPECT_EQ(2U, aggregator.size());
+    EXPECT_EQ(3U, aggregator.added());
+
+    SDWANMetricsRecord aggregated;
+    EXPECT_TRUE(aggregator.GetMetricsRecord("tenant1::site1::device1",
+                                            &aggregated));
+    EXPECT_FALSE(aggregated.__isset.app_metrics_diff_link);
+    EXPECT_EQ(2U, aggregated.app_metrics_diff_sla.size());
+    const SDWANMetrics_diff &sla1(aggregated.app_metrics_diff_sla["sla1"]);
+    EXPECT_EQ(150U, sla1.total_bytes);
+    EXPECT_EQ(1U, sla1.session_count);
+    EXPECT_FALSE(sla1.__isset.input_bytes);
+    EXPECT_EQ(50U, aggregated.app_metrics_diff_sla["sla2"].total_bytes);
+    const SDWANMetrics_dial &link1(
+        aggregated.link_metrics_dial_traffic_type["link1"]);
+    EXPECT_EQ(20U, link1.rtt);
+    EXPECT_EQ(1U, link1.pkt_loss);
+
+    aggregator.Flush();
+    EXPECT_EQ(0U, aggregator.size());
+    EXPECT_EQ(2U, aggregator.sent());
+    EXPECT_FALSE(aggregator.GetMetricsRecord("tenant1::site1::device1",
+                                             &aggregated));
+}
+
 TEST_F(StructuredSyslogStatWalkerTest, SNMP_TRAPSyslog) {
     StatCbTester ct(PopulateTestMessageStatsInfo(true), true);
 
@@ -537,8 +728,8 @@ TEST_F(StructuredSyslogStatWalkerTest, SNMP_TRAPSyslog) {
     test_structured_syslog_File.close();
 
     boost::system::error_code ec;
-    boost::shared_ptr<std::string> sess_buf;
-    sess_buf.reset(new std::string(""));
+    structured_syslog::impl::StructuredSyslogSessionBufferPtr sess_buf;
+    sess_buf.reset(new structured_syslog::impl::StructuredSyslogSessionBuffer());
     boost::asio::ip::address raddr(
         boost::asio::ip::address::from_string("127.0.0.1", ec));
     boost::asio::ip::udp::endpoint rep(raddr, 0);
@@ -551,7 +742,7 @@ TEST_F(StructuredSyslogStatWalkerTest, SNMP_TRAPSyslog) {
         boost::bind(&StatCbTester::Cb, &ct, _1, _2, _3, _4, _5), config_obj,
         boost::shared_ptr<structured_syslog::StructuredSyslogForwarder>(),
         sess_buf);
-    sess_buf->clear();
+    sess_buf->Clear();
     delete config_obj;
     ASSERT_TRUE(r);
 
@@ -373,6 +373,23 @@ TEST_F(LineParserTest, NoAttrString)
                 "10.84.5.22", "address", "has", "my", "server"));
 }
 
+TEST_F(LineParserTest, TrailingSeparators)
+{
+    EXPECT_THAT(Parse("peer 10.84.5.22. stats 1/2/ \" spaced \""),
+            testing::ElementsAre(
+                "/", "1/2/", "10.84.5.22.", "peer", "spaced ", "stats"));
+}
+
+TEST_F(LineParserTest, MakeSane)
+{
+    EXPECT_EQ("plain ascii text", LineParser::MakeSane("plain ascii text"));
+    EXPECT_EQ("caf&#195;&#169; 5&#226;&#130;&#172;",
+            LineParser::MakeSane("caf\xc3\xa9 5\xe2\x82\xac"));
+    std::string s("0123456789abcdef<x>");
+    EXPECT_EQ(16U, LineParser::FindXmlSpecial(s.data(), s.size()));
+    EXPECT_EQ(s.size(), LineParser::FindNonAscii(s.data(), s.size()));
+}
+
 TEST_F(LineParserTest, RegexpTextSearch)
 {
     EXPECT_EQ(1, SearchPattern("box", "Its in the box of gems"));
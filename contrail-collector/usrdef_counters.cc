@@ -3,14 +3,206 @@
  */
 
 
+#include <string.h>
 #include <sstream>
+#include <algorithm>
+#include <deque>
 #include <boost/make_shared.hpp>
 #include <analytics/analytics_types.h>
 #include "usrdef_counters.h"
 #include "http/client/vncapi.h"
 #include "options.h"
 
+UserDefinedCounterMatcher::UserDefinedCounterMatcher(const Cfg_t &config) :
+    delta_(kAlphabetSize, 0),
+    outputs_(1) {
+    for (Cfg_t::const_iterator it = config.begin(); it != config.end(); ++it) {
+        uint32_t counter = counters_.size();
+        counters_.push_back(it->second);
+        regexps_.push_back(it->second->regexp());
+        std::string literal(RequiredLiteral(it->second->pattern()));
+        if (literal.empty()) {
+            unfiltered_.push_back(counter);
+        } else {
+            AddLiteral(literal, counter);
+        }
+    }
+    Build();
+}
+
+const char UserDefinedCounterMatcher::kOperandEscapes[] =
+    "0123456789cegkopuxELNPQU";
+
+std::string
+UserDefinedCounterMatcher::RequiredLiteral(const std::string &pattern)
+{
+    // Inline modifiers may make the pattern case insensitive, and
+    // lookarounds do not consume what they match
+    if (pattern.find("(?") != std::string::npos) {
+        return std::string();
+    }
+    std::string best, cur;
+    int depth = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            if (++i == pattern.size()) {
+                return std::string();
+            }
+            // \d, \w, \b, backreferences etc. are not literals
+            if (depth == 0 && !isalnum(static_cast<unsigned char>(pattern[i]))) {
+                cur += pattern[i];
+                continue;
+            }
+            // Numeric, control and named escapes are followed by operands
+            // that are not literals either, give up rather than guess
+            // where they end
+            if (strchr(kOperandEscapes, pattern[i]) != NULL) {
+                return std::string();
+            }
+            c = '\0';
+        } else if (c == '[') {
+            // skip the character class, a leading ] is part of it
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') j++;
+            if (j < pattern.size() && pattern[j] == ']') j++;
+            while (j < pattern.size() && pattern[j] != ']') {
+                if (pattern[j] == '\\') j++;
+                j++;
+            }
+            i = j;
+            c = '\0';
+        } else if (c == '(') {
+            depth++;
+            c = '\0';
+        } else if (c == ')') {
+            if (--depth < 0) {
+                return std::string();
+            }
+            c = '\0';
+        } else if (c == '|') {
+            // any branch may match, so no literal is required
+            if (depth == 0) {
+                return std::string();
+            }
+            c = '\0';
+        } else if (c == '*' || c == '?' || c == '{') {
+            // the preceding character may not be present
+            if (!cur.empty()) {
+                cur.erase(cur.size() - 1);
+            }
+            if (c == '{') {
+                i = std::min(pattern.find('}', i), pattern.size());
+            }
+            c = '\0';
+        } else if (c == '+' || c == '.' || c == '^' || c == '$') {
+            c = '\0';
+        }
+        if (depth == 0 && c != '\0') {
+            cur += c;
+            continue;
+        }
+        // the literal run ends here
+        if (cur.size() > best.size()) {
+            best = cur;
+        }
+        cur.clear();
+    }
+    if (cur.size() > best.size()) {
+        best = cur;
+    }
+    return best;
+}
+
+void
+UserDefinedCounterMatcher::AddLiteral(const std::string &literal,
+                                      uint32_t counter)
+{
+    // Build the trie, no transition leads back to the root so 0 stands
+    // for a missing edge until Build()
+    uint32_t state = 0;
+    for (std::string::const_iterator it = literal.begin();
+         it != literal.end(); ++it) {
+        uint32_t &next(delta_[state * kAlphabetSize +
+                              static_cast<uint8_t>(*it)]);
+        if (next == 0) {
+            next = outputs_.size();
+            outputs_.resize(outputs_.size() + 1);
+            delta_.resize(delta_.size() + kAlphabetSize, 0);
+        }
+        state = delta_[state * kAlphabetSize + static_cast<uint8_t>(*it)];
+    }
+    outputs_[state].push_back(counter);
+}
+
+void
+UserDefinedCounterMatcher::Build()
+{
+    // Breadth first computation of the failure links, turning the trie
+    // into a complete transition table
+    std::vector<uint32_t> fail(outputs_.size(), 0);
+    std::deque<uint32_t> queue;
+    for (uint32_t c = 0; c < kAlphabetSize; c++) {
+        if (delta_[c] != 0) {
+            queue.push_back(delta_[c]);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        const std::vector<uint32_t> &inherited(outputs_[fail[state]]);
+        outputs_[state].insert(outputs_[state].end(), inherited.begin(),
+                               inherited.end());
+        for (uint32_t c = 0; c < kAlphabetSize; c++) {
+            uint32_t &next(delta_[state * kAlphabetSize + c]);
+            uint32_t fallback = delta_[fail[state] * kAlphabetSize + c];
+            if (next != 0) {
+                fail[next] = fallback;
+                queue.push_back(next);
+            } else {
+                next = fallback;
+            }
+        }
+    }
+}
+
+void
+UserDefinedCounterMatcher::Match(const std::string &text,
+                                 LineParser::WordListType *words) const
+{
+    if (counters_.empty()) {
+        return;
+    }
+    std::vector<bool> candidate(counters_.size(), false);
+    for (std::vector<uint32_t>::const_iterator it = unfiltered_.begin();
+         it != unfiltered_.end(); ++it) {
+        candidate[*it] = true;
+    }
+    uint32_t state = 0;
+    for (std::string::const_iterator it = text.begin(); it != text.end();
+         ++it) {
+        state = delta_[state * kAlphabetSize + static_cast<uint8_t>(*it)];
+        const std::vector<uint32_t> &output(outputs_[state]);
+        for (std::vector<uint32_t>::const_iterator oit = output.begin();
+             oit != output.end(); ++oit) {
+            candidate[*oit] = true;
+        }
+    }
+    for (size_t i = 0; i < counters_.size(); i++) {
+        if (!candidate[i]) {
+            continue;
+        }
+        boost::match_results<std::string::const_iterator> what;
+        if (regex_search(text.begin(), text.end(), what, regexps_[i],
+                         boost::match_default)) {
+            counters_[i]->Increment();
+            words->insert(counters_[i]->name());
+        }
+    }
+}
+
 UserDefinedCounters::UserDefinedCounters() {
+    UpdateMatcher();
 }
 
 UserDefinedCounters::~UserDefinedCounters() {
@@ -39,6 +231,7 @@ UserDefinedCounters::UDCHandler(const contrail_rapidjson::Document &jdoc, bool a
                     config_.erase(dit);
                 }
             }    
+            UpdateMatcher();
             return;
         }
 
@@ -65,7 +258,7 @@ UserDefinedCounters::UDCHandler(const contrail_rapidjson::Document &jdoc, bool a
             }
             std::string name = gsc[i]["name"].GetString(),
                         patrn = gsc[i]["pattern"].GetString();
-            AddConfig(name, patrn);
+            UpdateConfig(name, patrn);
             std::cout << "\nname: " << name << "\npattern: "
                 << patrn << "\n";
         }
@@ -81,6 +274,7 @@ UserDefinedCounters::UDCHandler(const contrail_rapidjson::Document &jdoc, bool a
                 config_.erase(dit);
             }
         }
+        UpdateMatcher();
     }
 
     return;
@@ -89,19 +283,47 @@ UserDefinedCounters::UDCHandler(const contrail_rapidjson::Document &jdoc, bool a
 void
 UserDefinedCounters::MatchFilter(std::string text, LineParser::WordListType *w)
 {
-    for(Cfg_t::iterator it=config_.begin(); it != config_.end(); ++it) {
-        if (LineParser::SearchPattern(it->second->regexp(), text)) {
-            UserDefinedLogStatistic udc;
-            udc.set_name(it->first);
-            udc.set_rx_event(1);
-            UserDefinedLogStatisticUVE::Send(udc);
-            w->insert(it->first);
+    boost::shared_ptr<const UserDefinedCounterMatcher> matcher(
+        boost::atomic_load(&matcher_));
+    matcher->Match(text, w);
+}
+
+void
+UserDefinedCounters::SendUVEs()
+{
+    boost::shared_ptr<const UserDefinedCounterMatcher> matcher(
+        boost::atomic_load(&matcher_));
+    const std::vector<boost::shared_ptr<UserDefinedCounterData> > &counters(
+        matcher->counters());
+    for (size_t i = 0; i < counters.size(); i++) {
+        uint64_t count = counters[i]->Collect();
+        if (count == 0) {
+            continue;
         }
+        UserDefinedLogStatistic udc;
+        udc.set_name(counters[i]->name());
+        udc.set_rx_event(count);
+        UserDefinedLogStatisticUVE::Send(udc);
     }
 }
 
+void
+UserDefinedCounters::UpdateMatcher()
+{
+    boost::shared_ptr<const UserDefinedCounterMatcher> matcher(
+        new UserDefinedCounterMatcher(config_));
+    boost::atomic_store(&matcher_, matcher);
+}
+
 void
 UserDefinedCounters::AddConfig(std::string name, std::string pattern)
+{
+    UpdateConfig(name, pattern);
+    UpdateMatcher();
+}
+
+void
+UserDefinedCounters::UpdateConfig(std::string name, std::string pattern)
 {
     Cfg_t::iterator it=config_.find(name);
     if (it  != config_.end()) {
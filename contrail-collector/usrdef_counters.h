@@ -6,6 +6,7 @@
 
 
 #include <map>
+#include <vector>
 #include <tbb/atomic.h>
 #include <boost/shared_ptr.hpp>
 #include "http/client/vncapi.h"
@@ -25,6 +26,7 @@ class UserDefinedCounterData {
         explicit UserDefinedCounterData(std::string name, std::string pat):
             refreshed_(true), name_(name) {
             SetPattern(pat);
+            count_ = 0;
         }
         void SetPattern(std::string pat) {
             regexp_ = contrail::regex(pat);
@@ -39,27 +41,77 @@ class UserDefinedCounterData {
         const std::string pattern() const { return regexp_str_; }
         void Refresh() { refreshed_ = true; }
         bool IsRefreshed() { bool r = refreshed_; refreshed_ = false; return r;}
+        // Matches since the last UVE was sent
+        void Increment() { count_++; }
+        uint64_t Collect() { return count_.fetch_and_store(0); }
     private:
         bool                   refreshed_;
         std::string            name_;
         std::string            regexp_str_;
         contrail::regex        regexp_;
+        tbb::atomic<uint64_t>  count_;
 };
 
 typedef std::map<std::string, boost::shared_ptr<UserDefinedCounterData> > Cfg_t;
 
+//
+// Matches a text against all the configured counter patterns at once.
+//
+// A literal substring that every match of a pattern must contain is
+// extracted from each pattern, and all the literals are compiled into a
+// single Aho-Corasick automaton. A text is scanned once through the
+// automaton, and only the patterns whose literal was found, or that have
+// no usable literal, are run as regular expressions. The matcher is
+// immutable and rebuilt when the configuration changes.
+//
+class UserDefinedCounterMatcher {
+    public:
+        explicit UserDefinedCounterMatcher(const Cfg_t &config);
+        // Calls Increment() on, and inserts into words the name of, every
+        // counter whose pattern matches text
+        void Match(const std::string &text,
+                   LineParser::WordListType *words) const;
+        const std::vector<boost::shared_ptr<UserDefinedCounterData> > &
+            counters() const { return counters_; }
+        // Longest literal that is part of every match of pattern, or an
+        // empty string if there is none
+        static std::string RequiredLiteral(const std::string &pattern);
+    private:
+        static const uint32_t kAlphabetSize = 256;
+        // Escapes whose operands RequiredLiteral does not parse
+        static const char kOperandEscapes[];
+        void AddLiteral(const std::string &literal, uint32_t counter);
+        void Build();
+
+        std::vector<boost::shared_ptr<UserDefinedCounterData> > counters_;
+        std::vector<contrail::regex> regexps_;
+        // counters without a literal, matched against every text
+        std::vector<uint32_t> unfiltered_;
+        // automaton transitions, kAlphabetSize per state
+        std::vector<uint32_t> delta_;
+        // counters whose literal ends at each state
+        std::vector<std::vector<uint32_t> > outputs_;
+};
+
 class UserDefinedCounters {
     public:
         UserDefinedCounters();
         virtual ~UserDefinedCounters();
         virtual void MatchFilter(std::string text, LineParser::WordListType *words);
+        // Sends the matches counted since the last call, one UVE per
+        // counter that matched
         void SendUVEs();
         void AddConfig(std::string name, std::string pattern);
         bool FindByName(std::string name);
         void UDCHandler(const contrail_rapidjson::Document &jdoc, bool add_change);
         void GetUDCConfig(std::vector<LogStatisticConfigInfo> *config_info);
     private:
+        void UpdateConfig(std::string name, std::string pattern);
+        void UpdateMatcher();
+
         Cfg_t config_;
+        // Built from config_, read without a lock by MatchFilter
+        boost::shared_ptr<const UserDefinedCounterMatcher> matcher_;
 };
 
 
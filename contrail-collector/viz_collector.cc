@@ -17,6 +17,7 @@
 #include "sandesh/sandesh_session.h"
 
 #include "ruleeng.h"
+#include "sflow_collector.h"
 #include "structured_syslog_collector.h"
 #include "viz_sandesh.h"
 #include <zookeeper/zookeeper_client.h>
@@ -42,6 +43,9 @@ VizCollector::VizCollector(EventManager *evm, unsigned short listen_port,
             const std::string &structured_syslog_kafka_topic,
             uint16_t structured_syslog_kafka_partitions,
             uint64_t structured_syslog_active_session_map_limit,
+            uint64_t structured_syslog_active_session_timeout,
+            uint32_t structured_syslog_uve_aggregation_interval,
+            int sflow_port,
             const std::string &redis_uve_ip, unsigned short redis_uve_port,
             const std::string &redis_password,
             const std::map<std::string, std::string>& aggconf,
@@ -93,10 +97,18 @@ VizCollector::VizCollector(EventManager *evm, unsigned short listen_port,
             structured_syslog_kafka_topic,
             structured_syslog_kafka_partitions,
             structured_syslog_active_session_map_limit,
+            structured_syslog_active_session_timeout,
+            structured_syslog_uve_aggregation_interval,
             kafka_options,
             db_initializer_?db_initializer_->GetDbHandler():DbHandlerPtr(),
             config_client));
     }
+    if (sflow_port != -1 && db_initializer_) {
+        sflow_collector_.reset(new SFlowCollector(evm, listen_ip, sflow_port,
+            boost::bind(&DbHandler::UnderlayFlowSampleInsert,
+                db_initializer_->GetDbHandler(), _1, _2,
+                GenDb::GenDbIf::DbAddColumnCb())));
+    }
 
     host_ip_ = host_ip;
     zookeeper_server_list_ = zookeeper_server_list;
@@ -173,6 +185,10 @@ void VizCollector::Shutdown() {
         structured_syslog_collector_->Shutdown();
         WaitForIdle();
     }
+    if (sflow_collector_) {
+        sflow_collector_->Shutdown();
+        WaitForIdle();
+    }
     if (db_initializer_) {
         db_initializer_->Shutdown();
     }
@@ -184,6 +200,9 @@ void VizCollector::DbInitializeCb() {
     if (structured_syslog_collector_) {
         structured_syslog_collector_->Initialize();
     }
+    if (sflow_collector_) {
+        sflow_collector_->Initialize();
+    }
 }
 
 bool VizCollector::Init() {
@@ -199,6 +218,19 @@ void VizCollector::SendGeneratorStatistics() {
     }
 }
 
+void VizCollector::SendSFlowStatistics() {
+    if (sflow_collector_) {
+        sflow_collector_->SendStatistics();
+    }
+}
+
+void VizCollector::SendUDCStatistics() {
+    if (!db_initializer_) {
+        return;
+    }
+    db_initializer_->GetDbHandler()->SendUDCStatistics();
+}
+
 void VizCollector::SendDbStatistics() {
     if (!db_initializer_) {
         return;
@@ -243,6 +275,15 @@ void VizCollector::SendDbStatistics() {
     db_handler->GetSessionTableDbInfo(&stds);
     cds.set_session_table_stats(stds);
 
+    std::map<std::string, DbWriteClassInfo> write_class_info;
+    db_handler->GetDbWriteClassInfo(&write_class_info);
+    cds.set_write_class_stats(write_class_info);
+
+    DbSpoolInfo spool_info;
+    if (db_handler->GetDbSpoolInfo(&spool_info)) {
+        cds.set_spool_stats(spool_info);
+    }
+
     cass::cql::DbStats cql_stats;
     if (db_handler->GetCqlStats(&cql_stats)) {
         cds.set_cql_stats(cql_stats);
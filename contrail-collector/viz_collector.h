@@ -24,6 +24,7 @@
 class Ruleeng;
 class ProtobufCollector;
 class StructuredSyslogCollector;
+class SFlowCollector;
 class Options;
 
 namespace zookeeper {
@@ -44,6 +45,9 @@ public:
             const std::string &structured_syslog_kafka_topic,
             uint16_t structured_syslog_kafka_partitions,
             uint64_t structured_syslog_active_session_map_limit,
+            uint64_t structured_syslog_active_session_timeout,
+            uint32_t structured_syslog_uve_aggregation_interval,
+            int sflow_port,
             const std::string &redis_uve_ip, unsigned short redis_uve_port,
             const std::string &redis_password,
             const std::map<std::string, std::string>& aggconf,
@@ -92,7 +96,9 @@ public:
         }
     }
     void SendDbStatistics();
+    void SendUDCStatistics();
     void SendGeneratorStatistics();
+    void SendSFlowStatistics();
     bool GetCqlMetrics(cass::cql::Metrics *metrics);
 
     static const unsigned int kPartCountCnodes = 1;
@@ -149,6 +155,7 @@ private:
     boost::scoped_ptr<Ruleeng> ruleeng_;
     Collector *collector_;
     boost::scoped_ptr<StructuredSyslogCollector> structured_syslog_collector_;
+    boost::scoped_ptr<SFlowCollector> sflow_collector_;
     boost::scoped_ptr<zookeeper::client::ZookeeperClient> zoo_client_;
     std::string host_ip_;
     std::string name_;
@@ -55,6 +55,63 @@ int RuleMsg::field_value(const std::string& field_id, std::string& type, std::st
     return field_value_recur(field_id, type, value, message_node_);
 }
 
+RuleFieldPath::RuleFieldPath(size_t id, const std::string& field_id) :
+    id(id) {
+    size_t start = 0, dotpos;
+    while ((dotpos = field_id.find_first_of('.', start)) != std::string::npos) {
+        components.push_back(field_id.substr(start, dotpos - start));
+        start = dotpos + 1;
+    }
+    components.push_back(field_id.substr(start));
+}
+
+namespace {
+
+struct NodeNamePredicate {
+    explicit NodeNamePredicate(const char *name) : name_(name) { }
+    bool operator()(pugi::xml_node node) const {
+        return (strcmp(node.name(), name_) == 0);
+    }
+    const char *name_;
+};
+
+}  // namespace
+
+// Same lookup as field_value_recur, without splitting the field name
+pugi::xml_node RuleMsg::ResolveFieldPath(const RuleFieldPath& path) const {
+    pugi::xml_node node = message_node_;
+    for (size_t i = 0; i < path.components.size(); i++) {
+        node = node.find_node(
+            NodeNamePredicate(path.components[i].c_str()));
+        if (node.type() == pugi::node_null) {
+            return pugi::xml_node();
+        }
+        if (i + 1 < path.components.size() &&
+            strncmp("struct", node.attribute("type").value(), 6)) {
+            return pugi::xml_node();
+        }
+    }
+    return node;
+}
+
+int RuleMsg::field_value(const RuleFieldPath& path, std::string& type, std::string& value) const {
+    if (path.id >= resolved_.size()) {
+        resolved_.resize(path.id + 1, false);
+        resolved_nodes_.resize(path.id + 1);
+    }
+    if (!resolved_[path.id]) {
+        resolved_nodes_[path.id] = ResolveFieldPath(path);
+        resolved_[path.id] = true;
+    }
+    const pugi::xml_node &node(resolved_nodes_[path.id]);
+    if (node.type() == pugi::node_null) {
+        return -1;
+    }
+    value = node.child_value();
+    type = node.attribute("type").value();
+    return 0;
+}
+
 void VizMsgStats::Update(const VizMsg *vmsg) {
     const SandeshHeader &header(vmsg->msg->GetHeader());
     messages++;
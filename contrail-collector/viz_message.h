@@ -6,6 +6,7 @@
 #define __VIZ_MESSAGE_H__
 
 #include <string>
+#include <vector>
 #include <boost/uuid/uuid.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <pugixml/pugixml.hpp>
@@ -63,6 +64,19 @@ struct VizMsgStatistics {
     TypeLevelMap type_level_map;
 };
 
+/*
+ * field name used in a rule, split into its '.' separated components
+ * once when the rule is compiled. id indexes the per message resolution
+ * cache in RuleMsg, paths are interned per rule list so that conditions
+ * on the same field share the lookup.
+ */
+struct RuleFieldPath {
+    RuleFieldPath(size_t id, const std::string& field_id);
+
+    size_t id;
+    std::vector<std::string> components;
+};
+
 /* generic message for ruleeng processing */
 struct RuleMsg {
 public:
@@ -71,6 +85,8 @@ public:
 
     int field_value(const std::string& field_id, std::string& type,
         std::string& value) const;
+    int field_value(const RuleFieldPath& path, std::string& type,
+        std::string& value) const;
 
     struct RuleMsgPredicate {
         RuleMsgPredicate(const std::string &name) : tmp_(name) { }
@@ -90,7 +106,12 @@ private:
     int field_value_recur(const std::string& field_id, std::string& type,
         std::string& value, pugi::xml_node doc) const;
 
+    pugi::xml_node ResolveFieldPath(const RuleFieldPath& path) const;
+
     pugi::xml_node message_node_;
+    // nodes of the field paths looked up so far, indexed by path id
+    mutable std::vector<pugi::xml_node> resolved_nodes_;
+    mutable std::vector<bool> resolved_;
 };
 
 #endif // __VIZ_MESSAGE_H__
@@ -236,16 +236,39 @@ def redis_query_status(host, port, redis_password, redis_ssl_params, qid):
 # end redis_query_status
 
 
-def redis_query_chunk_iter(host, port, redis_password, redis_ssl_params, qid, chunk_id):
+class QueryStreamError(Exception):
+    pass
+# end class QueryStreamError
+
+
+def redis_query_chunk_iter(host, port, redis_password, redis_ssl_params, qid, chunk_id,
+                           stream=False):
     redish = StrictRedisWrapper(db=0, host=host, port=port,
                                password=redis_password,
                                **redis_ssl_params)
 
     iters = 0
+    lines = 0
     fin = False
 
     while not fin:
         #import pdb; pdb.set_trace()
+        if stream and iters >= lines:
+            # The query is still running, only the lists counted in
+            # "lines" of its status have been pushed
+            status = redis_query_status(host, port, redis_password,
+                                        redis_ssl_params, qid)
+            if status is None or status['progress'] < 0:
+                raise QueryStreamError('Query %s failed while its result '
+                                       'was read' % qid)
+            if status['progress'] == 100:
+                # All the lists are pushed, read them up to the end
+                stream = False
+            else:
+                lines = int(status['chunks'][0].get('lines', 0))
+                if iters >= lines:
+                    gevent.sleep(1)
+                    continue
         # Keep the result line valid while it is being read
         redish.persist("RESULT:" + qid + ":" + str(iters))
         elems = redish.lrange("RESULT:" + qid + ":" + str(iters), 0, -1)
@@ -260,8 +283,10 @@ def redis_query_chunk_iter(host, port, redis_password, redis_ssl_params, qid, ch
 # end redis_query_chunk_iter
 
 
-def redis_query_chunk(host, port, redis_password, redis_ssl_params, qid, chunk_id):
-    res_iter = redis_query_chunk_iter(host, port, redis_password, redis_ssl_params, qid, chunk_id)
+def redis_query_chunk(host, port, redis_password, redis_ssl_params, qid, chunk_id,
+                      stream=False):
+    res_iter = redis_query_chunk_iter(host, port, redis_password, redis_ssl_params, qid, chunk_id,
+                                      stream)
 
     dli = u''
     starter = True
@@ -297,7 +322,8 @@ def redis_query_chunk(host, port, redis_password, redis_ssl_params, qid, chunk_i
 
 
 
-def redis_query_result(host, port, redis_password, redis_ssl_params, qid):
+def redis_query_result(host, port, redis_password, redis_ssl_params, qid,
+                       stream=False):
     try:
         status = redis_query_status(host, port, redis_password, redis_ssl_params, qid)
     except redis.exceptions.ConnectionError:
@@ -316,6 +342,11 @@ def redis_query_result(host, port, redis_password, redis_ssl_params, qid):
                 for gen in redis_query_chunk(host, port, redis_password, redis_ssl_params, qid,
                                              chunk_id):
                     yield gen
+        elif stream and status['progress'] >= 0:
+            # The rows are read as the query pushes them
+            for gen in redis_query_chunk(host, port, redis_password, redis_ssl_params, qid,
+                                         0, stream):
+                yield gen
         else:
             yield {}
     return
@@ -1702,7 +1733,8 @@ class OpServer(object):
 
     def _sync_query(self, request, qid):
         # In Sync mode, Keep polling query status until final result is
-        # available
+        # available, or until the query starts streaming its rows
+        streamed = False
         try:
             self._logger.info("Polling %s for query result" % ("REPLY:" + qid))
             prg = 0
@@ -1716,16 +1748,19 @@ class OpServer(object):
                                           redis_ssl_params=self.default_redis_ssl_params(),
                                           qid=qid)
 
+                lines = resp["chunks"][0].get("lines", 0)
+
                 # We want to print progress only if it has changed
-                if int(resp["progress"]) == prg:
+                if int(resp["progress"]) == prg and not lines:
                     continue
 
                 self._logger.info(
                     "Query Progress is %s time %d" % (str(resp), time.time()))
                 prg = int(resp["progress"])
 
-                # Either there was an error, or the query is complete
-                if (prg < 0) or (prg == 100):
+                # Either there was an error, the query is complete, or
+                # its rows can be read as they are pushed
+                if (prg < 0) or (prg == 100) or lines:
                     done = True
 
             if prg < 0:
@@ -1736,18 +1771,19 @@ class OpServer(object):
                 yield reply
                 return
 
-            # In Sync mode, its time to read the final result. Status is in
+            # In Sync mode, its time to read the result. Status is in
             # "resp"
             done = False
             gen = redis_query_result(host='127.0.0.1',
                                      port=int(self._args.redis_query_port),
                                      redis_password=self._args.redis_password,
                                      redis_ssl_params=self.default_redis_ssl_params(),
-                                     qid=qid)
+                                     qid=qid, stream=True)
             bottle.response.set_header('Content-Type', 'application/json')
             while not done:
                 try:
                     yield next(gen)
+                    streamed = True
                 except StopIteration:
                     done = True
             '''
@@ -1761,10 +1797,18 @@ class OpServer(object):
             '''
 
         except redis.exceptions.ConnectionError:
+            if streamed:
+                # Part of the result is sent, abort the response rather
+                # than leave the client with a partial result
+                self._logger.error("Query %s - Failure in connection to "
+                                   "the query DB" % qid)
+                raise
             yield bottle.HTTPError(_ERRORS[errno.EIO],
                     'Failure in connection to the query DB')
         except Exception as e:
             self._logger.error("Exception: %s" % str(e))
+            if streamed:
+                raise
             yield bottle.HTTPError(_ERRORS[errno.EIO],
                     'Error: %s' % e)
         else:
@@ -93,88 +93,70 @@ public:
         uint32_t max_rows;
         tbb::atomic<uint32_t> chunk_q;
         tbb::atomic<uint32_t> total_rows;
+        // RESULT lists and rows sent to redis as the chunks completed,
+        // when no merge is needed
+        tbb::atomic<uint32_t> result_lines;
+        tbb::atomic<uint32_t> result_rows;
+        // Serializes the lists streamed for the query and the line count
+        // in its status, shared by the copies of the input
+        shared_ptr<tbb::mutex> stream_mutex;
     };
 
-    void JsonInsert(std::vector<query_column> &columns,
-            contrail_rapidjson::Document& dd,
-            std::pair<const string,string> * map_it) {
+    void JsonInsert(const ResultSchema& schema, const BufferT::Row& row,
+            size_t col, contrail_rapidjson::Document& dd) {
+        contrail_rapidjson::Value vk;
+        vk.SetString(schema.name(col).c_str(), dd.GetAllocator());
 
-        bool found = false;
-        for (size_t j = 0; j < columns.size(); j++)
-        {
-            if ((0 == map_it->first.compare(0,5,string("COUNT")))) {
+        if (row.IsText(col) && row.GetText(col).length() == 0) {
+            contrail_rapidjson::Value val(contrail_rapidjson::kNullType);
+            dd.AddMember(vk, val, dd.GetAllocator());
+            return;
+        }
+
+        // find out type and convert
+        switch (schema.type(col)) {
+        case ResultSchema::UINT64: {
                 contrail_rapidjson::Value val(contrail_rapidjson::kNumberType);
-                unsigned long num = 0;
-                stringToInteger(map_it->second, num);
+                uint64_t num = 0;
+                if (row.IsText(col)) {
+                    stringToInteger(row.GetText(col), num);
+                } else {
+                    num = row.GetUint64(col);
+                }
                 val.SetUint64(num);
-                contrail_rapidjson::Value vk;
-                dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
-                found = true;
-            } else if (columns[j].name == map_it->first) {
-                if (map_it->second.length() == 0) {
-                    contrail_rapidjson::Value val(contrail_rapidjson::kNullType);
-                    contrail_rapidjson::Value vk;
-                    dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
-                    found = true;
-                    continue;
+                dd.AddMember(vk, val, dd.GetAllocator());
+            }
+            break;
+        case ResultSchema::DOUBLE: {
+                contrail_rapidjson::Value val(contrail_rapidjson::kNumberType);
+                double dval;
+                if (row.IsText(col)) {
+                    dval = strtod(row.GetText(col).c_str(), NULL);
+                } else {
+                    dval = row.GetDouble(col);
                 }
-
-                // find out type and convert
-                if (columns[j].datatype == "string" || 
-                    columns[j].datatype == "uuid")
-                {
-                    contrail_rapidjson::Value val(contrail_rapidjson::kStringType);
-                    val.SetString(map_it->second.c_str(), dd.GetAllocator());
-                    contrail_rapidjson::Value vk;
-                    dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
-                } else if (columns[j].datatype == "ipaddr") {
-                    contrail_rapidjson::Value val(contrail_rapidjson::kStringType);
-                   val.SetString(map_it->second.c_str(),
-                                 dd.GetAllocator());
-                    contrail_rapidjson::Value vk;
-                    dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
-
-                } else if (columns[j].datatype == "double") {
-                    contrail_rapidjson::Value val(contrail_rapidjson::kNumberType);
-                    double dval = (double) strtod(map_it->second.c_str(), NULL);
-                    val.SetDouble(dval);
-                    contrail_rapidjson::Value vk;
-                    dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
+                val.SetDouble(dval);
+                dd.AddMember(vk, val, dd.GetAllocator());
+            }
+            break;
+        default: {
+                contrail_rapidjson::Value val(contrail_rapidjson::kStringType);
+                if (row.IsText(col)) {
+                    val.SetString(row.GetText(col).c_str(), dd.GetAllocator());
                 } else {
-                    contrail_rapidjson::Value val(contrail_rapidjson::kNumberType);
-                    unsigned long num = 0;
-                    stringToInteger(map_it->second, num);
-                    val.SetUint64(num);
-                    contrail_rapidjson::Value vk;
-                    dd.AddMember(vk.SetString(map_it->first.c_str(), dd.GetAllocator()), val, dd.GetAllocator());
+                    val.SetString(row.GetString(col).c_str(),
+                        dd.GetAllocator());
                 }
-                found = true;
+                dd.AddMember(vk, val, dd.GetAllocator());
             }
+            break;
         }
-        assert(found);    
     }
 
     void QueryJsonify(const string& table, bool map_output,
         const BufferT* raw_res, const OutRowMultimapT* raw_mres, QEOutputT* raw_json) {
 
-        vector<OutRowT>::iterator res_it;
-
-        std::vector<query_column>  columns;
-
         if (!table.size()) return;
-        bool found = false;
-        for(size_t i = 0; i < g_viz_constants._TABLES.size(); i++)
-        {
-            if (g_viz_constants._TABLES[i].name == table) {
-                found = true;
-                columns = g_viz_constants._TABLES[i].schema.columns;
-            }
-        }
-        if (!found) {
-            found = true;
-            columns = g_viz_constants._OBJECT_TABLE_SCHEMA.columns;
-        }
-        assert(found || map_output);
 
         if (map_output) {
             OutRowMultimapT::const_iterator mres_it;
@@ -184,18 +166,18 @@ public:
                 raw_json->push_back(jstr);
             }
         } else {
-            QEOpServerProxy::BufferT* raw_result = 
-                const_cast<QEOpServerProxy::BufferT*>(raw_res);
-            QEOpServerProxy::BufferT::iterator res_it;
-            for (res_it = raw_result->begin(); res_it != raw_result->end(); ++res_it) {
-                std::map<std::string, std::string>::iterator map_it;
+            raw_json->reserve(raw_json->size() + raw_res->size());
+            for (size_t idx = 0; idx < raw_res->size(); idx++) {
+                BufferT::Row row = raw_res->row(idx);
                 contrail_rapidjson::Document dd;
                 dd.SetObject();
 
-                for (map_it = (*res_it).first.begin(); 
-                     map_it != (*res_it).first.end(); ++map_it) {
-                    // search for column name in the schema
-                    JsonInsert(columns, dd, &(*map_it));
+                // The columns of the schema are sorted by name
+                const ResultSchema& schema = *raw_res->schema();
+                for (size_t col = 0; col < schema.size(); col++) {
+                    if (row.Has(col)) {
+                        JsonInsert(schema, row, col, dd);
+                    }
                 }
                 contrail_rapidjson::StringBuffer sb;
                 contrail_rapidjson::Writer<contrail_rapidjson::StringBuffer> writer(sb);
@@ -205,6 +187,54 @@ public:
         }        
     }
 
+    // When no merge is needed, the rows of a chunk are final as soon as
+    // the chunk completes. They are sent to redis right away as RESULT
+    // lists, numbered after the lists of the chunks that completed before,
+    // so that they are not held in memory until the query finishes. The
+    // "lines" of the status count the lists pushed so far, the opserver
+    // reads up to there while the query runs. The lists are only set to
+    // expire once the final status is pushed, as the REPLY list is.
+    void QueryStream(const Input & inp, uint32_t chunknum,
+            const RawResultT * raw) {
+        QEOutputT jsonresult;
+        BufferT empty_res;
+        OutRowMultimapT empty_mres;
+        QueryJsonify(inp.table, inp.map_output,
+            raw->res ? raw->res.get() : &empty_res,
+            raw->mres ? raw->mres.get() : &empty_mres, &jsonresult);
+        if (jsonresult.empty()) return;
+
+        RedisAsyncConnection * rac = conns_[inp.redis_host_idx][inp.cnum].get();
+        Input& cinp = const_cast<Input&>(inp);
+        string key = "REPLY:" + inp.qp.qid;
+        std::stringstream keystr;
+        char stat[80];
+        vector<string>::size_type idx = 0;
+
+        // The lists of a chunk are pushed together, and the line count
+        // in REPLY only covers lists that have been pushed
+        tbb::mutex::scoped_lock lock(*inp.stream_mutex);
+        while (idx < jsonresult.size()) {
+            uint32_t rowsize = 0;
+            uint32_t rownum = cinp.result_lines.fetch_and_increment();
+            keystr.str(string());
+            keystr << "RESULT:" << inp.qp.qid << ":" << rownum;
+            vector<string> command = list_of(string("RPUSH"))(keystr.str());
+            while ((idx < jsonresult.size()) &&
+                    (((int)rowsize) < kMaxRowThreshold)) {
+                command.push_back(jsonresult[idx]);
+                rowsize += jsonresult[idx].size();
+                idx++;
+            }
+            RedisAsyncArgCommand(rac, NULL, command);
+        }
+        cinp.result_rows.fetch_and_add(jsonresult.size());
+        uint prg = 10 + ((chunknum + 1) * 75)/inp.chunk_size.size();
+        sprintf(stat,"{\"progress\":%d, \"lines\":%d}", prg,
+            (int)cinp.result_lines);
+        RedisAsyncArgCommand(rac, NULL,
+            list_of(string("RPUSH"))(key)(stat));
+    }
 
     void QECallback(void * qid, QPerfInfo qperf,
             auto_ptr<std::vector<query_result_unit_t> > res) {
@@ -352,31 +382,29 @@ public:
                     static_cast<uint32_t>((UTCTimestampUsec() - then)/1000));
         
             } else {
-                // TODO : When merge is not needed, we can just send
-                //        a result upto redis at this point.
-
                 if (inp.map_output) {
                     added_rows = exts[step-1]->mres->size();
-                    OutRowMultimapT::iterator jt = res.mresult->begin();
-                    for (OutRowMultimapT::const_iterator it = exts[step-1]->mres->begin();
-                            it != exts[step-1]->mres->end(); it++ ) {
-
-                        jt = res.mresult->insert(jt,
-                                std::make_pair(it->first, it->second));
-                    }
                 } else {
                     added_rows = exts[step-1]->res->size();
-                    res.result->insert(res.result->begin(),
-                        exts[step-1]->res->begin(),
-                        exts[step-1]->res->end());                        
                 }
             }
             Input& cinp = const_cast<Input&>(inp);
-            if (cinp.total_rows.fetch_and_add(added_rows) > cinp.max_rows) {
+            uint32_t base_total = cinp.total_rows.fetch_and_add(added_rows);
+            if (base_total > cinp.max_rows) {
                 QE_LOG_NOQID(ERROR,  "QueryExec Max Rows Exceeded " <<
                     cinp.total_rows << " chunk " << cinp.chunk_q);
                 return NULL;
             }
+            if (!inp.need_merge) {
+                // Send the rows of this chunk upto redis, they are not
+                // needed any more once sent. The query fails once
+                // max_rows is exceeded, don't send those rows at all.
+                if (base_total + added_rows <= cinp.max_rows) {
+                    QueryStream(inp, res.current_chunk, exts[step-1]);
+                }
+                exts[step-1]->res.reset();
+                exts[step-1]->mres.reset();
+            }
             
 	    res.current_chunk = cinp.chunk_q.fetch_and_increment();
             const uint32_t chunknum = res.current_chunk;
@@ -386,11 +414,20 @@ public:
                 // Update query status
                 RedisAsyncConnection * rac = conns_[res.inp.redis_host_idx][res.inp.cnum].get();
                 string rkey = "REPLY:" + res.inp.qp.qid;
-                char stat[40];
+                char stat[80];
                 uint prg = 10 + (chunknum * 75)/inp.chunk_size.size();
-                sprintf(stat,"{\"progress\":%d}", prg);
-                RedisAsyncArgCommand(rac, NULL, 
-                    list_of(string("RPUSH"))(rkey)(stat));         
+                if (inp.need_merge) {
+                    sprintf(stat,"{\"progress\":%d}", prg);
+                    RedisAsyncArgCommand(rac, NULL, 
+                        list_of(string("RPUSH"))(rkey)(stat));         
+                } else {
+                    // The latest status keeps the count of streamed lists
+                    tbb::mutex::scoped_lock lock(*inp.stream_mutex);
+                    sprintf(stat,"{\"progress\":%d, \"lines\":%d}", prg,
+                        (int)cinp.result_lines);
+                    RedisAsyncArgCommand(rac, NULL,
+                        list_of(string("RPUSH"))(rkey)(stat));
+                }
                 return boost::bind(&QueryEngine::QueryExecWhere, qosp_->qe_,
                         _1, inp.qp, chunknum, 0);
             } else {
@@ -424,8 +461,15 @@ public:
         res.overflow = false;
         res.inp = subs[0]->inp;
         res.fm_time = 0;
+        // The stage instances took their copy of the input before the
+        // rows were streamed
+        res.inp.result_lines = inp->result_lines;
+        res.inp.result_rows = inp->result_rows;
 
         uint32_t total_rows = 0;      
+        if (!res.inp.need_merge) {
+            total_rows = inp->total_rows;
+        }
         for (vector<shared_ptr<Stage0Out> >::const_iterator it = subs.begin() ;
                 it!=subs.end(); it++) {
             if (res.inp.map_output)
@@ -474,26 +518,9 @@ public:
 
             uint64_t now = UTCTimestampUsec();
             res.fm_time = static_cast<uint32_t>((now - then)/1000);
-        } else {
-            // TODO : If a merge was not needed, results have been sent to 
-            //        redis already. The only thing still needed is the status
-            for (vector<shared_ptr<Stage0Out> >::const_iterator it = subs.begin() ;
-                    it!=subs.end(); it++) {
-
-                if (res.inp.map_output) {
-                    OutRowMultimapT::iterator jt = res.mresult.begin();
-                    for (OutRowMultimapT::const_iterator kt = (*it)->mresult->begin();
-                            kt != (*it)->mresult->end(); kt++) {
-                        jt = res.mresult.insert(jt,
-                                std::make_pair(kt->first, kt->second));
-                    }
-                } else {
-                    res.result.insert(res.result.begin(),
-                        (*it)->result->begin(),
-                        (*it)->result->end());
-                }
-            }
         }
+        // If a merge was not needed, results have been sent to redis
+        // already. The only thing still needed is the status
 
         return true;
     }
@@ -522,7 +549,8 @@ public:
                         
                     vector<string> const * const res = jsonresult.get();
                     vector<string>::size_type idx = 0;
-                    uint32_t rownum = 0;
+                    // Continue after the lists streamed by QueryExec, if any
+                    uint32_t rownum = inp.inp.result_lines;
 
                     QE_LOG_NOQID(INFO,  "Did Jsonify #rows " << res->size());
                     
@@ -546,8 +574,6 @@ public:
                                 idx++;
                             }
                             RedisAsyncArgCommand(rac, NULL, command);
-                            RedisAsyncArgCommand(rac, NULL, 
-                                list_of(string("EXPIRE"))(keystr.str())("300"));
                             sprintf(stat,"{\"progress\":90, \"lines\":%d}",
                                 (int)rownum);
                             RedisAsyncArgCommand(rac, NULL, 
@@ -555,7 +581,16 @@ public:
                             rownum++;
                         }
                         sprintf(stat,"{\"progress\":100, \"lines\":%d, \"count\":%d}",
-                            (int)rownum, (int)res->size());
+                            (int)rownum,
+                            (int)(inp.inp.result_rows + res->size()));
+                    }
+                    // The lists, streamed ones included, expire along
+                    // with the final status
+                    for (uint32_t line = 0; line < rownum; line++) {
+                        keystr.str(string());
+                        keystr << "RESULT:" << ret.inp.qp.qid << ":" << line;
+                        RedisAsyncArgCommand(rac, NULL,
+                            list_of(string("EXPIRE"))(keystr.str())("300"));
                     }
                     uint64_t now = UTCTimestampUsec();
                     ret.redis_time = static_cast<uint32_t>((now - then)/1000);
@@ -588,6 +623,7 @@ public:
                         outsize = inp.mresult.size();
                     else
                         outsize = inp.result.size();
+                    outsize += inp.inp.result_rows;
 
                     qs.set_rows(static_cast<uint32_t>(outsize));                                           
                     qs.set_time(qtime);
@@ -903,6 +939,9 @@ public:
         inp.get()->table = table;
         inp.get()->chunk_q = 0;
         inp.get()->total_rows = 0;
+        inp.get()->result_lines = 0;
+        inp.get()->result_rows = 0;
+        inp.get()->stream_mutex.reset(new tbb::mutex);
         inp.get()->max_rows = max_rows_;
         inp.get()->wterms = wterms;
         vector<pair<int,int> > tinfo;
@@ -15,6 +15,8 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include "result_buffer.h"
+
 extern "C" {
 #include <base/tdigest.h>
 };
@@ -78,8 +80,7 @@ public:
     typedef std::map<std::string /* Col Name */,
                      std::string /* Col Value */> OutRowT;
     typedef boost::shared_ptr<QueryResultMetaData> MetadataT;
-    typedef std::pair<OutRowT, MetadataT> ResultRowT; 
-    typedef std::vector<ResultRowT> BufferT;
+    typedef ResultBuffer BufferT;
 
     typedef boost::variant<boost::blank, std::string, uint64_t, double, boost::uuids::uuid, boost::shared_ptr<TDigest>, boost::shared_ptr<Centroid> > SubVal;
     enum VarType {
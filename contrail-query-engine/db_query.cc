@@ -262,10 +262,8 @@ void DbQueryUnit::WPCompleteCb(QEPipeT *wp, bool ret_code) {
              query_result->begin(); it != query_result->end(); it++) {
             const query_result_unit_t &result_unit(*it);
             ss << "T: " << result_unit.timestamp << ": ";
-            for (GenDb::DbDataValueVec::const_iterator rt =
-                 result_unit.info.begin(); rt != result_unit.info.end();
-                 rt++) {
-                ss << " " << *rt;
+            for (size_t i = 0; i < result_unit.info.size(); i++) {
+                ss << " " << result_unit.info.at(i);
             }
             ss << std::endl;
         }
@@ -322,6 +320,8 @@ void DbQueryUnit::cb(GenDb::DbOpResult::type dresult,
             false, 1);
     }
     GenDb::NewColVec::iterator i;
+    // The rows of this response are allocated together
+    WhereRowArena arena;
 
     for (i = column_list->columns_.begin(); i != column_list->columns_.end();
          i++) {
@@ -391,34 +391,34 @@ void DbQueryUnit::cb(GenDb::DbOpResult::type dresult,
                     QE_ASSERT(0);
                 }
 
-                result_unit.set_stattable_info(
+                result_unit.set_stattable_info(&arena,
                     attribstr,
                     uuid);
             } else if (m_query->is_session_query(m_query->table())
                       || m_query->is_flow_query(m_query->table())) {
-                result_unit.info.clear();
-                result_unit.info.push_back(is_si);
-                result_unit.info.push_back(session_type);
-                result_unit.info.push_back(i->name->at(0));
-                result_unit.info.push_back(i->name->at(1));
-                result_unit.info.push_back(i->name->at(2));
-                result_unit.info.push_back(i->name->at(3));
+                arena.Add(is_si);
+                arena.Add(session_type);
+                arena.Add(i->name->at(0));
+                arena.Add(i->name->at(1));
+                arena.Add(i->name->at(2));
+                arena.Add(i->name->at(3));
                 GenDb::DbDataValueVec::const_iterator itr;
                 GenDb::DbDataValueVec::const_iterator end =
                     (m_query->selectquery_->unroll_needed?
                         (i->value->end()):(i->value->end() - 1));
                 for (itr = i->value->begin(); itr != end;
                     itr++) {
-                    result_unit.info.push_back(*itr);
+                    arena.Add(*itr);
                 }
+                result_unit.info = arena.Build();
             } else {
                 // If message index table uuid is not the value, but
                 // column name
                 if (t_only_col) {
                     GenDb::DbDataValueVec val = gri.get()->rowkey;
-                    message_table_query_get_row(val, i, result_unit);
+                    message_table_query_get_row(val, i, &arena, result_unit);
                 } else {
-                    result_unit.info = *i->value;
+                    result_unit.info = arena.Build(*i->value);
                 }
             }
             q_result_ptr->push_back(result_unit);
@@ -436,6 +436,7 @@ void DbQueryUnit::cb(GenDb::DbOpResult::type dresult,
 void DbQueryUnit::message_table_query_get_row(
                                 GenDb::DbDataValueVec const &val,
                                 GenDb::NewColVec::iterator const &res_it,
+                                WhereRowArena *arena,
                                 query_result_unit_t &result_unit) {
     // cassandra returns fields in the ascending order by column-name.
     // pushing fields in order as per schema.
@@ -461,26 +462,27 @@ void DbQueryUnit::message_table_query_get_row(
     // column18 = value[8]
     // column19 = value[9]
     // DATA     = value[17]
-    result_unit.info.push_back(val.at(0));
-    result_unit.info.push_back(val.at(1));
-    result_unit.info.push_back(res_it->name->at(0));
-    result_unit.info.push_back(res_it->name->at(1));
-    result_unit.info.push_back(res_it->value->at(10));
-    result_unit.info.push_back(res_it->value->at(11));
-    result_unit.info.push_back(res_it->value->at(12));
-    result_unit.info.push_back(res_it->value->at(13));
-    result_unit.info.push_back(res_it->value->at(14));
-    result_unit.info.push_back(res_it->value->at(15));
-    result_unit.info.push_back(res_it->value->at(16));
-    result_unit.info.push_back(res_it->value->at(0));
-    result_unit.info.push_back(res_it->value->at(1));
-    result_unit.info.push_back(res_it->value->at(2));
-    result_unit.info.push_back(res_it->value->at(3));
-    result_unit.info.push_back(res_it->value->at(4));
-    result_unit.info.push_back(res_it->value->at(5));
-    result_unit.info.push_back(res_it->value->at(6));
-    result_unit.info.push_back(res_it->value->at(7));
-    result_unit.info.push_back(res_it->value->at(8));
-    result_unit.info.push_back(res_it->value->at(9));
-    result_unit.info.push_back(res_it->value->at(17));
+    arena->Add(val.at(0));
+    arena->Add(val.at(1));
+    arena->Add(res_it->name->at(0));
+    arena->Add(res_it->name->at(1));
+    arena->Add(res_it->value->at(10));
+    arena->Add(res_it->value->at(11));
+    arena->Add(res_it->value->at(12));
+    arena->Add(res_it->value->at(13));
+    arena->Add(res_it->value->at(14));
+    arena->Add(res_it->value->at(15));
+    arena->Add(res_it->value->at(16));
+    arena->Add(res_it->value->at(0));
+    arena->Add(res_it->value->at(1));
+    arena->Add(res_it->value->at(2));
+    arena->Add(res_it->value->at(3));
+    arena->Add(res_it->value->at(4));
+    arena->Add(res_it->value->at(5));
+    arena->Add(res_it->value->at(6));
+    arena->Add(res_it->value->at(7));
+    arena->Add(res_it->value->at(8));
+    arena->Add(res_it->value->at(9));
+    arena->Add(res_it->value->at(17));
+    result_unit.info = arena->Build();
 }
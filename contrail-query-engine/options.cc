@@ -197,6 +197,10 @@ void Options::Initialize(EventManager &evm,
     database_config.add_options()
         ("DATABASE.cluster_id", opt::value<string>()->default_value(""),
              "Analytics Cluster Id")
+        ("DATABASE.local_stats_directory",
+             opt::value<string>()->default_value(""),
+             "Directory of the statistics tables kept by the collector "
+             "instead of the database")
         ;
 
     config_file_options_.add(config).add(cassandra_config)
@@ -280,6 +284,8 @@ void Options::Process(int argc, char *argv[],
     GetOptValue<string>(var_map, redis_certfile_, "REDIS.redis_certfile");
     GetOptValue<string>(var_map, redis_ca_cert_, "REDIS.redis_ca_cert");
     GetOptValue<string>(var_map, cluster_id_, "DATABASE.cluster_id");
+    GetOptValue<string>(var_map, local_stats_directory_,
+                        "DATABASE.local_stats_directory");
     GetOptValue<string>(var_map, cassandra_user_, "CASSANDRA.cassandra_user");
     GetOptValue<string>(var_map, cassandra_password_, "CASSANDRA.cassandra_password");
     GetOptValue<bool>(var_map, cassandra_use_ssl_, "CASSANDRA.cassandra_use_ssl");
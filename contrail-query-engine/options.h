@@ -65,6 +65,9 @@ public:
     const int analytics_data_ttl() const { return analytics_data_ttl_; }
     const bool test_mode() const { return test_mode_; }
     const std::string cluster_id() const { return cluster_id_; }
+    const std::string local_stats_directory() const {
+        return local_stats_directory_;
+    }
     const std::string cassandra_user() const { return cassandra_user_; }
     const std::string cassandra_password() const { return cassandra_password_; }
     const bool cassandra_use_ssl() const { return cassandra_use_ssl_; }
@@ -118,6 +121,7 @@ private:
 
     boost::program_options::options_description config_file_options_;
     std::string cluster_id_;
+    std::string local_stats_directory_;
     std::string cassandra_user_;
     std::string cassandra_password_;
     bool cassandra_use_ssl_;
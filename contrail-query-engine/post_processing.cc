@@ -2,7 +2,11 @@
  * Copyright (c) 2013 Juniper Networks, Inc. All rights reserved.
  */
 
+#include <deque>
 #include <boost/assign/list_of.hpp>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/task_arena.h>
 #include "base/regex.h"
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
@@ -14,31 +18,273 @@ using contrail::regex;
 using contrail::regex_match;
 using contrail::regex_search;
 
-bool PostProcessingQuery::sort_field_comparator(
-        const QEOpServerProxy::ResultRowT& lhs,
-        const QEOpServerProxy::ResultRowT& rhs) {
-    std::map<std::string, std::string>::const_iterator lhs_it, rhs_it;
-    for (std::vector<sort_field_t>::iterator sort_it = sort_fields.begin();
-         sort_it != sort_fields.end(); sort_it++) {
-        lhs_it = lhs.first.find((*sort_it).name);
-        QE_ASSERT(lhs_it != lhs.first.end());
-        rhs_it = rhs.first.find((*sort_it).name);
-        QE_ASSERT(rhs_it != rhs.first.end());
-        if ((*sort_it).type == std::string("int") ||
-            (*sort_it).type == std::string("long") ||
-            (*sort_it).type == std::string("ipv4")) {
-            uint64_t lhs_val = 0, rhs_val = 0;
-            stringToInteger(lhs_it->second, lhs_val);
-            stringToInteger(rhs_it->second, rhs_val);
-            if (lhs_val < rhs_val) return true;
-            if (lhs_val > rhs_val) return false;
+namespace {
+
+// Rows up to which sorting and merging are not worth splitting across
+// the task pool
+const size_t kParallelSortMinRows = 16 * 1024;
+
+// Sorting and merging run in an arena of their own: a thread waiting for
+// the sort to complete must not pick up an unrelated Task from the
+// scheduler arena.
+tbb::task_arena sort_arena;
+
+//
+// Sort keys of the rows of a result, extracted once per row so that
+// comparing two rows neither looks the sort columns up nor converts
+// their values.
+//
+class SortKeys {
+public:
+    SortKeys(const QEOpServerProxy::BufferT& result,
+             const std::vector<sort_field_t>& sort_fields,
+             bool descending);
+
+    // Whether row lhs sorts before row rhs
+    bool Less(size_t lhs, size_t rhs) const {
+        if (descending_) {
+            std::swap(lhs, rhs);
+        }
+        const SortKey *lkey = &keys_[lhs * nfields_];
+        const SortKey *rkey = &keys_[rhs * nfields_];
+        for (size_t i = 0; i < nfields_; i++) {
+            if (integer_[i]) {
+                if (lkey[i].ival < rkey[i].ival) return true;
+                if (lkey[i].ival > rkey[i].ival) return false;
+            } else {
+                int cmp = lkey[i].sval->compare(*rkey[i].sval);
+                if (cmp < 0) return true;
+                if (cmp > 0) return false;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct SortKey {
+        uint64_t ival;
+        const std::string *sval;
+    };
+
+    size_t nfields_;
+    bool descending_;
+    std::vector<bool> integer_;
+    // nfields_ keys per row
+    std::vector<SortKey> keys_;
+    // String form of the typed values sorted as strings
+    std::deque<std::string> strings_;
+};
+
+SortKeys::SortKeys(const QEOpServerProxy::BufferT& result,
+                   const std::vector<sort_field_t>& sort_fields,
+                   bool descending) :
+    nfields_(sort_fields.size()),
+    descending_(descending) {
+    if (result.empty()) {
+        return;
+    }
+    const ResultSchema& schema = *result.schema();
+    std::vector<size_t> cols;
+    for (size_t i = 0; i < nfields_; i++) {
+        int col = schema.Find(sort_fields[i].name);
+        QE_ASSERT(col >= 0);
+        cols.push_back(col);
+        integer_.push_back(sort_fields[i].type == std::string("int") ||
+                           sort_fields[i].type == std::string("long") ||
+                           sort_fields[i].type == std::string("ipv4"));
+    }
+    keys_.resize(result.size() * nfields_);
+    for (size_t row = 0; row < result.size(); row++) {
+        QEOpServerProxy::BufferT::Row rrow(result.row(row));
+        for (size_t i = 0; i < nfields_; i++) {
+            size_t col = cols[i];
+            QE_ASSERT(rrow.Has(col));
+            SortKey& key = keys_[row * nfields_ + i];
+            key.ival = 0;
+            key.sval = NULL;
+            if (integer_[i]) {
+                if (schema.type(col) == ResultSchema::UINT64 &&
+                    !rrow.IsText(col)) {
+                    key.ival = rrow.GetUint64(col);
+                } else {
+                    stringToInteger(rrow.GetString(col), key.ival);
+                }
+            } else if (rrow.IsText(col)) {
+                key.sval = &rrow.GetText(col);
+            } else {
+                strings_.push_back(rrow.GetString(col));
+                key.sval = &strings_.back();
+            }
+        }
+    }
+}
+
+struct SortKeyLess {
+    explicit SortKeyLess(const SortKeys *keys) : keys_(keys) {
+    }
+    bool operator()(size_t lhs, size_t rhs) const {
+        return keys_->Less(lhs, rhs);
+    }
+    const SortKeys *keys_;
+};
+
+struct ParallelSort {
+    ParallelSort(std::vector<size_t> *order, const SortKeys *keys) :
+        order_(order), keys_(keys) {
+    }
+    void operator()() const {
+        tbb::parallel_sort(order_->begin(), order_->end(), SortKeyLess(keys_));
+    }
+    std::vector<size_t> *order_;
+    const SortKeys *keys_;
+};
+
+// Merges two sorted ranges by splitting the larger one in half and the
+// other one at the same key, the two halves being merged in parallel. As
+// with std::merge, the rows of the first range come first on equal keys.
+struct ParallelMerge {
+    ParallelMerge(const size_t *first1, const size_t *last1,
+                  const size_t *first2, const size_t *last2,
+                  size_t *out, const SortKeys *keys) :
+        first1_(first1), last1_(last1), first2_(first2), last2_(last2),
+        out_(out), keys_(keys) {
+    }
+    void operator()() const {
+        size_t size1 = last1_ - first1_;
+        size_t size2 = last2_ - first2_;
+        if (size1 + size2 <= kParallelSortMinRows) {
+            std::merge(first1_, last1_, first2_, last2_, out_,
+                       SortKeyLess(keys_));
+            return;
+        }
+        // The row the larger range is split at goes in between the halves
+        bool split1 = size1 >= size2;
+        const size_t *mid1, *mid2;
+        if (split1) {
+            // The rows of the second range equal to *mid1 go after it
+            mid1 = first1_ + size1 / 2;
+            mid2 = std::lower_bound(first2_, last2_, *mid1,
+                                    SortKeyLess(keys_));
         } else {
-            if (lhs_it->second < rhs_it->second) return true;
-            if (lhs_it->second > rhs_it->second) return false;
+            // The rows of the first range equal to *mid2 go before it
+            mid2 = first2_ + size2 / 2;
+            mid1 = std::upper_bound(first1_, last1_, *mid2,
+                                    SortKeyLess(keys_));
         }
+        size_t *mid_out = out_ + (mid1 - first1_) + (mid2 - first2_);
+        *mid_out = split1 ? *mid1 : *mid2;
+        tbb::parallel_invoke(
+            ParallelMerge(first1_, mid1, first2_, mid2, out_, keys_),
+            ParallelMerge(mid1 + split1, last1_, mid2 + !split1, last2_,
+                          mid_out + 1, keys_));
+    }
+    const size_t *first1_;
+    const size_t *last1_;
+    const size_t *first2_;
+    const size_t *last2_;
+    size_t *out_;
+    const SortKeys *keys_;
+};
+
+// Next row of a sorted run of rows, [row_, end_)
+struct RunCursor {
+    RunCursor(size_t row, size_t end) : row_(row), end_(end) {
+    }
+    size_t row_;
+    size_t end_;
+};
+
+// Orders the runs of a k-way merge so that the run with the first row is
+// at the top of the heap
+struct RunCursorGreater {
+    explicit RunCursorGreater(const SortKeys *keys) : keys_(keys) {
+    }
+    bool operator()(const RunCursor& lhs, const RunCursor& rhs) const {
+        return keys_->Less(rhs.row_, lhs.row_);
+    }
+    const SortKeys *keys_;
+};
+
+}  // namespace
+
+size_t PostProcessingQuery::top_k() const {
+    // A filter may remove any of the first rows, all of them are needed
+    if (!sorted || limit <= 0 || !filter_list.empty()) {
+        return 0;
     }
+    return limit;
+}
+
+// The rows are sorted by index and moved into place once
+void PostProcessingQuery::sort_result(QEOpServerProxy::BufferT& result,
+                                      size_t top) {
+    SortKeys keys(result, sort_fields, sorting_type != ASCENDING);
+    std::vector<size_t> order(result.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    if (top && top < order.size()) {
+        std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                          SortKeyLess(&keys));
+        order.resize(top);
+    } else if (order.size() <= kParallelSortMinRows) {
+        std::sort(order.begin(), order.end(), SortKeyLess(&keys));
+    } else {
+        sort_arena.execute(ParallelSort(&order, &keys));
+    }
+    result.Select(order);
+}
 
-    return false;
+void PostProcessingQuery::merge_sorted_result(
+        QEOpServerProxy::BufferT& result, size_t mid) {
+    SortKeys keys(result, sort_fields, sorting_type != ASCENDING);
+    std::vector<size_t> order(result.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::vector<size_t> merged(order.size());
+    if (merged.empty()) {
+        return;
+    }
+    ParallelMerge merge(&order[0], &order[0] + mid,
+                        &order[0] + mid, &order[0] + order.size(),
+                        &merged[0], &keys);
+    if (order.size() <= kParallelSortMinRows) {
+        merge();
+    } else {
+        sort_arena.execute(merge);
+    }
+    result.Select(merged);
+}
+
+void PostProcessingQuery::merge_sorted_runs(QEOpServerProxy::BufferT& result,
+        const std::vector<size_t>& runs, size_t top) {
+    SortKeys keys(result, sort_fields, sorting_type != ASCENDING);
+    std::vector<RunCursor> heap;
+    for (size_t i = 0; i < runs.size(); i++) {
+        size_t end = i + 1 < runs.size() ? runs[i + 1] : result.size();
+        if (runs[i] < end) {
+            heap.push_back(RunCursor(runs[i], end));
+        }
+    }
+    RunCursorGreater greater(&keys);
+    std::make_heap(heap.begin(), heap.end(), greater);
+    std::vector<size_t> order;
+    if (top == 0 || top > result.size()) {
+        top = result.size();
+    }
+    order.reserve(top);
+    while (!heap.empty() && order.size() < top) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        RunCursor& cursor = heap.back();
+        order.push_back(cursor.row_++);
+        if (cursor.row_ == cursor.end_) {
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+    }
+    result.Select(order);
 }
 
 bool PostProcessingQuery::merge_processing(
@@ -59,23 +305,9 @@ bool PostProcessingQuery::merge_processing(
 
         if (result_.get() == NULL) {
             size_t merged_result_size = merged_result->size();
-            merged_result->reserve(merged_result_size + raw_result1->size());
-            copy(raw_result1->begin(), raw_result1->end(),
-                 std::back_inserter(*merged_result));
+            merged_result->Append(*raw_result1);
             if (merged_result_size) {
-                if (sorting_type == ASCENDING) {
-                    std::inplace_merge(merged_result->begin(),
-                        merged_result->begin() + merged_result_size,
-                        merged_result->end(),
-                        boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                    this, _1, _2));
-                } else {
-                    std::inplace_merge(merged_result->rbegin(),
-                        merged_result->rbegin() + raw_result1->size(),
-                        merged_result->rend(),
-                        boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                    this, _1, _2));
-                }
+                merge_sorted_result(*merged_result, merged_result_size);
             }
         } else {
             QEOpServerProxy::BufferT *raw_result2 = result_.get();
@@ -83,20 +315,11 @@ bool PostProcessingQuery::merge_processing(
             size_t size2 = raw_result2->size();
             QE_TRACE(DEBUG, "Merging results from vectors of size:" <<
                      size1 << " and " << size2);
-            merged_result->reserve(raw_result1->size() + raw_result2->size());
-            if (sorting_type == ASCENDING) {
-                std::merge(raw_result1->begin(), raw_result1->end(),
-                           raw_result2->begin(), raw_result2->end(),
-                           std::back_inserter(*merged_result),
-                           boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                       this, _1, _2));
-            } else {
-                std::merge(raw_result1->rbegin(), raw_result1->rend(),
-                           raw_result2->rbegin(), raw_result2->rend(),
-                           std::back_inserter(*merged_result),
-                           boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                       this, _1, _2));
-            }
+            QEOpServerProxy::BufferT sorted_result;
+            sorted_result.Append(*raw_result1);
+            sorted_result.Append(*raw_result2);
+            merge_sorted_result(sorted_result, size1);
+            merged_result->Append(sorted_result);
         }
     } else {
         QE_TRACE(DEBUG, "Merge_Processing: Adding inputs to output");
@@ -105,9 +328,7 @@ bool PostProcessingQuery::merge_processing(
 
         if (result_.get() == NULL)
         {
-            merged_result->reserve(raw_result1->size());
-            copy(raw_result1->begin(), raw_result1->end(),
-                std::back_inserter(*merged_result));
+            merged_result->Append(*raw_result1);
         } else {
 
             QEOpServerProxy::BufferT *raw_result2 = result_.get();
@@ -115,15 +336,17 @@ bool PostProcessingQuery::merge_processing(
             size_t size2 = raw_result2->size();
             QE_TRACE(DEBUG, "Merging results from vectors of size:" <<
                     size1 << " and " << size2);
-            merged_result->reserve(raw_result1->size() + raw_result2->size());
-            copy(raw_result1->begin(), raw_result1->end(),
-                std::back_inserter(*merged_result));
-            copy(raw_result2->begin(), raw_result2->end(),
-                std::back_inserter(*merged_result));
+            merged_result->Append(*raw_result1);
+            merged_result->Append(*raw_result2);
         }
         QE_TRACE(DEBUG, "Merge_Processing: Done adding inputs to output");
     }
 
+    // The rows past the limit will never make it to the final result
+    if (limit) {
+        output.Truncate(limit);
+    }
+
     // Have the result ready and processing is done
     status_details = 0;
     return true;
@@ -133,8 +356,6 @@ bool PostProcessingQuery::final_merge_processing(
 const std::vector<boost::shared_ptr<QEOpServerProxy::BufferT> >& inputs,
                         QEOpServerProxy::BufferT& output)
 {
-    bool merge_done = false;
-
     if (status_details != 0)
     {
         QE_TRACE(DEBUG,
@@ -142,42 +363,28 @@ const std::vector<boost::shared_ptr<QEOpServerProxy::BufferT> >& inputs,
         return false;
     }
 
-    if (!merge_done) {
-        QEOpServerProxy::BufferT *merged_result = &output;
-        size_t final_vector_size = 0;
-        // merge the results from parallel queries
-        for (size_t i = 0; i < inputs.size(); i++) {
-            final_vector_size += inputs[i]->size();
-        }
-        merged_result->reserve(final_vector_size);
-        QE_TRACE(DEBUG, "Merging results between " << inputs.size()
-                 << " vectors with final vector size:" << final_vector_size);
-        for (size_t i = 0; i < inputs.size(); i++) {
-            QEOpServerProxy::BufferT *raw_result = inputs[i].get();
-            copy(raw_result->begin(), raw_result->end(),
-                 std::back_inserter(*merged_result));
-        }
+    QEOpServerProxy::BufferT *merged_result = &output;
+    size_t final_vector_size = 0;
+    // merge the results from parallel queries
+    for (size_t i = 0; i < inputs.size(); i++) {
+        final_vector_size += inputs[i]->size();
+    }
+    QE_TRACE(DEBUG, "Merging results between " << inputs.size()
+             << " vectors with final vector size:" << final_vector_size);
+    std::vector<size_t> runs;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        runs.push_back(merged_result->size());
+        merged_result->Append(*inputs[i]);
     }
 
+    // The results of the parallel queries are sorted already
     if (sorted) {
-        QEOpServerProxy::BufferT *merged_result = &output;
-        if (sorting_type == ASCENDING) {
-            std::sort(merged_result->begin(), merged_result->end(),
-                      boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                  this, _1, _2));
-        } else {
-            std::sort(merged_result->rbegin(), merged_result->rend(),
-                      boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                  this, _1, _2));
-        }
+        merge_sorted_runs(output, runs, limit > 0 ? limit : 0);
     }
 
     if (limit) {
-        QEOpServerProxy::BufferT *merged_result = &output;
         QE_TRACE(DEBUG, "Apply Limit [" << limit << "]");
-        if (merged_result->size() > (size_t)limit) {
-            merged_result->resize(limit);
-        }
+        merged_result->Truncate(limit);
     }
 
     // Have the result ready and processing is done
@@ -328,12 +535,13 @@ query_status_t PostProcessingQuery::process_query() {
 
     /* below is filter processing for non stats table queries
      */
-    if (filter_list.size() != 0) {
-        QEOpServerProxy::BufferT filtered_table;
+    if (filter_list.size() != 0 && !raw_result->empty()) {
+        const ResultSchema& schema = *raw_result->schema();
+        std::vector<size_t> filtered_rows;
         // do filter operation
         QE_TRACE(DEBUG, "Doing filter operation");
         for (size_t i = 0; i < raw_result->size(); i++) {
-            QEOpServerProxy::ResultRowT row = (*raw_result)[i];
+            QEOpServerProxy::BufferT::Row row = raw_result->row(i);
             bool delete_row = true;
 
             for (size_t j = 0; j < filter_list.size(); j++) {
@@ -341,9 +549,8 @@ query_status_t PostProcessingQuery::process_query() {
                 bool and_check = true;
 
                 for (size_t k = 0; k < filter_and.size(); k++) {
-                    std::map<std::string, std::string>::iterator iter;
-                    iter = row.first.find(filter_and[k].name);
-                    if (iter == row.first.end())
+                    int col = schema.Find(filter_and[k].name);
+                    if (col < 0 || !row.Has(col))
                       {
                         if (!(filter_and[k].ignore_col_absence)) {
                             and_check = false;
@@ -351,18 +558,25 @@ query_status_t PostProcessingQuery::process_query() {
                         }
                         continue;
                       }
+                    std::string typed_value;
+                    const std::string *value = &typed_value;
+                    if (row.IsText(col)) {
+                        value = &row.GetText(col);
+                    } else {
+                        typed_value = row.GetString(col);
+                    }
 
                     switch(filter_and[k].op)
                       {
                         case EQUAL:
-                            if (filter_and[k].value != iter->second)
+                            if (filter_and[k].value != *value)
                               {
                                 and_check = false;
                               }
                             break;
 
                         case NOT_EQUAL:
-                            if (filter_and[k].value == iter->second)
+                            if (filter_and[k].value == *value)
                               {
                                 and_check = false;
                               }
@@ -372,7 +586,7 @@ query_status_t PostProcessingQuery::process_query() {
                               {
                                 int filter_value =
                                     atoi(filter_and[k].value.c_str());
-                                int column_value= atoi(iter->second.c_str());
+                                int column_value= atoi(value->c_str());
                                 if (column_value > filter_value)
                                   {
                                     and_check = false;
@@ -384,7 +598,7 @@ query_status_t PostProcessingQuery::process_query() {
                               {
                                 int filter_value =
                                     atoi(filter_and[k].value.c_str());
-                                int column_value= atoi(iter->second.c_str());
+                                int column_value= atoi(value->c_str());
                                 if (column_value < filter_value)
                                   {
                                     and_check = false;
@@ -394,7 +608,7 @@ query_status_t PostProcessingQuery::process_query() {
 
                         case REGEX_MATCH:
                               {
-                                if (!regex_match(iter->second,
+                                if (!regex_match(*value,
                                                  filter_and[k].match_e))
                                   {
                                     and_check = false;
@@ -419,35 +633,28 @@ query_status_t PostProcessingQuery::process_query() {
                 }
             }
             if (!delete_row) {
-                filtered_table.push_back(row);
+                filtered_rows.push_back(i);
             }
         }
-        *raw_result = filtered_table;
+        raw_result->Select(filtered_rows);
     }
 
     // Check if the result has to be sorted
-    if (sorted) {
-        if (sorting_type == ASCENDING) {
-            std::sort(raw_result->begin(), raw_result->end(),
-                      boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                  this, _1, _2));
-        } else {
-            std::sort(raw_result->rbegin(), raw_result->rend(),
-                      boost::bind(&PostProcessingQuery::sort_field_comparator,
-                                  this, _1, _2));
-        }
-    }
-
     // If the flow series query is parallelized, we should apply the limit
     // only after the result from all the tasks are merged
     // (@ final_merge_processing).
-    if ((mquery->table() != g_viz_constants.FLOW_SERIES_TABLE ||
+    bool apply_limit = (mquery->table() != g_viz_constants.FLOW_SERIES_TABLE ||
         (mquery->table() == g_viz_constants.FLOW_SERIES_TABLE &&
-        !mquery->is_query_parallelized())) && limit) {
+        !mquery->is_query_parallelized())) && limit;
+
+    // Only the rows within the limit need to be sorted
+    if (sorted) {
+        sort_result(*raw_result, apply_limit ? limit : 0);
+    }
+
+    if (apply_limit) {
         QE_TRACE(DEBUG, "Apply Limit [" << limit << "]");
-        if (raw_result->size() > (size_t)limit) {
-            raw_result->resize(limit);
-        }
+        raw_result->Truncate(limit);
 	if (mresult_->size() > (size_t)limit) {
 	    MapBufT::iterator it = mresult_->begin();
 	    std::advance(it, limit);
@@ -457,18 +664,18 @@ query_status_t PostProcessingQuery::process_query() {
 
     if (IS_TRACE_ENABLED(POSTPROCESS_RESULT_TRACE))
     {
-        std::vector<QEOpServerProxy::ResultRowT>::iterator res_it;
         QE_TRACE(DEBUG, "== Post Processing Result ==");
-        for (res_it = raw_result->begin(); res_it != raw_result->end();
-             ++res_it) {
+        for (size_t i = 0; i < raw_result->size(); i++) {
+            QEOpServerProxy::BufferT::Row row = raw_result->row(i);
             std::vector<final_result_col> row_entry;
-            std::map<std::string, std::string>::iterator map_it;
-            for (map_it = (*res_it).first.begin();
-                 map_it != (*res_it).first.end(); ++map_it) {
+            for (size_t j = 0; j < raw_result->schema()->size(); j++) {
+                if (!row.Has(j)) {
+                    continue;
+                }
                 final_result_col col;
-                col.set_col(map_it->first); col.set_value(map_it->second);
+                col.set_col(raw_result->schema()->name(j));
+                col.set_value(row.GetString(j));
                 row_entry.push_back(col);
-                //QE_TRACE(DEBUG, map_it->first << " : " << map_it->second);
             }
             FINAL_RESULT_ROW_TRACE(QeTraceBuf, mquery->query_id, row_entry);
         }
@@ -360,7 +360,8 @@ main(int argc, char *argv[]) {
             options.cassandra_use_ssl(),
             options.cassandra_ca_certs(),
             options.cluster_id(),
-            options.host_ip()));
+            options.host_ip(),
+            options.local_stats_directory()));
     }
     QESandeshContext qec(qe.get());
     Sandesh::set_client_context(&qec);
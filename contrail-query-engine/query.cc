@@ -22,6 +22,7 @@
 #include "base/connection_info.h"
 #include "utils.h"
 #include <database/cassandra/cql/cql_if.h>
+#include <contrail-collector/stat_table_db_if.h>
 #include <boost/make_shared.hpp>
 #include "qe_sandesh.h"
 #include <algorithm>
@@ -714,11 +715,12 @@ void query_result_unit_t::get_uuid(boost::uuids::uuid& u) const
     }
 }
 
-void query_result_unit_t::set_stattable_info(
+void query_result_unit_t::set_stattable_info(WhereRowArena *arena,
         const std::string& attribstr,
         const boost::uuids::uuid& uuid) {
-    info.push_back(attribstr);
-    info.push_back(uuid);
+    arena->Add(attribstr);
+    arena->Add(uuid);
+    info = arena->Build();
 }
 
 void query_result_unit_t::get_objectid(std::string& object_id) const {
@@ -960,7 +962,8 @@ QueryEngine::QueryEngine(EventManager *evm,
             bool cassandra_use_ssl,
             const std::string & cassandra_ca_certs,
             const std::string & cluster_id,
-            const std::string &host_ip) :
+            const std::string &host_ip,
+            const std::string &local_stats_directory) :
         qosp_(new QEOpServerProxy(evm,
             this, redis_ip_ports, redis_password, redis_ssl_enable, redis_keyfile,
             redis_certfile, redis_ca_cert, host_ip, max_tasks)),
@@ -971,9 +974,17 @@ QueryEngine::QueryEngine(EventManager *evm,
         cassandra_password_(cassandra_password),
         cassandra_use_ssl_(cassandra_use_ssl),
         cassandra_ca_certs_(cassandra_ca_certs) {
-        dbif_.reset(new cass::cql::CqlIf(evm, cassandra_ips,
-            cassandra_ports[0], cassandra_user, cassandra_password,
-            cassandra_use_ssl_, cassandra_ca_certs_));
+        if (local_stats_directory.empty()) {
+            dbif_.reset(new cass::cql::CqlIf(evm, cassandra_ips,
+                cassandra_ports[0], cassandra_user, cassandra_password,
+                cassandra_use_ssl_, cassandra_ca_certs_));
+        } else {
+            // The stat tables are read from the collector's local store
+            dbif_.reset(new StatTableDbIf(evm, cassandra_ips,
+                cassandra_ports[0], cassandra_user, cassandra_password,
+                cassandra_use_ssl_, cassandra_ca_certs_, false,
+                local_stats_directory));
+        }
         if (cluster_id.empty()) {
             keyspace_ = g_viz_constants.COLLECTOR_KEYSPACE_CQL;
         } else {
@@ -1308,10 +1319,16 @@ QueryEngine::QueryExec(void * handle, QueryParams qp, uint32_t chunk,
             "ModuleId", "ControlNode")(
             "Source","b1s1")(
             "ObjectLog","\n<IFMapString type=\"sandesh\"><message type=\"string\" identifier=\"1\">Cancelling Response timer.</message><file type=\"string\" identifier=\"-32768\">src/ifmap/client/ifmap_state_machine.cc</file><line type=\"i32\" identifier=\"-32767\">578</line></IFMapString>");
-        QEOpServerProxy::MetadataT metadata;
+        std::vector<std::string> columns;
+        for (QEOpServerProxy::OutRowT::const_iterator it = outrow.begin();
+             it != outrow.end(); ++it) {
+            columns.push_back(it->first);
+        }
+        final_output->set_schema(ResultSchemaPtr(new ResultSchema(
+            g_viz_constants.MESSAGE_TABLE, columns)));
         std::auto_ptr<QEOpServerProxy::OutRowMultimapT> final_moutput(new QEOpServerProxy::OutRowMultimapT);
         for (int i = 0 ; i < 100; i++)
-            final_output->push_back(std::make_pair(outrow, metadata));
+            final_output->AppendRow(outrow);
         QE_TRACE_NOQID(DEBUG, " Finished query processing for QID " << qid << " chunk:" << chunk);
         QEOpServerProxy::QPerfInfo qperf(0,0,0);
         qperf.error = 0;
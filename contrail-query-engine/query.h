@@ -68,6 +68,7 @@
 #include <contrail-collector/viz_message.h>
 #include "json_parse.h"
 #include "QEOpServerProxy.h"
+#include "where_row.h"
 #include "base/logging.h"
 #include <sandesh/sandesh_ctrl_types.h>
 #include <sandesh/sandesh_trace.h>
@@ -293,11 +294,11 @@ struct query_result_unit_t {
     // stats+UUID+8-tuple afer flow-series WHERE query
     // AttribJSON+UUID for StatsTable queries
     // key,key2,column1-column19,DATA for messagetablev2
-    GenDb::DbDataValueVec info;
+    WhereRow info;
 
     // Following APIs will be invoked based on the table being queried
 
-    void set_stattable_info(
+    void set_stattable_info(WhereRowArena *arena,
             const std::string& attribstr,
             const boost::uuids::uuid& uuid);
 
@@ -444,6 +445,7 @@ public:
          columns, GetRowInput *get_row_ctx, void *privdata);
     void message_table_query_get_row(GenDb::DbDataValueVec const &val,
                                      GenDb::NewColVec::iterator const &res_it,
+                                     WhereRowArena *arena,
                                      query_result_unit_t &result_unit);
     void WPCompleteCb(QEPipeT *wp, bool ret_code);
     std::vector<GenDb::DbDataValueVec> populate_row_keys();
@@ -458,6 +460,10 @@ struct SetOperationUnit {
         std::vector<WhereResultT*> inp);
     static void op_or(std::string qi, WhereResultT& res,
         std::vector<WhereResultT*> inp);
+
+    // Time ranges a large set operation is split into at most, the
+    // concurrency of the set operation arena if 0
+    static size_t max_parts_;
 };
 
 typedef boost::function<void (void *, QEOpServerProxy::QPerfInfo,
@@ -629,7 +635,7 @@ private:
     //
     // Object table query
     //
-    void get_query_column_value(const GenDb::DbDataValueVec &info,
+    void get_query_column_value(const WhereRow &info,
                                 unsigned int index,
                                 std::string *query_column,
                                 GenDb::DbDataValue *value,
@@ -637,7 +643,7 @@ private:
     bool process_object_query_specific_select_params(
                         const std::string& sel_field,
                         std::map<std::string, GenDb::DbDataValue>& col_res_map,
-                        std::map<std::string, std::string>& cmap,
+                        std::string *value,
                         const boost::uuids::uuid& uuid,
                         std::map<boost::uuids::uuid, std::string>&);
 
@@ -785,8 +791,19 @@ public:
     std::auto_ptr<BufT> result_;
     std::auto_ptr<MapBufT> mresult_;
 
-    bool sort_field_comparator(const QEOpServerProxy::ResultRowT& lhs,
-                               const QEOpServerProxy::ResultRowT& rhs);
+    // Number of rows of a chunk that may make it to the final result,
+    // once sorted, 0 if all of them may
+    size_t top_k() const;
+
+    // Sorts the rows of result, keeping only the first top rows if top
+    // is not 0
+    void sort_result(QEOpServerProxy::BufferT& result, size_t top = 0);
+    // Sorts the rows of result, rows [0, mid) and [mid, end) being sorted
+    void merge_sorted_result(QEOpServerProxy::BufferT& result, size_t mid);
+    // Merges the sorted runs of result starting at the rows in runs,
+    // keeping only the first top rows if top is not 0
+    void merge_sorted_runs(QEOpServerProxy::BufferT& result,
+                           const std::vector<size_t>& runs, size_t top);
 
     bool merge_processing(
         const QEOpServerProxy::BufferT& input,
@@ -957,6 +974,10 @@ const std::vector<boost::shared_ptr<QEOpServerProxy::BufferT> >& inputs,
 // limit on the size of query result we can handle
 static const int query_result_size_limit = 25000000;
 
+// SELECT rows kept before the first top-k rows are selected, so that
+// small limits do not select after every few rows
+static const size_t top_k_min_rows = 4096;
+
 // main class
 class QueryEngine {
 public:
@@ -993,7 +1014,8 @@ public:
             bool cassandra_use_ssl,
             const std::string& cassandra_ca_certs,
             const std::string & cluster_id,
-            const std::string &host_ip);
+            const std::string &host_ip,
+            const std::string &local_stats_directory = std::string());
 
     QueryEngine(EventManager *evm,
             std::vector<std::string> redis_ip_ports,
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <boost/variant/static_visitor.hpp>
+
+#include <base/string_util.h>
+#include <analytics/viz_constants.h>
+
+#include "result_buffer.h"
+
+namespace {
+
+ResultSchema::ColumnType ColumnDataType(
+    const std::vector<query_column> &columns, const std::string &name) {
+    // Aggregates are counts, whatever the column counted
+    if (name.compare(0, 5, "COUNT") == 0) {
+        return ResultSchema::UINT64;
+    }
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].name != name) {
+            continue;
+        }
+        const std::string &datatype(columns[i].datatype);
+        if (datatype == "string" || datatype == "ipaddr") {
+            return ResultSchema::STRING;
+        } else if (datatype == "uuid") {
+            return ResultSchema::UUID;
+        } else if (datatype == "double") {
+            return ResultSchema::DOUBLE;
+        }
+        return ResultSchema::UINT64;
+    }
+    return ResultSchema::STRING;
+}
+
+// Stores a value read from the database in the type of its column
+class SetVisitor : public boost::static_visitor<bool> {
+public:
+    SetVisitor(ResultSchema::ColumnType type, uint64_t *value,
+               boost::uuids::uuid *uuid) :
+        type_(type), value_(value), uuid_(uuid) {
+    }
+
+    bool operator()(const boost::uuids::uuid &value) const {
+        if (type_ != ResultSchema::UUID) {
+            return false;
+        }
+        *uuid_ = value;
+        return true;
+    }
+    bool operator()(const uint16_t &value) const {
+        return SetUint64(value);
+    }
+    bool operator()(const uint32_t &value) const {
+        return SetUint64(value);
+    }
+    bool operator()(const uint64_t &value) const {
+        return SetUint64(value);
+    }
+    bool operator()(const double &value) const {
+        if (type_ != ResultSchema::DOUBLE) {
+            return false;
+        }
+        memcpy(value_, &value, sizeof(value));
+        return true;
+    }
+    // Kept as text
+    template <typename T>
+    bool operator()(const T &value) const {
+        return false;
+    }
+
+private:
+    bool SetUint64(uint64_t value) const {
+        if (type_ != ResultSchema::UINT64) {
+            return false;
+        }
+        *value_ = value;
+        return true;
+    }
+
+    ResultSchema::ColumnType type_;
+    uint64_t *value_;
+    boost::uuids::uuid *uuid_;
+};
+
+}  // namespace
+
+ResultSchema::ResultSchema(const std::string &table,
+                           const std::vector<std::string> &columns) :
+    names_(columns) {
+    std::sort(names_.begin(), names_.end());
+    names_.erase(std::unique(names_.begin(), names_.end()), names_.end());
+
+    const std::vector<query_column> *table_columns =
+        &g_viz_constants._OBJECT_TABLE_SCHEMA.columns;
+    for (size_t i = 0; i < g_viz_constants._TABLES.size(); i++) {
+        if (g_viz_constants._TABLES[i].name == table) {
+            table_columns = &g_viz_constants._TABLES[i].schema.columns;
+            break;
+        }
+    }
+    for (size_t col = 0; col < names_.size(); col++) {
+        types_.push_back(ColumnDataType(*table_columns, names_[col]));
+    }
+}
+
+int ResultSchema::Find(const std::string &name) const {
+    std::vector<std::string>::const_iterator it =
+        std::lower_bound(names_.begin(), names_.end(), name);
+    if (it == names_.end() || *it != name) {
+        return -1;
+    }
+    return it - names_.begin();
+}
+
+bool ResultSchema::operator==(const ResultSchema &rhs) const {
+    return names_ == rhs.names_ && types_ == rhs.types_;
+}
+
+double ResultBuffer::Row::GetDouble(size_t col) const {
+    double value;
+    memcpy(&value, &buffer_->columns_[col].values[row_], sizeof(value));
+    return value;
+}
+
+std::string ResultBuffer::Row::GetString(size_t col) const {
+    const Column &column(buffer_->columns_[col]);
+    switch (column.state[row_]) {
+    case ABSENT:
+        return std::string();
+    case TEXT:
+        return GetText(col);
+    default:
+        break;
+    }
+    switch (buffer_->schema_->type(col)) {
+    case ResultSchema::UINT64:
+        return integerToString(GetUint64(col));
+    case ResultSchema::DOUBLE:
+        return GenDb::DbDataValueToString(GenDb::DbDataValue(GetDouble(col)));
+    case ResultSchema::UUID:
+        return GenDb::DbDataValueToString(GenDb::DbDataValue(GetUuid(col)));
+    default:
+        break;
+    }
+    return std::string();
+}
+
+ResultBuffer::ResultBuffer() :
+    rows_(0) {
+}
+
+ResultBuffer::ResultBuffer(const ResultSchemaPtr &schema) :
+    rows_(0) {
+    set_schema(schema);
+}
+
+void ResultBuffer::set_schema(const ResultSchemaPtr &schema) {
+    assert(rows_ == 0);
+    schema_ = schema;
+    columns_.clear();
+    if (schema_) {
+        columns_.resize(schema_->size());
+    }
+}
+
+void ResultBuffer::reserve(size_t rows) {
+    for (size_t col = 0; col < columns_.size(); col++) {
+        columns_[col].state.reserve(rows);
+        columns_[col].values.reserve(rows);
+        if (schema_->type(col) == ResultSchema::UUID) {
+            columns_[col].uuids.reserve(rows);
+        }
+    }
+}
+
+void ResultBuffer::clear() {
+    rows_ = 0;
+    for (size_t col = 0; col < columns_.size(); col++) {
+        columns_[col] = Column();
+    }
+    strings_.clear();
+    string_ids_.clear();
+}
+
+void ResultBuffer::swap(ResultBuffer &rhs) {
+    schema_.swap(rhs.schema_);
+    std::swap(rows_, rhs.rows_);
+    columns_.swap(rhs.columns_);
+    strings_.swap(rhs.strings_);
+    string_ids_.swap(rhs.string_ids_);
+}
+
+size_t ResultBuffer::AddRow() {
+    for (size_t col = 0; col < columns_.size(); col++) {
+        Column &column(columns_[col]);
+        column.state.push_back(ABSENT);
+        column.values.push_back(0);
+        if (schema_->type(col) == ResultSchema::UUID) {
+            column.uuids.push_back(boost::uuids::uuid());
+        }
+    }
+    return rows_++;
+}
+
+void ResultBuffer::PopRow() {
+    assert(rows_ > 0);
+    for (size_t col = 0; col < columns_.size(); col++) {
+        Column &column(columns_[col]);
+        column.state.pop_back();
+        column.values.pop_back();
+        if (schema_->type(col) == ResultSchema::UUID) {
+            column.uuids.pop_back();
+        }
+    }
+    rows_--;
+}
+
+uint64_t ResultBuffer::Intern(const std::string &value) {
+    if (value.size() > kMaxLookupSize) {
+        strings_.push_back(value);
+        return strings_.size() - 1;
+    }
+    std::pair<boost::unordered_map<std::string, uint32_t>::iterator, bool>
+        ret(string_ids_.insert(std::make_pair(value, strings_.size())));
+    if (ret.second) {
+        strings_.push_back(value);
+    }
+    return ret.first->second;
+}
+
+void ResultBuffer::SetUint64(size_t row, size_t col, uint64_t value) {
+    columns_[col].state[row] = TYPED;
+    columns_[col].values[row] = value;
+}
+
+void ResultBuffer::SetDouble(size_t row, size_t col, double value) {
+    columns_[col].state[row] = TYPED;
+    memcpy(&columns_[col].values[row], &value, sizeof(value));
+}
+
+void ResultBuffer::SetUuid(size_t row, size_t col,
+                           const boost::uuids::uuid &value) {
+    columns_[col].state[row] = TYPED;
+    columns_[col].uuids[row] = value;
+}
+
+void ResultBuffer::Set(size_t row, size_t col,
+                       const GenDb::DbDataValue &value) {
+    Column &column(columns_[col]);
+    if (boost::apply_visitor(SetVisitor(schema_->type(col),
+            &column.values[row],
+            column.uuids.empty() ? NULL : &column.uuids[row]), value)) {
+        column.state[row] = TYPED;
+        return;
+    }
+    if (const std::string *svalue = boost::get<std::string>(&value)) {
+        SetText(row, col, *svalue);
+        return;
+    }
+    SetText(row, col, GenDb::DbDataValueToString(value));
+}
+
+void ResultBuffer::SetText(size_t row, size_t col, const std::string &value) {
+    // Only integers that print back the same are converted
+    if (schema_->type(col) == ResultSchema::UINT64 && !value.empty() &&
+        value.size() < 20 && value[0] >= '1' && value[0] <= '9' &&
+        value.find_first_not_of("0123456789") == std::string::npos) {
+        uint64_t ivalue;
+        stringToInteger(value, ivalue);
+        SetUint64(row, col, ivalue);
+        return;
+    }
+    columns_[col].state[row] = TEXT;
+    columns_[col].values[row] = Intern(value);
+}
+
+void ResultBuffer::AppendRow(const std::map<std::string, std::string> &values) {
+    size_t row(AddRow());
+    for (std::map<std::string, std::string>::const_iterator it =
+            values.begin(); it != values.end(); ++it) {
+        int col(schema_->Find(it->first));
+        if (col >= 0) {
+            SetText(row, col, it->second);
+        }
+    }
+}
+
+void ResultBuffer::MapColumns(const ResultBuffer &src,
+                              std::vector<int> *cols) const {
+    cols->resize(src.columns_.size());
+    bool same(schema_ == src.schema_ || *schema_ == *src.schema_);
+    for (size_t col = 0; col < src.columns_.size(); col++) {
+        if (same) {
+            (*cols)[col] = col;
+            continue;
+        }
+        int dcol(schema_->Find(src.schema_->name(col)));
+        // The value is only copied when stored the same way
+        if (dcol >= 0 && schema_->type(dcol) != src.schema_->type(col)) {
+            dcol = -1;
+        }
+        (*cols)[col] = dcol;
+    }
+}
+
+void ResultBuffer::CopyRow(const ResultBuffer &src, size_t row,
+                           const std::vector<int> &cols) {
+    size_t drow(AddRow());
+    for (size_t col = 0; col < cols.size(); col++) {
+        if (cols[col] < 0) {
+            continue;
+        }
+        const Column &scolumn(src.columns_[col]);
+        size_t dcol(cols[col]);
+        switch (scolumn.state[row]) {
+        case TYPED:
+            columns_[dcol].state[drow] = TYPED;
+            columns_[dcol].values[drow] = scolumn.values[row];
+            if (!scolumn.uuids.empty()) {
+                columns_[dcol].uuids[drow] = scolumn.uuids[row];
+            }
+            break;
+        case TEXT:
+            columns_[dcol].state[drow] = TEXT;
+            columns_[dcol].values[drow] =
+                Intern(src.strings_[scolumn.values[row]]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ResultBuffer::AppendRow(const ResultBuffer &src, size_t row) {
+    if (!schema_) {
+        set_schema(src.schema_);
+    }
+    std::vector<int> cols;
+    MapColumns(src, &cols);
+    CopyRow(src, row, cols);
+}
+
+void ResultBuffer::Append(const ResultBuffer &src) {
+    if (src.empty()) {
+        return;
+    }
+    if (empty() && (!schema_ || schema_ == src.schema_)) {
+        *this = src;
+        return;
+    }
+    if (!schema_) {
+        set_schema(src.schema_);
+    }
+    std::vector<int> cols;
+    MapColumns(src, &cols);
+    reserve(rows_ + src.rows_);
+    for (size_t row = 0; row < src.rows_; row++) {
+        CopyRow(src, row, cols);
+    }
+}
+
+void ResultBuffer::Select(const std::vector<size_t> &rows) {
+    ResultBuffer selected(schema_);
+    selected.reserve(rows.size());
+    // The strings are moved to the new buffer rather than copied, as
+    // the rows are kept in a different order or fewer of them are kept
+    std::vector<uint32_t> string_map(strings_.size(), ~0U);
+    selected.strings_.reserve(strings_.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        size_t row(rows[i]);
+        size_t drow(selected.AddRow());
+        for (size_t col = 0; col < columns_.size(); col++) {
+            const Column &column(columns_[col]);
+            Column &dcolumn(selected.columns_[col]);
+            dcolumn.state[drow] = column.state[row];
+            dcolumn.values[drow] = column.values[row];
+            if (!column.uuids.empty()) {
+                dcolumn.uuids[drow] = column.uuids[row];
+            }
+            if (column.state[row] != TEXT) {
+                continue;
+            }
+            uint32_t &id(string_map[column.values[row]]);
+            if (id == ~0U) {
+                id = selected.strings_.size();
+                selected.strings_.push_back(std::string());
+                selected.strings_.back().swap(
+                    strings_[column.values[row]]);
+                const std::string &value(selected.strings_.back());
+                if (value.size() <= kMaxLookupSize) {
+                    selected.string_ids_.insert(std::make_pair(value, id));
+                }
+            }
+            dcolumn.values[drow] = id;
+        }
+    }
+    swap(selected);
+}
+
+void ResultBuffer::Truncate(size_t rows) {
+    if (rows >= rows_) {
+        return;
+    }
+    std::vector<size_t> kept(rows);
+    for (size_t row = 0; row < rows; row++) {
+        kept[row] = row;
+    }
+    Select(kept);
+}
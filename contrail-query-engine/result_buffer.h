@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef QUERY_ENGINE_RESULT_BUFFER_H_
+#define QUERY_ENGINE_RESULT_BUFFER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include <database/gendb_if.h>
+
+//
+// Columns of the rows of a ResultBuffer, sorted by name, with their types
+// taken from the schema of the queried table. A schema is built once per
+// query chunk and shared by the buffers of the chunk.
+//
+class ResultSchema {
+public:
+    enum ColumnType {
+        STRING,
+        UINT64,
+        DOUBLE,
+        UUID,
+    };
+
+    ResultSchema(const std::string &table,
+                 const std::vector<std::string> &columns);
+
+    size_t size() const { return names_.size(); }
+    const std::string &name(size_t col) const { return names_[col]; }
+    ColumnType type(size_t col) const { return types_[col]; }
+    // Index of the column, -1 if it is not part of the schema
+    int Find(const std::string &name) const;
+    bool operator==(const ResultSchema &rhs) const;
+
+private:
+    std::vector<std::string> names_;
+    std::vector<ColumnType> types_;
+};
+
+typedef boost::shared_ptr<const ResultSchema> ResultSchemaPtr;
+
+//
+// Rows of a MessageTable or ObjectTable query result, stored column by
+// column. A column holds its values in a vector of its own type. Values
+// that do not convert to the column type without loss, empty values
+// included, are kept as text. Text is interned per buffer, so that the
+// values repeated across rows, like the Source or the Messagetype, are
+// stored once. A row may not have all the columns of the schema.
+//
+class ResultBuffer {
+public:
+    class Row {
+    public:
+        Row(const ResultBuffer *buffer, size_t row) :
+            buffer_(buffer), row_(row) {
+        }
+
+        size_t index() const { return row_; }
+        bool Has(size_t col) const {
+            return buffer_->columns_[col].state[row_] != ABSENT;
+        }
+        // Whether the value is kept as text rather than as the column type
+        bool IsText(size_t col) const {
+            return buffer_->columns_[col].state[row_] == TEXT;
+        }
+        const std::string &GetText(size_t col) const {
+            return buffer_->strings_[buffer_->columns_[col].values[row_]];
+        }
+        uint64_t GetUint64(size_t col) const {
+            return buffer_->columns_[col].values[row_];
+        }
+        double GetDouble(size_t col) const;
+        const boost::uuids::uuid &GetUuid(size_t col) const {
+            return buffer_->columns_[col].uuids[row_];
+        }
+        // Value of the column as it was read from the database
+        std::string GetString(size_t col) const;
+
+    private:
+        const ResultBuffer *buffer_;
+        size_t row_;
+    };
+
+    ResultBuffer();
+    explicit ResultBuffer(const ResultSchemaPtr &schema);
+
+    const ResultSchemaPtr &schema() const { return schema_; }
+    // The schema can only be set on an empty buffer
+    void set_schema(const ResultSchemaPtr &schema);
+    size_t size() const { return rows_; }
+    bool empty() const { return rows_ == 0; }
+    Row row(size_t row) const { return Row(this, row); }
+    Row operator[](size_t row) const { return Row(this, row); }
+    void reserve(size_t rows);
+    void clear();
+    void swap(ResultBuffer &rhs);
+
+    // Adds a row without any column and returns its index
+    size_t AddRow();
+    // Removes the last row
+    void PopRow();
+    void Set(size_t row, size_t col, const GenDb::DbDataValue &value);
+    void SetText(size_t row, size_t col, const std::string &value);
+    // Adds a row from column names and values, the columns that are not
+    // part of the schema are ignored
+    void AppendRow(const std::map<std::string, std::string> &values);
+    void AppendRow(const ResultBuffer &src, size_t row);
+    void Append(const ResultBuffer &src);
+    // Keeps the rows listed, in the order listed
+    void Select(const std::vector<size_t> &rows);
+    void Truncate(size_t rows);
+
+private:
+    friend class Row;
+
+    enum State {
+        ABSENT,
+        TYPED,
+        TEXT,
+    };
+
+    struct Column {
+        std::vector<uint8_t> state;
+        // uint64 value, double bits, or index in strings_ for text
+        std::vector<uint64_t> values;
+        // UUID columns only
+        std::vector<boost::uuids::uuid> uuids;
+    };
+
+    // Strings longer than this are too unlikely to repeat to be looked
+    // up when interned
+    static const size_t kMaxLookupSize = 256;
+
+    uint64_t Intern(const std::string &value);
+    void SetUuid(size_t row, size_t col, const boost::uuids::uuid &value);
+    void SetUint64(size_t row, size_t col, uint64_t value);
+    void SetDouble(size_t row, size_t col, double value);
+    // Index of the columns of src in this buffer, -1 if not present
+    void MapColumns(const ResultBuffer &src, std::vector<int> *cols) const;
+    void CopyRow(const ResultBuffer &src, size_t row,
+                 const std::vector<int> &cols);
+
+    ResultSchemaPtr schema_;
+    size_t rows_;
+    std::vector<Column> columns_;
+    std::vector<std::string> strings_;
+    boost::unordered_map<std::string, uint32_t> string_ids_;
+};
+
+#endif  // QUERY_ENGINE_RESULT_BUFFER_H_
@@ -15,6 +15,7 @@
 #include <contrail-collector/vizd_table_desc.h>
 #include "utils.h"
 #include "stats_select.h"
+#include "stat_table_attribute_decoder.h"
 
 using contrail::regex;
 using contrail::regex_match;
@@ -593,7 +594,6 @@ query_status_t SelectQuery::process_query() {
     AnalyticsQuery *m_query = (AnalyticsQuery *)main_query;
     const std::vector<query_result_unit_t>& query_result =
         *m_query->where_info_;
-    boost::shared_ptr<QueryResultMetaData> nullmetadata;
 
     if (m_query->is_session_query(m_query->table())
               || m_query->is_flow_query(m_query->table())) {
@@ -609,22 +609,21 @@ query_status_t SelectQuery::process_query() {
             for (std::vector<query_result_unit_t>::const_iterator it = query_result.begin();
                     it != query_result.end(); it++) {
                 boost::uuids::uuid u;
-                GenDb::DbDataValueVec::const_iterator itr;
                 int idx = 2;
                 uint8_t session_type = boost::get<uint8_t>(it->info.at(1));
                 std::vector<StatsSelect::StatEntry> attribs;
                 SessionTableAttributeConverter session_attribs_builder(&attribs);
-                for (itr = it->info.begin(); itr != it->info.end(); ++itr) {
+                for (size_t itr = 0; itr < it->info.size(); ++itr) {
                     if (idx == SessionRecordFields::SESSION_T1) {
                         idx++;
                         continue;
                     }
                     if (idx == SessionRecordFields::SESSION_UUID) {
-                        u = boost::get<boost::uuids::uuid>(*itr);
+                        u = boost::get<boost::uuids::uuid>(it->info.at(itr));
                         idx++;
                         continue;
                     }
-                    const GenDb::DbDataValue &db_value(*itr);
+                    const GenDb::DbDataValue db_value(it->info.at(itr));
                     boost::apply_visitor(boost::bind(session_attribs_builder, _1,
                         g_viz_constants.SessionCassTableColumns[idx]), db_value);
                     ++idx;
@@ -646,12 +645,12 @@ query_status_t SelectQuery::process_query() {
             for (std::vector<query_result_unit_t>::const_iterator it =
                     query_result.begin(); it != query_result.end(); it++) {
                 boost::uuids::uuid u;
-                GenDb::DbDataValueVec::const_iterator itr;
+                size_t itr;
                 int idx = 2;
                 uint8_t session_type = boost::get<uint8_t>(it->info.at(1));
                 std::vector<StatsSelect::StatEntry> temp_attribs;
                 SessionTableAttributeConverter session_attribs_builder(&temp_attribs);
-                for (itr = it->info.begin(); itr != (it->info.end() - 1); ++itr) {
+                for (itr = 0; itr < it->info.size() - 1; ++itr) {
                     if (g_viz_constants.SessionCassTableColumns[idx] ==
                         SessionRecordFields::SESSION_T1) {
                         idx++;
@@ -665,16 +664,17 @@ query_status_t SelectQuery::process_query() {
                     }
                     if (g_viz_constants.SessionCassTableColumns[idx] ==
                         SessionRecordFields::SESSION_UUID) {
-                        u = boost::get<boost::uuids::uuid>(*itr);
+                        u = boost::get<boost::uuids::uuid>(it->info.at(itr));
                         idx++;
                         continue;
                     }
-                    const GenDb::DbDataValue &db_value(*itr);
+                    const GenDb::DbDataValue db_value(it->info.at(itr));
                     boost::apply_visitor(boost::bind(session_attribs_builder, _1,
                         g_viz_constants.SessionCassTableColumns[idx]), db_value);
                     ++idx;
                 }
-                std::string session_map(boost::get<std::string>(*itr));
+                std::string session_map(boost::get<std::string>(
+                    it->info.at(itr)));
                 contrail_rapidjson::Document d;
                 uint64_t thenj = UTCTimestampUsec();
                 if (d.Parse<0>(const_cast<char *>(
@@ -736,104 +736,34 @@ query_status_t SelectQuery::process_query() {
             QE_IO_ERROR_RETURN(0, QUERY_FAILURE);
         }
 
-        //uint64_t parset=0;
+        StatTableAttributeDecoder decoder(stats_.get());
+        string json_string;
+        boost::uuids::uuid u;
+        std::vector<StatsSelect::StatEntry> attribs;
         //uint64_t loadt=0;
         //uint64_t jsont=0;
         for (std::vector<query_result_unit_t>::const_iterator it = query_result.begin();
                 it != query_result.end(); it++) {
 
-            string json_string;
-            GenDb::DbDataValue value;
-            boost::uuids::uuid u;
-
             it->get_stattable_info(json_string, u);
 
             //uint64_t thenj = UTCTimestampUsec();
-            contrail_rapidjson::Document d;
-            if (d.Parse<0>(const_cast<char *>(
-                    json_string.c_str())).HasParseError()) {
+            if (!decoder.Decode(&json_string, &attribs)) {
+                // Parsed in place, get the document back for the log
+                it->get_stattable_info(json_string, u);
                 QE_LOG(ERROR, "Error parsing json document: " <<
-                       d.GetParseError() << " - " << json_string);
+                       decoder.ParseError() << " at " <<
+                       decoder.ParseErrorOffset() << " - " << json_string);
                 continue;
             }
             //jsont += UTCTimestampUsec() - thenj;
 
-            std::vector<StatsSelect::StatEntry> attribs;
-            {
-                for (contrail_rapidjson::Value::ConstMemberIterator itr = d.MemberBegin();
-                        itr != d.MemberEnd(); ++itr) {
-                    QE_ASSERT(itr->name.IsString());
-
-                    //uint64_t thenp = UTCTimestampUsec();
-                    std::string fvname(itr->name.GetString());
-                    char tname = fvname[fvname.length()-1];
-
-                    StatsSelect::StatEntry se;
-                    se.name = fvname.substr(0,fvname.length()-2);
-                    if (tname == 's') {
-                        se.value = itr->value.GetString();
-                        attribs.push_back(se);
-                    } else if (tname == 'n') {
-                        if (itr->value.IsUint()) {
-                            se.value = (uint64_t)itr->value.GetUint();
-                        } else {
-                            se.value = (uint64_t)itr->value.GetUint64();
-                        }
-                        attribs.push_back(se);
-                    } else if (tname == 'd') {
-                        se.value = (double) itr->value.GetDouble();
-                        attribs.push_back(se);
-                    } else if (tname == 'a') {
-                        std::ostringstream a_val;
-                        size_t i = 0;
-                        // handle list type
-                        for (contrail_rapidjson::Value::ConstValueIterator it =
-                            itr->value.Begin(); it != itr->value.End(); ++it) {
-                            if (i) {
-                                a_val << "; ";
-                            }
-                            QE_ASSERT(it->IsString());
-                            a_val << it->GetString();
-                            i++;
-                        }
-                        se.value = a_val.str();
-                        attribs.push_back(se);
-                    } else if (tname == 'm') {
-                        // handle map type
-                        std::ostringstream map_oss;
-                        map_oss << "{";
-                        size_t i = 0;
-                        for (contrail_rapidjson::Value::ConstMemberIterator it =
-                            itr->value.MemberBegin(); it != itr->value.MemberEnd();
-                            ++it) {
-                            QE_ASSERT(it->name.IsString() && it->value.IsString());
-                            StatsSelect::StatEntry entry;
-                            entry.name = se.name + "." + it->name.GetString();
-                            entry.value = it->value.GetString();
-                            if (i) {
-                                map_oss << ", ";
-                            }
-                            map_oss << "\"" << it->name.GetString() << "\"" << ":"
-                                    << "\"" << it->value.GetString() << "\"";
-                            attribs.push_back(entry);
-                            i++;
-                        }
-                        map_oss << "}";
-                        se.value = map_oss.str();
-                        attribs.push_back(se);
-                    } else {
-                        QE_ASSERT(0);
-                    }
-
-                    //parset += UTCTimestampUsec() - thenp; 
-                }
-            }
             //uint64_t thenl = UTCTimestampUsec();
             stats_->LoadRow(u, it->timestamp, attribs, *mresult_);
             //loadt += UTCTimestampUsec() - thenl; 
         }
         //QE_TRACE(DEBUG, "Select ProcTime - Entries : " << query_result.size() <<
-        //        " json : " << jsont << " parse : " << parset << " load : " << loadt);
+        //        " json : " << jsont << " load : " << loadt);
 
     } else if (m_query->table() == (g_viz_constants.OBJECT_VALUE_TABLE)) {
         uint32_t t2_start = m_query->from_time() >> g_viz_constants.RowTimeInBits;
@@ -894,11 +824,13 @@ query_status_t SelectQuery::process_query() {
             }
         }
         
+        result_->set_schema(ResultSchemaPtr(new ResultSchema(
+            m_query->table(),
+            std::vector<std::string>(1, g_viz_constants.OBJECT_ID))));
+        result_->reserve(unique_values.size());
         for (std::set<std::string>::iterator it = unique_values.begin();
                 it != unique_values.end(); it++) {
-            std::map<std::string, std::string> cmap;
-            cmap.insert(std::make_pair(g_viz_constants.OBJECT_ID, *it));
-            result_->push_back(std::make_pair(cmap, nullmetadata));
+            result_->SetText(result_->AddRow(), 0, *it);
         }
 
     } else {
@@ -912,6 +844,22 @@ query_status_t SelectQuery::process_query() {
         }
         QE_TRACE(DEBUG, "query_result.size():" << query_result.size());
 
+        // Column of each select field in the result
+        result_->set_schema(ResultSchemaPtr(new ResultSchema(
+            m_query->table(), select_column_fields)));
+        std::vector<size_t> select_cols;
+        for (std::vector<std::string>::const_iterator jt =
+                select_column_fields.begin();
+             jt != select_column_fields.end(); jt++) {
+            select_cols.push_back(result_->schema()->Find(*jt));
+        }
+        // Only the first top_k rows of the chunk may make it to the final
+        // result, the others are dropped as the rows are built
+        size_t top_k = m_query->postprocess_->top_k();
+        size_t max_rows = std::max(2 * top_k, top_k_min_rows);
+        result_->reserve(top_k ? std::min(max_rows, query_result.size()) :
+                         query_result.size());
+
         for (std::vector<query_result_unit_t>::const_iterator it = query_result.begin();
                 it != query_result.end(); it++) {
 
@@ -946,23 +894,26 @@ query_status_t SelectQuery::process_query() {
                 uuid_to_object_id.insert(std::make_pair(u, object_id));
             }
 
-            std::map<std::string, std::string> cmap;
+            size_t row = result_->AddRow();
             std::vector<std::string>::iterator jt;
             for (jt = select_column_fields.begin();
                  jt != select_column_fields.end(); jt++) {
+                size_t col = select_cols[jt - select_column_fields.begin()];
                 std::map<std::string, GenDb::DbDataValue>::iterator kt = col_res_map.find(*jt);
                 if (kt == col_res_map.end()) {
                     if (m_query->is_object_table_query(m_query->table())) {
+                        std::string value;
                         if (process_object_query_specific_select_params(
-                            *jt, col_res_map, cmap, uuid_rkey,
+                            *jt, col_res_map, &value, uuid_rkey,
                             uuid_to_object_id ) == false) {
                             // Exit the loop. User is not interested 
                             // in this object log. 
                             break;
                         }
+                        result_->SetText(row, col, value);
                     } else {
                         // do not assert, append an empty string
-                        cmap.insert(std::make_pair(*jt, std::string("")));
+                        result_->SetText(row, col, std::string(""));
                     }
                 } else if (*jt == g_viz_constants.UUID_KEY) {
 
@@ -975,15 +926,16 @@ query_status_t SelectQuery::process_query() {
                     std::string u_s(u.size(), 0);
                     std::copy(u.begin(), u.end(), u_s.begin());
 
-                    cmap.insert(std::make_pair(kt->first, u_s));
+                    result_->SetText(row, col, u_s);
                 } else {
-                    std::string vstr(GenDb::DbDataValueToString(kt->second));
-                    cmap.insert(std::make_pair(kt->first, vstr));
+                    result_->Set(row, col, kt->second);
                 } 
             }
-            if (jt == select_column_fields.end()) {
-                result_->push_back(std::make_pair(cmap, nullmetadata));
-            } 
+            if (jt != select_column_fields.end()) {
+                result_->PopRow();
+            } else if (top_k && result_->size() >= max_rows) {
+                m_query->postprocess_->sort_result(*result_, top_k);
+            }
         }
     }
     // Have the result ready and processing is done
@@ -992,7 +944,7 @@ query_status_t SelectQuery::process_query() {
     return QUERY_SUCCESS;
 }
 
-void SelectQuery::get_query_column_value(const GenDb::DbDataValueVec &info,
+void SelectQuery::get_query_column_value(const WhereRow &info,
                                          unsigned int index,
                                          std::string *query_column,
                                          GenDb::DbDataValue *value,
@@ -1033,7 +985,7 @@ void SelectQuery::get_query_column_value(const GenDb::DbDataValueVec &info,
 bool SelectQuery::process_object_query_specific_select_params(
                         const std::string& sel_field,
                         std::map<std::string, GenDb::DbDataValue>& col_res_map,
-                        std::map<std::string, std::string>& cmap,
+                        std::string *value,
                         const boost::uuids::uuid& uuid,
                         std::map<boost::uuids::uuid, std::string>&
                         uuid_to_objectid) {
@@ -1069,17 +1021,15 @@ bool SelectQuery::process_object_query_specific_select_params(
         } catch (boost::bad_get& ex) {
             QE_ASSERT(0);
         }
-        cmap.insert(std::make_pair(sel_field, xml_data));
+        *value = xml_data;
     } else if (sel_field == "ObjectId") {
         // Look up the object_id corresponding to the uuid
         std::map<boost::uuids::uuid, std::string>::iterator uuid_iter;
         uuid_iter = uuid_to_objectid.find(uuid);
         QE_ASSERT(uuid_iter != uuid_to_objectid.end());
-        std::string object_id_val(uuid_iter->second);
-        cmap.insert(std::make_pair(sel_field,
-            object_id_val));
+        *value = uuid_iter->second;
     } else if (is_present_in_select_column_fields(sandesh_type)) {
-        cmap.insert(std::make_pair(sel_field, std::string("")));
+        value->clear();
     } else {
         return false;
     }
@@ -2,6 +2,8 @@
  * Copyright (c) 2013 Juniper Networks, Inc. All rights reserved.
  */
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include "query.h"
 
 using std::vector;
@@ -13,57 +15,268 @@ bool query_result_unit_t::operator<(const query_result_unit_t& rhs) const
 {
     if (timestamp == rhs.timestamp)
     {
-        GenDb::DbDataValueVec::const_iterator it = info.begin();
-        GenDb::DbDataValueVec::const_iterator jt = rhs.info.begin();
-        for (; it != info.end() && jt != rhs.info.end(); it++, jt++) {
-            if (*it < *jt) {
-                return true;
-            } else if (*jt < *it) {
-                return false;
+        return info < rhs.info;
+    }
+
+    return (timestamp < rhs.timestamp);
+}
+
+
+namespace {
+
+// Rows under which the set operation is not split across time ranges
+const size_t kParallelSetMinRows = 64 * 1024;
+
+// Set operations of large results run in an arena of their own so that
+// a thread waiting for them does not pick up an unrelated Task
+tbb::task_arena set_arena;
+
+// Rows of an input still to be processed
+struct WhereRange {
+    WhereResultT::const_iterator first;
+    WhereResultT::const_iterator last;
+};
+typedef std::vector<WhereRange> WhereRanges;
+
+struct TimestampLess {
+    bool operator()(const query_result_unit_t& lhs, uint64_t rhs) const {
+        return lhs.timestamp < rhs;
+    }
+};
+
+// First row of [first, last) that is not less than value, probing at
+// exponentially growing distances so that skipping a few rows stays cheap
+WhereResultT::const_iterator Gallop(WhereResultT::const_iterator first,
+                                    WhereResultT::const_iterator last,
+                                    const query_result_unit_t& value) {
+    if (first == last || !(*first < value)) {
+        return first;
+    }
+    size_t size = last - first;
+    // first[lo] is less than value
+    size_t lo = 0;
+    size_t hi = 1;
+    while (hi < size && first[hi] < value) {
+        lo = hi;
+        hi *= 2;
+    }
+    return std::lower_bound(first + lo + 1, first + std::min(hi, size), value);
+}
+
+// Intersection of the ranges, with the rows of ranges[0]. The smallest
+// range drives the intersection, the others are probed by size.
+void Intersect(WhereRanges ranges, WhereResultT *res) {
+    std::vector<std::pair<size_t, size_t> > sizes;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        sizes.push_back(std::make_pair(ranges[i].last - ranges[i].first, i));
+    }
+    std::sort(sizes.begin(), sizes.end());
+    WhereRange& driver = ranges[sizes[0].second];
+    res->reserve(res->size() + sizes[0].first);
+    while (driver.first != driver.last) {
+        const query_result_unit_t& value = *driver.first;
+        bool found = true;
+        for (size_t i = 1; i < sizes.size(); i++) {
+            WhereRange& range = ranges[sizes[i].second];
+            range.first = Gallop(range.first, range.last, value);
+            if (range.first == range.last) {
+                return;
             }
+            if (value < *range.first) {
+                driver.first = Gallop(driver.first, driver.last,
+                                      *range.first);
+                found = false;
+                break;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+        res->push_back(*ranges[0].first);
+        for (size_t i = 0; i < ranges.size(); i++) {
+            ++ranges[i].first;
         }
-        return false;
     }
+}
 
-    return (timestamp < rhs.timestamp);
+// Orders the ranges of a union by their first row, the first input
+// before the others for equal rows
+struct RangeGreater {
+    explicit RangeGreater(const WhereRanges *ranges) : ranges_(ranges) {
+    }
+    bool operator()(size_t lhs, size_t rhs) const {
+        const query_result_unit_t& lrow = *(*ranges_)[lhs].first;
+        const query_result_unit_t& rrow = *(*ranges_)[rhs].first;
+        if (rrow < lrow) return true;
+        if (lrow < rrow) return false;
+        return lhs > rhs;
+    }
+    const WhereRanges *ranges_;
+};
+
+// Union of the ranges in a single k-way merge. A row present in several
+// ranges is taken from the first of them.
+void Unite(WhereRanges ranges, WhereResultT *res) {
+    RangeGreater greater(&ranges);
+    std::vector<size_t> heap;
+    size_t size = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (ranges[i].first != ranges[i].last) {
+            heap.push_back(i);
+            size = std::max(size, size_t(ranges[i].last - ranges[i].first));
+        }
+    }
+    res->reserve(res->size() + size);
+    std::make_heap(heap.begin(), heap.end(), greater);
+    std::vector<size_t> advanced;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        advanced.push_back(heap.back());
+        heap.pop_back();
+        const query_result_unit_t& value = *ranges[advanced[0]].first;
+        while (!heap.empty() && !(value < *ranges[heap.front()].first)) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            advanced.push_back(heap.back());
+            heap.pop_back();
+        }
+        res->push_back(value);
+        for (size_t i = 0; i < advanced.size(); i++) {
+            WhereRange& range = ranges[advanced[i]];
+            if (++range.first != range.last) {
+                heap.push_back(advanced[i]);
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+        }
+        advanced.clear();
+    }
+}
+
+typedef void (*SetOpFn)(WhereRanges, WhereResultT *);
+
+// Splits the inputs into time ranges, at the timestamps of the rows of
+// inp[pivot]. The rows of a timestamp are all in the same time range.
+void Partition(const std::vector<WhereResultT*>& inp, size_t pivot,
+               size_t parts, std::vector<WhereRanges> *ranges) {
+    const WhereResultT& prows = *inp[pivot];
+    std::vector<uint64_t> splits;
+    for (size_t part = 1; part < parts; part++) {
+        uint64_t ts = prows[part * prows.size() / parts].timestamp;
+        if (splits.empty() || ts > splits.back()) {
+            splits.push_back(ts);
+        }
+    }
+    ranges->resize(splits.size() + 1);
+    for (size_t i = 0; i < inp.size(); i++) {
+        const WhereResultT& rows = *inp[i];
+        WhereResultT::const_iterator first = rows.begin();
+        for (size_t part = 0; part <= splits.size(); part++) {
+            WhereRange range;
+            range.first = first;
+            range.last = part < splits.size() ?
+                std::lower_bound(first, rows.end(), splits[part],
+                                 TimestampLess()) : rows.end();
+            (*ranges)[part].push_back(range);
+            first = range.last;
+        }
+    }
+}
+
+struct SetOpTask {
+    SetOpTask(SetOpFn fn, const std::vector<WhereRanges> *ranges,
+              std::vector<WhereResultT> *results) :
+        fn_(fn), ranges_(ranges), results_(results) {
+    }
+    void operator()(size_t part) const {
+        fn_((*ranges_)[part], &(*results_)[part]);
+    }
+    SetOpFn fn_;
+    const std::vector<WhereRanges> *ranges_;
+    std::vector<WhereResultT> *results_;
+};
+
+struct ParallelSetOp {
+    explicit ParallelSetOp(const SetOpTask &task) : task_(task) {
+    }
+    void operator()() const {
+        tbb::parallel_for(size_t(0), task_.ranges_->size(), task_);
+    }
+    SetOpTask task_;
+};
+
+// Runs the set operation on the inputs, in parallel across time ranges
+// when they are large enough
+void SetOp(SetOpFn fn, WhereResultT& res,
+           const std::vector<WhereResultT*>& inp, size_t pivot) {
+    res.clear();
+    size_t total = 0;
+    for (size_t i = 0; i < inp.size(); i++) {
+        total += inp[i]->size();
+    }
+    size_t max_parts = SetOperationUnit::max_parts_ ?
+        SetOperationUnit::max_parts_ : set_arena.max_concurrency();
+    size_t parts = std::min(max_parts, total / kParallelSetMinRows);
+    std::vector<WhereRanges> ranges;
+    if (parts <= 1 || inp[pivot]->empty()) {
+        Partition(inp, pivot, 1, &ranges);
+        fn(ranges[0], &res);
+        return;
+    }
+    Partition(inp, pivot, parts, &ranges);
+    std::vector<WhereResultT> results(ranges.size());
+    set_arena.execute(ParallelSetOp(SetOpTask(fn, &ranges, &results)));
+    size_t size = 0;
+    for (size_t part = 0; part < results.size(); part++) {
+        size += results[part].size();
+    }
+    // The rows are moved rather than copied
+    res.resize(size);
+    WhereResultT::iterator it = res.begin();
+    for (size_t part = 0; part < results.size(); part++) {
+        for (size_t i = 0; i < results[part].size(); i++, ++it) {
+            it->timestamp = results[part][i].timestamp;
+            it->info.swap(results[part][i].info);
+        }
+    }
 }
 
+}  // namespace
+
+size_t SetOperationUnit::max_parts_ = 0;
 
 void
 SetOperationUnit::op_and(string qi, WhereResultT& res,
         vector<WhereResultT*> inp) {
-    res = *inp[0];
+    if (inp.empty()) {
+        res.clear();
+        return;
+    }
+    size_t smallest = 0;
     for (size_t and_idx=1; and_idx<inp.size(); and_idx++) {
-        WhereResultT tmp_query_result;
-        QE_LOG_NOQID(INFO, qi << " INT between tables of sizes " << 
-                res.size() << " and " << inp[and_idx]->size());
-        set_intersection(res.begin(), res.end(),
-                inp[and_idx]->begin(),
-                inp[and_idx]->end(),
-                std::back_inserter(tmp_query_result));
-        res = tmp_query_result;    // keep the result in output var
-        QE_LOG_NOQID(INFO, qi << " Resulting size of set " <<
-                res.size());
-        
+        if (inp[and_idx]->size() < inp[smallest]->size()) {
+            smallest = and_idx;
+        }
     }
+    QE_LOG_NOQID(INFO, qi << " INT between " << inp.size() <<
+            " tables, smallest of size " << inp[smallest]->size());
+    SetOp(&Intersect, res, inp, smallest);
+    QE_LOG_NOQID(INFO, qi << " Resulting size of set " << res.size());
 }
 
 void
 SetOperationUnit::op_or(string qi, WhereResultT& res,
         vector<WhereResultT*> inp) {
-    res = *inp[0];
+    if (inp.empty()) {
+        res.clear();
+        return;
+    }
+    size_t largest = 0;
     for (size_t or_idx=1; or_idx<inp.size(); or_idx++) {
-            // If the OR term has mulitple ORs, union is needed
-            WhereResultT tmp_query_result;
-            QE_LOG_NOQID(INFO, qi << " UNION between tables of sizes " << 
-                    res.size() << " and " << inp[or_idx]->size());
-            set_union(res.begin(), res.end(),
-                    inp[or_idx]->begin(),
-                    inp[or_idx]->end(),
-                    std::back_inserter(tmp_query_result));
-            res = tmp_query_result;    // keep the result in output var
-            QE_LOG_NOQID(INFO, qi <<  " Resulting size of set " <<
-                    res.size());
+        if (inp[or_idx]->size() > inp[largest]->size()) {
+            largest = or_idx;
+        }
     }
+    QE_LOG_NOQID(INFO, qi << " UNION between " << inp.size() <<
+            " tables, largest of size " << inp[largest]->size());
+    SetOp(&Unite, res, inp, largest);
+    QE_LOG_NOQID(INFO, qi << " Resulting size of set " << res.size());
 }
-
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef QUERY_ENGINE_STAT_TABLE_ATTRIBUTE_DECODER_H_
+#define QUERY_ENGINE_STAT_TABLE_ATTRIBUTE_DECODER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rapidjson/reader.h"
+#include "query.h"
+#include "stats_select.h"
+
+//
+// Decodes the attributes of a stat table row, a json object whose member
+// names carry the attribute type in their last character. The json is
+// parsed in place by a reader reused across the rows, and only the
+// attributes that StatsSelect::LoadRow uses are decoded, the others are
+// skipped without being copied. The member names are resolved once and
+// the entries of the row are reused, so that a row of the same attributes
+// as the previous one is decoded without allocating.
+//
+class StatTableAttributeDecoder :
+    public contrail_rapidjson::BaseReaderHandler<
+        contrail_rapidjson::UTF8<>, StatTableAttributeDecoder> {
+public:
+    typedef contrail_rapidjson::SizeType SizeType;
+
+    explicit StatTableAttributeDecoder(const StatsSelect *stats) :
+        stats_(stats), attrib_(NULL), depth_(0), skip_(false),
+        values_(0), attribs_(NULL), count_(0) {
+    }
+
+    // Decodes json, which is modified, into attribs. Returns false if json
+    // is not an object of attributes.
+    bool Decode(std::string *json, std::vector<StatsSelect::StatEntry> *attribs) {
+        attribs_ = attribs;
+        count_ = 0;
+        attrib_ = NULL;
+        depth_ = 0;
+        skip_ = false;
+        // The terminating null of json ends the in place stream
+        json->c_str();
+        contrail_rapidjson::InsituStringStream stream(&(*json)[0]);
+        reader_.Parse<contrail_rapidjson::kParseInsituFlag>(stream, *this);
+        attribs_->resize(count_);
+        return !reader_.HasParseError();
+    }
+
+    contrail_rapidjson::ParseErrorCode ParseError() const {
+        return reader_.GetParseErrorCode();
+    }
+    size_t ParseErrorOffset() const {
+        return reader_.GetErrorOffset();
+    }
+
+    // SAX events
+    bool Default() {
+        return SkipValue();
+    }
+    bool Uint(unsigned value) {
+        return Unsigned(value);
+    }
+    bool Uint64(uint64_t value) {
+        return Unsigned(value);
+    }
+    bool Int(int value) {
+        return Signed(value);
+    }
+    bool Int64(int64_t value) {
+        return Signed(value);
+    }
+    bool Double(double value) {
+        if (skip_) {
+            return SkipValue();
+        }
+        if (depth_ != 1 || attrib_->type != 'd') {
+            return false;
+        }
+        SetDouble(attrib_->name, value);
+        return true;
+    }
+    bool String(const char *str, SizeType length, bool copy) {
+        if (skip_) {
+            return SkipValue();
+        }
+        if (depth_ == 1 && attrib_->type == 's') {
+            SetString(attrib_->name, str, length);
+            return true;
+        }
+        if (depth_ != 2) {
+            return false;
+        }
+        if (attrib_->type == 'a') {
+            if (values_++) {
+                value_.append("; ");
+            }
+            value_.append(str, length);
+            return true;
+        }
+        // Map value, loaded as the attribute name.key as well
+        if (attrib_->loaded) {
+            if (values_++) {
+                value_.append(", ");
+            }
+            value_.append("\"").append(key_).append("\":\"");
+            value_.append(str, length).append("\"");
+        }
+        if (attrib_->prefix_loaded) {
+            name_.assign(attrib_->name).append(".").append(key_);
+            if (stats_->IsLoaded(name_)) {
+                SetString(name_, str, length);
+            }
+        }
+        return true;
+    }
+    bool Key(const char *str, SizeType length, bool copy) {
+        if (skip_) {
+            return true;
+        }
+        if (depth_ == 2) {
+            key_.assign(str, length);
+            return true;
+        }
+        attrib_ = Resolve(str, length);
+        if (attrib_ == NULL) {
+            return false;
+        }
+        skip_ = !attrib_->loaded && !attrib_->prefix_loaded;
+        return true;
+    }
+    bool StartObject() {
+        depth_++;
+        if (skip_ || depth_ == 1) {
+            return true;
+        }
+        if (depth_ != 2 || attrib_->type != 'm') {
+            return false;
+        }
+        value_.assign("{");
+        values_ = 0;
+        return true;
+    }
+    bool EndObject(SizeType count) {
+        if (!skip_ && depth_ == 2 && attrib_->loaded) {
+            value_.append("}");
+            SetString(attrib_->name, value_.data(), value_.size());
+        }
+        return EndContainer();
+    }
+    bool StartArray() {
+        depth_++;
+        if (skip_) {
+            return true;
+        }
+        if (depth_ != 2 || attrib_->type != 'a') {
+            return false;
+        }
+        value_.clear();
+        values_ = 0;
+        return true;
+    }
+    bool EndArray(SizeType count) {
+        if (!skip_ && depth_ == 2) {
+            SetString(attrib_->name, value_.data(), value_.size());
+        }
+        return EndContainer();
+    }
+
+private:
+    struct Attribute {
+        std::string name;
+        char type;
+        // Whether LoadRow uses the attribute, or for a map an attribute
+        // name.key of its values
+        bool loaded;
+        bool prefix_loaded;
+    };
+    typedef std::map<std::string, Attribute> AttributeMap;
+
+    const Attribute *Resolve(const char *str, SizeType length) {
+        name_.assign(str, length);
+        AttributeMap::iterator it = resolved_.find(name_);
+        if (it != resolved_.end()) {
+            return &it->second;
+        }
+        if (length < 2) {
+            return NULL;
+        }
+        Attribute attrib;
+        attrib.name = name_.substr(0, length - 2);
+        attrib.type = name_[length - 1];
+        QE_ASSERT(attrib.type == 's' || attrib.type == 'n' ||
+                  attrib.type == 'd' || attrib.type == 'a' ||
+                  attrib.type == 'm');
+        attrib.loaded = stats_->IsLoaded(attrib.name);
+        attrib.prefix_loaded = attrib.type == 'm' &&
+            stats_->IsLoadedPrefix(attrib.name + ".");
+        return &resolved_.insert(std::make_pair(name_, attrib)).first->second;
+    }
+
+    bool Unsigned(uint64_t value) {
+        if (skip_) {
+            return SkipValue();
+        }
+        if (depth_ != 1) {
+            return false;
+        }
+        if (attrib_->type == 'n') {
+            StatsSelect::StatEntry &entry = NextEntry(attrib_->name);
+            entry.value = value;
+            return true;
+        }
+        if (attrib_->type == 'd') {
+            SetDouble(attrib_->name, value);
+            return true;
+        }
+        return false;
+    }
+    bool Signed(int64_t value) {
+        if (skip_) {
+            return SkipValue();
+        }
+        if (depth_ != 1 || attrib_->type != 'd') {
+            return false;
+        }
+        SetDouble(attrib_->name, value);
+        return true;
+    }
+    // A scalar of a skipped attribute, or inside of one
+    bool SkipValue() {
+        if (!skip_) {
+            return false;
+        }
+        if (depth_ == 1) {
+            skip_ = false;
+        }
+        return true;
+    }
+    bool EndContainer() {
+        depth_--;
+        if (skip_ && depth_ == 1) {
+            skip_ = false;
+        }
+        return true;
+    }
+
+    // Entries are overwritten in place, reusing the memory of the entries
+    // of the previous rows
+    StatsSelect::StatEntry &NextEntry(const std::string &name) {
+        if (count_ == attribs_->size()) {
+            attribs_->resize(count_ + 1);
+        }
+        StatsSelect::StatEntry &entry = (*attribs_)[count_++];
+        entry.name = name;
+        return entry;
+    }
+    void SetString(const std::string &name, const char *str, size_t length) {
+        StatsSelect::StatEntry &entry = NextEntry(name);
+        std::string *value = boost::get<std::string>(&entry.value);
+        if (value) {
+            value->assign(str, length);
+        } else {
+            entry.value = std::string(str, length);
+        }
+    }
+    void SetDouble(const std::string &name, double value) {
+        StatsSelect::StatEntry &entry = NextEntry(name);
+        entry.value = value;
+    }
+
+    const StatsSelect *stats_;
+    contrail_rapidjson::Reader reader_;
+    AttributeMap resolved_;
+    const Attribute *attrib_;
+    // Nesting of the current value, 1 for the attributes
+    int depth_;
+    // Whether the current attribute is not decoded
+    bool skip_;
+    // List or map value being built, with its number of values so far
+    std::string value_;
+    size_t values_;
+    // Key of the current map value, and scratch name
+    std::string key_;
+    std::string name_;
+    std::vector<StatsSelect::StatEntry> *attribs_;
+    size_t count_;
+};
+
+#endif  // QUERY_ENGINE_STAT_TABLE_ATTRIBUTE_DECODER_H_
@@ -340,9 +340,26 @@ StatsSelect::StatsSelect(AnalyticsQuery * m_query,
         }
     }
 
+    // CLASS only hashes the unik columns, so it needs no column of its own
+    load_cols_.insert(unik_cols_.begin(), unik_cols_.end());
+    load_cols_.insert(sum_cols_.begin(), sum_cols_.end());
+    load_cols_.insert(max_field_.begin(), max_field_.end());
+    load_cols_.insert(min_field_.begin(), min_field_.end());
+    load_cols_.insert(avg_field_.begin(), avg_field_.end());
+    load_cols_.insert(percentile_cols_.begin(), percentile_cols_.end());
+
     status_ = true;
 }
 
+bool StatsSelect::IsLoaded(const std::string& name) const {
+    return load_cols_.find(name) != load_cols_.end();
+}
+
+bool StatsSelect::IsLoadedPrefix(const std::string& prefix) const {
+    std::set<std::string>::const_iterator it = load_cols_.lower_bound(prefix);
+    return it != load_cols_.end() && it->compare(0, prefix.size(), prefix) == 0;
+}
+
 void StatsSelect::SetSortOrder(const std::vector<sort_field_t>& sort_fields) {
     if (sort_fields.size()) {
         sort_cols_.clear();
@@ -49,6 +49,12 @@ public:
 
     bool Status() { return status_; }
 
+    // Whether LoadRow uses the attribute, the attributes it does not use
+    // need not be decoded from the rows
+    bool IsLoaded(const std::string& name) const;
+    // Whether LoadRow uses any attribute whose name starts with prefix
+    bool IsLoadedPrefix(const std::string& prefix) const;
+
     bool IsMergeNeeded() { return !isT_; }
 
     static void Merge(const std::string& count_distinct_field_, const MapBufT& input, MapBufT& output);
@@ -109,5 +115,8 @@ private:
 
     std::set<std::string> percentile_cols_;
 
+    // This is the set of all the columns above that LoadRow reads from a row
+    std::set<std::string> load_cols_;
+
 };
 #endif
@@ -275,7 +275,7 @@ TEST_F(DbQueryUnitTest, WhereQueryProcessing) {
 }
 
 /*
- * push uuid and object_id into query_result_unit_t.info
+ * build query_result_unit_t.info from uuid and object_id
  * check if GetObjectId returns the object id correctly
  */
 TEST_F(DbQueryUnitTest, GetObjectId) {
@@ -283,8 +283,10 @@ TEST_F(DbQueryUnitTest, GetObjectId) {
     boost::uuids::random_generator rgen_;
     boost::uuids::uuid unm(rgen_());
     std::string object_id("id1");
-    res1.info.push_back(unm);
-    res1.info.push_back(object_id);
+    WhereRowArena arena;
+    arena.Add(unm);
+    arena.Add(object_id);
+    res1.info = arena.Build();
     std::string returned_val;
     res1.get_objectid(returned_val);
     EXPECT_EQ(object_id, returned_val);
@@ -115,6 +115,7 @@ bool CdbIfMock::Db_GetMultiRow(GenDb::ColListVec *col_list,
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/scoped_ptr.hpp>
 #include "testing/gunit.h"
 #include "base/logging.h"
 
@@ -177,15 +178,16 @@ TEST_F(AnalyticsQueryTest, ApplyLimitTest) {
     // that output result count is 1
     TtlMap ttlmap_;
     std::vector<query_result_unit_t> where_info;
+    WhereRowArena arena;
     query_result_unit_t query_result;
     boost::uuids::uuid uuid = StringToUuid("6e6c7dcc-800f-4e98-8838-b6e9d9fc21eb");
-    query_result.info.push_back("\{\"counters.instancess\":\"*\"}");
-    query_result.info.push_back(uuid);
+    query_result.set_stattable_info(&arena,
+        "\{\"counters.instancess\":\"*\"}", uuid);
     where_info.push_back(query_result);
     query_result_unit_t query_result2;
-    query_result2.info.push_back("\{\"counters.partitionsss\":\"*\"}");
     uuid = StringToUuid("some-random-string");
-    query_result2.info.push_back(uuid);
+    query_result2.set_stattable_info(&arena,
+        "\{\"counters.partitionsss\":\"*\"}", uuid);
     where_info.push_back(query_result2);
     AnalyticsQuery *q = new AnalyticsQuery(qid, (boost::shared_ptr<GenDb::GenDbIf>)dbif_mock_, json_api_data, -1, &where_info, ttlmap_, 0, 1, NULL);
     EXPECT_EQ(QUERY_SUCCESS, q->process_query()); // query was parsed and successful
@@ -231,6 +233,292 @@ TEST_F(AnalyticsQueryTest, TestQueryTimeAdjustment) {
     delete q;
 }
 
+// Rows from which post-processing sorts and merges rows in parallel
+static const size_t kParallelSortRows = 16 * 1024;
+
+//
+// Post-processing of sorted MessageTable queries. The rows are sorted on
+// MessageTS, which many rows share, and are told apart by their Level.
+//
+class PostProcessingTest : public ::testing::Test {
+public:
+    typedef std::vector<std::pair<uint64_t, uint64_t> > RowsT;
+
+    PostProcessingTest() :
+        dbif_(new CdbIfMock(&evm_)),
+        ttlmap_(g_viz_constants.TtlValuesDefault),
+        schema_(new ResultSchema(g_viz_constants.MESSAGE_TABLE,
+            boost::assign::list_of(g_viz_constants.TIMESTAMP)
+                (g_viz_constants.SOURCE)(g_viz_constants.LEVEL))) {
+    }
+
+    // Query sorted on MessageTS in the sort order, ASCENDING or
+    // DESCENDING, with a limit if not 0 and a filter if not empty
+    AnalyticsQuery *SortedQuery(int sort, int limit,
+                                const std::string &filter = std::string()) {
+        std::map<std::string, std::string> json_api_data;
+        uint64_t end_time = UTCTimestampUsec();
+        json_api_data[QUERY_TABLE] =
+            "\"" + g_viz_constants.MESSAGE_TABLE + "\"";
+        json_api_data[QUERY_START_TIME] =
+            integerToString(end_time - 10 * 60 * 1000 * 1000ULL);
+        json_api_data[QUERY_END_TIME] = integerToString(end_time);
+        json_api_data[QUERY_SELECT] =
+            "[\"MessageTS\", \"Source\", \"Level\"]";
+        json_api_data[QUERY_SORT_FIELDS] = "[\"MessageTS\"]";
+        json_api_data[QUERY_SORT_OP] = integerToString(sort);
+        if (limit) {
+            json_api_data[QUERY_LIMIT] = integerToString(limit);
+        }
+        if (!filter.empty()) {
+            json_api_data[QUERY_FILTER] = filter;
+        }
+        return new AnalyticsQuery("TEST-QUERY", dbif_, json_api_data, -1,
+                                  NULL, ttlmap_, 0, 1, NULL);
+    }
+
+    // Adds the rows first to first + count, with fewer timestamps than
+    // rows, the Level being the number of the row
+    void AddRows(ResultBuffer *result, size_t first, size_t count) {
+        int timestamp(schema_->Find(g_viz_constants.TIMESTAMP));
+        int source(schema_->Find(g_viz_constants.SOURCE));
+        int level(schema_->Find(g_viz_constants.LEVEL));
+        for (size_t i = first; i < first + count; i++) {
+            size_t row(result->AddRow());
+            result->Set(row, timestamp,
+                GenDb::DbDataValue(uint64_t(1368037623434740ULL +
+                                            (i * 7919) % 997)));
+            result->Set(row, source,
+                GenDb::DbDataValue(std::string(i % 3 ? "b1s1" : "b1s2")));
+            result->Set(row, level, GenDb::DbDataValue(uint64_t(i)));
+        }
+    }
+
+    // Runs the rows of batches of chunks through the query the way the
+    // query engine does. SELECT keeps the first top_k() rows of a chunk
+    // as it adds rows, the chunk is post-processed and merged with the
+    // chunks of its batch before it, and the batches are merged last.
+    void RunQuery(int sort, int limit, const std::string &filter,
+                  size_t batches, size_t chunks, size_t rows,
+                  ResultBuffer *result) {
+        std::vector<boost::shared_ptr<ResultBuffer> > inputs;
+        size_t first = 0;
+        for (size_t batch = 0; batch < batches; batch++) {
+            boost::shared_ptr<ResultBuffer> output(new ResultBuffer);
+            for (size_t chunk = 0; chunk < chunks; chunk++) {
+                boost::scoped_ptr<AnalyticsQuery> q(
+                    SortedQuery(sort, limit, filter));
+                ResultBuffer *select = q->selectquery_->result_.get();
+                select->set_schema(schema_);
+                size_t top_k = q->postprocess_->top_k();
+                size_t max_rows = std::max(2 * top_k, top_k_min_rows);
+                for (size_t i = 0; i < rows; i++) {
+                    AddRows(select, first++, 1);
+                    if (top_k && select->size() >= max_rows) {
+                        q->postprocess_->sort_result(*select, top_k);
+                    }
+                }
+                EXPECT_EQ(QUERY_SUCCESS, q->postprocess_->process_query());
+
+                boost::scoped_ptr<AnalyticsQuery> acc(
+                    SortedQuery(sort, limit, filter));
+                EXPECT_TRUE(acc->merge_processing(
+                    *q->postprocess_->result_, *output));
+            }
+            inputs.push_back(output);
+        }
+        boost::scoped_ptr<AnalyticsQuery> q(SortedQuery(sort, limit, filter));
+        EXPECT_TRUE(q->final_merge_processing(inputs, *result));
+    }
+
+    // Sorts the rows on MessageTS, keeping the order of the rows that
+    // share a timestamp
+    void StableSort(ResultBuffer *result, int sort) {
+        std::vector<size_t> order(result->size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(),
+            boost::bind(&PostProcessingTest::TimestampLess, this,
+                        boost::cref(*result), sort, _1, _2));
+        result->Select(order);
+    }
+
+    // MessageTS and Level of the rows
+    RowsT Rows(const ResultBuffer &result) {
+        int timestamp(schema_->Find(g_viz_constants.TIMESTAMP));
+        int level(schema_->Find(g_viz_constants.LEVEL));
+        RowsT rows;
+        for (size_t i = 0; i < result.size(); i++) {
+            rows.push_back(std::make_pair(result[i].GetUint64(timestamp),
+                                          result[i].GetUint64(level)));
+        }
+        return rows;
+    }
+
+    // Source of the rows
+    std::vector<std::string> Sources(const ResultBuffer &result) {
+        int source(schema_->Find(g_viz_constants.SOURCE));
+        std::vector<std::string> sources;
+        for (size_t i = 0; i < result.size(); i++) {
+            sources.push_back(result[i].GetString(source));
+        }
+        return sources;
+    }
+
+    // MessageTS of the rows
+    std::vector<uint64_t> Timestamps(const ResultBuffer &result) {
+        RowsT rows(Rows(result));
+        std::vector<uint64_t> timestamps;
+        for (size_t i = 0; i < rows.size(); i++) {
+            timestamps.push_back(rows[i].first);
+        }
+        return timestamps;
+    }
+
+    // Level of the rows, sorted
+    std::vector<uint64_t> Levels(const ResultBuffer &result) {
+        RowsT rows(Rows(result));
+        std::vector<uint64_t> levels;
+        for (size_t i = 0; i < rows.size(); i++) {
+            levels.push_back(rows[i].second);
+        }
+        std::sort(levels.begin(), levels.end());
+        return levels;
+    }
+
+    EventManager evm_;
+    GenDbIfPtr dbif_;
+    TtlMap ttlmap_;
+    ResultSchemaPtr schema_;
+
+private:
+    bool TimestampLess(const ResultBuffer &result, int sort,
+                       size_t lhs, size_t rhs) {
+        int timestamp(schema_->Find(g_viz_constants.TIMESTAMP));
+        uint64_t lts(result[lhs].GetUint64(timestamp));
+        uint64_t rts(result[rhs].GetUint64(timestamp));
+        return sort == ASCENDING ? lts < rts : rts < lts;
+    }
+};
+
+// The sort is not stable, only the timestamps are in a set order
+TEST_F(PostProcessingTest, SortResult) {
+    const int sorts[] = { ASCENDING, DESCENDING };
+    const size_t sizes[] = { 1000, 3 * kParallelSortRows };
+    for (size_t i = 0; i < sizeof(sorts) / sizeof(sorts[0]); i++) {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            boost::scoped_ptr<AnalyticsQuery> q(SortedQuery(sorts[i], 0));
+            ResultBuffer result(schema_);
+            AddRows(&result, 0, sizes[j]);
+            ResultBuffer expected(result);
+            StableSort(&expected, sorts[i]);
+
+            q->postprocess_->sort_result(result);
+            EXPECT_TRUE(Timestamps(expected) == Timestamps(result));
+            EXPECT_TRUE(Levels(expected) == Levels(result));
+        }
+    }
+}
+
+// As a stable sort, the merge keeps the rows of the first run first on
+// equal timestamps, below and above the rows merged in parallel
+TEST_F(PostProcessingTest, MergeSortedResult) {
+    const int sorts[] = { ASCENDING, DESCENDING };
+    const size_t sizes[] = { 1000, 3 * kParallelSortRows };
+    for (size_t i = 0; i < sizeof(sorts) / sizeof(sorts[0]); i++) {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            // Smaller and larger first runs
+            const size_t mids[] = { 0, sizes[j] / 4, sizes[j] / 2,
+                                    sizes[j] * 3 / 4, sizes[j] };
+            for (size_t k = 0; k < sizeof(mids) / sizeof(mids[0]); k++) {
+                boost::scoped_ptr<AnalyticsQuery> q(
+                    SortedQuery(sorts[i], 0));
+                ResultBuffer first(schema_), second(schema_);
+                AddRows(&first, 0, mids[k]);
+                AddRows(&second, mids[k], sizes[j] - mids[k]);
+                StableSort(&first, sorts[i]);
+                StableSort(&second, sorts[i]);
+                ResultBuffer result(schema_);
+                result.Append(first);
+                result.Append(second);
+                ResultBuffer expected(result);
+                StableSort(&expected, sorts[i]);
+
+                q->postprocess_->merge_sorted_result(result, mids[k]);
+                EXPECT_TRUE(Rows(expected) == Rows(result)) <<
+                    "sort " << sorts[i] << " rows " << sizes[j] <<
+                    " first run " << mids[k];
+            }
+        }
+    }
+}
+
+// A sorted query with a limit returns the first rows of the fully sorted
+// result, SELECT and the chunk merges dropping the rows past the limit
+// early when there is no filter
+TEST_F(PostProcessingTest, SortedLimit) {
+    const int sorts[] = { ASCENDING, DESCENDING };
+    // Below and above the rows SELECT keeps before it selects the first
+    // top_k rows
+    const int limits[] = { 10, 3000 };
+    const std::string filters[] = { std::string(),
+        "[[{\"name\": \"Source\", \"value\": \"b1s2\", \"op\": 2}]]" };
+    const size_t kBatches = 3, kChunks = 2, kRows = 7000;
+    for (size_t i = 0; i < sizeof(sorts) / sizeof(sorts[0]); i++) {
+        for (size_t j = 0; j < sizeof(limits) / sizeof(limits[0]); j++) {
+            for (size_t k = 0; k < sizeof(filters) / sizeof(filters[0]);
+                 k++) {
+                boost::scoped_ptr<AnalyticsQuery> q(
+                    SortedQuery(sorts[i], limits[j], filters[k]));
+                ASSERT_EQ(0, q->status_details);
+                // A filter may remove any of the first rows of a chunk
+                EXPECT_EQ(filters[k].empty() ? size_t(limits[j]) : 0,
+                          q->postprocess_->top_k());
+
+                ResultBuffer all(schema_);
+                AddRows(&all, 0, kBatches * kChunks * kRows);
+                std::vector<std::string> sources(Sources(all));
+                std::vector<size_t> filtered;
+                for (size_t row = 0; row < all.size(); row++) {
+                    if (filters[k].empty() || sources[row] != "b1s2") {
+                        filtered.push_back(row);
+                    }
+                }
+                all.Select(filtered);
+                ResultBuffer expected(all);
+                StableSort(&expected, sorts[i]);
+                expected.Truncate(limits[j]);
+
+                ResultBuffer result;
+                RunQuery(sorts[i], limits[j], filters[k], kBatches,
+                         kChunks, kRows, &result);
+                EXPECT_TRUE(Timestamps(expected) == Timestamps(result)) <<
+                    "sort " << sorts[i] << " limit " << limits[j] <<
+                    " filter " << filters[k];
+                sources = Sources(result);
+                EXPECT_TRUE(filters[k].empty() ||
+                    std::find(sources.begin(), sources.end(), "b1s2") ==
+                    sources.end());
+            }
+        }
+    }
+}
+
+// The final merge of a query that failed to parse fails
+TEST_F(PostProcessingTest, FinalMergeParseError) {
+    boost::scoped_ptr<AnalyticsQuery> q(SortedQuery(ASCENDING, 10,
+        "[[{\"name\": \"Source\", \"value\": \"b1s2\"}]]"));
+    EXPECT_NE(0, q->postprocess_->status_details);
+
+    std::vector<boost::shared_ptr<ResultBuffer> > inputs;
+    inputs.push_back(boost::shared_ptr<ResultBuffer>(
+        new ResultBuffer(schema_)));
+    AddRows(inputs.back().get(), 0, 100);
+    ResultBuffer result;
+    EXPECT_FALSE(q->postprocess_->final_merge_processing(inputs, result));
+}
+
 int main(int argc, char **argv) {
     LoggingInit();
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <testing/gunit.h>
+#include <boost/assign/list_of.hpp>
+#include <base/logging.h>
+#include <analytics/viz_constants.h>
+#include "../result_buffer.h"
+
+using boost::assign::list_of;
+using boost::assign::map_list_of;
+
+class ResultBufferTest : public ::testing::Test {
+protected:
+    ResultBufferTest() :
+        schema_(new ResultSchema(g_viz_constants.MESSAGE_TABLE,
+            list_of(g_viz_constants.TIMESTAMP)(g_viz_constants.SOURCE)
+                (g_viz_constants.LEVEL)(g_viz_constants.SOURCE)
+                ("COUNT(Source)"))) {
+    }
+
+    // Adds a row, in the order of the columns of schema_
+    void AddRow(ResultBuffer *buffer, uint64_t timestamp,
+                const std::string &source) {
+        size_t row(buffer->AddRow());
+        buffer->Set(row, 0, GenDb::DbDataValue(timestamp));
+        buffer->Set(row, 1, GenDb::DbDataValue(source));
+    }
+
+    ResultSchemaPtr schema_;
+};
+
+TEST_F(ResultBufferTest, Schema) {
+    ASSERT_EQ(4, schema_->size());
+    // Sorted by name, without duplicates
+    EXPECT_EQ("COUNT(Source)", schema_->name(0));
+    EXPECT_EQ(ResultSchema::UINT64, schema_->type(0));
+    EXPECT_EQ(ResultSchema::UINT64,
+              schema_->type(schema_->Find(g_viz_constants.LEVEL)));
+    EXPECT_EQ(ResultSchema::STRING,
+              schema_->type(schema_->Find(g_viz_constants.SOURCE)));
+    EXPECT_EQ(ResultSchema::UINT64,
+              schema_->type(schema_->Find(g_viz_constants.TIMESTAMP)));
+    EXPECT_EQ(-1, schema_->Find(g_viz_constants.MODULE));
+}
+
+TEST_F(ResultBufferTest, Values) {
+    ResultBuffer buffer(schema_);
+    int source(schema_->Find(g_viz_constants.SOURCE));
+    int level(schema_->Find(g_viz_constants.LEVEL));
+    int timestamp(schema_->Find(g_viz_constants.TIMESTAMP));
+
+    size_t row(buffer.AddRow());
+    buffer.Set(row, timestamp, GenDb::DbDataValue(uint64_t(1368037623434740)));
+    buffer.Set(row, level, GenDb::DbDataValue(uint32_t(6)));
+    buffer.Set(row, source, GenDb::DbDataValue(std::string("b1s1")));
+    row = buffer.AddRow();
+    buffer.SetText(row, timestamp, "1368037623434741");
+    // Not an integer that prints back the same
+    buffer.SetText(row, level, "06");
+    buffer.Set(row, source, GenDb::DbDataValue());
+    ASSERT_EQ(2, buffer.size());
+
+    ResultBuffer::Row row0(buffer.row(0));
+    EXPECT_FALSE(row0.Has(0));
+    EXPECT_FALSE(row0.IsText(timestamp));
+    EXPECT_EQ(1368037623434740ULL, row0.GetUint64(timestamp));
+    EXPECT_EQ("1368037623434740", row0.GetString(timestamp));
+    EXPECT_EQ(6, row0.GetUint64(level));
+    EXPECT_TRUE(row0.IsText(source));
+    EXPECT_EQ("b1s1", row0.GetText(source));
+
+    ResultBuffer::Row row1(buffer.row(1));
+    EXPECT_FALSE(row1.IsText(timestamp));
+    EXPECT_EQ(1368037623434741ULL, row1.GetUint64(timestamp));
+    EXPECT_TRUE(row1.IsText(level));
+    EXPECT_EQ("06", row1.GetString(level));
+    EXPECT_TRUE(row1.Has(source));
+    EXPECT_EQ("", row1.GetString(source));
+
+    buffer.PopRow();
+    EXPECT_EQ(1, buffer.size());
+}
+
+TEST_F(ResultBufferTest, AppendRow) {
+    ResultBuffer buffer(schema_);
+    std::map<std::string, std::string> values = map_list_of
+        (g_viz_constants.SOURCE, "b1s1")
+        (g_viz_constants.TIMESTAMP, "10")
+        (g_viz_constants.MODULE, "ControlNode");
+    buffer.AppendRow(values);
+    ASSERT_EQ(1, buffer.size());
+    int timestamp(schema_->Find(g_viz_constants.TIMESTAMP));
+    EXPECT_FALSE(buffer[0].IsText(timestamp));
+    EXPECT_EQ(10, buffer[0].GetUint64(timestamp));
+    EXPECT_EQ("b1s1", buffer[0].GetString(
+        schema_->Find(g_viz_constants.SOURCE)));
+    EXPECT_FALSE(buffer[0].Has(schema_->Find(g_viz_constants.LEVEL)));
+}
+
+TEST_F(ResultBufferTest, Append) {
+    ResultSchemaPtr schema(new ResultSchema(g_viz_constants.MESSAGE_TABLE,
+        list_of(g_viz_constants.TIMESTAMP)(g_viz_constants.SOURCE)));
+    ResultBuffer buffer1(schema), buffer2(schema);
+    AddRow(&buffer1, 1, "b1s1");
+    AddRow(&buffer1, 2, "b1s2");
+    AddRow(&buffer2, 3, "b1s1");
+
+    ResultBuffer output;
+    output.Append(buffer1);
+    output.Append(buffer2);
+    ASSERT_EQ(3, output.size());
+    EXPECT_EQ(3, output[2].GetUint64(0));
+    EXPECT_EQ("b1s1", output[2].GetText(1));
+
+    // Columns are matched by name across schemas
+    ResultBuffer buffer3(schema_);
+    int source(schema_->Find(g_viz_constants.SOURCE));
+    size_t row(buffer3.AddRow());
+    buffer3.SetText(row, source, "b1s3");
+    output.Append(buffer3);
+    ASSERT_EQ(4, output.size());
+    EXPECT_FALSE(output[3].Has(0));
+    EXPECT_EQ("b1s3", output[3].GetText(1));
+}
+
+TEST_F(ResultBufferTest, Select) {
+    ResultSchemaPtr schema(new ResultSchema(g_viz_constants.MESSAGE_TABLE,
+        list_of(g_viz_constants.TIMESTAMP)(g_viz_constants.SOURCE)));
+    ResultBuffer buffer(schema);
+    std::string long_source(1000, 'x');
+    AddRow(&buffer, 1, "b1s1");
+    AddRow(&buffer, 2, long_source);
+    AddRow(&buffer, 3, "b1s1");
+    AddRow(&buffer, 4, "b1s2");
+
+    std::vector<size_t> rows = list_of(3)(1)(0);
+    buffer.Select(rows);
+    ASSERT_EQ(3, buffer.size());
+    EXPECT_EQ(4, buffer[0].GetUint64(0));
+    EXPECT_EQ("b1s2", buffer[0].GetText(1));
+    EXPECT_EQ(long_source, buffer[1].GetText(1));
+    EXPECT_EQ("b1s1", buffer[2].GetText(1));
+
+    // The strings are still interned after a selection
+    AddRow(&buffer, 5, "b1s1");
+    EXPECT_EQ(&buffer[2].GetText(1), &buffer[3].GetText(1));
+
+    buffer.Truncate(2);
+    ASSERT_EQ(2, buffer.size());
+    EXPECT_EQ(2, buffer[1].GetUint64(0));
+    buffer.Truncate(10);
+    EXPECT_EQ(2, buffer.size());
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
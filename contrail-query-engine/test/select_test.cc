@@ -5,8 +5,12 @@
 #include "testing/gunit.h"
 
 #include "query.h"
+#include "stats_select.h"
+#include "stat_table_attribute_decoder.h"
 #include "analytics_query_mock.h"
+#include <boost/assign/list_of.hpp>
 #include <boost/uuid/uuid.hpp>
+#include "rapidjson/document.h"
 
 using ::testing::_;
 using ::testing::Return;
@@ -51,12 +55,12 @@ public:
     bool test_process_object_query_specific_select_params(
                         const std::string& sel_field,
                         std::map<std::string, GenDb::DbDataValue>& col_res_map,
-                        std::map<std::string, std::string>& cmap,
+                        std::string *value,
                         const boost::uuids::uuid& uuid,
                         std::map<boost::uuids::uuid, std::string>&
                         uuid_to_objid_map, SelectQuery *sq) {
          return sq->process_object_query_specific_select_params(sel_field,
-             col_res_map, cmap, uuid, uuid_to_objid_map);
+             col_res_map, value, uuid, uuid_to_objid_map);
     }
 };
 
@@ -142,25 +146,222 @@ TEST_F(SelectTest, TestProcessObjectQuerySelectParams) {
     GenDb::DbDataValue sandesh_type;
     sandesh_type=(uint32_t)7; // corresposnds to SandeshType::Object
     col_res_map.insert(std::make_pair("Type",sandesh_type));
-    std::map<std::string, std::string> cmap;
+    std::string value;
     boost::uuids::random_generator rgen_;
     boost::uuids::uuid unm(rgen_());
     // This is the map looked up to get the object id based on uuid
     std::map<boost::uuids::uuid, std::string> uuid_to_objectid;
     uuid_to_objectid.insert(std::make_pair(unm, "id1"));
     if(test_process_object_query_specific_select_params(select_field,
-        col_res_map, cmap, unm, uuid_to_objectid, select_query)) {
-        std::map<std::string, std::string>::iterator cit;
-        cit = cmap.find(select_field);
-        ASSERT_TRUE(cit != cmap.end());
-        std::string actual_val = cit->second;
-        EXPECT_EQ(actual_val, "id1");
+        col_res_map, &value, unm, uuid_to_objectid, select_query)) {
+        EXPECT_EQ(value, "id1");
    } else {
         ASSERT_TRUE(0);
    }
 
 }
 
+//
+// The entries the stat table attribute decoder passes to LoadRow are
+// checked against the entries of the Document based decoding it replaced,
+// less the ones LoadRow does not use.
+//
+class StatTableAttributeDecoderTest : public ::testing::Test {
+public:
+    typedef std::vector<StatsSelect::StatEntry> EntriesT;
+
+    StatTableAttributeDecoderTest() :
+        stats_(NULL, boost::assign::list_of<std::string>
+            ("name")("SUM(cpu)")("MAX(count)")("ifs")("tags.color")
+            ("all")("COUNT(name)")),
+        decoder_(&stats_) {
+    }
+
+    // Decodes the row with the decoder reused across the rows
+    bool Decode(const std::string &json, EntriesT *attribs) {
+        std::string row(json);
+        return decoder_.Decode(&row, attribs);
+    }
+
+    // Decodes the row into a Document, then into entries for all of its
+    // attributes, and keeps the entries LoadRow uses
+    bool DocumentDecode(const std::string &json, EntriesT *attribs) {
+        attribs->clear();
+        contrail_rapidjson::Document d;
+        if (d.Parse<0>(json.c_str()).HasParseError()) {
+            return false;
+        }
+        EntriesT all;
+        for (contrail_rapidjson::Value::ConstMemberIterator itr =
+                d.MemberBegin(); itr != d.MemberEnd(); ++itr) {
+            std::string fvname(itr->name.GetString());
+            char tname = fvname[fvname.length()-1];
+            StatsSelect::StatEntry se;
+            se.name = fvname.substr(0, fvname.length()-2);
+            if (tname == 's') {
+                se.value = std::string(itr->value.GetString());
+            } else if (tname == 'n') {
+                if (itr->value.IsUint()) {
+                    se.value = (uint64_t)itr->value.GetUint();
+                } else {
+                    se.value = (uint64_t)itr->value.GetUint64();
+                }
+            } else if (tname == 'd') {
+                se.value = (double)itr->value.GetDouble();
+            } else if (tname == 'a') {
+                std::ostringstream a_val;
+                size_t i = 0;
+                for (contrail_rapidjson::Value::ConstValueIterator it =
+                        itr->value.Begin(); it != itr->value.End(); ++it) {
+                    if (i) {
+                        a_val << "; ";
+                    }
+                    a_val << it->GetString();
+                    i++;
+                }
+                se.value = a_val.str();
+            } else if (tname == 'm') {
+                std::ostringstream map_oss;
+                map_oss << "{";
+                size_t i = 0;
+                for (contrail_rapidjson::Value::ConstMemberIterator it =
+                        itr->value.MemberBegin();
+                     it != itr->value.MemberEnd(); ++it) {
+                    StatsSelect::StatEntry entry;
+                    entry.name = se.name + "." + it->name.GetString();
+                    entry.value = std::string(it->value.GetString());
+                    if (i) {
+                        map_oss << ", ";
+                    }
+                    map_oss << "\"" << it->name.GetString() << "\"" << ":"
+                            << "\"" << it->value.GetString() << "\"";
+                    all.push_back(entry);
+                    i++;
+                }
+                map_oss << "}";
+                se.value = map_oss.str();
+            }
+            all.push_back(se);
+        }
+        for (size_t i = 0; i < all.size(); i++) {
+            if (stats_.IsLoaded(all[i].name)) {
+                attribs->push_back(all[i]);
+            }
+        }
+        return true;
+    }
+
+    // Decodes the row, then expected, the row less the attributes the
+    // Document based decoding cannot decode, and compares the entries
+    void ExpectDecode(const std::string &json, const std::string &expected,
+                      EntriesT *attribs) {
+        ASSERT_TRUE(Decode(json, attribs)) << json;
+        EntriesT expected_attribs;
+        ASSERT_TRUE(DocumentDecode(expected, &expected_attribs));
+        ASSERT_EQ(expected_attribs.size(), attribs->size()) << json;
+        for (size_t i = 0; i < attribs->size(); i++) {
+            EXPECT_EQ(expected_attribs[i].name, (*attribs)[i].name) << json;
+            EXPECT_TRUE(expected_attribs[i].value == (*attribs)[i].value) <<
+                json << " " << (*attribs)[i].name;
+        }
+    }
+    void ExpectDecode(const std::string &json, EntriesT *attribs) {
+        ExpectDecode(json, json, attribs);
+    }
+
+    StatsSelect stats_;
+    StatTableAttributeDecoder decoder_;
+};
+
+TEST_F(StatTableAttributeDecoderTest, Scalars) {
+    EntriesT attribs;
+    ExpectDecode("{\"name|s\":\"vr1\", \"skip|s\":\"x\", \"cpu|d\":0.5, "
+        "\"count|n\":4294967296, \"other|n\":3, \"load|d\":2}", &attribs);
+    ASSERT_EQ(3, attribs.size());
+    EXPECT_EQ("count", attribs[2].name);
+    EXPECT_TRUE(StatsSelect::StatVal(uint64_t(4294967296ULL)) ==
+                attribs[2].value);
+    // A double written as an integer
+    ExpectDecode("{\"cpu|d\":5, \"count|n\":3}", &attribs);
+    ExpectDecode("{\"cpu|d\":-2}", &attribs);
+}
+
+// Nested values of the attributes LoadRow does not use are skipped, the
+// Document based decoding could not decode them
+TEST_F(StatTableAttributeDecoderTest, SkippedNested) {
+    EntriesT attribs;
+    ExpectDecode("{\"name|s\":\"vr1\", "
+        "\"nested|m\":{\"x\":{\"y\":[1, {\"z\":null}]}}, "
+        "\"flag|s\":true, \"big|a\":[\"a\", [\"b\"]], \"cpu|d\":1.5}",
+        "{\"name|s\":\"vr1\", \"cpu|d\":1.5}", &attribs);
+    EXPECT_EQ(2, attribs.size());
+}
+
+// Only the name.key entries LoadRow uses are decoded from tags
+TEST_F(StatTableAttributeDecoderTest, MapPrefix) {
+    EntriesT attribs;
+    ExpectDecode("{\"tags|m\":{\"size\":\"l\", \"color\":\"red\"}, "
+        "\"other|m\":{\"color\":\"blue\"}}", &attribs);
+    ASSERT_EQ(1, attribs.size());
+    EXPECT_EQ("tags.color", attribs[0].name);
+    ExpectDecode("{\"tags|m\":{}}", &attribs);
+    EXPECT_TRUE(attribs.empty());
+}
+
+TEST_F(StatTableAttributeDecoderTest, Map) {
+    EntriesT attribs;
+    ExpectDecode("{\"all|m\":{\"a\":\"1\", \"b\":\"2\"}}", &attribs);
+    ASSERT_EQ(1, attribs.size());
+    EXPECT_TRUE(StatsSelect::StatVal(std::string(
+        "{\"a\":\"1\", \"b\":\"2\"}")) == attribs[0].value);
+    ExpectDecode("{\"all|m\":{}}", &attribs);
+}
+
+TEST_F(StatTableAttributeDecoderTest, List) {
+    EntriesT attribs;
+    ExpectDecode("{\"ifs|a\":[\"eth0\", \"eth1\", \"eth2\"]}", &attribs);
+    ASSERT_EQ(1, attribs.size());
+    EXPECT_TRUE(StatsSelect::StatVal(std::string("eth0; eth1; eth2")) ==
+                attribs[0].value);
+    ExpectDecode("{\"ifs|a\":[]}", &attribs);
+}
+
+// A malformed row is skipped, and does not affect the next row
+TEST_F(StatTableAttributeDecoderTest, Malformed) {
+    EntriesT attribs, expected_attribs;
+    const char *rows[] = {
+        "{\"name|s\":\"vr1\"",
+        "{\"name|s\":\"vr1\",}",
+        "",
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        EXPECT_FALSE(DocumentDecode(rows[i], &expected_attribs)) << rows[i];
+        EXPECT_FALSE(Decode(rows[i], &attribs)) << rows[i];
+        ExpectDecode("{\"name|s\":\"vr1\", \"ifs|a\":[\"eth0\"]}", &attribs);
+    }
+    // Not an object, the Document based decoding asserted on it
+    EXPECT_FALSE(Decode("[\"name|s\"]", &attribs));
+    // A value not of the type of the attribute
+    EXPECT_FALSE(Decode("{\"name|s\":5}", &attribs));
+    EXPECT_FALSE(Decode("{\"count|n\":\"5\"}", &attribs));
+    EXPECT_FALSE(Decode("{\"ifs|a\":[1]}", &attribs));
+    EXPECT_FALSE(Decode("{\"all|m\":{\"a\":[\"1\"]}}", &attribs));
+}
+
+// The entries of a row are reused by the next row
+TEST_F(StatTableAttributeDecoderTest, FewerAttributes) {
+    EntriesT attribs;
+    ExpectDecode("{\"name|s\":\"vr1\", \"cpu|d\":0.5, \"count|n\":4, "
+        "\"ifs|a\":[\"eth0\"], \"tags|m\":{\"color\":\"red\"}, "
+        "\"all|m\":{\"a\":\"1\"}}", &attribs);
+    EXPECT_EQ(6, attribs.size());
+    // Entries of other types in place of the previous ones
+    ExpectDecode("{\"count|n\":3, \"name|s\":\"vr2\"}", &attribs);
+    EXPECT_EQ(2, attribs.size());
+    ExpectDecode("{}", &attribs);
+    EXPECT_TRUE(attribs.empty());
+}
+
 int main(int argc, char **argv) {
     LoggingInit();
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <testing/gunit.h>
+#include <base/logging.h>
+#include "query.h"
+
+//
+// op_and and op_or are checked against std::set_intersection and
+// std::set_union, applied to the inputs in order. A row of the first
+// input has a single value, the rows of the other inputs have a second
+// one. Rows compare on the values both have, so that a row of the first
+// input is equal to, but can be told apart from, a row of another.
+//
+class SetOperationTest : public ::testing::Test {
+protected:
+    virtual void TearDown() {
+        SetOperationUnit::max_parts_ = 0;
+    }
+
+    // Adds the row of the input to rows
+    void AddRow(WhereResultT *rows, uint64_t timestamp, uint32_t value,
+                size_t input) {
+        GenDb::DbDataValueVec values;
+        values.push_back(value);
+        if (input) {
+            values.push_back(uint32_t(1));
+        }
+        query_result_unit_t row;
+        row.timestamp = timestamp;
+        row.info = arena_.Build(values);
+        rows->push_back(row);
+    }
+
+    // Adds count sorted rows, the rows of a timestamp having a few values
+    void AddRows(WhereResultT *rows, size_t count, uint64_t timestamps,
+                 size_t input) {
+        WhereResultT added;
+        for (size_t i = 0; i < count; i++) {
+            AddRow(&added, rand() % timestamps, rand() % 4, input);
+        }
+        std::sort(added.begin(), added.end());
+        rows->insert(rows->end(), added.begin(), added.end());
+    }
+
+    WhereResultT Intersection(const std::vector<WhereResultT*> &inputs) {
+        WhereResultT res;
+        if (inputs.empty()) {
+            return res;
+        }
+        res = *inputs[0];
+        for (size_t i = 1; i < inputs.size(); i++) {
+            WhereResultT prev;
+            prev.swap(res);
+            std::set_intersection(prev.begin(), prev.end(),
+                inputs[i]->begin(), inputs[i]->end(),
+                std::back_inserter(res));
+        }
+        return res;
+    }
+
+    WhereResultT Union(const std::vector<WhereResultT*> &inputs) {
+        WhereResultT res;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            WhereResultT prev;
+            prev.swap(res);
+            std::set_union(prev.begin(), prev.end(),
+                inputs[i]->begin(), inputs[i]->end(),
+                std::back_inserter(res));
+        }
+        return res;
+    }
+
+    // Whether the rows are equal and taken from the same inputs
+    static bool Same(const WhereResultT &lhs, const WhereResultT &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (lhs[i] < rhs[i] || rhs[i] < lhs[i] ||
+                lhs[i].info.size() != rhs[i].info.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ExpectSetOps(const std::vector<WhereResultT*> &inputs) {
+        WhereResultT res;
+        SetOperationUnit::op_and("TEST-QUERY", res, inputs);
+        EXPECT_TRUE(Same(Intersection(inputs), res));
+        SetOperationUnit::op_or("TEST-QUERY", res, inputs);
+        EXPECT_TRUE(Same(Union(inputs), res));
+    }
+
+    WhereRowArena arena_;
+};
+
+// A row n times in an input and m times in another is min(n, m)
+// times in the intersection and max(n, m) times in the union
+TEST_F(SetOperationTest, Duplicates) {
+    WhereResultT rows1, rows2;
+    AddRow(&rows1, 1, 0, 0);
+    AddRow(&rows1, 1, 0, 0);
+    AddRow(&rows1, 1, 0, 0);
+    AddRow(&rows1, 2, 0, 0);
+    AddRow(&rows1, 3, 0, 0);
+    AddRow(&rows1, 3, 0, 0);
+    AddRow(&rows2, 1, 0, 1);
+    AddRow(&rows2, 1, 0, 1);
+    AddRow(&rows2, 3, 0, 1);
+    AddRow(&rows2, 3, 0, 1);
+    AddRow(&rows2, 3, 0, 1);
+    AddRow(&rows2, 4, 0, 1);
+    std::vector<WhereResultT*> inputs;
+    inputs.push_back(&rows1);
+    inputs.push_back(&rows2);
+
+    WhereResultT res;
+    SetOperationUnit::op_and("TEST-QUERY", res, inputs);
+    EXPECT_EQ(4, res.size());
+    EXPECT_TRUE(Same(Intersection(inputs), res));
+    SetOperationUnit::op_or("TEST-QUERY", res, inputs);
+    EXPECT_EQ(8, res.size());
+    EXPECT_TRUE(Same(Union(inputs), res));
+}
+
+// Rows equal across inputs are taken from the first input if it has them,
+// whatever the order of the input sizes
+TEST_F(SetOperationTest, FirstInput) {
+    srand(1);
+    for (size_t i = 0; i < 3; i++) {
+        WhereResultT rows[3];
+        std::vector<WhereResultT*> inputs;
+        for (size_t j = 0; j < 3; j++) {
+            AddRows(&rows[j], 50 + 200 * ((i + j) % 3), 20, j);
+            inputs.push_back(&rows[j]);
+        }
+        ExpectSetOps(inputs);
+    }
+}
+
+TEST_F(SetOperationTest, Empty) {
+    WhereResultT res, rows, empty;
+    AddRows(&rows, 100, 20, 0);
+    std::vector<WhereResultT*> inputs;
+    SetOperationUnit::op_and("TEST-QUERY", res, inputs);
+    EXPECT_TRUE(res.empty());
+    SetOperationUnit::op_or("TEST-QUERY", res, inputs);
+    EXPECT_TRUE(res.empty());
+
+    inputs.push_back(&empty);
+    ExpectSetOps(inputs);
+    inputs.push_back(&rows);
+    ExpectSetOps(inputs);
+    std::swap(inputs[0], inputs[1]);
+    ExpectSetOps(inputs);
+}
+
+// Large inputs are split into time ranges at the timestamps of the rows
+// of one of the inputs, the rows of a timestamp staying in the same range
+TEST_F(SetOperationTest, Partitioned) {
+    SetOperationUnit::max_parts_ = 8;
+    srand(1);
+    WhereResultT rows[3];
+    std::vector<WhereResultT*> inputs;
+    for (size_t i = 0; i < 3; i++) {
+        // Many rows per timestamp, the largest input being the second
+        AddRows(&rows[i], 100 * 1000 + 20 * 1000 * (i % 2), 1000, i);
+        inputs.push_back(&rows[i]);
+    }
+    ExpectSetOps(inputs);
+    // The smallest input is the last
+    rows[2].resize(rows[2].size() / 2);
+    ExpectSetOps(inputs);
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <testing/gunit.h>
+#include <boost/uuid/random_generator.hpp>
+#include <base/logging.h>
+#include "../where_row.h"
+
+class WhereRowTest : public ::testing::Test {
+protected:
+    WhereRow Build(const GenDb::DbDataValueVec &values) {
+        return arena_.Build(values);
+    }
+
+    WhereRowArena arena_;
+};
+
+TEST_F(WhereRowTest, Values) {
+    boost::uuids::random_generator rgen;
+    GenDb::DbDataValueVec values;
+    values.push_back(GenDb::DbDataValue());
+    values.push_back(std::string("ObjectVNTable:vn1"));
+    values.push_back(rgen());
+    values.push_back(uint8_t(1));
+    values.push_back(uint16_t(8080));
+    values.push_back(uint32_t(1368037623));
+    values.push_back(uint64_t(1368037623434740ULL));
+    values.push_back(0.5);
+    values.push_back(IpAddress(boost::asio::ip::address_v4(0x0a000001)));
+    values.push_back(IpAddress(
+        boost::asio::ip::address_v6::from_string("fe80::1")));
+    values.push_back(std::string(""));
+    WhereRow row(Build(values));
+    ASSERT_EQ(values.size(), row.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(values[i].which(), row.which(i));
+        EXPECT_TRUE(values[i] == row.at(i));
+    }
+    EXPECT_THROW(row.at(values.size()), std::out_of_range);
+
+    WhereRow empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_TRUE(Build(GenDb::DbDataValueVec()).empty());
+}
+
+TEST_F(WhereRowTest, Compare) {
+    std::vector<GenDb::DbDataValueVec> values(4);
+    values[0].push_back(uint32_t(2));
+    values[0].push_back(std::string("b1s1"));
+    values[1].push_back(uint32_t(2));
+    values[1].push_back(std::string("b1s10"));
+    values[2].push_back(uint32_t(10));
+    values[2].push_back(std::string("a"));
+    values[3].push_back(std::string("a"));
+    std::vector<WhereRow> rows;
+    for (size_t i = 0; i < values.size(); i++) {
+        rows.push_back(Build(values[i]));
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        for (size_t j = 0; j < rows.size(); j++) {
+            EXPECT_EQ(values[i] < values[j], rows[i] < rows[j]);
+        }
+    }
+    // Only the values of the shorter row are compared
+    GenDb::DbDataValueVec prefix(values[0].begin(), values[0].begin() + 1);
+    WhereRow row(Build(prefix));
+    EXPECT_FALSE(row < rows[0]);
+    EXPECT_FALSE(rows[0] < row);
+}
+
+TEST_F(WhereRowTest, Blocks) {
+    // Rows outlive their arena, and rows larger than a block get a block
+    // of their own
+    std::vector<WhereRow> rows;
+    {
+        WhereRowArena arena;
+        for (int i = 0; i < 1000; i++) {
+            arena.Add(uint64_t(i));
+            arena.Add(std::string(i % 100 ? 100 : 100000, 'x'));
+            rows.push_back(arena.Build());
+        }
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        EXPECT_TRUE(GenDb::DbDataValue(uint64_t(i)) == rows[i].at(0));
+        EXPECT_TRUE(GenDb::DbDataValue(std::string(i % 100 ? 100 : 100000,
+            'x')) == rows[i].at(1));
+    }
+    WhereRow row(rows[1]);
+    rows.clear();
+    EXPECT_TRUE(GenDb::DbDataValue(uint64_t(1)) == row.at(0));
+}
+
+int main(int argc, char **argv) {
+    LoggingInit();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include <base/address.h>
+
+#include "where_row.h"
+
+WhereRowBlock *WhereRowBlock::Create(size_t size) {
+    void *memory = malloc(sizeof(WhereRowBlock) + size);
+    if (memory == NULL) {
+        throw std::bad_alloc();
+    }
+    WhereRowBlock *block = new (memory) WhereRowBlock;
+    block->refcount_ = 0;
+    block->size_ = size;
+    return block;
+}
+
+void intrusive_ptr_add_ref(WhereRowBlock *block) {
+    block->refcount_.fetch_and_increment();
+}
+
+void intrusive_ptr_release(WhereRowBlock *block) {
+    if (block->refcount_.fetch_and_decrement() == 1) {
+        block->~WhereRowBlock();
+        free(block);
+    }
+}
+
+namespace {
+
+void AppendUint32(std::string *bytes, uint32_t value) {
+    // Big endian, so that the bytes compare as the value
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        bytes->push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+uint32_t ReadUint32(const char *bytes) {
+    const uint8_t *ubytes = reinterpret_cast<const uint8_t *>(bytes);
+    return (uint32_t(ubytes[0]) << 24) | (uint32_t(ubytes[1]) << 16) |
+        (uint32_t(ubytes[2]) << 8) | uint32_t(ubytes[3]);
+}
+
+// Addresses are encoded as their version followed by their bytes, so that
+// the encoded addresses compare as IpAddress does
+const char kInet4 = 4;
+const char kInet6 = 6;
+
+}  // namespace
+
+class WhereRowEncoder : public boost::static_visitor<> {
+public:
+    explicit WhereRowEncoder(WhereRowArena *arena) : arena_(arena) {
+    }
+
+    void operator()(const boost::blank &value) const {
+        arena_->slots_.push_back(0);
+    }
+    void operator()(const std::string &value) const {
+        AddBytes(value.data(), value.size());
+    }
+    void operator()(const boost::uuids::uuid &value) const {
+        AddBytes(reinterpret_cast<const char *>(value.data), value.size());
+    }
+    void operator()(const uint8_t &value) const {
+        arena_->slots_.push_back(value);
+    }
+    void operator()(const uint16_t &value) const {
+        arena_->slots_.push_back(value);
+    }
+    void operator()(const uint32_t &value) const {
+        arena_->slots_.push_back(value);
+    }
+    void operator()(const uint64_t &value) const {
+        arena_->slots_.push_back(value);
+    }
+    void operator()(const double &value) const {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        arena_->slots_.push_back(bits);
+    }
+    void operator()(const IpAddress &value) const {
+        std::string bytes;
+        if (value.is_v4()) {
+            bytes.push_back(kInet4);
+            AppendUint32(&bytes, value.to_v4().to_ulong());
+        } else {
+            boost::asio::ip::address_v6 v6(value.to_v6());
+            boost::asio::ip::address_v6::bytes_type addr(v6.to_bytes());
+            bytes.push_back(kInet6);
+            bytes.append(reinterpret_cast<const char *>(addr.data()),
+                         addr.size());
+            AppendUint32(&bytes, v6.scope_id());
+        }
+        AddBytes(bytes.data(), bytes.size());
+    }
+    void operator()(const GenDb::Blob &value) const {
+        AddBytes(reinterpret_cast<const char *>(value.data()), value.size());
+    }
+
+private:
+    void AddBytes(const char *data, size_t size) const {
+        uint64_t offset = arena_->bytes_.size();
+        arena_->bytes_.append(data, size);
+        arena_->slots_.push_back((offset << 32) | size);
+    }
+
+    WhereRowArena *arena_;
+};
+
+GenDb::DbDataValue WhereRow::at(size_t index) const {
+    if (index >= size()) {
+        throw std::out_of_range("WhereRow::at");
+    }
+    uint64_t slot = slots()[index];
+    const char *data = bytes() + ByteOffset(slot);
+    size_t length = ByteLength(slot);
+    switch (tags()[index]) {
+    case GenDb::DB_VALUE_STRING:
+        return std::string(data, length);
+    case GenDb::DB_VALUE_UUID: {
+        boost::uuids::uuid value;
+        memcpy(value.data, data, value.size());
+        return value;
+    }
+    case GenDb::DB_VALUE_UINT8:
+        return static_cast<uint8_t>(slot);
+    case GenDb::DB_VALUE_UINT16:
+        return static_cast<uint16_t>(slot);
+    case GenDb::DB_VALUE_UINT32:
+        return static_cast<uint32_t>(slot);
+    case GenDb::DB_VALUE_UINT64:
+        return slot;
+    case GenDb::DB_VALUE_DOUBLE: {
+        double value;
+        memcpy(&value, &slot, sizeof(value));
+        return value;
+    }
+    case GenDb::DB_VALUE_INET:
+        if (data[0] == kInet4) {
+            return IpAddress(boost::asio::ip::address_v4(
+                ReadUint32(data + 1)));
+        } else {
+            boost::asio::ip::address_v6::bytes_type addr;
+            memcpy(addr.data(), data + 1, addr.size());
+            return IpAddress(boost::asio::ip::address_v6(addr,
+                ReadUint32(data + 1 + addr.size())));
+        }
+    case GenDb::DB_VALUE_BLOB:
+        return GenDb::Blob(reinterpret_cast<const uint8_t *>(data), length);
+    default:
+        return GenDb::DbDataValue();
+    }
+}
+
+int WhereRow::CompareValue(size_t index, const WhereRow &rhs) const {
+    int ltag = tags()[index];
+    int rtag = rhs.tags()[index];
+    if (ltag != rtag) {
+        return ltag < rtag ? -1 : 1;
+    }
+    uint64_t lslot = slots()[index];
+    uint64_t rslot = rhs.slots()[index];
+    switch (ltag) {
+    case GenDb::DB_VALUE_BLANK:
+        return 0;
+    case GenDb::DB_VALUE_UINT8:
+    case GenDb::DB_VALUE_UINT16:
+    case GenDb::DB_VALUE_UINT32:
+    case GenDb::DB_VALUE_UINT64:
+        return lslot < rslot ? -1 : (rslot < lslot ? 1 : 0);
+    case GenDb::DB_VALUE_DOUBLE: {
+        double lvalue, rvalue;
+        memcpy(&lvalue, &lslot, sizeof(lvalue));
+        memcpy(&rvalue, &rslot, sizeof(rvalue));
+        return lvalue < rvalue ? -1 : (rvalue < lvalue ? 1 : 0);
+    }
+    default: {
+        // Strings, uuids, addresses and blobs compare byte by byte
+        size_t llength = ByteLength(lslot);
+        size_t rlength = ByteLength(rslot);
+        int cmp = memcmp(bytes() + ByteOffset(lslot),
+                         rhs.bytes() + ByteOffset(rslot),
+                         std::min(llength, rlength));
+        if (cmp != 0) {
+            return cmp;
+        }
+        return llength < rlength ? -1 : (rlength < llength ? 1 : 0);
+    }
+    }
+}
+
+bool WhereRow::operator<(const WhereRow &rhs) const {
+    size_t count = std::min(size(), rhs.size());
+    for (size_t index = 0; index < count; index++) {
+        int cmp = CompareValue(index, rhs);
+        if (cmp != 0) {
+            return cmp < 0;
+        }
+    }
+    return false;
+}
+
+void WhereRow::swap(WhereRow &rhs) {
+    block_.swap(rhs.block_);
+    std::swap(data_, rhs.data_);
+}
+
+const size_t WhereRowArena::kMinBlockSize;
+const size_t WhereRowArena::kMaxBlockSize;
+
+WhereRowArena::WhereRowArena() :
+    used_(0),
+    next_size_(kMinBlockSize) {
+}
+
+void WhereRowArena::Add(const GenDb::DbDataValue &value) {
+    tags_.push_back(value.which());
+    boost::apply_visitor(WhereRowEncoder(this), value);
+}
+
+WhereRow WhereRowArena::Build() {
+    size_t count = tags_.size();
+    size_t size = sizeof(WhereRow::Header) + count * sizeof(uint64_t) +
+        count + bytes_.size();
+    // Keep the rows, and so their slots, aligned
+    size = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+    WhereRowBlock *block;
+    char *data;
+    if (size > kMaxBlockSize) {
+        // Too large to share a block
+        block = WhereRowBlock::Create(size);
+        data = block->data();
+    } else {
+        data = Allocate(size);
+        block = block_.get();
+    }
+    WhereRow::Header *header = reinterpret_cast<WhereRow::Header *>(data);
+    header->count = count;
+    header->bytes = bytes_.size();
+    char *cursor = reinterpret_cast<char *>(header + 1);
+    if (count) {
+        memcpy(cursor, &slots_[0], count * sizeof(uint64_t));
+        cursor += count * sizeof(uint64_t);
+        memcpy(cursor, &tags_[0], count);
+        cursor += count;
+    }
+    memcpy(cursor, bytes_.data(), bytes_.size());
+
+    slots_.clear();
+    tags_.clear();
+    bytes_.clear();
+    return WhereRow(block, data);
+}
+
+WhereRow WhereRowArena::Build(const GenDb::DbDataValueVec &values) {
+    for (GenDb::DbDataValueVec::const_iterator it = values.begin();
+         it != values.end(); ++it) {
+        Add(*it);
+    }
+    return Build();
+}
+
+char *WhereRowArena::Allocate(size_t size) {
+    if (!block_ || used_ + size > block_->size()) {
+        // Blocks grow, so that the many responses of a few rows do not
+        // each hold a large block
+        size_t block_size = std::max(next_size_, size);
+        next_size_ = std::min(2 * next_size_, kMaxBlockSize);
+        block_.reset(WhereRowBlock::Create(block_size));
+        used_ = 0;
+    }
+    char *data = block_->data() + used_;
+    used_ += size;
+    return data;
+}
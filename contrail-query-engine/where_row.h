@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2018 Juniper Networks, Inc. All rights reserved.
+ */
+
+#ifndef QUERY_ENGINE_WHERE_ROW_H_
+#define QUERY_ENGINE_WHERE_ROW_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+#include <tbb/atomic.h>
+
+#include <database/gendb_if.h>
+
+class WhereRowArena;
+
+//
+// Block of memory the rows of a WhereRowArena are allocated from. A block
+// is freed as a whole once no row refers to it any more.
+//
+class WhereRowBlock {
+public:
+    static WhereRowBlock *Create(size_t size);
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+    size_t size() const { return size_; }
+
+private:
+    friend void intrusive_ptr_add_ref(WhereRowBlock *block);
+    friend void intrusive_ptr_release(WhereRowBlock *block);
+
+    tbb::atomic<uint32_t> refcount_;
+    size_t size_;
+};
+
+//
+// Values of a WHERE result row, as read from the database. The values are
+// encoded back to back in a block of a WhereRowArena: fixed width values
+// inline, strings, uuids and addresses as offsets into the bytes of the
+// row. A row is immutable, copying it only takes a reference on its block.
+//
+class WhereRow {
+public:
+    WhereRow() : data_(NULL) {
+    }
+
+    size_t size() const { return data_ ? header()->count : 0; }
+    bool empty() const { return size() == 0; }
+    // Decodes the value, throws std::out_of_range past the last value
+    GenDb::DbDataValue at(size_t index) const;
+    // Type of the value, as GenDb::DbDataValue::which()
+    int which(size_t index) const { return tags()[index]; }
+    // Compares the values the way the GenDb::DbDataValueVec they were
+    // encoded from would compare, up to the values of the shorter row
+    bool operator<(const WhereRow &rhs) const;
+    void swap(WhereRow &rhs);
+
+private:
+    friend class WhereRowArena;
+
+    struct Header {
+        uint32_t count;
+        uint32_t bytes;
+    };
+
+    WhereRow(WhereRowBlock *block, const char *data) :
+        block_(block), data_(data) {
+    }
+
+    const Header *header() const {
+        return reinterpret_cast<const Header *>(data_);
+    }
+    const uint64_t *slots() const {
+        return reinterpret_cast<const uint64_t *>(header() + 1);
+    }
+    const uint8_t *tags() const {
+        return reinterpret_cast<const uint8_t *>(slots() + header()->count);
+    }
+    const char *bytes() const {
+        return reinterpret_cast<const char *>(tags() + header()->count);
+    }
+    // Offset and length in the bytes of the row of a variable width value
+    static size_t ByteOffset(uint64_t slot) { return slot >> 32; }
+    static size_t ByteLength(uint64_t slot) { return slot & 0xffffffff; }
+    int CompareValue(size_t index, const WhereRow &rhs) const;
+
+    boost::intrusive_ptr<WhereRowBlock> block_;
+    const char *data_;
+};
+
+//
+// Allocates WhereRows from blocks growing up to kMaxBlockSize. An arena
+// is not thread safe, each database response builds its rows in an arena
+// of its own.
+//
+class WhereRowArena {
+public:
+    static const size_t kMinBlockSize = 4 * 1024;
+    static const size_t kMaxBlockSize = 64 * 1024;
+
+    WhereRowArena();
+
+    // Appends a value to the row being built
+    void Add(const GenDb::DbDataValue &value);
+    // Row of the values added since the last row was built
+    WhereRow Build();
+    WhereRow Build(const GenDb::DbDataValueVec &values);
+
+private:
+    friend class WhereRowEncoder;
+
+    char *Allocate(size_t size);
+
+    boost::intrusive_ptr<WhereRowBlock> block_;
+    size_t used_;
+    size_t next_size_;
+    // Row being built
+    std::vector<uint64_t> slots_;
+    std::vector<uint8_t> tags_;
+    std::string bytes_;
+};
+
+#endif  // QUERY_ENGINE_WHERE_ROW_H_